@@ -20,9 +20,17 @@
 #include "utility.h"
 #include "pacer.h"
 #include "log.h"
+#include "audio_source.h"
+#include "audio_rt.h"
+#include "audio_aec.h"
+#include "audio_vad.h"
+#include "audio_preproc.h"
+#include "audio_encoder.h"
+#include "audio_preroll.h"
 
 #define DEFAULT_CHANNEL_NAME "hello_demo"
 #define DEFAULT_CERTIFACTE_FILENAME "certificate.bin"
+#define DEFAULT_DEVICE_CACHE_FILENAME "audio_device.cache"
 #define DEFAULT_SEND_AUDIO_FILENAME_PCM_16K "send_audio_16k_1ch.pcm"
 #define DEFAULT_SEND_AUDIO_FILENAME_PCM_08K "send_audio_8k_1ch.pcm"
 #define DEFAULT_SEND_AUDIO_FILENAME "send_audio_16k_1ch.pcm"
@@ -34,6 +42,15 @@
 #define DEFAULT_SEND_AUDIO_FRAME_PERIOD_MS (20)
 #define DEFAULT_PCM_SAMPLE_RATE (16000)
 #define DEFAULT_PCM_CHANNEL_NUM (1)
+#define DEFAULT_TONE_HZ (440)
+#define DEFAULT_JITTER_MIN_MS (40)
+#define DEFAULT_JITTER_MAX_MS (200)
+#define DEFAULT_MIX_MAX_STREAMS (4)
+#define DEFAULT_RECORD_ROTATE_MB (64)
+#define DEFAULT_RECORD_ROTATE_SEC (3600)
+#define DEFAULT_RECORD_BUDGET_KB (4096)
+#define MAX_CONN_CNT (16)
+#define MAX_PREROLL_MS (10000)
 
 typedef struct {
   // common config
@@ -50,12 +67,28 @@ typedef struct {
   // audio related config
   audio_data_type_e audio_data_type;
   audio_codec_type_e audio_codec_type;
+  audio_encoder_type_e encode;
   const char *send_audio_file_path;
+  audio_source_type_e audio_source;
+  uint32_t tone_hz;
   uint32_t pcm_sample_rate;
   uint32_t pcm_channel_num;
   uint32_t pcm_duration;
   const char *capture_device;
   const char *playback_device;
+  uint32_t jitter_min_ms;
+  uint32_t jitter_max_ms;
+  bool plc;
+  bool drift_comp;
+  uint32_t mix_max_streams;
+  const char *mix_gains;
+  uint32_t alsa_period_frames;
+  uint32_t capture_batch;
+  uint32_t preroll_ms;
+  audio_preroll_mode_e preroll_mode;
+  uint32_t device_sample_rate;
+  uint32_t capture_channel;
+  bool alsa_mmap;
 
   // advanced config
   bool enable_audio_mixer;
@@ -64,6 +97,29 @@ typedef struct {
   bool domain_limit;
   bool lan_accelerate;
   int conn_cnt;
+  const char *stats_out;
+  const char *ctl_socket;
+  const char *device_cache;
+  const char *record_dir;
+  uint32_t record_rotate_mb;
+  uint32_t record_rotate_sec;
+  uint32_t record_budget_kb;
+  bool rt;
+  int rt_prio_capture;
+  int rt_prio_playout;
+  int rt_cpu_capture;
+  int rt_cpu_playout;
+  bool aec;
+  uint32_t aec_tail_ms;
+  audio_vad_mode_e vad_mode;
+  uint32_t vad_attack_ms;
+  uint32_t vad_hangover_ms;
+  uint32_t vad_thin_ms;
+  bool ns;
+  uint32_t ns_max_db;
+  bool agc;
+  int agc_target_dbfs;
+  uint32_t agc_max_gain_db;
 } app_config_t;
 
 static void app_print_usage(int argc, char **argv)
@@ -74,6 +130,7 @@ static void app_print_usage(int argc, char **argv)
   LOGS(" -i, --app-id              : application id; either app-id OR token MUST be set");
   LOGS(" -t, --token               : token for authentication");
   LOGS(" -c, --channel-id          : channel name; default is 'demo'");
+  LOGS("                             a comma separated list joins one connection per channel");
   LOGS(" -u, --user-id             : user id; default is 0");
   LOGS(" -U, --user-name           : user name");
   LOGS(" -l, --license             : license value MUST be set when release");
@@ -83,11 +140,13 @@ static void app_print_usage(int argc, char **argv)
   LOGS(" -C, --audio-codec         : audio codec type; only valid when audio type is PCM; default is 1=opus");
   LOGS("                             support: 0:Disable 1=OPUS, 2=G722 3=G711A 4=G711U");
   LOGS(" -S, --send-audio-file     : send audio file path; default is './%s'", DEFAULT_SEND_AUDIO_FILENAME);
+  LOGS("                             implies --source file unless --source is given");
   LOGS(" -r, --pcm-sample-rate     : sample rate for the input PCM data; only valid when audio type is PCM");
   LOGS(" -n, --pcm-channel-num     : channel number for the input PCM data; only valid when audio type is PCM");
   LOGS(" -D, --pcm-duration        : sample duration; default is %d", DEFAULT_SEND_AUDIO_FRAME_PERIOD_MS);
   LOGS(" -I, --capture-device      : audio capture device name; default is 'default'");
   LOGS(" -O, --playback-device     : audio playback device name; default is 'default'");
+  LOGS("                             'none' paces playout without a sound card and discards it");
   LOGS(" -A, --area                : hex format with 0x header, supported area_code list:");
   LOGS("                             CN (Mainland China) : 0x00000001");
   LOGS("                             NA (North America)  : 0x00000002");
@@ -107,6 +166,79 @@ static void app_print_usage(int argc, char **argv)
 
   // long options
   LOGS(" --lan-accelerate          : enable lan accelerate");
+  LOGS(" --conn-cnt                : number of connections fed from the same audio source, at most %d;", MAX_CONN_CNT);
+  LOGS("                             connection N>0 joins '<channel>_N' unless -c lists the channels;");
+  LOGS("                             default is 0=one per listed channel");
+  LOGS(" --jitter-min-ms           : lower bound of the adaptive playout jitter buffer; default is %d", DEFAULT_JITTER_MIN_MS);
+  LOGS(" --jitter-max-ms           : upper bound of the adaptive playout jitter buffer; default is %d", DEFAULT_JITTER_MAX_MS);
+  LOGS(" --plc                     : conceal late or lost frames by pitch repetition and time-stretch");
+  LOGS("                             playback to keep the jitter buffer at its target");
+  LOGS(" --drift-comp              : estimate the sound card clock drift and trim the capture and playback");
+  LOGS("                             resampling ratio so queue depths stay bounded; ALSA only");
+  LOGS(" --mix-max-streams         : max remote users mixed into each playback period, the loudest win;");
+  LOGS("                             default is %d", DEFAULT_MIX_MAX_STREAMS);
+  LOGS(" --mix-gain                : per-user playback gain, e.g. '1234:0.5,5678:2'");
+  LOGS(" --alsa-period-frames      : force the ALSA period size; default is 0=smallest stable size");
+  LOGS(" --encode                  : encode PCM in the app and send it pre-encoded, the SDK codec is");
+  LOGS("                             disabled; pcma/pcmu need -r 8000, g722 needs -r 16000, mono only;");
+  LOGS("                             support: none pcma pcmu g722; default is none");
+  LOGS(" --capture-batch           : frames read per capture/source wakeup and sent as one burst, at most");
+  LOGS("                             %d; fewer wakeups and syscalls for up to N-1 frames of extra latency;", AUDIO_CAPTURE_MAX_BATCH);
+  LOGS("                             default is 1");
+  LOGS(" --preroll-ms              : keep capturing while joining or reconnecting and send up to this many");
+  LOGS("                             ms of it once a connection is up, at most %d; PCM only;", MAX_PREROLL_MS);
+  LOGS("                             default is 0=stop capturing while no connection is up");
+  LOGS(" --preroll-mode            : how the pre-roll backlog is caught up: stretch (cut pitch periods,");
+  LOGS("                             up to 25%% faster, bursts if that is too slow) or burst (send it at");
+  LOGS("                             twice the real-time rate); default is stretch");
+  LOGS(" --device-rate             : sample rate to open the sound cards at; audio is resampled to/from");
+  LOGS("                             pcm-sample-rate; default is 0=same as pcm-sample-rate");
+  LOGS(" --capture-channel         : take only this (1-based) channel from a multichannel mic;");
+  LOGS("                             default is 0=downmix all channels");
+  LOGS(" --source                  : audio source to send: alsa, file, sine, noise; default is alsa");
+  LOGS(" --tone-hz                 : frequency of the sine source; default is %d", DEFAULT_TONE_HZ);
+  LOGS(" --mmap                    : access the sound cards through ALSA mmap instead of read/write");
+  LOGS(" --stats-out               : write per-second latency histograms as JSON lines to this file,");
+  LOGS("                             or to a listening unix stream socket with 'unix:<path>'");
+  LOGS(" --ctl-socket              : listen for control commands on this unix socket path: 'stats',");
+  LOGS("                             'get', 'set <option> <value>' and 'gain <uid> <gain>'; changes are");
+  LOGS("                             applied between periods without leaving the channel");
+  LOGS(" --device-cache            : file caching the negotiated sound card configuration per device, so");
+  LOGS("                             later starts skip probing; 'none' disables it; default is %s",
+       DEFAULT_DEVICE_CACHE_FILENAME);
+  LOGS(" --record-dir              : record the sent audio and every received uid as WAV files in this");
+  LOGS("                             directory, written by a background thread");
+  LOGS(" --record-rotate-mb        : start a new recording file after this many MB; default is %d", DEFAULT_RECORD_ROTATE_MB);
+  LOGS(" --record-rotate-sec       : start a new recording file after this many seconds of audio;");
+  LOGS("                             default is %d", DEFAULT_RECORD_ROTATE_SEC);
+  LOGS(" --record-budget-kb        : memory for audio waiting to be written; frames beyond it are dropped");
+  LOGS("                             and counted; default is %d", DEFAULT_RECORD_BUDGET_KB);
+  LOGS(" --rt                      : run the capture/source and playback threads under SCHED_FIFO and");
+  LOGS("                             lock all memory; needs root, CAP_SYS_NICE or an rtprio limit");
+  LOGS(" --rt-prio-capture         : SCHED_FIFO priority of the capture/source thread; default is %d", AUDIO_RT_DEFAULT_PRIORITY);
+  LOGS(" --rt-prio-playout         : SCHED_FIFO priority of the playback thread; default is %d", AUDIO_RT_DEFAULT_PRIORITY);
+  LOGS(" --rt-cpu-capture          : pin the capture/source thread to this CPU; default is -1=no pinning");
+  LOGS(" --rt-cpu-playout          : pin the playback thread to this CPU; default is -1=no pinning");
+  LOGS(" --aec                     : cancel the playback echo from the captured audio before sending;");
+  LOGS("                             needs a mono alsa source and plays back at pcm-sample-rate");
+  LOGS(" --aec-tail-ms             : echo tail covered by the canceller, at most %d; default is %d",
+       AUDIO_AEC_MAX_TAIL_MS, AUDIO_AEC_DEFAULT_TAIL_MS);
+  LOGS(" --vad                     : gate PCM frames with voice activity detection before sending:");
+  LOGS("                             off, suppress (drop silent frames), thin (send one silent frame");
+  LOGS("                             every --vad-thin-ms); default is off");
+  LOGS(" --vad-attack-ms           : speech must last this long before sending starts; default is %d",
+       AUDIO_VAD_DEFAULT_ATTACK_MS);
+  LOGS(" --vad-hangover-ms         : keep sending this long after speech ends; default is %d",
+       AUDIO_VAD_DEFAULT_HANGOVER_MS);
+  LOGS(" --vad-thin-ms             : interval between silent frames in thin mode; default is %d",
+       AUDIO_VAD_DEFAULT_THIN_MS);
+  LOGS(" --ns                      : spectral noise suppression on the captured audio (mono only);");
+  LOGS("                             adds less than one frame of latency");
+  LOGS(" --ns-max-db               : max attenuation of a noise-only band, at most %d; default is %d",
+       AUDIO_NS_MAX_DB, AUDIO_NS_DEFAULT_MAX_DB);
+  LOGS(" --agc                     : automatic gain control with a peak limiter on the captured audio");
+  LOGS(" --agc-target-dbfs         : speech level the agc aims for; default is %d", AUDIO_AGC_DEFAULT_TARGET_DBFS);
+  LOGS(" --agc-max-gain-db         : max gain the agc applies; default is %d", AUDIO_AGC_DEFAULT_MAX_GAIN_DB);
   LOGS(" --local-ap                : params_str = {\"ipList\": [\"ip1\", \"ip2\"], \"domainList\":[\"domain1\", \"domain2\"], \"mode\": 1}");
   LOGS("                             mode: 0: ConnectivityFirst, 1: LocalOnly");
   LOGS("\nExample:");
@@ -127,15 +259,41 @@ static void app_print_config(app_config_t *config) {
 	LOGS("<audio config info>       -");
 	LOGS("  audio_data_type         : %d", config->audio_data_type);
 	LOGS("  audio_codec_type        : %d", config->audio_codec_type);
+  LOGS("  encode                  : %s", audio_encoder_name(config->encode));
 	LOGS("  pcm_sample_rate         : %u", config->pcm_sample_rate);
   LOGS("  pcm_duration            : %u", config->pcm_duration);
+  LOGS("  device_sample_rate      : %u", config->device_sample_rate);
+  LOGS("  alsa_mmap               : %d", config->alsa_mmap);
+  LOGS("  capture_batch           : %u", config->capture_batch);
+  LOGS("  preroll                 : %u ms (%s)", config->preroll_ms, audio_preroll_mode_name(config->preroll_mode));
 	LOGS("  send_audio_file_path    : %s", config->send_audio_file_path);
+  LOGS("  audio_source            : %s", audio_source_name(config->audio_source));
 	LOGS("  capture_device          : %s", config->capture_device);
 	LOGS("  playback_device         : %s", config->playback_device);
+  LOGS("  jitter_buffer           : %u-%u ms", config->jitter_min_ms, config->jitter_max_ms);
+  LOGS("  plc                     : %d", config->plc);
+  LOGS("  drift_comp              : %d", config->drift_comp);
+  LOGS("  mix_max_streams         : %u", config->mix_max_streams);
+  LOGS("  mix_gains               : %s", config->mix_gains);
 	LOGS("<advanced config info>    -");
 	LOGS("  enable_audio_mixer      : %d", config->enable_audio_mixer);
 	LOGS("  received_data_only      : %d", config->receive_data_only);
   LOGS("  lan-accelerate          : %d", config->lan_accelerate);
+  LOGS("  conn-cnt                : %d", config->conn_cnt);
+  LOGS("  stats-out               : %s", config->stats_out);
+  LOGS("  ctl-socket              : %s", config->ctl_socket);
+  LOGS("  device-cache            : %s", config->device_cache);
+  LOGS("  record-dir              : %s (rotate %u MB/%u s, budget %u KB)", config->record_dir,
+       config->record_rotate_mb, config->record_rotate_sec, config->record_budget_kb);
+  LOGS("  rt                      : %d (prio %d/%d, cpu %d/%d)", config->rt, config->rt_prio_capture,
+       config->rt_prio_playout, config->rt_cpu_capture, config->rt_cpu_playout);
+  LOGS("  aec                     : %d (tail %u ms)", config->aec, config->aec_tail_ms);
+  LOGS("  vad                     : %s (attack %u ms, hangover %u ms, thin %u ms)",
+       audio_vad_mode_name(config->vad_mode), config->vad_attack_ms, config->vad_hangover_ms,
+       config->vad_thin_ms);
+  LOGS("  ns                      : %d (max %u dB)", config->ns, config->ns_max_db);
+  LOGS("  agc                     : %d (target %d dBFS, max gain %u dB)", config->agc, config->agc_target_dbfs,
+       config->agc_max_gain_db);
 	LOGS("---------------app config show end-----------------------");
 }
 
@@ -166,10 +324,50 @@ static int app_parse_args(int argc, char **argv, app_config_t *config)
                                            { "lan-accelerate", 0, &av_option_flag, 3 },
                                            { "capture-device", 1, NULL, 'I' },
                                            { "playback-device", 1, NULL, 'O' },
+                                           { "jitter-min-ms", 1, &av_option_flag, 4 },
+                                           { "jitter-max-ms", 1, &av_option_flag, 5 },
+                                           { "alsa-period-frames", 1, &av_option_flag, 6 },
+                                           { "device-rate", 1, &av_option_flag, 7 },
+                                           { "capture-channel", 1, &av_option_flag, 8 },
+                                           { "mmap", 0, &av_option_flag, 9 },
+                                           { "source", 1, &av_option_flag, 10 },
+                                           { "tone-hz", 1, &av_option_flag, 11 },
+                                           { "mix-max-streams", 1, &av_option_flag, 12 },
+                                           { "mix-gain", 1, &av_option_flag, 13 },
+                                           { "stats-out", 1, &av_option_flag, 14 },
+                                           { "rt", 0, &av_option_flag, 15 },
+                                           { "rt-prio-capture", 1, &av_option_flag, 16 },
+                                           { "rt-prio-playout", 1, &av_option_flag, 17 },
+                                           { "rt-cpu-capture", 1, &av_option_flag, 18 },
+                                           { "rt-cpu-playout", 1, &av_option_flag, 19 },
+                                           { "aec", 0, &av_option_flag, 20 },
+                                           { "aec-tail-ms", 1, &av_option_flag, 21 },
+                                           { "vad", 1, &av_option_flag, 22 },
+                                           { "vad-attack-ms", 1, &av_option_flag, 23 },
+                                           { "vad-hangover-ms", 1, &av_option_flag, 24 },
+                                           { "vad-thin-ms", 1, &av_option_flag, 25 },
+                                           { "ns", 0, &av_option_flag, 26 },
+                                           { "ns-max-db", 1, &av_option_flag, 27 },
+                                           { "agc", 0, &av_option_flag, 28 },
+                                           { "agc-target-dbfs", 1, &av_option_flag, 29 },
+                                           { "agc-max-gain-db", 1, &av_option_flag, 30 },
+                                           { "plc", 0, &av_option_flag, 31 },
+                                           { "drift-comp", 0, &av_option_flag, 32 },
+                                           { "ctl-socket", 1, &av_option_flag, 33 },
+                                           { "record-dir", 1, &av_option_flag, 34 },
+                                           { "record-rotate-mb", 1, &av_option_flag, 35 },
+                                           { "record-rotate-sec", 1, &av_option_flag, 36 },
+                                           { "record-budget-kb", 1, &av_option_flag, 37 },
+                                           { "capture-batch", 1, &av_option_flag, 38 },
+                                           { "encode", 1, &av_option_flag, 39 },
+                                           { "preroll-ms", 1, &av_option_flag, 40 },
+                                           { "preroll-mode", 1, &av_option_flag, 41 },
+                                           { "device-cache", 1, &av_option_flag, 42 },
                                            { 0, 0, 0, 0 } };
 
   int ch = -1;
   int optidx = 0;
+  bool source_set = false;
   int rval = 0;
 
   while (1) {
@@ -177,6 +375,10 @@ static int app_parse_args(int argc, char **argv, app_config_t *config)
     if (ch == -1) {
       break;
     }
+    // long-only options report their id through av_option_flag
+    if (ch == 0) {
+      ch = av_option_flag;
+    }
 
     switch (ch) {
     case 'h':
@@ -247,6 +449,136 @@ static int app_parse_args(int argc, char **argv, app_config_t *config)
     case 3:
       config->lan_accelerate = true;
       break;
+    case 4:
+      config->jitter_min_ms = strtoul(optarg, NULL, 10);
+      break;
+    case 5:
+      config->jitter_max_ms = strtoul(optarg, NULL, 10);
+      break;
+    case 6:
+      config->alsa_period_frames = strtoul(optarg, NULL, 10);
+      break;
+    case 7:
+      config->device_sample_rate = strtoul(optarg, NULL, 10);
+      break;
+    case 8:
+      config->capture_channel = strtoul(optarg, NULL, 10);
+      break;
+    case 9:
+      config->alsa_mmap = true;
+      break;
+    case 10:
+      if (audio_source_parse(optarg, &config->audio_source) < 0) {
+        LOGE("unknown audio source '%s'", optarg);
+        return -1;
+      }
+      source_set = true;
+      break;
+    case 11:
+      config->tone_hz = strtoul(optarg, NULL, 10);
+      break;
+    case 12:
+      config->mix_max_streams = strtoul(optarg, NULL, 10);
+      break;
+    case 13:
+      config->mix_gains = optarg;
+      break;
+    case 14:
+      config->stats_out = optarg;
+      break;
+    case 15:
+      config->rt = true;
+      break;
+    case 16:
+      config->rt_prio_capture = atoi(optarg);
+      break;
+    case 17:
+      config->rt_prio_playout = atoi(optarg);
+      break;
+    case 18:
+      config->rt_cpu_capture = atoi(optarg);
+      break;
+    case 19:
+      config->rt_cpu_playout = atoi(optarg);
+      break;
+    case 20:
+      config->aec = true;
+      break;
+    case 21:
+      config->aec_tail_ms = strtoul(optarg, NULL, 10);
+      break;
+    case 22:
+      if (audio_vad_mode_parse(optarg, &config->vad_mode) < 0) {
+        LOGE("unknown vad mode '%s'", optarg);
+        return -1;
+      }
+      break;
+    case 23:
+      config->vad_attack_ms = strtoul(optarg, NULL, 10);
+      break;
+    case 24:
+      config->vad_hangover_ms = strtoul(optarg, NULL, 10);
+      break;
+    case 25:
+      config->vad_thin_ms = strtoul(optarg, NULL, 10);
+      break;
+    case 26:
+      config->ns = true;
+      break;
+    case 27:
+      config->ns_max_db = strtoul(optarg, NULL, 10);
+      break;
+    case 28:
+      config->agc = true;
+      break;
+    case 29:
+      config->agc_target_dbfs = atoi(optarg);
+      break;
+    case 30:
+      config->agc_max_gain_db = strtoul(optarg, NULL, 10);
+      break;
+    case 31:
+      config->plc = true;
+      break;
+    case 32:
+      config->drift_comp = true;
+      break;
+    case 33:
+      config->ctl_socket = optarg;
+      break;
+    case 34:
+      config->record_dir = optarg;
+      break;
+    case 35:
+      config->record_rotate_mb = strtoul(optarg, NULL, 10);
+      break;
+    case 36:
+      config->record_rotate_sec = strtoul(optarg, NULL, 10);
+      break;
+    case 37:
+      config->record_budget_kb = strtoul(optarg, NULL, 10);
+      break;
+    case 38:
+      config->capture_batch = strtoul(optarg, NULL, 10);
+      break;
+    case 39:
+      if (audio_encoder_parse(optarg, &config->encode) < 0) {
+        LOGE("unknown encoder '%s'", optarg);
+        return -1;
+      }
+      break;
+    case 40:
+      config->preroll_ms = strtoul(optarg, NULL, 10);
+      break;
+    case 41:
+      if (audio_preroll_mode_parse(optarg, &config->preroll_mode) < 0) {
+        LOGE("unknown preroll mode '%s'", optarg);
+        return -1;
+      }
+      break;
+    case 42:
+      config->device_cache = optarg;
+      break;
     default:
       return -1;
     }
@@ -263,6 +595,42 @@ static int app_parse_args(int argc, char **argv, app_config_t *config)
     return -1;
   }
 
+  if (config->conn_cnt < 0 || config->conn_cnt > MAX_CONN_CNT) {
+    LOGE("conn-cnt MUST be in 0-%d", MAX_CONN_CNT);
+    return -1;
+  }
+
+  if (config->capture_batch < 1 || config->capture_batch > AUDIO_CAPTURE_MAX_BATCH) {
+    LOGE("capture-batch MUST be in 1-%d", AUDIO_CAPTURE_MAX_BATCH);
+    return -1;
+  }
+
+  if (config->encode != AUDIO_ENCODER_NONE && config->audio_data_type != AUDIO_DATA_TYPE_PCM) {
+    LOGE("encode needs audio-type 100=PCM");
+    return -1;
+  }
+
+  if (config->encode != AUDIO_ENCODER_NONE &&
+      (config->pcm_sample_rate != audio_encoder_sample_rate(config->encode) || config->pcm_channel_num != 1)) {
+    LOGE("encode %s needs pcm-sample-rate %u and pcm-channel-num 1", audio_encoder_name(config->encode),
+         audio_encoder_sample_rate(config->encode));
+    return -1;
+  }
+
+  if (config->preroll_ms > MAX_PREROLL_MS) {
+    LOGE("preroll-ms MUST be in 0-%d", MAX_PREROLL_MS);
+    return -1;
+  }
+
+  if (config->preroll_ms && config->audio_data_type != AUDIO_DATA_TYPE_PCM) {
+    LOGE("preroll-ms needs audio-type 100=PCM");
+    return -1;
+  }
+
+  if (config->send_audio_file_path && !source_set) {
+    config->audio_source = AUDIO_SOURCE_FILE;
+  }
+
   return 0;
 }
 
@@ -317,4 +685,35 @@ static media_file_type_e audio_data_type_to_file_type(audio_data_type_e type)
   return file_type;
 }
 
+// data type of the frames produced by the in-app encoder
+static audio_data_type_e audio_encoder_data_type(audio_encoder_type_e type)
+{
+  switch (type) {
+  case AUDIO_ENCODER_PCMA:
+    return AUDIO_DATA_TYPE_PCMA;
+  case AUDIO_ENCODER_PCMU:
+    return AUDIO_DATA_TYPE_PCMU;
+  case AUDIO_ENCODER_G722:
+    return AUDIO_DATA_TYPE_G722;
+  default:
+    return AUDIO_DATA_TYPE_PCM;
+  }
+}
+
+// interval between two frames of the given data type, used to pace file sources
+static uint32_t audio_data_type_frame_us(audio_data_type_e type, uint32_t pcm_duration)
+{
+  switch (type) {
+  case AUDIO_DATA_TYPE_AACLC_8K:
+    return 1024 * 1000000 / 8000;
+  case AUDIO_DATA_TYPE_AACLC_16K:
+  case AUDIO_DATA_TYPE_HEAAC:
+    return 1024 * 1000000 / 16000;
+  case AUDIO_DATA_TYPE_AACLC:
+    return 1024 * 1000000 / 48000;
+  default:
+    return pcm_duration * 1000;
+  }
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,471 @@
+/*************************************************************
+ * File  :  audio_aec.c
+ * Module:  Frequency-domain acoustic echo canceller fed with the
+ *          playout stream as reference.
+ *
+ * The playout thread appends every period it hands to the sound
+ * card to a reference ring, together with the time its end will
+ * leave the speaker (now + snd_pcm_delay). The capture side
+ * knows when its last sample hit the mic, so each capture frame
+ * is paired with the reference that was playing at that moment
+ * plus a small lead; the adaptive filter only has to model the
+ * acoustic path, not the buffering on either side.
+ *
+ * The filter is a partitioned-block frequency-domain NLMS
+ * (overlap-save, 2B-point FFT per block of B samples). Step size
+ * is normalized by the reference power summed over all
+ * partitions. Once converged the step also shrinks with the
+ * ratio of echo estimate to error energy, which collapses when
+ * the near end talks, and the error spectrum is clipped so a
+ * single block cannot drag the weights far; the gradient
+ * constraint is applied to one partition per block in
+ * turn to keep the FFT count at five per block.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio_aec.h"
+#include "audio_simd.h"
+#include "audio_ring.h"
+#include "audio_time.h"
+#include "audio_stats.h"
+#include "log.h"
+
+#define AEC_MIN_BLOCK (16)
+#define AEC_MAX_BLOCK (128)
+#define AEC_STEP (0.5f)
+// 归一化误差幅度上限，双讲时限制单个分块对权重的拉动
+#define AEC_ERR_CLIP (1.5f)
+// 每个采样的参考功率低于 -70dBFS 时视为远端无声，不更新滤波器
+#define AEC_FAR_ACTIVE_POW (1e-7f)
+// 归一化分母的下限，对应 -60dBFS 的参考
+#define AEC_REG_POW (1e-6f)
+#define AEC_POW_SMOOTH (0.05f)
+// 收敛后按 回声估计/误差 的能量比缩小步长: 误差明显大于残留回声说明近端在讲话
+#define AEC_DTD_RATIO (0.25f)
+#define AEC_MIN_STEP (0.02f)
+// ERLE 连续这么多个分块超过阈值后认为已收敛
+#define AEC_CONVERGED_DB (10.0f)
+#define AEC_CONVERGED_BLOCKS (50)
+// 输出能量持续这么多个分块大于输入时认为发散
+#define AEC_DIVERGE_BLOCKS (50)
+#define AEC_S16_SCALE (1.0f / 32768.0f)
+
+static void *aec_alloc(size_t bytes)
+{
+    void *p = NULL;
+    if (posix_memalign(&p, AUDIO_CACHE_LINE, bytes ? bytes : AUDIO_CACHE_LINE) != 0) {
+        return NULL;
+    }
+    memset(p, 0, bytes);
+    return p;
+}
+
+// y += w * x
+static void aec_cmac(float *yr, float *yi, const float *wr, const float *wi,
+                     const float *xr, const float *xi, uint32_t n)
+{
+    uint32_t k = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    for (; k + 4 <= n; k += 4) {
+        __m128 a_r = _mm_load_ps(wr + k), a_i = _mm_load_ps(wi + k);
+        __m128 b_r = _mm_load_ps(xr + k), b_i = _mm_load_ps(xi + k);
+        __m128 re = _mm_sub_ps(_mm_mul_ps(a_r, b_r), _mm_mul_ps(a_i, b_i));
+        __m128 im = _mm_add_ps(_mm_mul_ps(a_r, b_i), _mm_mul_ps(a_i, b_r));
+        _mm_store_ps(yr + k, _mm_add_ps(_mm_load_ps(yr + k), re));
+        _mm_store_ps(yi + k, _mm_add_ps(_mm_load_ps(yi + k), im));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    for (; k + 4 <= n; k += 4) {
+        float32x4_t a_r = vld1q_f32(wr + k), a_i = vld1q_f32(wi + k);
+        float32x4_t b_r = vld1q_f32(xr + k), b_i = vld1q_f32(xi + k);
+        float32x4_t re = vmlsq_f32(vmlaq_f32(vld1q_f32(yr + k), a_r, b_r), a_i, b_i);
+        float32x4_t im = vmlaq_f32(vmlaq_f32(vld1q_f32(yi + k), a_r, b_i), a_i, b_r);
+        vst1q_f32(yr + k, re);
+        vst1q_f32(yi + k, im);
+    }
+#endif
+    for (; k < n; k++) {
+        yr[k] += wr[k] * xr[k] - wi[k] * xi[k];
+        yi[k] += wr[k] * xi[k] + wi[k] * xr[k];
+    }
+}
+
+// w += conj(x) * e
+static void aec_update(float *wr, float *wi, const float *xr, const float *xi,
+                       const float *er, const float *ei, uint32_t n)
+{
+    uint32_t k = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    for (; k + 4 <= n; k += 4) {
+        __m128 x_r = _mm_load_ps(xr + k), x_i = _mm_load_ps(xi + k);
+        __m128 e_r = _mm_load_ps(er + k), e_i = _mm_load_ps(ei + k);
+        __m128 re = _mm_add_ps(_mm_mul_ps(x_r, e_r), _mm_mul_ps(x_i, e_i));
+        __m128 im = _mm_sub_ps(_mm_mul_ps(x_r, e_i), _mm_mul_ps(x_i, e_r));
+        _mm_store_ps(wr + k, _mm_add_ps(_mm_load_ps(wr + k), re));
+        _mm_store_ps(wi + k, _mm_add_ps(_mm_load_ps(wi + k), im));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    for (; k + 4 <= n; k += 4) {
+        float32x4_t x_r = vld1q_f32(xr + k), x_i = vld1q_f32(xi + k);
+        float32x4_t e_r = vld1q_f32(er + k), e_i = vld1q_f32(ei + k);
+        float32x4_t re = vmlaq_f32(vmlaq_f32(vld1q_f32(wr + k), x_r, e_r), x_i, e_i);
+        float32x4_t im = vmlsq_f32(vmlaq_f32(vld1q_f32(wi + k), x_r, e_i), x_i, e_r);
+        vst1q_f32(wr + k, re);
+        vst1q_f32(wi + k, im);
+    }
+#endif
+    for (; k < n; k++) {
+        wr[k] += xr[k] * er[k] + xi[k] * ei[k];
+        wi[k] += xr[k] * ei[k] - xi[k] * er[k];
+    }
+}
+
+int audio_aec_init(audio_aec_t *aec, const audio_aec_config_t *cfg)
+{
+    memset(aec, 0, sizeof(*aec));
+    aec->cfg = *cfg;
+    if (aec->cfg.tail_ms == 0) {
+        aec->cfg.tail_ms = AUDIO_AEC_DEFAULT_TAIL_MS;
+    }
+    if (aec->cfg.tail_ms > AUDIO_AEC_MAX_TAIL_MS) {
+        aec->cfg.tail_ms = AUDIO_AEC_MAX_TAIL_MS;
+    }
+    if (cfg->sample_rate == 0 || cfg->frame_samples == 0) {
+        return -1;
+    }
+
+    // 分块取整除帧长的最大 2 的幂，帧内整数个分块，不引入额外延迟
+    uint32_t block = AEC_MAX_BLOCK;
+    while (block >= AEC_MIN_BLOCK && cfg->frame_samples % block != 0) {
+        block >>= 1;
+    }
+    if (block < AEC_MIN_BLOCK) {
+        LOGE("回声消除不支持每帧 %u 个采样，帧长需为 %d 的倍数", cfg->frame_samples, AEC_MIN_BLOCK);
+        return -1;
+    }
+    aec->block = block;
+    aec->bins = block + 1;
+    aec->stride = (aec->bins + 3) & ~3u;
+    // 尾长之外再覆盖参考提前的余量
+    uint32_t taps = (aec->cfg.tail_ms + AUDIO_AEC_REF_LEAD_MS) * cfg->sample_rate / 1000;
+    aec->parts = (taps + block - 1) / block;
+
+    aec->ref_size = 1;
+    while (aec->ref_size < cfg->sample_rate * AUDIO_AEC_REF_MS / 1000) {
+        aec->ref_size <<= 1;
+    }
+
+    size_t spec = (size_t)aec->parts * aec->stride * sizeof(float);
+    size_t bin = aec->stride * sizeof(float);
+    aec->x_re = aec_alloc(spec);
+    aec->x_im = aec_alloc(spec);
+    aec->w_re = aec_alloc(spec);
+    aec->w_im = aec_alloc(spec);
+    aec->x_pow = aec_alloc(bin);
+    aec->y_re = aec_alloc(bin);
+    aec->y_im = aec_alloc(bin);
+    aec->e_re = aec_alloc(bin);
+    aec->e_im = aec_alloc(bin);
+    aec->x_time = aec_alloc(2 * block * sizeof(float));
+    aec->time_buf = aec_alloc(2 * block * sizeof(float));
+    aec->ref = aec_alloc(aec->ref_size * sizeof(int16_t));
+    aec->ref_frame = aec_alloc(cfg->frame_samples * sizeof(int16_t));
+    if (!aec->x_re || !aec->x_im || !aec->w_re || !aec->w_im || !aec->x_pow || !aec->y_re ||
+        !aec->y_im || !aec->e_re || !aec->e_im || !aec->x_time || !aec->time_buf || !aec->ref ||
+        !aec->ref_frame || audio_fft_init(&aec->fft, 2 * block) < 0) {
+        LOGE("无法分配回声消除缓冲区");
+        audio_aec_deinit(aec);
+        return -1;
+    }
+
+    atomic_init(&aec->ref_write, 0);
+    atomic_init(&aec->anchor_seq, 0);
+    LOGI("回声消除已启用: 采样率=%u, 分块=%u, 分段=%u, 尾长=%ums, FFT=%u (%s)", cfg->sample_rate,
+         block, aec->parts, aec->cfg.tail_ms, 2 * block, AUDIO_SIMD_NAME);
+    return 0;
+}
+
+void audio_aec_deinit(audio_aec_t *aec)
+{
+    audio_fft_deinit(&aec->fft);
+    free(aec->x_re);
+    free(aec->x_im);
+    free(aec->w_re);
+    free(aec->w_im);
+    free(aec->x_pow);
+    free(aec->y_re);
+    free(aec->y_im);
+    free(aec->e_re);
+    free(aec->e_im);
+    free(aec->x_time);
+    free(aec->time_buf);
+    free(aec->ref);
+    free(aec->ref_frame);
+    aec->x_re = aec->x_im = aec->w_re = aec->w_im = NULL;
+    aec->x_pow = aec->y_re = aec->y_im = aec->e_re = aec->e_im = NULL;
+    aec->x_time = aec->time_buf = NULL;
+    aec->ref = aec->ref_frame = NULL;
+}
+
+void audio_aec_report(const audio_aec_t *aec)
+{
+    uint64_t frames = atomic_load(&aec->stats.frames);
+
+    LOGI("回声消除统计: 帧=%llu, 缺参考=%llu, 自适应分块=%llu, 重置=%llu, ERLE=%.1fdB, "
+         "参考余量=%.1fms, 耗时 平均=%.1fus 最大=%.1fus",
+         (unsigned long long)frames, atomic_load(&aec->stats.ref_missing),
+         atomic_load(&aec->stats.adapt_blocks), atomic_load(&aec->stats.resets),
+         atomic_load(&aec->stats.erle_db_x10) / 10.0, atomic_load(&aec->stats.ref_lead_us) / 1000.0,
+         frames ? atomic_load(&aec->stats.cost_ns_sum) / 1000.0 / frames : 0.0,
+         atomic_load(&aec->stats.cost_ns_max) / 1000.0);
+}
+
+void audio_aec_push_ref(audio_aec_t *aec, const int16_t *data, uint32_t samples, int64_t play_end_us)
+{
+    uint64_t pos = atomic_load_explicit(&aec->ref_write, memory_order_relaxed);
+    uint32_t mask = aec->ref_size - 1;
+
+    if (samples > aec->ref_size) {
+        data += samples - aec->ref_size;
+        pos += samples - aec->ref_size;
+        samples = aec->ref_size;
+    }
+    uint32_t at = (uint32_t)(pos & mask);
+    uint32_t first = samples < aec->ref_size - at ? samples : aec->ref_size - at;
+    memcpy(aec->ref + at, data, first * sizeof(int16_t));
+    memcpy(aec->ref, data + first, (samples - first) * sizeof(int16_t));
+    pos += samples;
+    atomic_store_explicit(&aec->ref_write, pos, memory_order_release);
+
+    uint32_t seq = atomic_load_explicit(&aec->anchor_seq, memory_order_relaxed);
+    atomic_store_explicit(&aec->anchor_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&aec->anchor_pos, pos, memory_order_relaxed);
+    atomic_store_explicit(&aec->anchor_us, play_end_us, memory_order_relaxed);
+    atomic_store_explicit(&aec->anchor_seq, seq + 2, memory_order_release);
+}
+
+// 取出与本帧采集对齐的参考: mic 上每个采样对应提前 AUDIO_AEC_REF_LEAD_MS 播出的参考采样
+static bool aec_fetch_ref(audio_aec_t *aec, uint32_t samples, int64_t capture_us)
+{
+    uint32_t seq;
+    uint64_t anchor_pos;
+    int64_t anchor_us;
+
+    do {
+        seq = atomic_load_explicit(&aec->anchor_seq, memory_order_acquire);
+        anchor_pos = atomic_load_explicit(&aec->anchor_pos, memory_order_relaxed);
+        anchor_us = atomic_load_explicit(&aec->anchor_us, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || seq != atomic_load_explicit(&aec->anchor_seq, memory_order_relaxed));
+
+    memset(aec->ref_frame, 0, samples * sizeof(int16_t));
+    if (seq == 0) {
+        return false;
+    }
+
+    int64_t offset_us = capture_us + AUDIO_AEC_REF_LEAD_MS * 1000 - anchor_us;
+    int64_t end = (int64_t)anchor_pos + llround((double)offset_us * aec->cfg.sample_rate / 1000000) + 1;
+    int64_t begin = end - samples;
+    uint64_t written = atomic_load_explicit(&aec->ref_write, memory_order_acquire);
+    atomic_store_explicit(&aec->stats.ref_lead_us,
+                          (int)(((int64_t)written - end) * 1000000 / aec->cfg.sample_rate),
+                          memory_order_relaxed);
+
+    // 留出四分之一的环作为播放线程正在写入的保护区
+    if (begin < 0 || end > (int64_t)written ||
+        begin < (int64_t)written - (int64_t)(aec->ref_size - aec->ref_size / 4)) {
+        return false;
+    }
+
+    uint32_t mask = aec->ref_size - 1;
+    uint32_t at = (uint32_t)(begin & mask);
+    uint32_t first = samples < aec->ref_size - at ? samples : aec->ref_size - at;
+    memcpy(aec->ref_frame, aec->ref + at, first * sizeof(int16_t));
+    memcpy(aec->ref_frame + first, aec->ref, (samples - first) * sizeof(int16_t));
+    return true;
+}
+
+static void aec_reset_filter(audio_aec_t *aec)
+{
+    size_t spec = (size_t)aec->parts * aec->stride * sizeof(float);
+    memset(aec->w_re, 0, spec);
+    memset(aec->w_im, 0, spec);
+    aec->diverge_blocks = 0;
+    aec->converged_blocks = 0;
+    aec->converged = false;
+    atomic_fetch_add_explicit(&aec->stats.resets, 1, memory_order_relaxed);
+}
+
+// 新分段写入 slot 前更新各 bin 在全部分段上的功率和；每绕一圈重算一次以消除累积误差
+static void aec_update_power(audio_aec_t *aec, uint32_t slot)
+{
+    const float *xr = aec->x_re + (size_t)slot * aec->stride;
+    const float *xi = aec->x_im + (size_t)slot * aec->stride;
+
+    if (slot == 0) {
+        memset(aec->x_pow, 0, aec->stride * sizeof(float));
+        for (uint32_t p = 0; p < aec->parts; p++) {
+            const float *pr = aec->x_re + (size_t)p * aec->stride;
+            const float *pi = aec->x_im + (size_t)p * aec->stride;
+            for (uint32_t k = 0; k < aec->bins; k++) {
+                aec->x_pow[k] += pr[k] * pr[k] + pi[k] * pi[k];
+            }
+        }
+        return;
+    }
+    for (uint32_t k = 0; k < aec->bins; k++) {
+        aec->x_pow[k] += xr[k] * xr[k] + xi[k] * xi[k];
+    }
+}
+
+static void aec_evict_power(audio_aec_t *aec, uint32_t slot)
+{
+    const float *xr = aec->x_re + (size_t)slot * aec->stride;
+    const float *xi = aec->x_im + (size_t)slot * aec->stride;
+
+    for (uint32_t k = 0; k < aec->bins; k++) {
+        float v = aec->x_pow[k] - (xr[k] * xr[k] + xi[k] * xi[k]);
+        aec->x_pow[k] = v > 0.0f ? v : 0.0f;
+    }
+}
+
+static void aec_block(audio_aec_t *aec, int16_t *mic, const int16_t *ref)
+{
+    uint32_t B = aec->block;
+    uint32_t stride = aec->stride;
+    float *t = aec->time_buf;
+
+    // 1. 最新一段参考的频谱写入环形历史，分段 p 位于 (x_head + p) % parts
+    memmove(aec->x_time, aec->x_time + B, B * sizeof(float));
+    float far_pow = 0.0f;
+    for (uint32_t i = 0; i < B; i++) {
+        float v = ref[i] * AEC_S16_SCALE;
+        aec->x_time[B + i] = v;
+        far_pow += v * v;
+    }
+    aec->x_head = (aec->x_head + aec->parts - 1) % aec->parts;
+    aec_evict_power(aec, aec->x_head);
+    audio_fft_forward(&aec->fft, aec->x_time, aec->x_re + (size_t)aec->x_head * stride,
+                      aec->x_im + (size_t)aec->x_head * stride);
+    aec_update_power(aec, aec->x_head);
+
+    // 2. 回声估计 Y = sum(W_p * X_p)，重叠保留取后半段
+    memset(aec->y_re, 0, stride * sizeof(float));
+    memset(aec->y_im, 0, stride * sizeof(float));
+    for (uint32_t p = 0; p < aec->parts; p++) {
+        size_t x = (size_t)((aec->x_head + p) % aec->parts) * stride;
+        size_t w = (size_t)p * stride;
+        aec_cmac(aec->y_re, aec->y_im, aec->w_re + w, aec->w_im + w, aec->x_re + x, aec->x_im + x, stride);
+    }
+    audio_fft_inverse(&aec->fft, aec->y_re, aec->y_im, t);
+
+    // 3. 误差 e = d - y，放在后半段做下一步的频谱
+    float mic_pow = 0.0f;
+    float err_pow = 0.0f;
+    float echo_pow = 0.0f;
+    for (uint32_t i = 0; i < B; i++) {
+        float d = mic[i] * AEC_S16_SCALE;
+        float e = d - t[B + i];
+        mic_pow += d * d;
+        err_pow += e * e;
+        echo_pow += t[B + i] * t[B + i];
+        t[i] = 0.0f;
+        t[B + i] = e;
+    }
+    // 输出不比输入更响: 尚未收敛或发散时直接透传
+    if (err_pow <= mic_pow) {
+        for (uint32_t i = 0; i < B; i++) {
+            mic[i] = audio_sat16((int32_t)lrintf(t[B + i] * 32768.0f));
+        }
+    }
+
+    if (far_pow < AEC_FAR_ACTIVE_POW * B) {
+        return;
+    }
+    atomic_fetch_add_explicit(&aec->stats.adapt_blocks, 1, memory_order_relaxed);
+    aec->mic_pow += AEC_POW_SMOOTH * (mic_pow - aec->mic_pow);
+    aec->err_pow += AEC_POW_SMOOTH * (err_pow - aec->err_pow);
+    if (aec->err_pow > 0.0f && aec->mic_pow > 0.0f) {
+        float erle_db = 10.0f * log10f(aec->mic_pow / aec->err_pow);
+        atomic_store_explicit(&aec->stats.erle_db_x10, (int)(erle_db * 10.0f), memory_order_relaxed);
+        if (!aec->converged) {
+            aec->converged_blocks = erle_db > AEC_CONVERGED_DB ? aec->converged_blocks + 1 : 0;
+            aec->converged = aec->converged_blocks >= AEC_CONVERGED_BLOCKS;
+        }
+    }
+    if (err_pow > 2.0f * mic_pow) {
+        if (++aec->diverge_blocks >= AEC_DIVERGE_BLOCKS) {
+            aec_reset_filter(aec);
+            return;
+        }
+    } else {
+        aec->diverge_blocks = 0;
+    }
+
+    // 4. 归一化并限幅的误差频谱
+    audio_fft_forward(&aec->fft, t, aec->e_re, aec->e_im);
+    float step = AEC_STEP;
+    if (aec->converged) {
+        float ratio = echo_pow / (AEC_DTD_RATIO * err_pow + 1e-12f);
+        step *= ratio < AEC_MIN_STEP ? AEC_MIN_STEP : (ratio > 1.0f ? 1.0f : ratio);
+    }
+    float reg = AEC_REG_POW * B * aec->parts;
+    for (uint32_t k = 0; k < aec->bins; k++) {
+        float den = aec->x_pow[k] + reg;
+        float er = aec->e_re[k];
+        float ei = aec->e_im[k];
+        float mag2 = (er * er + ei * ei) / den;
+        float g = step / den;
+        if (mag2 > AEC_ERR_CLIP * AEC_ERR_CLIP) {
+            g *= AEC_ERR_CLIP / sqrtf(mag2);
+        }
+        aec->e_re[k] = er * g;
+        aec->e_im[k] = ei * g;
+    }
+
+    // 5. W_p += conj(X_p) * E
+    for (uint32_t p = 0; p < aec->parts; p++) {
+        size_t x = (size_t)((aec->x_head + p) % aec->parts) * stride;
+        size_t w = (size_t)p * stride;
+        aec_update(aec->w_re + w, aec->w_im + w, aec->x_re + x, aec->x_im + x, aec->e_re, aec->e_im, stride);
+    }
+
+    // 6. 轮流把一个分段的冲激响应截断到前 B 个采样
+    size_t c = (size_t)aec->constrain_part * stride;
+    audio_fft_inverse(&aec->fft, aec->w_re + c, aec->w_im + c, t);
+    memset(t + B, 0, B * sizeof(float));
+    audio_fft_forward(&aec->fft, t, aec->w_re + c, aec->w_im + c);
+    aec->constrain_part = (aec->constrain_part + 1) % aec->parts;
+}
+
+void audio_aec_process(audio_aec_t *aec, int16_t *mic, uint32_t samples, int64_t capture_us)
+{
+    int64_t start_ns = audio_now_ns();
+
+    if (samples > aec->cfg.frame_samples || samples % aec->block != 0) {
+        return;
+    }
+    if (!aec_fetch_ref(aec, samples, capture_us)) {
+        atomic_fetch_add_explicit(&aec->stats.ref_missing, 1, memory_order_relaxed);
+    }
+    for (uint32_t off = 0; off < samples; off += aec->block) {
+        aec_block(aec, mic + off, aec->ref_frame + off);
+    }
+
+    uint64_t cost_ns = audio_now_ns() - start_ns;
+    audio_stats_record(AUDIO_STAT_AEC, cost_ns);
+    atomic_fetch_add_explicit(&aec->stats.frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&aec->stats.cost_ns_sum, cost_ns, memory_order_relaxed);
+    if (cost_ns > atomic_load_explicit(&aec->stats.cost_ns_max, memory_order_relaxed)) {
+        atomic_store_explicit(&aec->stats.cost_ns_max, (uint32_t)cost_ns, memory_order_relaxed);
+    }
+}
@@ -0,0 +1,96 @@
+/*************************************************************
+ * File  :  audio_aec.h
+ * Module:  Frequency-domain acoustic echo canceller fed with the
+ *          playout stream as reference.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_AEC_H_
+#define _AUDIO_AEC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "audio_fft.h"
+
+#define AUDIO_AEC_DEFAULT_TAIL_MS (128)
+#define AUDIO_AEC_MAX_TAIL_MS (500)
+// 参考信号相对回声提前的余量，吸收延迟测量误差，回声路径仍保持因果
+#define AUDIO_AEC_REF_LEAD_MS (8)
+// 参考信号环保留的时长
+#define AUDIO_AEC_REF_MS (1000)
+
+typedef struct {
+    uint32_t sample_rate;       // 采集与参考共同的采样率(RTC 格式，单声道)
+    uint32_t frame_samples;     // 每次处理的采样数
+    uint32_t tail_ms;           // 回声尾长，0 表示默认值
+} audio_aec_config_t;
+
+typedef struct {
+    atomic_ullong frames;           // 处理的帧
+    atomic_ullong ref_missing;      // 找不到对齐参考(尚未写入或已被覆盖)的帧
+    atomic_ullong adapt_blocks;     // 有远端信号、更新了滤波器的分块
+    atomic_ullong resets;           // 发散后重置滤波器的次数
+    atomic_ullong cost_ns_sum;      // 累计处理耗时
+    atomic_uint cost_ns_max;
+    atomic_int erle_db_x10;         // 远端有声时的回声衰减估计(0.1dB)
+    atomic_int ref_lead_us;         // 最近一帧参考相对采集的提前量
+} audio_aec_stats_t;
+
+typedef struct {
+    audio_aec_config_t cfg;
+    uint32_t block;                 // 分块长度 B，整除帧长的 2 的幂
+    uint32_t bins;                  // B + 1
+    uint32_t stride;                // 每个分段频谱的存储步长(按 4 对齐)
+    uint32_t parts;                 // 滤波器分段数
+    audio_fft_t fft;                // 长度 2B
+
+    // 参考信号环: 播放线程写，采集线程读
+    int16_t *ref;
+    uint32_t ref_size;              // 2 的幂
+    atomic_ullong ref_write;        // 已写入的采样总数
+    // 锚点: 第 anchor_pos 个参考采样的预计播放时刻，序列锁保护
+    atomic_uint anchor_seq;
+    atomic_ullong anchor_pos;
+    atomic_llong anchor_us;
+
+    // 以下只在采集线程使用
+    float *x_re;                    // 参考频谱历史 parts 个分段，环形
+    float *x_im;
+    uint32_t x_head;                // 最新分段的下标
+    float *w_re;                    // 滤波器权重 parts 个分段
+    float *w_im;
+    float *x_pow;                   // 参考信号每个 bin 的平滑功率
+    float *x_time;                  // 最近 2B 个参考采样
+    float *time_buf;                // 2B 的时域暂存
+    float *y_re;
+    float *y_im;
+    float *e_re;
+    float *e_im;
+    int16_t *ref_frame;             // 与本帧采集对齐的参考
+    uint32_t constrain_part;        // 本分块做梯度约束的分段
+    float mic_pow;                  // 远端有声时的平滑能量
+    float err_pow;
+    uint32_t diverge_blocks;        // 输出能量持续大于输入的分块数
+    uint32_t converged_blocks;      // ERLE 连续达标的分块数
+    bool converged;                 // 收敛后才启用双讲步长控制
+
+    audio_aec_stats_t stats;
+} audio_aec_t;
+
+int audio_aec_init(audio_aec_t *aec, const audio_aec_config_t *cfg);
+void audio_aec_deinit(audio_aec_t *aec);
+void audio_aec_report(const audio_aec_t *aec);
+
+// 播放线程调用: 写入刚交给设备的一段参考，play_end_us 为其后一个采样预计播出的时刻
+void audio_aec_push_ref(audio_aec_t *aec, const int16_t *data, uint32_t samples, int64_t play_end_us);
+
+// 采集线程调用: 原地消除 mic 中的回声；capture_us 为最后一个采样的采集时刻
+void audio_aec_process(audio_aec_t *aec, int16_t *mic, uint32_t samples, int64_t capture_us);
+
+#endif
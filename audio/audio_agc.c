@@ -0,0 +1,190 @@
+/*************************************************************
+ * File  :  audio_agc.c
+ * Module:  Digital automatic gain control with a peak limiter.
+ *
+ * Once per frame the RMS level is compared with the target and
+ * the gain in dB moves towards the difference: quickly when the
+ * gain has to come down, slowly when it may go up, so loud onsets
+ * are caught. Frames below a fixed gate or close to a tracked
+ * noise floor keep the current gain, so pauses do not pump the
+ * background up. The gain is then capped so the
+ * frame peak stays under the limit, and applied as a linear ramp
+ * from the previous frame's gain to avoid zipper noise.
+ *
+ * The level reuses audio_energy_s16; the peak scan and the ramped
+ * gain run eight samples at a time with SSE2/NEON and saturate
+ * back to S16.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio_agc.h"
+#include "audio_simd.h"
+#include "audio_mix.h"
+#include "log.h"
+
+// 低于该电平，或高出噪声底不到 AGC_SPEECH_MARGIN_DB 时认为没有语音，增益保持不变
+#define AGC_GATE_DBFS (-55.0f)
+#define AGC_SPEECH_MARGIN_DB (6.0f)
+#define AGC_FLOOR_RISE_DB_PER_S (1.0f)
+// 最多衰减的量
+#define AGC_MIN_GAIN_DB (-12.0f)
+// 需要降低增益时每帧走完剩余差值的比例
+#define AGC_ATTACK (0.5f)
+#define AGC_RELEASE_DB_PER_S (6.0f)
+// 峰值上限，约 -1dBFS
+#define AGC_PEAK_LIMIT (29000.0f)
+
+bool audio_agc_config_valid(const audio_agc_config_t *cfg)
+{
+    return cfg->sample_rate != 0 && cfg->frame_samples != 0;
+}
+
+int audio_agc_init(audio_agc_t *agc, const audio_agc_config_t *cfg)
+{
+    memset(agc, 0, sizeof(*agc));
+    agc->cfg = *cfg;
+    if (!audio_agc_config_valid(cfg)) {
+        return -1;
+    }
+    agc->frame_s = (float)cfg->frame_samples / cfg->sample_rate;
+    agc->applied = 1.0f;
+    agc->floor_db = AGC_GATE_DBFS;
+
+    LOGI("自动增益已启用: 目标=%ddBFS, 最大增益=%udB, 门限=%.0fdBFS (%s)", cfg->target_dbfs,
+         cfg->max_gain_db, AGC_GATE_DBFS, AUDIO_SIMD_NAME);
+    return 0;
+}
+
+static int32_t agc_peak(const int16_t *in, uint32_t samples)
+{
+    int32_t peak = 0;
+    uint32_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    // max(x, -x) 对 -32768 仍得到 -32768，用 min 同时跟踪负峰值
+    __m128i vmax = _mm_setzero_si128();
+    __m128i vmin = _mm_setzero_si128();
+    for (; i + 8 <= samples; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+        vmax = _mm_max_epi16(vmax, x);
+        vmin = _mm_min_epi16(vmin, x);
+    }
+    int16_t hi[8], lo[8];
+    _mm_storeu_si128((__m128i *)hi, vmax);
+    _mm_storeu_si128((__m128i *)lo, vmin);
+    for (int k = 0; k < 8; k++) {
+        peak = hi[k] > peak ? hi[k] : peak;
+        peak = -lo[k] > peak ? -lo[k] : peak;
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    int16x8_t vmax = vdupq_n_s16(0);
+    int16x8_t vmin = vdupq_n_s16(0);
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t x = vld1q_s16(in + i);
+        vmax = vmaxq_s16(vmax, x);
+        vmin = vminq_s16(vmin, x);
+    }
+    int16_t hi[8], lo[8];
+    vst1q_s16(hi, vmax);
+    vst1q_s16(lo, vmin);
+    for (int k = 0; k < 8; k++) {
+        peak = hi[k] > peak ? hi[k] : peak;
+        peak = -lo[k] > peak ? -lo[k] : peak;
+    }
+#endif
+    for (; i < samples; i++) {
+        int32_t a = in[i] < 0 ? -in[i] : in[i];
+        peak = a > peak ? a : peak;
+    }
+    return peak;
+}
+
+// 增益从 g0 线性过渡到 g1
+static void agc_apply(int16_t *data, uint32_t samples, float g0, float g1)
+{
+    float step = (g1 - g0) / samples;
+    uint32_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    __m128 g = _mm_add_ps(_mm_set1_ps(g0), _mm_mul_ps(_mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), _mm_set1_ps(step)));
+    __m128 g_step = _mm_set1_ps(4.0f * step);
+    for (; i + 8 <= samples; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+        lo = _mm_mul_ps(lo, g);
+        g = _mm_add_ps(g, g_step);
+        hi = _mm_mul_ps(hi, g);
+        g = _mm_add_ps(g, g_step);
+        _mm_storeu_si128((__m128i *)(data + i), _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    static const float ramp[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    float32x4_t g = vmlaq_n_f32(vdupq_n_f32(g0), vld1q_f32(ramp), step);
+    float32x4_t g_step = vdupq_n_f32(4.0f * step);
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t x = vld1q_s16(data + i);
+        float32x4_t lo = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), g);
+        g = vaddq_f32(g, g_step);
+        float32x4_t hi = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), g);
+        g = vaddq_f32(g, g_step);
+        vst1q_s16(data + i, vcombine_s16(vqmovn_s32(audio_neon_round_s32(lo)), vqmovn_s32(audio_neon_round_s32(hi))));
+    }
+#endif
+    for (; i < samples; i++) {
+        data[i] = audio_sat16((int32_t)lrintf(data[i] * (g0 + step * i)));
+    }
+}
+
+void audio_agc_process(audio_agc_t *agc, int16_t *data, uint32_t samples)
+{
+    if (samples == 0) {
+        return;
+    }
+    double mean = (double)audio_energy_s16(data, samples) / samples;
+    float level_db = 10.0f * log10f((float)mean / (32768.0f * 32768.0f) + 1e-10f);
+
+    // 噪声底: 低于当前值时立即跟随，高于时缓慢上升
+    if (level_db < agc->floor_db) {
+        agc->floor_db = level_db;
+    } else {
+        agc->floor_db += AGC_FLOOR_RISE_DB_PER_S * agc->frame_s;
+    }
+
+    if (level_db < AGC_GATE_DBFS || level_db < agc->floor_db + AGC_SPEECH_MARGIN_DB) {
+        atomic_fetch_add_explicit(&agc->stats.gated_frames, 1, memory_order_relaxed);
+    } else {
+        float want = agc->cfg.target_dbfs - level_db;
+        want = want > agc->cfg.max_gain_db ? agc->cfg.max_gain_db : want;
+        want = want < AGC_MIN_GAIN_DB ? AGC_MIN_GAIN_DB : want;
+        if (want < agc->gain_db) {
+            agc->gain_db += AGC_ATTACK * (want - agc->gain_db);
+        } else {
+            float rise = AGC_RELEASE_DB_PER_S * agc->frame_s;
+            agc->gain_db += want - agc->gain_db < rise ? want - agc->gain_db : rise;
+        }
+    }
+
+    float gain = powf(10.0f, agc->gain_db / 20.0f);
+    float start = agc->applied;
+    int32_t peak = agc_peak(data, samples);
+    if (peak > 0 && peak * gain > AGC_PEAK_LIMIT) {
+        // 限幅优先于平滑: 整帧直接使用压低后的增益
+        gain = AGC_PEAK_LIMIT / peak;
+        start = start > gain ? gain : start;
+        atomic_fetch_add_explicit(&agc->stats.limited_frames, 1, memory_order_relaxed);
+    }
+    if (start != 1.0f || gain != 1.0f) {
+        agc_apply(data, samples, start, gain);
+    }
+    agc->applied = gain;
+
+    atomic_fetch_add_explicit(&agc->stats.frames, 1, memory_order_relaxed);
+    atomic_store_explicit(&agc->stats.gain_db_x10, (int)(20.0f * log10f(gain) * 10.0f), memory_order_relaxed);
+}
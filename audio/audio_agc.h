@@ -0,0 +1,51 @@
+/*************************************************************
+ * File  :  audio_agc.h
+ * Module:  Digital automatic gain control with a peak limiter.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_AGC_H_
+#define _AUDIO_AGC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#define AUDIO_AGC_DEFAULT_TARGET_DBFS (-18)
+#define AUDIO_AGC_DEFAULT_MAX_GAIN_DB (20)
+
+typedef struct {
+    uint32_t sample_rate;
+    uint32_t frame_samples;     // 每帧每通道的采样数
+    int target_dbfs;            // 语音的目标电平(RMS)
+    uint32_t max_gain_db;       // 最大放大量
+} audio_agc_config_t;
+
+typedef struct {
+    atomic_ullong frames;
+    atomic_ullong gated_frames;     // 电平低于门限或接近噪声底、保持增益不变的帧
+    atomic_ullong limited_frames;   // 峰值限制压低了增益的帧
+    atomic_int gain_db_x10;         // 当前增益(0.1dB)
+} audio_agc_stats_t;
+
+typedef struct {
+    audio_agc_config_t cfg;
+    float frame_s;
+    float gain_db;              // 平滑后的增益
+    float floor_db;             // 噪声底估计
+    float applied;              // 上一帧结束时实际使用的线性增益
+    audio_agc_stats_t stats;
+} audio_agc_t;
+
+int audio_agc_init(audio_agc_t *agc, const audio_agc_config_t *cfg);
+// audio_agc_init 会接受的参数返回 true，供运行中打开之前检查
+bool audio_agc_config_valid(const audio_agc_config_t *cfg);
+
+// 原地处理交织的 S16 数据，samples 为采样总数
+void audio_agc_process(audio_agc_t *agc, int16_t *data, uint32_t samples);
+
+#endif
@@ -0,0 +1,445 @@
+/*************************************************************
+ * File  :  audio_capture.c
+ * Module:  Event-driven capture thread woken by ALSA poll
+ *          descriptors.
+ *
+ * The thread sleeps in poll() on the PCM descriptors plus an
+ * eventfd used for shutdown, and hands one frame of pcm_duration
+ * to the callback per wakeup, so pacing follows the sound card
+ * clock instead of a sleep loop. With a batch of N the device
+ * wakes the thread once per N frames; read/write access then
+ * pulls them with a single snd_pcm_readi and delivers them back
+ * to back as slices of one buffer, each stamped with its own
+ * capture time; a short read leaves its partial tail at the
+ * head of that buffer for the next read to complete. This
+ * trades up to N-1 frames of latency for N times fewer wakeups
+ * and syscalls.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "audio_capture.h"
+#include "audio_time.h"
+#include "audio_device.h"
+#include "audio_stats.h"
+#include "log.h"
+
+#define CAPTURE_REPORT_INTERVAL_US (10 * 1000000)
+
+static void capture_report(audio_capture_t *cap)
+{
+    uint64_t frames = atomic_load(&cap->stats.frames);
+    uint64_t avg = frames ? atomic_load(&cap->stats.latency_sum_us) / frames : 0;
+
+    LOGI("采集统计(%s): 帧数=%llu, 唤醒=%llu, 空唤醒=%llu, 读取=%llu, 读错误=%llu, 零拷贝=%llu, 帧池未命中=%llu, "
+         "读取耗时 平均=%.1fus, 采集到发送延迟 平均=%lluus 最大=%uus, 唤醒滞后 平均=%.1fus 最大=%uus, "
+         "时钟偏差=%.1fppm",
+         cap->cfg.mmap ? "mmap" : "rw", (unsigned long long)frames,
+         atomic_load(&cap->stats.wakeups), atomic_load(&cap->stats.idle_wakeups),
+         atomic_load(&cap->stats.reads), atomic_load(&cap->stats.read_errors), atomic_load(&cap->stats.zero_copy_frames),
+         atomic_load(&cap->stats.pool_misses),
+         frames ? atomic_load(&cap->stats.io_ns_sum) / 1000.0 / frames : 0.0,
+         (unsigned long long)avg, atomic_load(&cap->stats.latency_max_us),
+         frames ? (double)atomic_load(&cap->stats.wake_late_sum_us) / frames : 0.0,
+         atomic_load(&cap->stats.wake_late_max_us), audio_drift_ppm(&cap->drift));
+}
+
+// 唤醒时缓冲区里多于一批的数据说明线程晚于数据就绪时刻被调度，
+// 精度受设备周期粒度限制
+static void capture_add_wake_late(audio_capture_t *cap, snd_pcm_sframes_t avail)
+{
+    int64_t expect = (int64_t)cap->cfg.batch * cap->frame_samples;
+    uint32_t late_us = avail > expect ? (uint32_t)((avail - expect) * 1000000 / cap->cfg.sample_rate) : 0;
+
+    audio_stats_record(AUDIO_STAT_CAPTURE_WAKEUP, late_us);
+    atomic_fetch_add_explicit(&cap->stats.wake_late_sum_us, late_us, memory_order_relaxed);
+    if (late_us > atomic_load_explicit(&cap->stats.wake_late_max_us, memory_order_relaxed)) {
+        atomic_store_explicit(&cap->stats.wake_late_max_us, late_us, memory_order_relaxed);
+    }
+}
+
+static void capture_add_io(audio_capture_t *cap, int64_t start_ns)
+{
+    int64_t io_ns = audio_now_ns() - start_ns;
+    atomic_fetch_add_explicit(&cap->stats.io_ns_sum, io_ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&cap->stats.reads, 1, memory_order_relaxed);
+    audio_stats_record(AUDIO_STAT_CAPTURE_READ, io_ns);
+}
+
+// 一帧交给回调之后记录采集到送出的延迟
+static void capture_add_latency(audio_capture_t *cap, int64_t capture_us)
+{
+    int64_t latency_us = audio_now_us() - capture_us;
+
+    audio_stats_record(AUDIO_STAT_CAPTURE_DELAY, latency_us);
+    atomic_fetch_add_explicit(&cap->stats.frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&cap->stats.latency_sum_us, latency_us, memory_order_relaxed);
+    if ((uint32_t)latency_us > atomic_load_explicit(&cap->stats.latency_max_us, memory_order_relaxed)) {
+        atomic_store_explicit(&cap->stats.latency_max_us, (uint32_t)latency_us, memory_order_relaxed);
+    }
+}
+
+// 优先从帧池取一帧，池已空时退回到内部缓冲区(借用帧)
+static audio_frame_t *capture_get_frame(audio_capture_t *cap, audio_frame_t *fallback)
+{
+    audio_frame_t *frame = cap->cfg.pool ? audio_frame_acquire(cap->cfg.pool) : NULL;
+    if (!frame) {
+        if (cap->cfg.pool) {
+            atomic_fetch_add_explicit(&cap->stats.pool_misses, 1, memory_order_relaxed);
+        }
+        audio_frame_borrow(fallback, cap->buffer, cap->frame_bytes, 0);
+        frame = fallback;
+    }
+    return frame;
+}
+
+static void capture_deliver(audio_capture_t *cap, audio_frame_t *frame, int64_t capture_us)
+{
+    frame->len = cap->frame_bytes;
+    frame->capture_us = capture_us;
+    cap->cfg.on_frame(cap->cfg.ctx, frame);
+    audio_frame_release(frame);
+}
+
+// 读写方式: 直接读入帧池中的帧后交给回调；读到的不足一帧时留作尾部，返回实际读到的帧数
+static int capture_rw_frame(audio_capture_t *cap, int64_t capture_us)
+{
+    const audio_capture_config_t *cfg = &cap->cfg;
+    audio_frame_t fallback;
+    audio_frame_t *frame = capture_get_frame(cap, &fallback);
+    int64_t start_ns = audio_now_ns();
+
+    snd_pcm_sframes_t frames = snd_pcm_readi(cfg->handle, frame->data, cap->frame_samples);
+    if (frames < 0) {
+        audio_frame_release(frame);
+        return (int)frames;
+    }
+    capture_add_io(cap, start_ns);
+    if ((uint32_t)frames < cap->frame_samples) {
+        // 与批量读取的尾部一样放在 buffer 开头，下一次读取接在它后面补齐这一帧
+        if (frame->data != cap->buffer) {
+            memcpy(cap->buffer, frame->data, (size_t)frames * cfg->bytes_per_frame);
+        }
+        cap->carry_samples = (uint32_t)frames;
+        audio_frame_release(frame);
+        return (int)frames;
+    }
+
+    capture_deliver(cap, frame, capture_us);
+    return (int)frames;
+}
+
+// mmap 方式: 一帧在 DMA 缓冲区中连续时直接把该区域交给回调，跨越环尾时才拷贝
+static int capture_mmap_frame(audio_capture_t *cap, int64_t capture_us)
+{
+    const audio_capture_config_t *cfg = &cap->cfg;
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset;
+    snd_pcm_uframes_t frames = cap->frame_samples;
+    snd_pcm_sframes_t committed;
+    int64_t start_ns = audio_now_ns();
+
+    int err = snd_pcm_mmap_begin(cfg->handle, &areas, &offset, &frames);
+    if (err < 0) {
+        return err;
+    }
+
+    if (frames == cap->frame_samples) {
+        // DMA 区域在提交前有效，以借用帧交出，需要保留的阶段自行拷贝
+        audio_frame_t dma;
+        audio_frame_borrow(&dma, audio_mmap_ptr(areas, offset), cap->frame_bytes, capture_us);
+        capture_add_io(cap, start_ns);
+        atomic_fetch_add_explicit(&cap->stats.zero_copy_frames, 1, memory_order_relaxed);
+        cfg->on_frame(cfg->ctx, &dma);
+        committed = snd_pcm_mmap_commit(cfg->handle, offset, frames);
+        return committed < 0 ? (int)committed : (int)frames;
+    }
+
+    audio_frame_t fallback;
+    audio_frame_t *frame = capture_get_frame(cap, &fallback);
+    size_t head_bytes = frames * cfg->bytes_per_frame;
+    memcpy(frame->data, audio_mmap_ptr(areas, offset), head_bytes);
+    committed = snd_pcm_mmap_commit(cfg->handle, offset, frames);
+    if (committed < 0) {
+        audio_frame_release(frame);
+        return (int)committed;
+    }
+
+    frames = cap->frame_samples - frames;
+    err = snd_pcm_mmap_begin(cfg->handle, &areas, &offset, &frames);
+    if (err < 0) {
+        audio_frame_release(frame);
+        return err;
+    }
+    memcpy(frame->data + head_bytes, audio_mmap_ptr(areas, offset), frames * cfg->bytes_per_frame);
+    committed = snd_pcm_mmap_commit(cfg->handle, offset, frames);
+    if (committed < 0) {
+        audio_frame_release(frame);
+        return (int)committed;
+    }
+    capture_add_io(cap, start_ns);
+
+    capture_deliver(cap, frame, capture_us);
+    return (int)cap->frame_samples;
+}
+
+// 读写方式批量读取: 一次 snd_pcm_readi 读出 count 帧，按帧切片依次以借用帧交给回调；
+// 读到的数据不是整帧时，尾部留在缓冲区开头，下一次读取接在它后面
+static int capture_rw_burst(audio_capture_t *cap, uint32_t count, const int64_t *capture_us)
+{
+    const audio_capture_config_t *cfg = &cap->cfg;
+    uint32_t carry = cap->carry_samples;
+    int64_t start_ns = audio_now_ns();
+
+    snd_pcm_sframes_t frames = snd_pcm_readi(cfg->handle, cap->buffer + (size_t)carry * cfg->bytes_per_frame,
+                                             (snd_pcm_uframes_t)count * cap->frame_samples - carry);
+    if (frames < 0) {
+        return (int)frames;
+    }
+    capture_add_io(cap, start_ns);
+
+    uint32_t total = carry + (uint32_t)frames;
+    uint32_t whole = total / cap->frame_samples;
+    for (uint32_t i = 0; i < whole; i++) {
+        audio_frame_t slice;
+        audio_frame_borrow(&slice, cap->buffer + (size_t)i * cap->frame_bytes, cap->frame_bytes, capture_us[i]);
+        cfg->on_frame(cfg->ctx, &slice);
+        capture_add_latency(cap, capture_us[i]);
+    }
+    cap->carry_samples = total - whole * cap->frame_samples;
+    if (cap->carry_samples) {
+        memmove(cap->buffer, cap->buffer + (size_t)whole * cap->frame_bytes,
+                (size_t)cap->carry_samples * cfg->bytes_per_frame);
+    }
+    return (int)frames;
+}
+
+// 读取最多一批整帧并交给回调；返回读取的帧数，设备中不足一帧时返回 0
+static int capture_read_frames(audio_capture_t *cap)
+{
+    const audio_capture_config_t *cfg = &cap->cfg;
+    int64_t capture_us[AUDIO_CAPTURE_MAX_BATCH];
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(cfg->handle);
+
+    if (avail < 0) {
+        return (int)avail;
+    }
+    // 上次批量读取留下的尾部与缓冲区中的数据一起凑整帧
+    int64_t pending = (int64_t)avail + cap->carry_samples;
+    if (pending < cap->frame_samples) {
+        return 0;
+    }
+
+    // 第 i 帧最后一个采样的时刻: 读取时仍留在缓冲区中、排在它之后的数据都比它新
+    uint32_t count = (uint32_t)(pending / cap->frame_samples);
+    count = count < cfg->batch ? count : cfg->batch;
+    int64_t now_us = audio_now_us();
+    for (uint32_t i = 0; i < count; i++) {
+        capture_us[i] = now_us - (pending - (int64_t)(i + 1) * cap->frame_samples) * 1000000 / cfg->sample_rate;
+    }
+
+    int frames = 0;
+    if (!cfg->mmap && (count > 1 || cap->carry_samples)) {
+        frames = capture_rw_burst(cap, count, capture_us);
+    } else {
+        // mmap 方式逐帧交出 DMA 区域，取数据本身不经过系统调用
+        for (uint32_t i = 0; i < count; i++) {
+            int n = cfg->mmap ? capture_mmap_frame(cap, capture_us[i]) : capture_rw_frame(cap, capture_us[i]);
+            if (n <= 0) {
+                frames = frames ? frames : n;
+                break;
+            }
+            frames += n;
+            if ((uint32_t)n < cap->frame_samples) {
+                break;
+            }
+            capture_add_latency(cap, capture_us[i]);
+        }
+    }
+    if (frames <= 0) {
+        return frames;
+    }
+    cap->device_pos += frames;
+    capture_add_wake_late(cap, avail);
+    return frames;
+}
+
+static void *capture_thread(void *arg)
+{
+    audio_capture_t *cap = arg;
+    const audio_capture_config_t *cfg = &cap->cfg;
+    int timeout_ms = (cfg->batch + 3) * cfg->frame_ms;
+    int64_t next_report_us = audio_now_us() + CAPTURE_REPORT_INTERVAL_US;
+
+    audio_rt_enter(&cfg->rt, "audio-capture");
+    while (atomic_load_explicit(&cap->running, memory_order_relaxed)) {
+        int rval = poll(cap->pfds, cap->pfd_count + 1, timeout_ms);
+        if (rval < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGE("poll 录音设备失败: %s", strerror(errno));
+            break;
+        }
+        if (rval == 0) {
+            LOGW("录音设备 %dms 内没有数据", timeout_ms);
+            continue;
+        }
+        if (cap->pfds[cap->pfd_count].revents) {
+            break;
+        }
+
+        unsigned short revents = 0;
+        snd_pcm_poll_descriptors_revents(cfg->handle, cap->pfds, cap->pfd_count, &revents);
+        atomic_fetch_add_explicit(&cap->stats.wakeups, 1, memory_order_relaxed);
+        if (!(revents & (POLLIN | POLLERR))) {
+            atomic_fetch_add_explicit(&cap->stats.idle_wakeups, 1, memory_order_relaxed);
+            continue;
+        }
+
+        int frames = capture_read_frames(cap);
+        if (frames == 0) {
+            atomic_fetch_add_explicit(&cap->stats.idle_wakeups, 1, memory_order_relaxed);
+        } else if (frames < 0 && frames != -EAGAIN) {
+            atomic_fetch_add_explicit(&cap->stats.read_errors, 1, memory_order_relaxed);
+            if (audio_xrun_recover(&cap->xrun, frames) < 0) {
+                LOGE("读取音频数据失败: %s", snd_strerror(frames));
+                usleep(cfg->frame_ms * 1000);
+            }
+            // 恢复后丢失的数据无法计入位置，留下的尾部也与之后的数据不再连续
+            audio_drift_reset(&cap->drift);
+            cap->carry_samples = 0;
+        }
+
+        int64_t now_us = audio_now_us();
+        if (frames > 0 && audio_drift_due(&cap->drift, now_us)) {
+            // 设备已采集的帧数 = 已读出的帧数 + 缓冲区中尚未读取的帧数
+            audio_drift_sample(&cap->drift, cfg->handle, cap->device_pos);
+        }
+        if (now_us >= next_report_us) {
+            capture_report(cap);
+            next_report_us = now_us + CAPTURE_REPORT_INTERVAL_US;
+        }
+    }
+    return NULL;
+}
+
+int audio_capture_start(audio_capture_t *cap, const audio_capture_config_t *cfg)
+{
+    int err;
+
+    memset(cap, 0, sizeof(*cap));
+    cap->cfg = *cfg;
+    cap->wake_fd = -1;
+    cap->frame_samples = cfg->sample_rate * cfg->frame_ms / 1000;
+    cap->frame_bytes = cap->frame_samples * cfg->bytes_per_frame;
+    if (cap->frame_samples == 0 || !cfg->on_frame) {
+        return -1;
+    }
+    if (cap->cfg.batch == 0) {
+        cap->cfg.batch = 1;
+    }
+    if (cap->cfg.batch > AUDIO_CAPTURE_MAX_BATCH) {
+        cap->cfg.batch = AUDIO_CAPTURE_MAX_BATCH;
+    }
+    if (cfg->pool && cfg->pool->frame_size < cap->frame_bytes) {
+        LOGE("帧池容量 %uB 小于采集帧 %uB", cfg->pool->frame_size, cap->frame_bytes);
+        return -1;
+    }
+
+    if (audio_xrun_init(&cap->xrun, cfg->handle, SND_PCM_STREAM_CAPTURE, "录音",
+                        cfg->sample_rate, cfg->bytes_per_frame, 0) < 0) {
+        return -1;
+    }
+    audio_drift_init(&cap->drift, "录音", cfg->sample_rate);
+
+    cap->buffer = calloc(cap->cfg.batch, cap->frame_bytes);
+    cap->pfd_count = snd_pcm_poll_descriptors_count(cfg->handle);
+    cap->pfds = cap->pfd_count > 0 ? calloc(cap->pfd_count + 1, sizeof(struct pollfd)) : NULL;
+    if (!cap->buffer || !cap->pfds) {
+        LOGE("无法分配采集缓冲区");
+        goto error;
+    }
+    audio_rt_prefault(cap->buffer, (size_t)cap->cfg.batch * cap->frame_bytes);
+
+    err = snd_pcm_poll_descriptors(cfg->handle, cap->pfds, cap->pfd_count);
+    if (err < 0) {
+        LOGE("无法获取录音设备 poll 描述符: %s", snd_strerror(err));
+        goto error;
+    }
+    cap->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (cap->wake_fd < 0) {
+        LOGE("无法创建 eventfd: %s", strerror(errno));
+        goto error;
+    }
+    cap->pfds[cap->pfd_count].fd = cap->wake_fd;
+    cap->pfds[cap->pfd_count].events = POLLIN;
+
+    // 非阻塞读取，等待全部交给 poll
+    snd_pcm_nonblock(cfg->handle, 1);
+    // 重新启动时设备处于 snd_pcm_drop 之后的 SETUP 状态，需要先 prepare
+    err = snd_pcm_prepare(cfg->handle);
+    if (err == 0) {
+        err = snd_pcm_start(cfg->handle);
+    }
+    if (err < 0) {
+        LOGE("无法启动录音设备: %s", snd_strerror(err));
+        goto error;
+    }
+
+    atomic_store(&cap->running, true);
+    if (pthread_create(&cap->thread, NULL, capture_thread, cap) != 0) {
+        LOGE("无法创建采集线程");
+        goto error;
+    }
+
+    LOGI("采集线程已启动: 帧长=%ums, 每帧采样=%u, 每次唤醒=%u 帧, poll 描述符=%d, 访问方式=%s", cfg->frame_ms,
+         cap->frame_samples, cap->cfg.batch, cap->pfd_count, cfg->mmap ? "mmap" : "rw");
+    return 0;
+
+error:
+    atomic_store(&cap->running, false);
+    if (cap->wake_fd >= 0) {
+        close(cap->wake_fd);
+    }
+    free(cap->pfds);
+    free(cap->buffer);
+    cap->pfds = NULL;
+    cap->buffer = NULL;
+    audio_xrun_deinit(&cap->xrun);
+    return -1;
+}
+
+void audio_capture_stop(audio_capture_t *cap)
+{
+    uint64_t one = 1;
+
+    if (!atomic_exchange(&cap->running, false)) {
+        return;
+    }
+    if (write(cap->wake_fd, &one, sizeof(one)) < 0) {
+        LOGW("无法唤醒采集线程: %s", strerror(errno));
+    }
+    pthread_join(cap->thread, NULL);
+    snd_pcm_drop(cap->cfg.handle);
+
+    capture_report(cap);
+    audio_xrun_report(&cap->xrun);
+    audio_drift_report(&cap->drift);
+
+    close(cap->wake_fd);
+    free(cap->pfds);
+    free(cap->buffer);
+    cap->pfds = NULL;
+    cap->buffer = NULL;
+    audio_xrun_deinit(&cap->xrun);
+}
@@ -0,0 +1,82 @@
+/*************************************************************
+ * File  :  audio_capture.h
+ * Module:  Event-driven capture thread woken by ALSA poll
+ *          descriptors.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_CAPTURE_H_
+#define _AUDIO_CAPTURE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <alsa/asoundlib.h>
+
+#include "audio_xrun.h"
+#include "audio_rt.h"
+#include "audio_frame.h"
+#include "audio_drift.h"
+
+// 一次唤醒最多处理的帧数
+#define AUDIO_CAPTURE_MAX_BATCH (8)
+
+// 每采集到一帧调用一次；frame->capture_us 为该帧最后一个采样的采集时刻。
+// 帧只在回调期间有效，需要继续持有时调用 audio_frame_hold。
+// mmap 方式下 frame 可能是直接指向 DMA 缓冲区的借用帧。
+typedef void (*audio_capture_frame_cb)(void *ctx, audio_frame_t *frame);
+
+typedef struct {
+    snd_pcm_t *handle;              // 录音设备句柄
+    uint32_t sample_rate;           // 采样率
+    uint32_t bytes_per_frame;       // 每个采样帧(所有通道)的字节数
+    uint32_t frame_ms;              // 每帧时长
+    bool mmap;                      // 设备以 mmap 方式访问
+    uint32_t batch;                 // 每次唤醒读取的帧数，须与设备的 avail_min 一致；0 与 1 相同
+    audio_rt_config_t rt;           // 采集线程的实时调度参数
+    audio_frame_pool_t *pool;       // 可选，设置后直接读入池中的帧
+    audio_capture_frame_cb on_frame;
+    void *ctx;
+} audio_capture_config_t;
+
+typedef struct {
+    atomic_ullong frames;           // 送出的帧数
+    atomic_ullong wakeups;          // poll 唤醒次数
+    atomic_ullong reads;            // 从设备取数据的次数，批量读取时一次取多帧
+    atomic_ullong idle_wakeups;     // 唤醒后数据不足一帧的次数
+    atomic_ullong read_errors;      // 读取失败次数
+    atomic_ullong zero_copy_frames; // 直接交出 DMA 区域的帧数
+    atomic_ullong io_ns_sum;        // 从设备取数据的累计耗时
+    atomic_ullong latency_sum_us;   // 采集到送出的累计延迟
+    atomic_uint latency_max_us;     // 采集到送出的最大延迟
+    atomic_ullong wake_late_sum_us; // 唤醒时已超出一帧的数据量折算的累计滞后
+    atomic_uint wake_late_max_us;   // 最大唤醒滞后
+    atomic_ullong pool_misses;      // 帧池已空、改用内部缓冲区的帧数
+} audio_capture_stats_t;
+
+typedef struct {
+    audio_capture_config_t cfg;
+    pthread_t thread;
+    atomic_bool running;
+    int wake_fd;                    // 用于停止时唤醒 poll
+    struct pollfd *pfds;
+    int pfd_count;
+    uint32_t frame_samples;
+    uint32_t frame_bytes;
+    uint8_t *buffer;                // 批量读取的缓冲区，也是帧池已空时的后备
+    audio_xrun_t xrun;
+    audio_drift_t drift;            // 录音设备相对系统时钟的偏差
+    int64_t device_pos;             // 已从设备读出的帧数
+    uint32_t carry_samples;         // 批量读取时不足一帧的尾部，留在 buffer 开头由下一次读取补齐
+    audio_capture_stats_t stats;
+} audio_capture_t;
+
+int audio_capture_start(audio_capture_t *cap, const audio_capture_config_t *cfg);
+void audio_capture_stop(audio_capture_t *cap);
+
+#endif
@@ -0,0 +1,171 @@
+/*************************************************************
+ * File  :  audio_convert.c
+ * Module:  Conversion stage between the device format and the
+ *          RTC format.
+ *
+ * All scratch buffers are sized at init from the largest input
+ * block and the RTC frame, so the per-frame path never
+ * allocates. Steps that are not needed are skipped entirely.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_convert.h"
+#include "audio_time.h"
+#include "log.h"
+
+static void *convert_alloc(size_t bytes)
+{
+    void *p = NULL;
+    if (posix_memalign(&p, 64, bytes ? bytes : 64) != 0) {
+        return NULL;
+    }
+    memset(p, 0, bytes);
+    return p;
+}
+
+int audio_convert_init(audio_convert_t *cv, const char *name, const audio_format_t *in,
+                       const audio_format_t *out, uint32_t max_in_frames,
+                       uint32_t out_frame_frames, uint32_t select_channel, bool adaptive)
+{
+    memset(cv, 0, sizeof(*cv));
+    cv->name = name;
+    cv->in = *in;
+    cv->out = *out;
+    cv->select_channel = select_channel;
+    if (max_in_frames == 0) {
+        LOGE("%s: 单次输入帧数不能为 0", name);
+        return -1;
+    }
+    cv->max_in_frames = max_in_frames;
+    cv->out_frame_bytes = audio_frame_bytes(out);
+    cv->adaptive = adaptive;
+    cv->resample = adaptive || in->rate != out->rate;
+    cv->passthrough = !cv->resample && in->channels == out->channels && in->format == out->format;
+    if (cv->passthrough) {
+        return 0;
+    }
+
+    uint32_t max_out = max_in_frames;
+    if (cv->resample) {
+        if (audio_resampler_init(&cv->rs, in->rate, out->rate, out->channels, max_in_frames) < 0) {
+            LOGE("%s: 无法创建重采样器 %u->%uHz", name, in->rate, out->rate);
+            return -1;
+        }
+        max_out = audio_resampler_max_out(&cv->rs, max_in_frames);
+    }
+
+    // 细调比例最多改变千分之一，max_out 的余量已经足够
+    cv->acc_capacity = max_out + 2 * out_frame_frames;
+    cv->s16 = convert_alloc((size_t)max_in_frames * in->channels * sizeof(int16_t));
+    cv->mix = convert_alloc((size_t)max_in_frames * out->channels * sizeof(int16_t));
+    cv->rs_out = convert_alloc((size_t)max_out * out->channels * sizeof(int16_t));
+    cv->acc = convert_alloc((size_t)cv->acc_capacity * cv->out_frame_bytes);
+    if (!cv->s16 || !cv->mix || !cv->rs_out || !cv->acc) {
+        audio_convert_deinit(cv);
+        return -1;
+    }
+
+    LOGI("%s: %uHz/%uch/%s -> %uHz/%uch/%s%s%s", name, in->rate, in->channels,
+         audio_sample_fmt_name(in->format), out->rate, out->channels,
+         audio_sample_fmt_name(out->format), select_channel ? " (单通道选择)" : "",
+         adaptive ? " (时钟偏差补偿)" : "");
+    return 0;
+}
+
+void audio_convert_deinit(audio_convert_t *cv)
+{
+    if (cv->resample) {
+        audio_resampler_deinit(&cv->rs);
+    }
+    free(cv->s16);
+    free(cv->mix);
+    free(cv->rs_out);
+    free(cv->acc);
+    cv->s16 = cv->mix = cv->rs_out = NULL;
+    cv->acc = NULL;
+}
+
+uint32_t audio_convert_push(audio_convert_t *cv, const void *in, uint32_t frames)
+{
+    int64_t start_ns = audio_now_ns();
+    const int16_t *cur = in;
+    uint32_t n = frames;
+
+    if (frames > cv->max_in_frames) {
+        frames = n = cv->max_in_frames;
+    }
+
+    uint32_t need = cv->resample ? audio_resampler_max_out(&cv->rs, frames) : frames;
+    // 调用者没有及时取走时丢弃最旧的数据，保证延迟有界
+    if (cv->acc_frames + need > cv->acc_capacity) {
+        uint32_t drop = cv->acc_frames + need - cv->acc_capacity;
+        audio_convert_consume(cv, drop);
+        atomic_fetch_add_explicit(&cv->stats.overflow_frames, drop, memory_order_relaxed);
+    }
+
+    if (cv->in.format != AUDIO_FMT_S16) {
+        audio_to_s16(cur, cv->in.format, cv->s16, (size_t)n * cv->in.channels);
+        cur = cv->s16;
+    }
+    if (cv->in.channels != cv->out.channels) {
+        audio_remix_s16(cur, cv->in.channels, cv->mix, cv->out.channels, n, cv->select_channel);
+        cur = cv->mix;
+    }
+    if (cv->resample) {
+        n = audio_resampler_process(&cv->rs, cur, n, cv->rs_out);
+        cur = cv->rs_out;
+    }
+
+    uint8_t *dst = cv->acc + (size_t)cv->acc_frames * cv->out_frame_bytes;
+    audio_from_s16(cur, dst, cv->out.format, (size_t)n * cv->out.channels);
+    cv->acc_frames += n;
+
+    uint32_t cost_ns = (uint32_t)(audio_now_ns() - start_ns);
+    atomic_fetch_add_explicit(&cv->stats.calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&cv->stats.cost_ns_sum, cost_ns, memory_order_relaxed);
+    if (cost_ns > atomic_load_explicit(&cv->stats.cost_ns_max, memory_order_relaxed)) {
+        atomic_store_explicit(&cv->stats.cost_ns_max, cost_ns, memory_order_relaxed);
+    }
+    return frames;
+}
+
+void audio_convert_consume(audio_convert_t *cv, uint32_t frames)
+{
+    if (frames >= cv->acc_frames) {
+        cv->acc_frames = 0;
+        return;
+    }
+    memmove(cv->acc, cv->acc + (size_t)frames * cv->out_frame_bytes,
+            (size_t)(cv->acc_frames - frames) * cv->out_frame_bytes);
+    cv->acc_frames -= frames;
+}
+
+void audio_convert_set_ppm(audio_convert_t *cv, double ppm)
+{
+    if (!cv->adaptive || cv->rs.ratio_ppm == ppm) {
+        return;
+    }
+    audio_resampler_set_ppm(&cv->rs, ppm);
+}
+
+void audio_convert_report(const audio_convert_t *cv)
+{
+    audio_convert_stats_t *stats = (audio_convert_stats_t *)&cv->stats;
+    uint64_t calls = atomic_load(&stats->calls);
+
+    if (cv->passthrough) {
+        return;
+    }
+    LOGI("%s: 格式转换 调用=%llu, 耗时 平均=%.1fus 最大=%.1fus, 溢出丢弃=%llu帧, 比例细调=%.1fppm",
+         cv->name, (unsigned long long)calls,
+         calls ? atomic_load(&stats->cost_ns_sum) / 1000.0 / calls : 0.0,
+         atomic_load(&stats->cost_ns_max) / 1000.0, atomic_load(&stats->overflow_frames),
+         cv->resample ? cv->rs.ratio_ppm : 0.0);
+}
@@ -0,0 +1,76 @@
+/*************************************************************
+ * File  :  audio_convert.h
+ * Module:  Conversion stage between the device format and the
+ *          RTC format.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_CONVERT_H_
+#define _AUDIO_CONVERT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "audio_format.h"
+#include "audio_resampler.h"
+
+typedef struct {
+    atomic_ullong calls;            // 处理次数
+    atomic_ullong cost_ns_sum;      // 累计耗时
+    atomic_uint cost_ns_max;        // 单次最大耗时
+    atomic_ullong overflow_frames;  // 输出未及时取走而被丢弃的帧
+} audio_convert_stats_t;
+
+// 依次执行: 格式转为 S16 -> 通道变换 -> 重采样 -> 转为输出格式。
+// 每次最多处理 max_in_frames 帧输入，输出累积在内部缓冲中，由调用者按整帧取走。
+typedef struct {
+    const char *name;
+    audio_format_t in;
+    audio_format_t out;
+    uint32_t select_channel;        // 下混时只取该通道，0 表示取平均
+    bool passthrough;               // 格式完全一致时不做任何处理
+    bool resample;
+    bool adaptive;                  // 采样率相同时也保留重采样器，用于时钟偏差补偿
+    audio_resampler_t rs;
+    uint32_t max_in_frames;
+    int16_t *s16;                   // 输入转 S16 的暂存
+    int16_t *mix;                   // 通道变换后的暂存
+    int16_t *rs_out;                // 重采样输出暂存
+    uint8_t *acc;                   // 输出格式的累积缓冲
+    uint32_t acc_frames;
+    uint32_t acc_capacity;
+    uint32_t out_frame_bytes;
+    audio_convert_stats_t stats;
+} audio_convert_t;
+
+int audio_convert_init(audio_convert_t *cv, const char *name, const audio_format_t *in,
+                       const audio_format_t *out, uint32_t max_in_frames,
+                       uint32_t out_frame_frames, uint32_t select_channel, bool adaptive);
+void audio_convert_deinit(audio_convert_t *cv);
+
+// 返回实际处理的输入帧数，超过 max_in_frames 的部分由调用者取走输出后再次推入
+uint32_t audio_convert_push(audio_convert_t *cv, const void *in, uint32_t frames);
+
+static inline uint32_t audio_convert_avail(const audio_convert_t *cv)
+{
+    return cv->acc_frames;
+}
+
+static inline const void *audio_convert_data(const audio_convert_t *cv)
+{
+    return cv->acc;
+}
+
+void audio_convert_consume(audio_convert_t *cv, uint32_t frames);
+
+// 微调重采样比例，正值表示消耗更多输入；需要以 adaptive 方式创建，只能在处理线程调用
+void audio_convert_set_ppm(audio_convert_t *cv, double ppm);
+
+void audio_convert_report(const audio_convert_t *cv);
+
+#endif
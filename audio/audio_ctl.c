@@ -0,0 +1,257 @@
+/*************************************************************
+ * File  :  audio_ctl.c
+ * Module:  Unix-domain control socket with a line-based
+ *          command protocol.
+ *
+ * A dedicated thread polls the listening socket, up to
+ * AUDIO_CTL_MAX_CLIENTS connections and an eventfd used for
+ * shutdown. Every newline-terminated request is split on
+ * whitespace and handed to the callback; the reply text is sent
+ * back followed by a final "ok" line, or as one "error: ..."
+ * line, so both scripts (one command per connection) and
+ * interactive sessions can tell where a reply ends. The audio
+ * threads never touch the socket.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/eventfd.h>
+
+#include "audio_ctl.h"
+#include "log.h"
+
+// 客户端不读回复时最多阻塞控制线程这么久
+#define CTL_SEND_TIMEOUT_MS (1000)
+
+static void ctl_send(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+static void ctl_close_client(audio_ctl_client_t *cl)
+{
+    close(cl->fd);
+    cl->fd = -1;
+    cl->len = 0;
+}
+
+static void ctl_handle_line(audio_ctl_t *ctl, audio_ctl_client_t *cl, char *line)
+{
+    char *argv[AUDIO_CTL_MAX_ARGS];
+    int argc = 0;
+    char *save = NULL;
+
+    for (char *tok = strtok_r(line, " \t\r", &save); tok && argc < AUDIO_CTL_MAX_ARGS;
+         tok = strtok_r(NULL, " \t\r", &save)) {
+        argv[argc++] = tok;
+    }
+    if (argc == 0) {
+        return;
+    }
+
+    ctl->reply[0] = '\0';
+    int rval = ctl->cfg.on_command(ctl->cfg.ctx, argc, argv, ctl->reply, sizeof(ctl->reply));
+    atomic_fetch_add_explicit(&ctl->commands, 1, memory_order_relaxed);
+    size_t len = strnlen(ctl->reply, sizeof(ctl->reply) - 1);
+
+    if (rval < 0) {
+        atomic_fetch_add_explicit(&ctl->errors, 1, memory_order_relaxed);
+        ctl_send(cl->fd, "error: ", 7);
+        ctl_send(cl->fd, ctl->reply, len);
+        ctl_send(cl->fd, "\n", 1);
+        return;
+    }
+    if (len > 0) {
+        ctl_send(cl->fd, ctl->reply, len);
+        if (ctl->reply[len - 1] != '\n') {
+            ctl_send(cl->fd, "\n", 1);
+        }
+    }
+    ctl_send(cl->fd, "ok\n", 3);
+}
+
+// 读出客户端数据，逐行处理；连接关闭或单行过长时断开
+static void ctl_read_client(audio_ctl_t *ctl, audio_ctl_client_t *cl)
+{
+    ssize_t n = recv(cl->fd, cl->buf + cl->len, sizeof(cl->buf) - 1 - cl->len, 0);
+    if (n <= 0) {
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            return;
+        }
+        ctl_close_client(cl);
+        return;
+    }
+    cl->len += n;
+
+    char *start = cl->buf;
+    char *nl;
+    while ((nl = memchr(start, '\n', cl->buf + cl->len - start)) != NULL) {
+        *nl = '\0';
+        ctl_handle_line(ctl, cl, start);
+        start = nl + 1;
+    }
+    cl->len -= start - cl->buf;
+    memmove(cl->buf, start, cl->len);
+    if (cl->len == sizeof(cl->buf) - 1) {
+        ctl_send(cl->fd, "error: 命令过长\n", strlen("error: 命令过长\n"));
+        ctl_close_client(cl);
+    }
+}
+
+static void ctl_accept(audio_ctl_t *ctl)
+{
+    int fd = accept4(ctl->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    // 没有发送超时的话，不读回复的客户端会让控制线程一直阻塞在 ctl_send
+    struct timeval tv = { CTL_SEND_TIMEOUT_MS / 1000, (CTL_SEND_TIMEOUT_MS % 1000) * 1000 };
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0) {
+        LOGW("无法设置控制连接的发送超时: %s", strerror(errno));
+        close(fd);
+        return;
+    }
+    for (int i = 0; i < AUDIO_CTL_MAX_CLIENTS; i++) {
+        if (ctl->clients[i].fd < 0) {
+            ctl->clients[i].fd = fd;
+            ctl->clients[i].len = 0;
+            return;
+        }
+    }
+    ctl_send(fd, "error: 控制连接数已满\n", strlen("error: 控制连接数已满\n"));
+    close(fd);
+}
+
+static void *ctl_thread(void *arg)
+{
+    audio_ctl_t *ctl = arg;
+    struct pollfd pfds[AUDIO_CTL_MAX_CLIENTS + 2];
+
+    while (atomic_load_explicit(&ctl->running, memory_order_relaxed)) {
+        int n = 0;
+        pfds[n++] = (struct pollfd) { .fd = ctl->wake_fd, .events = POLLIN };
+        pfds[n++] = (struct pollfd) { .fd = ctl->listen_fd, .events = POLLIN };
+        for (int i = 0; i < AUDIO_CTL_MAX_CLIENTS; i++) {
+            // 空闲项的 fd 为 -1，poll 会忽略
+            pfds[n++] = (struct pollfd) { .fd = ctl->clients[i].fd, .events = POLLIN };
+        }
+
+        if (poll(pfds, n, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGE("poll 控制套接字失败: %s", strerror(errno));
+            break;
+        }
+        if (pfds[0].revents) {
+            break;
+        }
+        for (int i = 0; i < AUDIO_CTL_MAX_CLIENTS; i++) {
+            if (pfds[2 + i].revents && ctl->clients[i].fd >= 0) {
+                ctl_read_client(ctl, &ctl->clients[i]);
+            }
+        }
+        if (pfds[1].revents & POLLIN) {
+            ctl_accept(ctl);
+        }
+    }
+    return NULL;
+}
+
+int audio_ctl_start(audio_ctl_t *ctl, const audio_ctl_config_t *cfg)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    memset(ctl, 0, sizeof(*ctl));
+    ctl->cfg = *cfg;
+    ctl->listen_fd = -1;
+    ctl->wake_fd = -1;
+    for (int i = 0; i < AUDIO_CTL_MAX_CLIENTS; i++) {
+        ctl->clients[i].fd = -1;
+    }
+    if (!cfg->path || !cfg->on_command || strlen(cfg->path) >= sizeof(addr.sun_path)) {
+        LOGE("控制套接字路径不合法");
+        return -1;
+    }
+    memcpy(addr.sun_path, cfg->path, strlen(cfg->path));
+
+    ctl->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (ctl->listen_fd < 0) {
+        LOGE("无法创建控制套接字: %s", strerror(errno));
+        return -1;
+    }
+    // 上次异常退出留下的套接字文件会导致 bind 失败
+    unlink(cfg->path);
+    if (bind(ctl->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(ctl->listen_fd, AUDIO_CTL_MAX_CLIENTS) < 0) {
+        LOGE("无法监听控制套接字 %s: %s", cfg->path, strerror(errno));
+        goto error;
+    }
+    ctl->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ctl->wake_fd < 0) {
+        LOGE("无法创建 eventfd: %s", strerror(errno));
+        goto error;
+    }
+
+    atomic_store(&ctl->running, true);
+    if (pthread_create(&ctl->thread, NULL, ctl_thread, ctl) != 0) {
+        LOGE("无法创建控制线程");
+        atomic_store(&ctl->running, false);
+        goto error;
+    }
+    LOGI("控制套接字已启动: %s", cfg->path);
+    return 0;
+
+error:
+    if (ctl->wake_fd >= 0) {
+        close(ctl->wake_fd);
+    }
+    close(ctl->listen_fd);
+    unlink(cfg->path);
+    ctl->listen_fd = -1;
+    ctl->wake_fd = -1;
+    return -1;
+}
+
+void audio_ctl_stop(audio_ctl_t *ctl)
+{
+    uint64_t one = 1;
+
+    if (!atomic_exchange(&ctl->running, false)) {
+        return;
+    }
+    if (write(ctl->wake_fd, &one, sizeof(one)) < 0) {
+        LOGW("无法唤醒控制线程: %s", strerror(errno));
+    }
+    pthread_join(ctl->thread, NULL);
+
+    for (int i = 0; i < AUDIO_CTL_MAX_CLIENTS; i++) {
+        if (ctl->clients[i].fd >= 0) {
+            ctl_close_client(&ctl->clients[i]);
+        }
+    }
+    close(ctl->listen_fd);
+    close(ctl->wake_fd);
+    unlink(ctl->cfg.path);
+    LOGI("控制套接字统计: 命令=%llu, 失败=%llu", atomic_load(&ctl->commands), atomic_load(&ctl->errors));
+}
@@ -0,0 +1,57 @@
+/*************************************************************
+ * File  :  audio_ctl.h
+ * Module:  Unix-domain control socket with a line-based
+ *          command protocol.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_CTL_H_
+#define _AUDIO_CTL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define AUDIO_CTL_MAX_CLIENTS (4)
+#define AUDIO_CTL_MAX_ARGS (8)
+#define AUDIO_CTL_LINE_SIZE (512)
+#define AUDIO_CTL_REPLY_SIZE (8192)
+
+// 处理一条命令，argv 为按空白切分后的参数；回复文本写入 reply，返回 0 表示成功。
+// 在控制线程中调用，一次只处理一条命令
+typedef int (*audio_ctl_handler)(void *ctx, int argc, char **argv, char *reply, size_t size);
+
+typedef struct {
+    const char *path;               // 套接字路径，已存在时先删除
+    audio_ctl_handler on_command;
+    void *ctx;
+} audio_ctl_config_t;
+
+typedef struct {
+    char buf[AUDIO_CTL_LINE_SIZE];
+    size_t len;
+    int fd;
+} audio_ctl_client_t;
+
+typedef struct {
+    audio_ctl_config_t cfg;
+    pthread_t thread;
+    atomic_bool running;
+    int listen_fd;
+    int wake_fd;                    // 用于停止时唤醒 poll
+    audio_ctl_client_t clients[AUDIO_CTL_MAX_CLIENTS];
+    char reply[AUDIO_CTL_REPLY_SIZE];
+    atomic_ullong commands;
+    atomic_ullong errors;
+} audio_ctl_t;
+
+int audio_ctl_start(audio_ctl_t *ctl, const audio_ctl_config_t *cfg);
+void audio_ctl_stop(audio_ctl_t *ctl);
+
+#endif
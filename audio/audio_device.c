@@ -0,0 +1,600 @@
+/*************************************************************
+ * File  :  audio_device.c
+ * Module:  ALSA capture/playback device negotiation and the
+ *          on-disk cache of negotiated device configurations.
+ *
+ * Capture and playback are negotiated independently, so a USB
+ * microphone and an on-board codec with different capabilities
+ * each get their own best configuration. The period size is
+ * chosen as the smallest the device accepts, with the buffer
+ * kept above a minimum duration so the configuration stays
+ * stable under normal scheduling. Both directions are opened in
+ * parallel.
+ *
+ * Probing costs a round of hw_params refinement per format, rate
+ * and channel test and a full snd_pcm_hw_params() per rejected
+ * period size, which is slow on USB and Bluetooth devices. The
+ * result is therefore cached in a small text file keyed by the
+ * stream, the device name and the requested parameters; the next
+ * open applies the cached configuration with a single
+ * snd_pcm_hw_params() and only probes again if the device no
+ * longer accepts it.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "audio_device.h"
+#include "audio_time.h"
+#include "log.h"
+
+#define DEVICE_MIN_PERIOD_FRAMES (64)
+#define DEVICE_MAX_PERIOD_FRAMES (8192)
+#define DEVICE_MIN_BUFFER_US (8000)
+#define DEVICE_CACHE_MAX_ENTRIES (32)
+#define DEVICE_CACHE_NAME_LEN (128)
+#define DEVICE_CACHE_PATH_LEN (256)
+#define DEVICE_CACHE_HEADER "# audio device cache v2"
+
+// 缓存的一条协商结果，前半部分为查找用的键
+typedef struct {
+    snd_pcm_stream_t stream;
+    char name[DEVICE_CACHE_NAME_LEN];
+    audio_device_params_t params;
+    bool mmap;
+    snd_pcm_format_t format;
+    unsigned int sample_rate;
+    unsigned int channels;
+    snd_pcm_uframes_t period_size;
+    snd_pcm_uframes_t buffer_size;
+} device_cache_entry_t;
+
+// 两个方向并行打开时同时查找和更新缓存
+static struct {
+    pthread_mutex_t lock;
+    bool enabled;
+    char path[DEVICE_CACHE_PATH_LEN];
+    device_cache_entry_t entries[DEVICE_CACHE_MAX_ENTRIES];
+    int count;
+} g_device_cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// 按优先级尝试的采样格式，S16 不需要任何转换
+static const struct {
+    snd_pcm_format_t format;
+    audio_sample_fmt_e sample_fmt;
+} g_formats[] = {
+    { SND_PCM_FORMAT_S16_LE, AUDIO_FMT_S16 },
+    { SND_PCM_FORMAT_S32_LE, AUDIO_FMT_S32 },
+    { SND_PCM_FORMAT_S24_LE, AUDIO_FMT_S24 },
+    { SND_PCM_FORMAT_S24_3LE, AUDIO_FMT_S24_3 },
+    { SND_PCM_FORMAT_FLOAT_LE, AUDIO_FMT_FLOAT },
+};
+
+static const char *stream_name(const audio_pcm_t *pcm)
+{
+    return pcm->stream == SND_PCM_STREAM_CAPTURE ? "录音" : "播放";
+}
+
+static snd_pcm_uframes_t div_round_up(snd_pcm_uframes_t a, snd_pcm_uframes_t b)
+{
+    return (a + b - 1) / b;
+}
+
+static bool device_params_equal(const audio_device_params_t *a, const audio_device_params_t *b)
+{
+    return a->sample_rate == b->sample_rate && a->channels == b->channels && a->frame_ms == b->frame_ms &&
+           a->period_frames == b->period_frames && a->capture_batch == b->capture_batch && a->mmap == b->mmap;
+}
+
+static device_cache_entry_t *device_cache_find(snd_pcm_stream_t stream, const char *name,
+                                               const audio_device_params_t *params)
+{
+    for (int i = 0; i < g_device_cache.count; i++) {
+        device_cache_entry_t *e = &g_device_cache.entries[i];
+        if (e->stream == stream && strcmp(e->name, name) == 0 && device_params_equal(&e->params, params)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+// 每行一条: 方向 期望参数 -> 协商结果 设备名，设备名放在最后，可以包含空格
+static int device_cache_write(void)
+{
+    char tmp[DEVICE_CACHE_PATH_LEN + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", g_device_cache.path);
+
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) {
+        return -1;
+    }
+    fprintf(fp, "%s\n", DEVICE_CACHE_HEADER);
+    for (int i = 0; i < g_device_cache.count; i++) {
+        const device_cache_entry_t *e = &g_device_cache.entries[i];
+        const audio_device_params_t *p = &e->params;
+        fprintf(fp, "%c %u %u %u %u %u %d -> %d %d %u %u %lu %lu %s\n",
+                e->stream == SND_PCM_STREAM_CAPTURE ? 'c' : 'p', p->sample_rate, p->channels, p->frame_ms,
+                p->period_frames, p->capture_batch, p->mmap, e->mmap, (int)e->format, e->sample_rate,
+                e->channels, (unsigned long)e->period_size, (unsigned long)e->buffer_size, e->name);
+    }
+    // 先写临时文件再改名，进程中途退出不会留下半个文件
+    if (fclose(fp) != 0 || rename(tmp, g_device_cache.path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int audio_device_cache_open(const char *path)
+{
+    char line[DEVICE_CACHE_NAME_LEN + 128];
+
+    pthread_mutex_lock(&g_device_cache.lock);
+    snprintf(g_device_cache.path, sizeof(g_device_cache.path), "%s", path);
+    g_device_cache.count = 0;
+    g_device_cache.enabled = true;
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        // 第一次运行，打开设备后写入
+        pthread_mutex_unlock(&g_device_cache.lock);
+        return 0;
+    }
+    if (!fgets(line, sizeof(line), fp) || strncmp(line, DEVICE_CACHE_HEADER, strlen(DEVICE_CACHE_HEADER)) != 0) {
+        LOGW("设备能力缓存 %s 格式不符，忽略", path);
+        fclose(fp);
+        pthread_mutex_unlock(&g_device_cache.lock);
+        return 0;
+    }
+    while (g_device_cache.count < DEVICE_CACHE_MAX_ENTRIES && fgets(line, sizeof(line), fp)) {
+        device_cache_entry_t *e = &g_device_cache.entries[g_device_cache.count];
+        audio_device_params_t *p = &e->params;
+        char stream;
+        int req_mmap, mmap, format, name_pos = 0;
+        unsigned long period, buffer;
+
+        memset(e, 0, sizeof(*e));
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "%c %u %u %u %u %u %d -> %d %d %u %u %lu %lu %n", &stream, &p->sample_rate,
+                   &p->channels, &p->frame_ms, &p->period_frames, &p->capture_batch, &req_mmap, &mmap, &format,
+                   &e->sample_rate, &e->channels, &period, &buffer, &name_pos) != 13 ||
+            name_pos == 0 || line[name_pos] == '\0' || (stream != 'c' && stream != 'p')) {
+            continue;
+        }
+        e->stream = stream == 'c' ? SND_PCM_STREAM_CAPTURE : SND_PCM_STREAM_PLAYBACK;
+        p->mmap = req_mmap != 0;
+        e->mmap = mmap != 0;
+        e->format = (snd_pcm_format_t)format;
+        e->period_size = period;
+        e->buffer_size = buffer;
+        snprintf(e->name, sizeof(e->name), "%s", line + name_pos);
+        g_device_cache.count++;
+    }
+    fclose(fp);
+    LOGI("设备能力缓存 %s: %d 条", path, g_device_cache.count);
+    pthread_mutex_unlock(&g_device_cache.lock);
+    return 0;
+}
+
+void audio_device_cache_close(void)
+{
+    pthread_mutex_lock(&g_device_cache.lock);
+    g_device_cache.enabled = false;
+    g_device_cache.count = 0;
+    pthread_mutex_unlock(&g_device_cache.lock);
+}
+
+static bool device_cache_lookup(const audio_pcm_t *pcm, const audio_device_params_t *params,
+                                device_cache_entry_t *out)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&g_device_cache.lock);
+    if (g_device_cache.enabled) {
+        device_cache_entry_t *e = device_cache_find(pcm->stream, pcm->name, params);
+        if (e) {
+            *out = *e;
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&g_device_cache.lock);
+    return found;
+}
+
+// 记录探测结果并立即写回文件；缓存已满时替换最早的一条
+static void device_cache_store(const audio_pcm_t *pcm, const audio_device_params_t *params)
+{
+    if (strlen(pcm->name) >= DEVICE_CACHE_NAME_LEN) {
+        return;
+    }
+    pthread_mutex_lock(&g_device_cache.lock);
+    if (!g_device_cache.enabled) {
+        pthread_mutex_unlock(&g_device_cache.lock);
+        return;
+    }
+    device_cache_entry_t *e = device_cache_find(pcm->stream, pcm->name, params);
+    if (!e) {
+        if (g_device_cache.count == DEVICE_CACHE_MAX_ENTRIES) {
+            memmove(&g_device_cache.entries[0], &g_device_cache.entries[1],
+                    (DEVICE_CACHE_MAX_ENTRIES - 1) * sizeof(device_cache_entry_t));
+            g_device_cache.count--;
+        }
+        e = &g_device_cache.entries[g_device_cache.count++];
+    }
+    memset(e, 0, sizeof(*e));
+    e->stream = pcm->stream;
+    snprintf(e->name, sizeof(e->name), "%s", pcm->name);
+    e->params = *params;
+    e->mmap = pcm->mmap;
+    e->format = pcm->format;
+    e->sample_rate = pcm->sample_rate;
+    e->channels = pcm->channels;
+    e->period_size = pcm->period_size;
+    e->buffer_size = pcm->buffer_size;
+    if (device_cache_write() < 0) {
+        LOGW("无法写入设备能力缓存 %s", g_device_cache.path);
+    }
+    pthread_mutex_unlock(&g_device_cache.lock);
+}
+
+// 从小到大尝试周期大小，取第一个设备接受的配置
+static int pcm_set_period_buffer(audio_pcm_t *pcm, snd_pcm_hw_params_t *hw_params,
+                                 const audio_device_params_t *params)
+{
+    snd_pcm_hw_params_t *trial;
+    snd_pcm_uframes_t frame_samples = pcm->sample_rate * params->frame_ms / 1000;
+    snd_pcm_uframes_t min_buffer = (snd_pcm_uframes_t)pcm->sample_rate * DEVICE_MIN_BUFFER_US / 1000000;
+    snd_pcm_uframes_t period = params->period_frames ? params->period_frames : DEVICE_MIN_PERIOD_FRAMES;
+    int err = -EINVAL;
+
+    // 录音按整批读取，缓冲区除了一批之外至少还要再容纳一帧；
+    // 播放每次阻塞写入一整帧，缓冲区至少容纳两帧，写入时设备还有一帧可播
+    snd_pcm_uframes_t batch = params->capture_batch ? params->capture_batch : 1;
+    snd_pcm_uframes_t min_frames = pcm->stream == SND_PCM_STREAM_CAPTURE ? batch + 1 : 2;
+    if (min_buffer < min_frames * frame_samples) {
+        min_buffer = min_frames * frame_samples;
+    }
+
+    snd_pcm_hw_params_alloca(&trial);
+    for (; period <= DEVICE_MAX_PERIOD_FRAMES; period *= 2) {
+        unsigned int periods = div_round_up(min_buffer, period);
+        if (periods < 2) {
+            periods = 2;
+        }
+
+        snd_pcm_hw_params_copy(trial, hw_params);
+        err = snd_pcm_hw_params_set_period_size(pcm->handle, trial, period, 0);
+        if (err == 0) {
+            err = snd_pcm_hw_params_set_periods(pcm->handle, trial, periods, 0);
+        }
+        if (err == 0) {
+            err = snd_pcm_hw_params(pcm->handle, trial);
+        }
+        if (err == 0 || params->period_frames) {
+            break;
+        }
+    }
+    if (err == 0) {
+        return 0;
+    }
+
+    // 设备不接受精确值时退回到就近设置
+    LOGW("%s设备不支持精确的周期配置，使用就近值", stream_name(pcm));
+    snd_pcm_uframes_t buffer_size = min_buffer > 4 * frame_samples ? min_buffer : 4 * frame_samples;
+    period = frame_samples / 4 ? frame_samples / 4 : DEVICE_MIN_PERIOD_FRAMES;
+
+    err = snd_pcm_hw_params_set_buffer_size_near(pcm->handle, hw_params, &buffer_size);
+    if (err < 0) {
+        LOGE("无法设置缓冲区大小: %s", snd_strerror(err));
+        return err;
+    }
+    err = snd_pcm_hw_params_set_period_size_near(pcm->handle, hw_params, &period, 0);
+    if (err < 0) {
+        LOGE("无法设置周期大小: %s", snd_strerror(err));
+        return err;
+    }
+    err = snd_pcm_hw_params(pcm->handle, hw_params);
+    if (err < 0) {
+        LOGE("无法应用%s设备硬件参数: %s", stream_name(pcm), snd_strerror(err));
+    }
+    return err;
+}
+
+static int pcm_set_hw_params(audio_pcm_t *pcm, const audio_device_params_t *params)
+{
+    snd_pcm_hw_params_t *hw_params;
+    snd_pcm_hw_params_t *current;
+    int err;
+
+    snd_pcm_hw_params_alloca(&hw_params);
+    err = snd_pcm_hw_params_any(pcm->handle, hw_params);
+    if (err < 0) {
+        LOGE("无法初始化硬件参数: %s", snd_strerror(err));
+        return err;
+    }
+
+    // 设置访问模式，mmap 不可用时退回读写方式
+    pcm->mmap = false;
+    if (params->mmap) {
+        if (snd_pcm_hw_params_set_access(pcm->handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0) {
+            pcm->mmap = true;
+        } else {
+            LOGW("%s设备不支持 mmap 访问，使用读写方式", stream_name(pcm));
+        }
+    }
+    err = pcm->mmap ? 0 : snd_pcm_hw_params_set_access(pcm->handle, hw_params,
+                                                       SND_PCM_ACCESS_RW_INTERLEAVED);
+    if (err < 0) {
+        LOGE("无法设置访问模式: %s", snd_strerror(err));
+        return err;
+    }
+
+    // 设置采样格式，优先 16 位有符号整数小端，其余格式由转换阶段处理
+    err = -EINVAL;
+    for (size_t i = 0; i < sizeof(g_formats) / sizeof(g_formats[0]); i++) {
+        if (snd_pcm_hw_params_test_format(pcm->handle, hw_params, g_formats[i].format) == 0) {
+            pcm->format = g_formats[i].format;
+            pcm->sample_fmt = g_formats[i].sample_fmt;
+            err = snd_pcm_hw_params_set_format(pcm->handle, hw_params, pcm->format);
+            break;
+        }
+    }
+    if (err < 0) {
+        LOGE("无法设置采样格式: %s", snd_strerror(err));
+        return err;
+    }
+
+    // 设置采样率，不支持目标值时取最接近的
+    pcm->sample_rate = params->sample_rate;
+    if (snd_pcm_hw_params_test_rate(pcm->handle, hw_params, pcm->sample_rate, 0) < 0) {
+        err = snd_pcm_hw_params_set_rate_near(pcm->handle, hw_params, &pcm->sample_rate, 0);
+        LOGW("%s设备不支持目标采样率 %uHz，将使用 %uHz", stream_name(pcm), params->sample_rate,
+             pcm->sample_rate);
+    } else {
+        err = snd_pcm_hw_params_set_rate(pcm->handle, hw_params, pcm->sample_rate, 0);
+    }
+    if (err < 0) {
+        LOGE("无法设置采样率: %s", snd_strerror(err));
+        return err;
+    }
+
+    // 设置通道数，不支持目标值时取最接近的
+    pcm->channels = params->channels;
+    if (snd_pcm_hw_params_test_channels(pcm->handle, hw_params, pcm->channels) < 0) {
+        err = snd_pcm_hw_params_set_channels_near(pcm->handle, hw_params, &pcm->channels);
+        LOGW("%s设备不支持 %u 通道，将使用 %u 通道", stream_name(pcm), params->channels,
+             pcm->channels);
+    } else {
+        err = snd_pcm_hw_params_set_channels(pcm->handle, hw_params, pcm->channels);
+    }
+    if (err < 0) {
+        LOGE("无法设置通道数: %s", snd_strerror(err));
+        return err;
+    }
+
+    err = pcm_set_period_buffer(pcm, hw_params, params);
+    if (err < 0) {
+        return err;
+    }
+
+    snd_pcm_hw_params_alloca(&current);
+    snd_pcm_hw_params_current(pcm->handle, current);
+    snd_pcm_hw_params_get_period_size(current, &pcm->period_size, NULL);
+    snd_pcm_hw_params_get_buffer_size(current, &pcm->buffer_size);
+    return 0;
+}
+
+// 一次性应用缓存的协商结果，设备不再接受时返回错误，由调用者重新探测
+static int pcm_apply_cached(audio_pcm_t *pcm, const device_cache_entry_t *e)
+{
+    snd_pcm_hw_params_t *hw_params;
+    snd_pcm_hw_params_t *current;
+    int err = -EINVAL;
+
+    pcm->sample_fmt = AUDIO_FMT_S16;
+    for (size_t i = 0; i < sizeof(g_formats) / sizeof(g_formats[0]); i++) {
+        if (g_formats[i].format == e->format) {
+            pcm->sample_fmt = g_formats[i].sample_fmt;
+            err = 0;
+            break;
+        }
+    }
+    if (err < 0) {
+        return err;
+    }
+
+    snd_pcm_hw_params_alloca(&hw_params);
+    err = snd_pcm_hw_params_any(pcm->handle, hw_params);
+    if (err == 0) {
+        err = snd_pcm_hw_params_set_access(pcm->handle, hw_params, e->mmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED :
+                                                                             SND_PCM_ACCESS_RW_INTERLEAVED);
+    }
+    if (err == 0) {
+        err = snd_pcm_hw_params_set_format(pcm->handle, hw_params, e->format);
+    }
+    if (err == 0) {
+        err = snd_pcm_hw_params_set_rate(pcm->handle, hw_params, e->sample_rate, 0);
+    }
+    if (err == 0) {
+        err = snd_pcm_hw_params_set_channels(pcm->handle, hw_params, e->channels);
+    }
+    if (err == 0) {
+        err = snd_pcm_hw_params_set_period_size(pcm->handle, hw_params, e->period_size, 0);
+    }
+    if (err == 0) {
+        err = snd_pcm_hw_params_set_buffer_size(pcm->handle, hw_params, e->buffer_size);
+    }
+    if (err == 0) {
+        err = snd_pcm_hw_params(pcm->handle, hw_params);
+    }
+    if (err < 0) {
+        return err;
+    }
+
+    pcm->mmap = e->mmap;
+    pcm->format = e->format;
+    pcm->sample_rate = e->sample_rate;
+    pcm->channels = e->channels;
+    snd_pcm_hw_params_alloca(&current);
+    snd_pcm_hw_params_current(pcm->handle, current);
+    snd_pcm_hw_params_get_period_size(current, &pcm->period_size, NULL);
+    snd_pcm_hw_params_get_buffer_size(current, &pcm->buffer_size);
+    return 0;
+}
+
+static int pcm_set_sw_params(audio_pcm_t *pcm, const audio_device_params_t *params)
+{
+    snd_pcm_sw_params_t *sw_params;
+    snd_pcm_uframes_t frame_samples = pcm->sample_rate * params->frame_ms / 1000;
+    snd_pcm_uframes_t batch_samples = frame_samples * (params->capture_batch ? params->capture_batch : 1);
+    snd_pcm_uframes_t avail_min, start_threshold;
+    int err;
+
+    if (pcm->stream == SND_PCM_STREAM_CAPTURE) {
+        // 数据满一批才唤醒，采集线程每次唤醒处理一批
+        avail_min = batch_samples < pcm->buffer_size ? batch_samples : pcm->period_size;
+        start_threshold = 1;
+    } else {
+        // 缓冲区填满后再启动，之后每空出一个周期唤醒一次写线程
+        avail_min = pcm->period_size;
+        start_threshold = pcm->buffer_size;
+    }
+
+    snd_pcm_sw_params_alloca(&sw_params);
+    err = snd_pcm_sw_params_current(pcm->handle, sw_params);
+    if (err == 0) {
+        err = snd_pcm_sw_params_set_avail_min(pcm->handle, sw_params, avail_min);
+    }
+    if (err == 0) {
+        err = snd_pcm_sw_params_set_start_threshold(pcm->handle, sw_params, start_threshold);
+    }
+    if (err == 0) {
+        // 硬件指针时间戳用于估计时钟偏差；旧版本 alsa-lib 不支持时只影响估计精度
+        if (snd_pcm_sw_params_set_tstamp_mode(pcm->handle, sw_params, SND_PCM_TSTAMP_ENABLE) < 0 ||
+            snd_pcm_sw_params_set_tstamp_type(pcm->handle, sw_params, SND_PCM_TSTAMP_TYPE_MONOTONIC) < 0) {
+            LOGW("%s设备不支持单调时钟时间戳", stream_name(pcm));
+        }
+        err = snd_pcm_sw_params(pcm->handle, sw_params);
+    }
+    if (err < 0) {
+        LOGE("无法设置%s设备软件参数: %s", stream_name(pcm), snd_strerror(err));
+    }
+    return err;
+}
+
+static int pcm_open(audio_pcm_t *pcm, const char *name, snd_pcm_stream_t stream,
+                    const audio_device_params_t *params)
+{
+    device_cache_entry_t cached;
+    int64_t t0 = audio_now_us();
+    int err;
+
+    memset(pcm, 0, sizeof(*pcm));
+    pcm->name = name;
+    pcm->stream = stream;
+
+    err = snd_pcm_open(&pcm->handle, name, stream, 0);
+    if (err < 0) {
+        LOGE("无法打开%s设备 %s: %s", stream_name(pcm), name, snd_strerror(err));
+        pcm->handle = NULL;
+        return -1;
+    }
+
+    if (device_cache_lookup(pcm, params, &cached)) {
+        if (pcm_apply_cached(pcm, &cached) == 0) {
+            pcm->cached = true;
+        } else {
+            LOGW("%s设备 %s 不再接受缓存的配置，重新探测", stream_name(pcm), name);
+        }
+    }
+    if ((!pcm->cached && pcm_set_hw_params(pcm, params) < 0) || pcm_set_sw_params(pcm, params) < 0) {
+        snd_pcm_close(pcm->handle);
+        pcm->handle = NULL;
+        return -1;
+    }
+    if (!pcm->cached) {
+        device_cache_store(pcm, params);
+    }
+    pcm->open_us = (uint32_t)(audio_now_us() - t0);
+
+    LOGI("%s设备 %s: 访问=%s, 格式=%s, 采样率=%uHz, 通道数=%u, 周期=%lu, 缓冲区=%lu, 延迟=%.1fms, "
+         "打开耗时=%.1fms(%s)", stream_name(pcm), name, pcm->mmap ? "mmap" : "rw",
+         audio_sample_fmt_name(pcm->sample_fmt), pcm->sample_rate, pcm->channels,
+         (unsigned long)pcm->period_size, (unsigned long)pcm->buffer_size,
+         pcm->buffer_size * 1000.0 / pcm->sample_rate, pcm->open_us / 1000.0, pcm->cached ? "缓存" : "探测");
+    return 0;
+}
+
+typedef struct {
+    audio_pcm_t *pcm;
+    const char *name;
+    snd_pcm_stream_t stream;
+    const audio_device_params_t *params;
+    int result;
+} device_open_job_t;
+
+static void *device_open_thread(void *arg)
+{
+    device_open_job_t *job = arg;
+    job->result = pcm_open(job->pcm, job->name, job->stream, job->params);
+    return NULL;
+}
+
+int audio_device_open(audio_device_t *dev, const char *capture_device,
+                      const char *playback_device, const audio_device_params_t *params)
+{
+    device_open_job_t capture = { &dev->capture, capture_device, SND_PCM_STREAM_CAPTURE, params, 0 };
+    pthread_t thread;
+    bool threaded = false;
+
+    memset(dev, 0, sizeof(*dev));
+    // 两个方向互不依赖，录音设备在辅助线程中探测，同时在当前线程中探测播放设备
+    if (capture_device && playback_device) {
+        threaded = pthread_create(&thread, NULL, device_open_thread, &capture) == 0;
+    }
+    if (capture_device && !threaded) {
+        device_open_thread(&capture);
+    }
+    int rval = playback_device ? pcm_open(&dev->playback, playback_device, SND_PCM_STREAM_PLAYBACK, params) : 0;
+    if (threaded) {
+        pthread_join(thread, NULL);
+    }
+    if (capture.result < 0 || rval < 0) {
+        audio_device_close(dev);
+        return -1;
+    }
+    return 0;
+}
+
+int audio_device_reopen(audio_device_t *dev, snd_pcm_stream_t stream, const char *name,
+                        const audio_device_params_t *params)
+{
+    audio_pcm_t *pcm = stream == SND_PCM_STREAM_CAPTURE ? &dev->capture : &dev->playback;
+
+    if (pcm->handle) {
+        snd_pcm_close(pcm->handle);
+    }
+    memset(pcm, 0, sizeof(*pcm));
+    if (!name) {
+        return 0;
+    }
+    return pcm_open(pcm, name, stream, params);
+}
+
+void audio_device_close(audio_device_t *dev)
+{
+    if (dev->capture.handle) {
+        snd_pcm_close(dev->capture.handle);
+        dev->capture.handle = NULL;
+    }
+    if (dev->playback.handle) {
+        snd_pcm_close(dev->playback.handle);
+        dev->playback.handle = NULL;
+    }
+}
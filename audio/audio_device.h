@@ -0,0 +1,82 @@
+/*************************************************************
+ * File  :  audio_device.h
+ * Module:  ALSA capture/playback device negotiation and the
+ *          on-disk cache of negotiated device configurations.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_DEVICE_H_
+#define _AUDIO_DEVICE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <alsa/asoundlib.h>
+
+#include "audio_format.h"
+
+// 单个方向的设备及协商结果
+typedef struct {
+    snd_pcm_t *handle;              // 设备句柄
+    const char *name;               // 设备名称
+    snd_pcm_stream_t stream;        // 方向
+    unsigned int sample_rate;       // 采样率
+    unsigned int channels;          // 通道数
+    snd_pcm_format_t format;        // 音频格式
+    audio_sample_fmt_e sample_fmt;  // 对应的内部采样格式
+    snd_pcm_uframes_t period_size;  // 周期大小
+    snd_pcm_uframes_t buffer_size;  // 缓冲区大小
+    bool mmap;                      // 以 mmap 方式访问
+    bool cached;                    // 直接应用了能力缓存中的配置，没有逐项探测
+    uint32_t open_us;               // 打开并配置设备所用的时间
+} audio_pcm_t;
+
+// 音频设备结构体
+typedef struct {
+    audio_pcm_t capture;            // 录音设备
+    audio_pcm_t playback;           // 播放设备
+} audio_device_t;
+
+// 期望的参数，两个方向各自向设备协商
+typedef struct {
+    unsigned int sample_rate;       // 期望采样率
+    unsigned int channels;          // 期望通道数
+    uint32_t frame_ms;              // 应用每帧时长
+    uint32_t period_frames;         // 指定周期大小，0 表示自动选择
+    uint32_t capture_batch;         // 录音设备每次唤醒采集线程时积累的帧数，0 与 1 相同
+    bool mmap;                      // 优先使用 mmap 访问
+} audio_device_params_t;
+
+// 设备能力缓存: 按设备名称和期望参数保存协商结果，之后打开同一设备时直接应用，
+// 跳过格式、采样率和周期大小的逐项探测；应用失败时重新探测并更新缓存。
+// path 文件不存在时新建，不调用则不使用缓存
+int audio_device_cache_open(const char *path);
+void audio_device_cache_close(void);
+
+// 设备名为 NULL 的方向不打开；两个方向都打开时并行探测
+int audio_device_open(audio_device_t *dev, const char *capture_device,
+                      const char *playback_device, const audio_device_params_t *params);
+void audio_device_close(audio_device_t *dev);
+
+// 关闭一个方向的设备后按新名称重新打开，name 为 NULL 时只关闭；失败时该方向保持关闭。
+// 名称字符串需要在设备打开期间保持有效
+int audio_device_reopen(audio_device_t *dev, snd_pcm_stream_t stream, const char *name,
+                        const audio_device_params_t *params);
+
+// 交错访问时 mmap 区域中第 offset 帧的地址
+static inline uint8_t *audio_mmap_ptr(const snd_pcm_channel_area_t *areas, snd_pcm_uframes_t offset)
+{
+    return (uint8_t *)areas[0].addr + areas[0].first / 8 + offset * (areas[0].step / 8);
+}
+
+// 协商结果对应的内部格式描述
+static inline audio_format_t audio_pcm_format(const audio_pcm_t *pcm)
+{
+    audio_format_t fmt = { pcm->sample_rate, pcm->channels, pcm->sample_fmt };
+    return fmt;
+}
+
+#endif
@@ -0,0 +1,192 @@
+/*************************************************************
+ * File  :  audio_drift.c
+ * Module:  Sound card clock drift estimation against the
+ *          monotonic system clock.
+ *
+ * Once a second the owning thread records how many frames the
+ * device has moved through together with the time the hardware
+ * pointer was last updated (snd_pcm_htimestamp, so scheduling
+ * jitter of the thread does not enter the measurement). The
+ * drift is the least-squares slope of the position residual
+ * against time over the last AUDIO_DRIFT_HISTORY snapshots,
+ * expressed in ppm of the nominal rate. A position that misses
+ * the prediction by more than DRIFT_JUMP_MS, or a fit outside
+ * DRIFT_MAX_PPM, means the stream was restarted or an xrun
+ * dropped data, and the history starts over.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <string.h>
+#include <math.h>
+
+#include "audio_drift.h"
+#include "audio_time.h"
+#include "log.h"
+
+#define DRIFT_INTERVAL_US (1000000)
+// 拟合跨度达到该值后估计才可用，没有硬件时间戳时需要更长的跨度平均掉周期粒度的误差
+#define DRIFT_MIN_SPAN_US (10 * 1000000)
+#define DRIFT_COARSE_SPAN_US (60 * 1000000)
+#define DRIFT_JUMP_MS (20)
+#define DRIFT_MAX_PPM (1000.0)
+
+void audio_drift_init(audio_drift_t *d, const char *name, uint32_t rate)
+{
+    memset(d, 0, sizeof(*d));
+    d->name = name;
+    d->rate = rate;
+}
+
+void audio_drift_reset(audio_drift_t *d)
+{
+    if (d->count > 0) {
+        atomic_fetch_add_explicit(&d->stats.resets, 1, memory_order_relaxed);
+    }
+    d->head = 0;
+    d->count = 0;
+    d->next_us = 0;
+    // 上一次的估计仍然代表这块声卡，保留给调用方继续使用
+}
+
+static uint32_t drift_index(const audio_drift_t *d, uint32_t i)
+{
+    return (d->head + AUDIO_DRIFT_HISTORY - d->count + i) % AUDIO_DRIFT_HISTORY;
+}
+
+// 以最早的快照为原点，拟合 (实际位置 - 名义位置) 对时间的斜率
+static bool drift_fit(const audio_drift_t *d, double *ppm)
+{
+    uint32_t first = drift_index(d, 0);
+    int64_t t0 = d->t_us[first];
+    int64_t p0 = d->pos[first];
+    double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+
+    for (uint32_t i = 0; i < d->count; i++) {
+        uint32_t k = drift_index(d, i);
+        double x = (d->t_us[k] - t0) / 1e6;
+        double y = (double)(d->pos[k] - p0) - x * d->rate;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+
+    double den = d->count * sxx - sx * sx;
+    if (den <= 0.0) {
+        return false;
+    }
+    *ppm = (d->count * sxy - sx * sy) / den / d->rate * 1e6;
+    return true;
+}
+
+static void drift_publish(audio_drift_t *d)
+{
+    int x100 = (int)lrint(d->ppm * 100.0);
+    bool was_valid = atomic_load_explicit(&d->stats.valid, memory_order_relaxed);
+
+    atomic_store_explicit(&d->stats.ppm_x100, x100, memory_order_relaxed);
+    if (!was_valid || x100 < atomic_load_explicit(&d->stats.ppm_min_x100, memory_order_relaxed)) {
+        atomic_store_explicit(&d->stats.ppm_min_x100, x100, memory_order_relaxed);
+    }
+    if (!was_valid || x100 > atomic_load_explicit(&d->stats.ppm_max_x100, memory_order_relaxed)) {
+        atomic_store_explicit(&d->stats.ppm_max_x100, x100, memory_order_relaxed);
+    }
+    if (!was_valid) {
+        LOGI("%s时钟偏差估计可用: %.1fppm", d->name, d->ppm);
+    }
+    atomic_store_explicit(&d->stats.valid, true, memory_order_release);
+}
+
+void audio_drift_observe(audio_drift_t *d, int64_t t_us, int64_t pos)
+{
+    d->next_us = audio_now_us() + DRIFT_INTERVAL_US;
+
+    if (d->count > 0) {
+        uint32_t last = drift_index(d, d->count - 1);
+        int64_t dt = t_us - d->t_us[last];
+        if (dt <= 0) {
+            // 硬件指针从上次之后没有更新
+            return;
+        }
+        double expect = d->pos[last] + dt / 1e6 * d->rate * (1.0 + d->ppm * 1e-6);
+        if (fabs(pos - expect) > (double)d->rate * DRIFT_JUMP_MS / 1000) {
+            LOGW("%s设备位置跳变 %.1fms，重新估计时钟偏差", d->name,
+                 (pos - expect) * 1000.0 / d->rate);
+            audio_drift_reset(d);
+            d->next_us = audio_now_us() + DRIFT_INTERVAL_US;
+        }
+    }
+
+    d->t_us[d->head] = t_us;
+    d->pos[d->head] = pos;
+    d->head = (d->head + 1) % AUDIO_DRIFT_HISTORY;
+    if (d->count < AUDIO_DRIFT_HISTORY) {
+        d->count++;
+    }
+
+    double ppm;
+    int64_t span = d->t_us[drift_index(d, d->count - 1)] - d->t_us[drift_index(d, 0)];
+    if (d->count < 3 || span < (d->coarse ? DRIFT_COARSE_SPAN_US : DRIFT_MIN_SPAN_US) ||
+        !drift_fit(d, &ppm)) {
+        return;
+    }
+    if (fabs(ppm) > DRIFT_MAX_PPM) {
+        LOGW("%s时钟偏差估计 %.0fppm 超出合理范围，重新估计", d->name, ppm);
+        audio_drift_reset(d);
+        return;
+    }
+    d->ppm = ppm;
+    drift_publish(d);
+}
+
+int audio_drift_sample(audio_drift_t *d, snd_pcm_t *handle, int64_t base)
+{
+    snd_pcm_uframes_t avail;
+    snd_htimestamp_t ts;
+    int64_t t_us;
+    int err = snd_pcm_htimestamp(handle, &avail, &ts);
+
+    if (err < 0) {
+        return err;
+    }
+    if (ts.tv_sec == 0 && ts.tv_nsec == 0) {
+        snd_pcm_sframes_t frames = snd_pcm_avail_update(handle);
+        if (frames < 0) {
+            return (int)frames;
+        }
+        if (!d->coarse) {
+            LOGW("%s设备没有硬件指针时间戳，时钟偏差估计需要更长时间", d->name);
+            d->coarse = true;
+        }
+        avail = frames;
+        t_us = audio_now_us();
+    } else {
+        t_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+    audio_drift_observe(d, t_us, base + (int64_t)avail);
+    return 0;
+}
+
+double audio_drift_ppm(const audio_drift_t *d)
+{
+    if (!atomic_load_explicit(&d->stats.valid, memory_order_acquire)) {
+        return 0.0;
+    }
+    return atomic_load_explicit(&d->stats.ppm_x100, memory_order_relaxed) / 100.0;
+}
+
+void audio_drift_report(const audio_drift_t *d)
+{
+    if (!atomic_load(&d->stats.valid)) {
+        LOGI("时钟偏差统计(%s): 运行时间不足，尚无估计, 重新估计=%llu", d->name,
+             atomic_load(&d->stats.resets));
+        return;
+    }
+    LOGI("时钟偏差统计(%s): 当前=%.2fppm, 最小=%.2fppm, 最大=%.2fppm, 重新估计=%llu", d->name,
+         atomic_load(&d->stats.ppm_x100) / 100.0, atomic_load(&d->stats.ppm_min_x100) / 100.0,
+         atomic_load(&d->stats.ppm_max_x100) / 100.0, atomic_load(&d->stats.resets));
+}
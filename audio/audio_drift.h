@@ -0,0 +1,68 @@
+/*************************************************************
+ * File  :  audio_drift.h
+ * Module:  Sound card clock drift estimation against the
+ *          monotonic system clock.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_DRIFT_H_
+#define _AUDIO_DRIFT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <alsa/asoundlib.h>
+
+// 每秒记录一个快照，按最近这么多个快照拟合
+#define AUDIO_DRIFT_HISTORY (64)
+
+typedef struct {
+    atomic_int ppm_x100;            // 当前估计，正值表示设备时钟比系统时钟快
+    atomic_int ppm_min_x100;
+    atomic_int ppm_max_x100;
+    atomic_bool valid;              // 拟合跨度足够长，估计可用
+    atomic_ullong resets;           // 设备位置跳变(xrun、重启)导致的重新估计
+} audio_drift_stats_t;
+
+// 由采集或播放线程独占更新，其它线程只读 stats
+typedef struct {
+    const char *name;
+    uint32_t rate;                  // 名义采样率
+    int64_t t_us[AUDIO_DRIFT_HISTORY];
+    int64_t pos[AUDIO_DRIFT_HISTORY];
+    uint32_t head;
+    uint32_t count;
+    int64_t next_us;                // 下一次记录快照的时刻
+    double ppm;
+    bool coarse;                    // 设备不提供硬件指针时间戳，快照误差可达一个周期
+    audio_drift_stats_t stats;
+} audio_drift_t;
+
+void audio_drift_init(audio_drift_t *d, const char *name, uint32_t rate);
+
+// 丢弃已有快照，例如设备 xrun 恢复之后
+void audio_drift_reset(audio_drift_t *d);
+
+// 是否到了记录下一个快照的时间，避免每个周期都查询设备
+static inline bool audio_drift_due(const audio_drift_t *d, int64_t now_us)
+{
+    return now_us >= d->next_us;
+}
+
+// 设备在 t_us 时刻已经走过 pos 帧，录音为已采集的帧数，播放为已播出的帧数
+void audio_drift_observe(audio_drift_t *d, int64_t t_us, int64_t pos);
+
+// 查询硬件指针最近一次更新时的可用帧数和时刻，以 base 加可用帧数作为位置记录快照；
+// 设备不提供时间戳时退回到当前时刻
+int audio_drift_sample(audio_drift_t *d, snd_pcm_t *handle, int64_t base);
+
+// 估计值(ppm)，估计尚不可用时为 0，可在任意线程调用
+double audio_drift_ppm(const audio_drift_t *d);
+
+void audio_drift_report(const audio_drift_t *d);
+
+#endif
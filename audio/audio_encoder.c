@@ -0,0 +1,532 @@
+/*************************************************************
+ * File  :  audio_encoder.c
+ * Module:  In-app G.711/G.722 encoder for sending pre-encoded
+ *          frames that the SDK passes through.
+ *
+ * With AUDIO_CODEC_DISABLED the SDK sends whatever the app hands
+ * it, so encoding moves out of the SDK into the send thread where
+ * it can be measured and made cheaper.
+ *
+ * G.711 (bit-exact with the ITU-T G.191 reference) needs the
+ * segment, i.e. the position of the leading one of the biased
+ * magnitude, and the four bits below it. Converting the magnitude
+ * to float produces exactly that: the exponent field is the
+ * segment plus a constant and the top four mantissa bits are the
+ * quantized step, so one int-to-float conversion and a shift
+ * encode four samples at a time with SSE2/NEON, without tables or
+ * branches.
+ *
+ * G.722 follows the ITU-T algorithm in its 16-bit form (as used by
+ * spandsp): a 24-tap QMF splits the 16kHz input into two 8kHz
+ * bands, which are coded with 6-bit and 2-bit ADPCM. The QMF runs
+ * as two 24-tap dot products per output pair with interleaved
+ * coefficients (pmaddwd/vmlal); the history is kept contiguous in
+ * front of the frame so no per-sample shifting is needed. The
+ * ADPCM predictors are inherently sequential and stay scalar, but
+ * the 30-level low band quantizer uses a binary search instead of
+ * a linear scan.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_encoder.h"
+#include "audio_simd.h"
+#include "audio_ring.h"
+#include "audio_time.h"
+#include "audio_stats.h"
+#include "log.h"
+
+#define G722_QMF_TAPS (24)
+// 每帧前面保留的上一帧尾部采样
+#define G722_QMF_HISTORY (G722_QMF_TAPS - 2)
+
+static const char *const g_encoder_names[AUDIO_ENCODER_COUNT] = {
+    [AUDIO_ENCODER_NONE]    = "none",
+    [AUDIO_ENCODER_PCMA]    = "pcma",
+    [AUDIO_ENCODER_PCMU]    = "pcmu",
+    [AUDIO_ENCODER_G722]    = "g722",
+};
+
+const char *audio_encoder_name(audio_encoder_type_e type)
+{
+    return (unsigned)type < AUDIO_ENCODER_COUNT ? g_encoder_names[type] : "?";
+}
+
+int audio_encoder_parse(const char *name, audio_encoder_type_e *type)
+{
+    for (int i = 0; i < AUDIO_ENCODER_COUNT; i++) {
+        if (strcmp(name, g_encoder_names[i]) == 0) {
+            *type = (audio_encoder_type_e)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+uint32_t audio_encoder_sample_rate(audio_encoder_type_e type)
+{
+    switch (type) {
+    case AUDIO_ENCODER_PCMA:
+    case AUDIO_ENCODER_PCMU:
+        return 8000;
+    case AUDIO_ENCODER_G722:
+        return 16000;
+    default:
+        return 0;
+    }
+}
+
+size_t audio_encoder_frame_bytes(const audio_encoder_t *enc, uint32_t samples)
+{
+    switch (enc->cfg.type) {
+    case AUDIO_ENCODER_PCMA:
+    case AUDIO_ENCODER_PCMU:
+        return samples;
+    case AUDIO_ENCODER_G722:
+        // 每两个采样编成一个字节
+        return (samples & ~1u) / 2;
+    default:
+        return 0;
+    }
+}
+
+/* ---------------------------------------------------------------- G.711 */
+
+// 偏置后的幅度转为浮点，指数域和尾数高 4 位右移 19 位后就是 段号<<4|量化值，
+// 再减去 段 0 对应的指数 (127 + 7) << 4
+#define G711_EXP_BIAS ((127 + 7) << 4)
+
+static inline int32_t g711_segment(int32_t mag)
+{
+    union { float f; uint32_t u; } v = { .f = (float)mag };
+    return (int32_t)(v.u >> 19) - G711_EXP_BIAS;
+}
+
+static inline uint8_t g711_ulaw(int16_t s)
+{
+    int32_t sign = s >> 15;
+    int32_t mag = s ^ sign;             // 负数取 -s-1，与参考实现一致
+    mag = (mag > 32635 ? 32635 : mag) + 0x84;
+    return (uint8_t)(g711_segment(mag) ^ (sign ? 0x7F : 0xFF));
+}
+
+static inline uint8_t g711_alaw(int16_t s)
+{
+    int32_t sign = s >> 15;
+    int32_t mag = s ^ sign;
+    // 段 0 和段 1 的步长相同，段 0 不能用浮点指数计算
+    int32_t code = mag < 256 ? mag >> 4 : g711_segment(mag);
+    return (uint8_t)(code ^ (sign ? 0x55 : 0xD5));
+}
+
+static void g711_encode_ulaw(const int16_t *in, uint8_t *out, size_t n)
+{
+    size_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i clip = _mm_set1_epi16(32635);
+    const __m128i bias = _mm_set1_epi16(0x84);
+    const __m128i exp_bias = _mm_set1_epi32(G711_EXP_BIAS);
+    const __m128i all = _mm_set1_epi16(0xFF);
+    const __m128i sign_bit = _mm_set1_epi16(0x80);
+    for (; i + 8 <= n; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i sign = _mm_srai_epi16(s, 15);
+        __m128i mag = _mm_add_epi16(_mm_min_epi16(_mm_xor_si128(s, sign), clip), bias);
+        __m128i f0 = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpacklo_epi16(mag, zero)));
+        __m128i f1 = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpackhi_epi16(mag, zero)));
+        __m128i c = _mm_packs_epi32(_mm_sub_epi32(_mm_srli_epi32(f0, 19), exp_bias),
+                                    _mm_sub_epi32(_mm_srli_epi32(f1, 19), exp_bias));
+        c = _mm_xor_si128(c, _mm_xor_si128(all, _mm_and_si128(sign, sign_bit)));
+        _mm_storel_epi64((__m128i *)(out + i), _mm_packus_epi16(c, c));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    const int32x4_t exp_bias = vdupq_n_s32(G711_EXP_BIAS);
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t s = vld1q_s16(in + i);
+        int16x8_t sign = vshrq_n_s16(s, 15);
+        int16x8_t mag = vaddq_s16(vminq_s16(veorq_s16(s, sign), vdupq_n_s16(32635)), vdupq_n_s16(0x84));
+        uint32x4_t f0 = vreinterpretq_u32_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(mag))));
+        uint32x4_t f1 = vreinterpretq_u32_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(mag))));
+        int16x8_t c = vcombine_s16(vmovn_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(f0, 19)), exp_bias)),
+                                   vmovn_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(f1, 19)), exp_bias)));
+        c = veorq_s16(c, veorq_s16(vdupq_n_s16(0xFF), vandq_s16(sign, vdupq_n_s16(0x80))));
+        vst1_u8(out + i, vmovn_u16(vreinterpretq_u16_s16(c)));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = g711_ulaw(in[i]);
+    }
+}
+
+static void g711_encode_alaw(const int16_t *in, uint8_t *out, size_t n)
+{
+    size_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i seg0 = _mm_set1_epi16(256);
+    const __m128i exp_bias = _mm_set1_epi32(G711_EXP_BIAS);
+    const __m128i pos_mask = _mm_set1_epi16(0xD5);
+    const __m128i sign_bit = _mm_set1_epi16(0x80);
+    for (; i + 8 <= n; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i sign = _mm_srai_epi16(s, 15);
+        __m128i mag = _mm_xor_si128(s, sign);
+        __m128i f0 = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpacklo_epi16(mag, zero)));
+        __m128i f1 = _mm_castps_si128(_mm_cvtepi32_ps(_mm_unpackhi_epi16(mag, zero)));
+        __m128i hi = _mm_packs_epi32(_mm_sub_epi32(_mm_srli_epi32(f0, 19), exp_bias),
+                                     _mm_sub_epi32(_mm_srli_epi32(f1, 19), exp_bias));
+        __m128i small = _mm_cmplt_epi16(mag, seg0);
+        __m128i c = _mm_or_si128(_mm_and_si128(small, _mm_srli_epi16(mag, 4)), _mm_andnot_si128(small, hi));
+        c = _mm_xor_si128(c, _mm_xor_si128(pos_mask, _mm_and_si128(sign, sign_bit)));
+        _mm_storel_epi64((__m128i *)(out + i), _mm_packus_epi16(c, c));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    const int32x4_t exp_bias = vdupq_n_s32(G711_EXP_BIAS);
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t s = vld1q_s16(in + i);
+        int16x8_t sign = vshrq_n_s16(s, 15);
+        int16x8_t mag = veorq_s16(s, sign);
+        uint32x4_t f0 = vreinterpretq_u32_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(mag))));
+        uint32x4_t f1 = vreinterpretq_u32_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(mag))));
+        int16x8_t hi = vcombine_s16(vmovn_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(f0, 19)), exp_bias)),
+                                    vmovn_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(f1, 19)), exp_bias)));
+        uint16x8_t small = vcltq_s16(mag, vdupq_n_s16(256));
+        int16x8_t c = vbslq_s16(small, vshrq_n_s16(mag, 4), hi);
+        c = veorq_s16(c, veorq_s16(vdupq_n_s16(0xD5), vandq_s16(sign, vdupq_n_s16(0x80))));
+        vst1_u8(out + i, vmovn_u16(vreinterpretq_u16_s16(c)));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = g711_alaw(in[i]);
+    }
+}
+
+/* ---------------------------------------------------------------- G.722 */
+
+static const int32_t g722_q6[32] = {
+    0, 35, 72, 110, 150, 190, 233, 276, 323, 370, 422, 473, 530, 587, 650, 714,
+    786, 858, 940, 1023, 1121, 1219, 1339, 1458, 1612, 1765, 1980, 2195, 2557, 2919, 0, 0,
+};
+static const int32_t g722_iln[32] = {
+    0, 63, 62, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19,
+    18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 0,
+};
+static const int32_t g722_ilp[32] = {
+    0, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49, 48, 47,
+    46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33, 32, 0,
+};
+static const int32_t g722_wl[8] = { -60, -30, 58, 172, 334, 538, 1198, 3042 };
+static const int32_t g722_rl42[16] = { 0, 7, 6, 5, 4, 3, 2, 1, 7, 6, 5, 4, 3, 2, 1, 0 };
+static const int32_t g722_ilb[32] = {
+    2048, 2093, 2139, 2186, 2233, 2282, 2332, 2383, 2435, 2489, 2543, 2599, 2656, 2714, 2774, 2834,
+    2896, 2960, 3025, 3091, 3158, 3228, 3298, 3371, 3444, 3520, 3597, 3676, 3756, 3838, 3922, 4008,
+};
+static const int32_t g722_qm4[16] = {
+    0, -20456, -12896, -8968, -6288, -4240, -2584, -1200, 20456, 12896, 8968, 6288, 4240, 2584, 1200, 0,
+};
+static const int32_t g722_qm2[4] = { -7408, -1616, 7408, 1616 };
+static const int32_t g722_ihn[3] = { 0, 1, 0 };
+static const int32_t g722_ihp[3] = { 0, 3, 2 };
+static const int32_t g722_wh[3] = { 0, -214, 798 };
+static const int32_t g722_rh2[4] = { 2, 1, 2, 1 };
+
+// 发送端 QMF 系数按窗口内采样的顺序交错排列: 偶数位置乘 h[i]，奇数位置乘 h[11-i]，
+// 低带取两者之和，高带取两者之差
+static const int16_t g722_qmf_low[G722_QMF_TAPS] = {
+    3, -11, -11, 53, 12, -156, 32, 362, -210, -805, 951, 3876,
+    3876, 951, -805, -210, 362, 32, -156, 12, 53, -11, -11, 3,
+};
+static const int16_t g722_qmf_high[G722_QMF_TAPS] = {
+    -3, -11, 11, 53, -12, -156, -32, 362, 210, -805, -951, 3876,
+    -3876, 951, 805, -210, -362, 32, 156, 12, -53, -11, 11, 3,
+};
+
+static inline int32_t g722_sat(int32_t v)
+{
+    return v > 32767 ? 32767 : (v < -32768 ? -32768 : v);
+}
+
+static inline int32_t g722_scale(int32_t nb, int32_t shift)
+{
+    int32_t wd1 = (nb >> 6) & 31;
+    int32_t wd2 = shift - (nb >> 11);
+    int32_t wd3 = wd2 < 0 ? g722_ilb[wd1] << -wd2 : g722_ilb[wd1] >> wd2;
+    return wd3 << 2;
+}
+
+// 重建信号并更新零极点预测器(ITU-T G.722 Block 4)
+static void g722_block4(audio_g722_band_t *b, int32_t d)
+{
+    int32_t wd1, wd2, wd3;
+
+    b->d[0] = d;
+    b->r[0] = g722_sat(b->s + d);
+    b->p[0] = g722_sat(b->sz + d);
+
+    // UPPOL2
+    for (int i = 0; i < 3; i++) {
+        b->sg[i] = b->p[i] >> 15;
+    }
+    wd1 = g722_sat(b->a[1] * 4);
+    wd2 = b->sg[0] == b->sg[1] ? -wd1 : wd1;
+    if (wd2 > 32767) {
+        wd2 = 32767;
+    }
+    wd3 = (wd2 >> 7) + (b->sg[0] == b->sg[2] ? 128 : -128) + ((b->a[2] * 32512) >> 15);
+    b->ap[2] = wd3 > 12288 ? 12288 : (wd3 < -12288 ? -12288 : wd3);
+
+    // UPPOL1
+    wd1 = b->sg[0] == b->sg[1] ? 192 : -192;
+    wd2 = (b->a[1] * 32640) >> 15;
+    b->ap[1] = g722_sat(wd1 + wd2);
+    wd3 = g722_sat(15360 - b->ap[2]);
+    if (b->ap[1] > wd3) {
+        b->ap[1] = wd3;
+    } else if (b->ap[1] < -wd3) {
+        b->ap[1] = -wd3;
+    }
+
+    // UPZERO
+    wd1 = d == 0 ? 0 : 128;
+    b->sg[0] = d >> 15;
+    for (int i = 1; i < 7; i++) {
+        b->sg[i] = b->d[i] >> 15;
+        wd2 = b->sg[i] == b->sg[0] ? wd1 : -wd1;
+        wd3 = (b->b[i] * 32640) >> 15;
+        b->bp[i] = g722_sat(wd2 + wd3);
+    }
+
+    // DELAYA
+    for (int i = 6; i > 0; i--) {
+        b->d[i] = b->d[i - 1];
+        b->b[i] = b->bp[i];
+    }
+    for (int i = 2; i > 0; i--) {
+        b->r[i] = b->r[i - 1];
+        b->p[i] = b->p[i - 1];
+        b->a[i] = b->ap[i];
+    }
+
+    // FILTEP / FILTEZ / PREDIC
+    wd1 = (b->a[1] * g722_sat(b->r[1] + b->r[1])) >> 15;
+    wd2 = (b->a[2] * g722_sat(b->r[2] + b->r[2])) >> 15;
+    b->sp = g722_sat(wd1 + wd2);
+    b->sz = 0;
+    for (int i = 6; i > 0; i--) {
+        b->sz += (b->b[i] * g722_sat(b->d[i] + b->d[i])) >> 15;
+    }
+    b->sz = g722_sat(b->sz);
+    b->s = g722_sat(b->sp + b->sz);
+}
+
+// 对 24 个采样的窗口做分带滤波，得到低带和高带各一个采样
+static inline void g722_qmf(const int16_t *x, int32_t *xlow, int32_t *xhigh)
+{
+#if defined(AUDIO_HAVE_SSE2)
+    __m128i lo = _mm_setzero_si128();
+    __m128i hi = _mm_setzero_si128();
+    for (int i = 0; i < G722_QMF_TAPS; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(x + i));
+        lo = _mm_add_epi32(lo, _mm_madd_epi16(v, _mm_loadu_si128((const __m128i *)(g722_qmf_low + i))));
+        hi = _mm_add_epi32(hi, _mm_madd_epi16(v, _mm_loadu_si128((const __m128i *)(g722_qmf_high + i))));
+    }
+    // 两个累加器交错后一起做水平求和: [lo0+lo2, hi0+hi2, lo1+lo3, hi1+hi3]
+    __m128i t = _mm_add_epi32(_mm_unpacklo_epi32(lo, hi), _mm_unpackhi_epi32(lo, hi));
+    t = _mm_add_epi32(t, _mm_srli_si128(t, 8));
+    *xlow = _mm_cvtsi128_si32(t) >> 14;
+    *xhigh = _mm_cvtsi128_si32(_mm_srli_si128(t, 4)) >> 14;
+#elif defined(AUDIO_HAVE_NEON)
+    int32x4_t lo = vdupq_n_s32(0);
+    int32x4_t hi = vdupq_n_s32(0);
+    for (int i = 0; i < G722_QMF_TAPS; i += 8) {
+        int16x8_t v = vld1q_s16(x + i);
+        int16x8_t cl = vld1q_s16(g722_qmf_low + i);
+        int16x8_t ch = vld1q_s16(g722_qmf_high + i);
+        lo = vmlal_s16(lo, vget_low_s16(v), vget_low_s16(cl));
+        lo = vmlal_s16(lo, vget_high_s16(v), vget_high_s16(cl));
+        hi = vmlal_s16(hi, vget_low_s16(v), vget_low_s16(ch));
+        hi = vmlal_s16(hi, vget_high_s16(v), vget_high_s16(ch));
+    }
+    int32x2_t lo2 = vadd_s32(vget_low_s32(lo), vget_high_s32(lo));
+    int32x2_t hi2 = vadd_s32(vget_low_s32(hi), vget_high_s32(hi));
+    *xlow = (vget_lane_s32(lo2, 0) + vget_lane_s32(lo2, 1)) >> 14;
+    *xhigh = (vget_lane_s32(hi2, 0) + vget_lane_s32(hi2, 1)) >> 14;
+#else
+    int32_t lo = 0;
+    int32_t hi = 0;
+    for (int i = 0; i < G722_QMF_TAPS; i++) {
+        lo += x[i] * g722_qmf_low[i];
+        hi += x[i] * g722_qmf_high[i];
+    }
+    *xlow = lo >> 14;
+    *xhigh = hi >> 14;
+#endif
+}
+
+// 低带 6 比特量化: 判决门限随 i 单调增加，二分查找第一个超过 |el| 的门限
+static inline int32_t g722_quant_low(int32_t el, int32_t det)
+{
+    int32_t wd = el >= 0 ? el : -(el + 1);
+    int lo = 1;
+    int hi = 30;
+
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (wd < ((g722_q6[mid] * det) >> 12)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return el < 0 ? g722_iln[lo] : g722_ilp[lo];
+}
+
+static size_t g722_encode(audio_encoder_t *enc, const int16_t *in, uint32_t n, uint8_t *out)
+{
+    int16_t *x = enc->qmf;
+    audio_g722_band_t *low = &enc->band[0];
+    audio_g722_band_t *high = &enc->band[1];
+    size_t bytes = 0;
+
+    memcpy(x + G722_QMF_HISTORY, in, n * sizeof(int16_t));
+    for (uint32_t j = 0; j + 2 <= n; j += 2) {
+        int32_t xlow, xhigh;
+        g722_qmf(x + j, &xlow, &xhigh);
+
+        // 低带: SUBTRA, QUANTL, INVQAL, LOGSCL, SCALEL
+        int32_t el = g722_sat(xlow - low->s);
+        int32_t ilow = g722_quant_low(el, low->det);
+        int32_t ril = ilow >> 2;
+        int32_t dlow = (low->det * g722_qm4[ril]) >> 15;
+        int32_t nb = ((low->nb * 127) >> 7) + g722_wl[g722_rl42[ril]];
+        low->nb = nb < 0 ? 0 : (nb > 18432 ? 18432 : nb);
+        low->det = g722_scale(low->nb, 8);
+        g722_block4(low, dlow);
+
+        // 高带: SUBTRA, QUANTH, INVQAH, LOGSCH, SCALEH
+        int32_t eh = g722_sat(xhigh - high->s);
+        int32_t wd = eh >= 0 ? eh : -(eh + 1);
+        int32_t mih = wd >= ((564 * high->det) >> 12) ? 2 : 1;
+        int32_t ihigh = eh < 0 ? g722_ihn[mih] : g722_ihp[mih];
+        int32_t dhigh = (high->det * g722_qm2[ihigh]) >> 15;
+        nb = ((high->nb * 127) >> 7) + g722_wh[g722_rh2[ihigh]];
+        high->nb = nb < 0 ? 0 : (nb > 22528 ? 22528 : nb);
+        high->det = g722_scale(high->nb, 10);
+        g722_block4(high, dhigh);
+
+        out[bytes++] = (uint8_t)((ihigh << 6) | ilow);
+    }
+    // 本帧尾部留作下一帧的滤波历史
+    memmove(x, x + n, G722_QMF_HISTORY * sizeof(int16_t));
+    return bytes;
+}
+
+/* ---------------------------------------------------------------- 接口 */
+
+int audio_encoder_init(audio_encoder_t *enc, const audio_encoder_config_t *cfg)
+{
+    memset(enc, 0, sizeof(*enc));
+    enc->cfg = *cfg;
+    if (cfg->type == AUDIO_ENCODER_NONE || (unsigned)cfg->type >= AUDIO_ENCODER_COUNT || cfg->frame_samples == 0) {
+        return -1;
+    }
+    if (cfg->sample_rate != audio_encoder_sample_rate(cfg->type) || cfg->channels != 1) {
+        LOGE("%s 编码只支持 %uHz 单声道，当前为 %uHz %u 声道", audio_encoder_name(cfg->type),
+             audio_encoder_sample_rate(cfg->type), cfg->sample_rate, cfg->channels);
+        return -1;
+    }
+    if (cfg->type == AUDIO_ENCODER_G722 && cfg->frame_samples % 2 != 0) {
+        LOGE("G.722 编码要求每帧采样数为偶数，当前为 %u", cfg->frame_samples);
+        return -1;
+    }
+
+    // G.711 每个采样一个字节，G.722 每两个采样一个字节
+    enc->out_size = cfg->type == AUDIO_ENCODER_G722 ? cfg->frame_samples / 2 : cfg->frame_samples;
+    if (posix_memalign((void **)&enc->out, AUDIO_CACHE_LINE, enc->out_size) != 0) {
+        enc->out = NULL;
+        LOGE("无法分配编码缓冲区");
+        return -1;
+    }
+    if (cfg->type == AUDIO_ENCODER_G722) {
+        enc->qmf = calloc(G722_QMF_HISTORY + cfg->frame_samples, sizeof(int16_t));
+        if (!enc->qmf) {
+            LOGE("无法分配编码缓冲区");
+            audio_encoder_deinit(enc);
+            return -1;
+        }
+        enc->band[0].det = 32;
+        enc->band[1].det = 8;
+    }
+
+    LOGI("发送端编码已启用: %s, %uHz, 每帧 %u 采样 -> %zu 字节 (%s)", audio_encoder_name(cfg->type),
+         cfg->sample_rate, cfg->frame_samples, enc->out_size, AUDIO_SIMD_NAME);
+    return 0;
+}
+
+void audio_encoder_deinit(audio_encoder_t *enc)
+{
+    free(enc->out);
+    free(enc->qmf);
+    enc->out = NULL;
+    enc->qmf = NULL;
+}
+
+void audio_encoder_report(const audio_encoder_t *enc)
+{
+    uint64_t frames = atomic_load(&enc->stats.frames);
+    uint64_t frame_ns = frames ? atomic_load(&enc->stats.bytes_in) / sizeof(int16_t) / frames *
+                                 1000000000ull / enc->cfg.sample_rate : 0;
+    uint64_t avg_ns = frames ? atomic_load(&enc->stats.cost_ns_sum) / frames : 0;
+
+    LOGI("编码统计(%s): 帧=%llu, 输入=%llu 字节, 输出=%llu 字节, 耗时 平均=%.1fus 最大=%.1fus, "
+         "占帧长 %.3f%%",
+         audio_encoder_name(enc->cfg.type), (unsigned long long)frames,
+         atomic_load(&enc->stats.bytes_in), atomic_load(&enc->stats.bytes_out),
+         avg_ns / 1000.0, atomic_load(&enc->stats.cost_ns_max) / 1000.0,
+         frame_ns ? avg_ns * 100.0 / frame_ns : 0.0);
+}
+
+int audio_encoder_encode(audio_encoder_t *enc, const int16_t *pcm, uint32_t samples, const uint8_t **out)
+{
+    size_t bytes = 0;
+
+    if (samples > enc->cfg.frame_samples) {
+        return -1;
+    }
+
+    int64_t start_ns = audio_now_ns();
+    switch (enc->cfg.type) {
+    case AUDIO_ENCODER_PCMA:
+        g711_encode_alaw(pcm, enc->out, samples);
+        bytes = samples;
+        break;
+    case AUDIO_ENCODER_PCMU:
+        g711_encode_ulaw(pcm, enc->out, samples);
+        bytes = samples;
+        break;
+    case AUDIO_ENCODER_G722:
+        bytes = g722_encode(enc, pcm, samples & ~1u, enc->out);
+        break;
+    default:
+        return -1;
+    }
+    uint64_t cost_ns = audio_now_ns() - start_ns;
+
+    audio_stats_record(AUDIO_STAT_ENCODE, cost_ns);
+    atomic_fetch_add_explicit(&enc->stats.frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&enc->stats.bytes_in, samples * sizeof(int16_t), memory_order_relaxed);
+    atomic_fetch_add_explicit(&enc->stats.bytes_out, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&enc->stats.cost_ns_sum, cost_ns, memory_order_relaxed);
+    if (cost_ns > atomic_load_explicit(&enc->stats.cost_ns_max, memory_order_relaxed)) {
+        atomic_store_explicit(&enc->stats.cost_ns_max, (uint32_t)cost_ns, memory_order_relaxed);
+    }
+    *out = enc->out;
+    return (int)bytes;
+}
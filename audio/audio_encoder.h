@@ -0,0 +1,85 @@
+/*************************************************************
+ * File  :  audio_encoder.h
+ * Module:  In-app G.711/G.722 encoder for sending pre-encoded
+ *          frames that the SDK passes through.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_ENCODER_H_
+#define _AUDIO_ENCODER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+typedef enum {
+    AUDIO_ENCODER_NONE = 0,         // 发送 PCM，由 SDK 编码
+    AUDIO_ENCODER_PCMA,             // G.711 A-law，8kHz 单声道
+    AUDIO_ENCODER_PCMU,             // G.711 u-law，8kHz 单声道
+    AUDIO_ENCODER_G722,             // G.722 64kbps，16kHz 单声道
+    AUDIO_ENCODER_COUNT,
+} audio_encoder_type_e;
+
+typedef struct {
+    audio_encoder_type_e type;
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint32_t frame_samples;         // 每帧的采样数，决定输出缓冲区大小
+} audio_encoder_config_t;
+
+typedef struct {
+    atomic_ullong frames;
+    atomic_ullong bytes_in;
+    atomic_ullong bytes_out;
+    atomic_ullong cost_ns_sum;
+    atomic_uint cost_ns_max;
+} audio_encoder_stats_t;
+
+// G.722 一个子带的 ADPCM 预测器状态
+typedef struct {
+    int32_t s;                      // 预测值
+    int32_t sp;                     // 极点部分
+    int32_t sz;                     // 零点部分
+    int32_t r[3];
+    int32_t a[3];
+    int32_t ap[3];
+    int32_t p[3];
+    int32_t d[7];
+    int32_t b[7];
+    int32_t bp[7];
+    int32_t sg[7];
+    int32_t nb;                     // 对数量化步长
+    int32_t det;                    // 量化步长
+} audio_g722_band_t;
+
+typedef struct {
+    audio_encoder_config_t cfg;
+    uint8_t *out;                   // 一帧的编码结果
+    size_t out_size;
+    int16_t *qmf;                   // G.722 分带滤波的历史采样加上当前帧
+    audio_g722_band_t band[2];
+    audio_encoder_stats_t stats;
+} audio_encoder_t;
+
+const char *audio_encoder_name(audio_encoder_type_e type);
+int audio_encoder_parse(const char *name, audio_encoder_type_e *type);
+// 编码器要求的采样率
+uint32_t audio_encoder_sample_rate(audio_encoder_type_e type);
+
+int audio_encoder_init(audio_encoder_t *enc, const audio_encoder_config_t *cfg);
+void audio_encoder_deinit(audio_encoder_t *enc);
+void audio_encoder_report(const audio_encoder_t *enc);
+
+// samples 个采样编码后的字节数，不实际编码，用于统计没有发送的帧
+size_t audio_encoder_frame_bytes(const audio_encoder_t *enc, uint32_t samples);
+
+// 在发送线程中编码一帧 PCM，*out 指向编码器内部的缓冲区，下次调用前有效；
+// 返回编码后的字节数，失败返回 -1
+int audio_encoder_encode(audio_encoder_t *enc, const int16_t *pcm, uint32_t samples, const uint8_t **out);
+
+#endif
@@ -0,0 +1,113 @@
+/*************************************************************
+ * File  :  audio_event.c
+ * Module:  Bounded lock-free multi-producer single-consumer
+ *          event queue from SDK callbacks to the main thread.
+ *
+ * Each slot carries a sequence number (Vyukov's bounded queue).
+ * A producer claims a position with a CAS on the shared tail only
+ * when the slot's sequence says it is free, fills the slot and
+ * then publishes it by storing position+1 with release order. The
+ * single consumer reads slots in order and hands each one back by
+ * storing position+capacity. Producers never wait for each other
+ * or for the consumer: a full queue fails the post and counts it.
+ * Posting does no locking, allocation or formatting, so SDK
+ * threads and signal handlers can use it; the consumer applies
+ * the events to the application state on its own thread.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_event.h"
+#include "audio_time.h"
+
+int audio_event_queue_init(audio_event_queue_t *q, uint32_t capacity)
+{
+    uint32_t n = 2;
+
+    memset(q, 0, sizeof(*q));
+    while (n < capacity) {
+        n <<= 1;
+    }
+    q->slots = calloc(n, sizeof(audio_event_slot_t));
+    if (!q->slots) {
+        return -1;
+    }
+    q->mask = n - 1;
+    for (uint32_t i = 0; i < n; i++) {
+        atomic_init(&q->slots[i].seq, i);
+    }
+    atomic_init(&q->tail, 0);
+    return 0;
+}
+
+void audio_event_queue_deinit(audio_event_queue_t *q)
+{
+    free(q->slots);
+    q->slots = NULL;
+}
+
+int audio_event_post(audio_event_queue_t *q, uint32_t type, uint32_t conn_id, uint32_t uid, int32_t code,
+                     int32_t value, const char *msg)
+{
+    audio_event_slot_t *slot;
+    uint32_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    for (;;) {
+        slot = &q->slots[pos & q->mask];
+        uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            // 失败时 pos 被更新为最新的 tail，重新检查对应的槽
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // 该槽还没有被消费者取走，队列已满
+            atomic_fetch_add_explicit(&q->dropped, 1, memory_order_relaxed);
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+
+    audio_event_t *ev = &slot->ev;
+    ev->type = type;
+    ev->conn_id = conn_id;
+    ev->uid = uid;
+    ev->code = code;
+    ev->value = value;
+    ev->ts_us = audio_now_us();
+    // 不用 snprintf: 信号处理函数中只能调用异步信号安全的函数
+    size_t len = 0;
+    while (msg && msg[len] && len < AUDIO_EVENT_MSG_LEN - 1) {
+        ev->msg[len] = msg[len];
+        len++;
+    }
+    ev->msg[len] = '\0';
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    atomic_fetch_add_explicit(&q->posted, 1, memory_order_relaxed);
+    return 0;
+}
+
+bool audio_event_pop(audio_event_queue_t *q, audio_event_t *ev)
+{
+    audio_event_slot_t *slot = &q->slots[q->head & q->mask];
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    // 下一个位置还没有发布(队列为空，或生产者占位后尚未写完)
+    if (seq != q->head + 1) {
+        return false;
+    }
+    *ev = slot->ev;
+    atomic_store_explicit(&slot->seq, q->head + q->mask + 1, memory_order_release);
+    q->head++;
+    return true;
+}
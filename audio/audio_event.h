@@ -0,0 +1,59 @@
+/*************************************************************
+ * File  :  audio_event.h
+ * Module:  Bounded lock-free multi-producer single-consumer
+ *          event queue from SDK callbacks to the main thread.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_EVENT_H_
+#define _AUDIO_EVENT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "audio_ring.h"
+
+#define AUDIO_EVENT_MSG_LEN (96)
+
+typedef struct {
+    uint32_t type;                  // 由使用者定义
+    uint32_t conn_id;
+    uint32_t uid;
+    int32_t code;
+    int32_t value;
+    int64_t ts_us;                  // 投递时刻，由 audio_event_post 填写
+    char msg[AUDIO_EVENT_MSG_LEN];
+} audio_event_t;
+
+typedef struct {
+    atomic_uint seq;                // 等于写入位置时可写，等于写入位置+1 时可读
+    audio_event_t ev;
+} audio_event_slot_t;
+
+typedef struct {
+    audio_event_slot_t *slots;
+    uint32_t mask;
+    _Alignas(AUDIO_CACHE_LINE) atomic_uint tail;    // 生产者竞争的写入位置
+    _Alignas(AUDIO_CACHE_LINE) uint32_t head;       // 只由消费者访问
+    atomic_ullong posted;
+    atomic_ullong dropped;          // 队列已满时丢弃的事件
+} audio_event_queue_t;
+
+// capacity 向上取整为 2 的幂
+int audio_event_queue_init(audio_event_queue_t *q, uint32_t capacity);
+void audio_event_queue_deinit(audio_event_queue_t *q);
+
+// 任意线程调用，不加锁也不分配内存，可以在信号处理函数中使用；
+// msg 可以为 NULL，超长时截断。队列已满返回 -1
+int audio_event_post(audio_event_queue_t *q, uint32_t type, uint32_t conn_id, uint32_t uid, int32_t code,
+                     int32_t value, const char *msg);
+
+// 只由一个消费者线程调用，取出一个事件返回 true
+bool audio_event_pop(audio_event_queue_t *q, audio_event_t *ev);
+
+#endif
@@ -0,0 +1,234 @@
+/*************************************************************
+ * File  :  audio_fft.c
+ * Module:  Radix-2 real FFT with SSE2/NEON butterflies.
+ *
+ * A real sequence of length n is packed into a complex one of
+ * length n/2 (even samples in the real part, odd in the
+ * imaginary part), transformed with an iterative decimation-in-
+ * time FFT and split back into the n/2+1 bins of the real
+ * spectrum. Data is kept in split real/imaginary arrays so the
+ * butterflies of every stage with a half-span of 4 or more run
+ * four at a time; the inverse reuses the forward kernel through
+ * conjugation.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio_fft.h"
+#include "audio_simd.h"
+#include "audio_ring.h"
+
+static float *fft_alloc(uint32_t count)
+{
+    void *p = NULL;
+    if (posix_memalign(&p, AUDIO_CACHE_LINE, (count ? count : 1) * sizeof(float)) != 0) {
+        return NULL;
+    }
+    memset(p, 0, count * sizeof(float));
+    return p;
+}
+
+int audio_fft_init(audio_fft_t *fft, uint32_t n)
+{
+    memset(fft, 0, sizeof(*fft));
+    if (n < AUDIO_FFT_MIN_SIZE || n > AUDIO_FFT_MAX_SIZE || (n & (n - 1)) != 0) {
+        return -1;
+    }
+    fft->n = n;
+    fft->half = n / 2;
+
+    uint32_t bits = 0;
+    while ((1u << bits) < fft->half) {
+        bits++;
+    }
+
+    fft->tw_re = fft_alloc(fft->half);
+    fft->tw_im = fft_alloc(fft->half);
+    fft->post_re = fft_alloc(fft->half);
+    fft->post_im = fft_alloc(fft->half);
+    fft->work_re = fft_alloc(fft->half);
+    fft->work_im = fft_alloc(fft->half);
+    fft->bitrev = calloc(fft->half, sizeof(uint32_t));
+    if (!fft->tw_re || !fft->tw_im || !fft->post_re || !fft->post_im || !fft->work_re ||
+        !fft->work_im || !fft->bitrev) {
+        audio_fft_deinit(fft);
+        return -1;
+    }
+
+    for (uint32_t m = 1; m < fft->half; m <<= 1) {
+        for (uint32_t k = 0; k < m; k++) {
+            double a = -M_PI * k / m;
+            fft->tw_re[m - 1 + k] = (float)cos(a);
+            fft->tw_im[m - 1 + k] = (float)sin(a);
+        }
+    }
+    for (uint32_t k = 0; k < fft->half; k++) {
+        double a = -2.0 * M_PI * k / n;
+        fft->post_re[k] = (float)cos(a);
+        fft->post_im[k] = (float)sin(a);
+
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < bits; b++) {
+            r |= ((k >> b) & 1) << (bits - 1 - b);
+        }
+        fft->bitrev[k] = r;
+    }
+    return 0;
+}
+
+void audio_fft_deinit(audio_fft_t *fft)
+{
+    free(fft->tw_re);
+    free(fft->tw_im);
+    free(fft->post_re);
+    free(fft->post_im);
+    free(fft->work_re);
+    free(fft->work_im);
+    free(fft->bitrev);
+    memset(fft, 0, sizeof(*fft));
+}
+
+static void fft_stage_scalar(float *re, float *im, uint32_t len, uint32_t m,
+                             const float *wr, const float *wi)
+{
+    for (uint32_t g = 0; g < len; g += 2 * m) {
+        for (uint32_t k = 0; k < m; k++) {
+            uint32_t a = g + k;
+            uint32_t b = a + m;
+            float tr = re[b] * wr[k] - im[b] * wi[k];
+            float ti = re[b] * wi[k] + im[b] * wr[k];
+            re[b] = re[a] - tr;
+            im[b] = im[a] - ti;
+            re[a] += tr;
+            im[a] += ti;
+        }
+    }
+}
+
+// 半跨度 m 为 4 的倍数时每次处理 4 个蝶形
+static void fft_stage_simd(float *re, float *im, uint32_t len, uint32_t m,
+                           const float *wr, const float *wi)
+{
+#if defined(AUDIO_HAVE_SSE2)
+    for (uint32_t g = 0; g < len; g += 2 * m) {
+        for (uint32_t k = 0; k < m; k += 4) {
+            float *ar = re + g + k, *ai = im + g + k;
+            float *br = ar + m, *bi = ai + m;
+            __m128 w_r = _mm_loadu_ps(wr + k);
+            __m128 w_i = _mm_loadu_ps(wi + k);
+            __m128 x_r = _mm_loadu_ps(br);
+            __m128 x_i = _mm_loadu_ps(bi);
+            __m128 tr = _mm_sub_ps(_mm_mul_ps(x_r, w_r), _mm_mul_ps(x_i, w_i));
+            __m128 ti = _mm_add_ps(_mm_mul_ps(x_r, w_i), _mm_mul_ps(x_i, w_r));
+            __m128 y_r = _mm_loadu_ps(ar);
+            __m128 y_i = _mm_loadu_ps(ai);
+            _mm_storeu_ps(br, _mm_sub_ps(y_r, tr));
+            _mm_storeu_ps(bi, _mm_sub_ps(y_i, ti));
+            _mm_storeu_ps(ar, _mm_add_ps(y_r, tr));
+            _mm_storeu_ps(ai, _mm_add_ps(y_i, ti));
+        }
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    for (uint32_t g = 0; g < len; g += 2 * m) {
+        for (uint32_t k = 0; k < m; k += 4) {
+            float *ar = re + g + k, *ai = im + g + k;
+            float *br = ar + m, *bi = ai + m;
+            float32x4_t w_r = vld1q_f32(wr + k);
+            float32x4_t w_i = vld1q_f32(wi + k);
+            float32x4_t x_r = vld1q_f32(br);
+            float32x4_t x_i = vld1q_f32(bi);
+            float32x4_t tr = vmlsq_f32(vmulq_f32(x_r, w_r), x_i, w_i);
+            float32x4_t ti = vmlaq_f32(vmulq_f32(x_r, w_i), x_i, w_r);
+            float32x4_t y_r = vld1q_f32(ar);
+            float32x4_t y_i = vld1q_f32(ai);
+            vst1q_f32(br, vsubq_f32(y_r, tr));
+            vst1q_f32(bi, vsubq_f32(y_i, ti));
+            vst1q_f32(ar, vaddq_f32(y_r, tr));
+            vst1q_f32(ai, vaddq_f32(y_i, ti));
+        }
+    }
+#else
+    fft_stage_scalar(re, im, len, m, wr, wi);
+#endif
+}
+
+// 对已按位反序排列的 work 做原地复数正变换
+static void fft_complex(audio_fft_t *fft)
+{
+    for (uint32_t m = 1; m < fft->half; m <<= 1) {
+        const float *wr = fft->tw_re + m - 1;
+        const float *wi = fft->tw_im + m - 1;
+        if (m >= 4) {
+            fft_stage_simd(fft->work_re, fft->work_im, fft->half, m, wr, wi);
+        } else {
+            fft_stage_scalar(fft->work_re, fft->work_im, fft->half, m, wr, wi);
+        }
+    }
+}
+
+void audio_fft_forward(audio_fft_t *fft, const float *in, float *re, float *im)
+{
+    uint32_t half = fft->half;
+    float *zr = fft->work_re;
+    float *zi = fft->work_im;
+
+    for (uint32_t k = 0; k < half; k++) {
+        uint32_t j = fft->bitrev[k];
+        zr[j] = in[2 * k];
+        zi[j] = in[2 * k + 1];
+    }
+    fft_complex(fft);
+
+    re[0] = zr[0] + zi[0];
+    im[0] = 0.0f;
+    re[half] = zr[0] - zi[0];
+    im[half] = 0.0f;
+    for (uint32_t k = 1; k < half; k++) {
+        // 偶数点谱 E = (Z[k] + conj(Z[half-k])) / 2, 奇数点谱 O = (Z[k] - conj(Z[half-k])) / 2i
+        float er = 0.5f * (zr[k] + zr[half - k]);
+        float ei = 0.5f * (zi[k] - zi[half - k]);
+        float or_ = 0.5f * (zi[k] + zi[half - k]);
+        float oi = -0.5f * (zr[k] - zr[half - k]);
+        float wr = fft->post_re[k];
+        float wi = fft->post_im[k];
+        re[k] = er + wr * or_ - wi * oi;
+        im[k] = ei + wr * oi + wi * or_;
+    }
+}
+
+void audio_fft_inverse(audio_fft_t *fft, const float *re, const float *im, float *out)
+{
+    uint32_t half = fft->half;
+    float *zr = fft->work_re;
+    float *zi = fft->work_im;
+    float scale = 1.0f / half;
+
+    for (uint32_t k = 0; k < half; k++) {
+        // E = (X[k] + conj(X[half-k])) / 2, O = conj(W^k) * (X[k] - conj(X[half-k])) / 2
+        float er = 0.5f * (re[k] + re[half - k]);
+        float ei = 0.5f * (im[k] - im[half - k]);
+        float dr = 0.5f * (re[k] - re[half - k]);
+        float di = 0.5f * (im[k] + im[half - k]);
+        float wr = fft->post_re[k];
+        float wi = fft->post_im[k];
+        float or_ = dr * wr + di * wi;
+        float oi = di * wr - dr * wi;
+        // Z = E + i*O，取共轭后用正变换完成逆变换
+        uint32_t j = fft->bitrev[k];
+        zr[j] = er - oi;
+        zi[j] = -(ei + or_);
+    }
+    fft_complex(fft);
+
+    for (uint32_t k = 0; k < half; k++) {
+        out[2 * k] = zr[k] * scale;
+        out[2 * k + 1] = -zi[k] * scale;
+    }
+}
@@ -0,0 +1,41 @@
+/*************************************************************
+ * File  :  audio_fft.h
+ * Module:  Radix-2 real FFT with SSE2/NEON butterflies.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_FFT_H_
+#define _AUDIO_FFT_H_
+
+#include <stdint.h>
+
+#define AUDIO_FFT_MIN_SIZE (8)
+#define AUDIO_FFT_MAX_SIZE (8192)
+
+// 频谱以实部、虚部分开的数组存放，每个数组 n/2+1 个点
+typedef struct {
+    uint32_t n;             // 实数序列长度，2 的幂
+    uint32_t half;          // 内部复数 FFT 长度 n/2
+    float *tw_re;           // 各级蝶形的旋转因子，第 m 级(半跨度 m)从下标 m-1 开始
+    float *tw_im;
+    float *post_re;         // 实数拆分用的 exp(-2*pi*i*k/n)
+    float *post_im;
+    uint32_t *bitrev;
+    float *work_re;
+    float *work_im;
+} audio_fft_t;
+
+int audio_fft_init(audio_fft_t *fft, uint32_t n);
+void audio_fft_deinit(audio_fft_t *fft);
+
+// in[n] -> re[n/2+1], im[n/2+1]，不做归一化
+void audio_fft_forward(audio_fft_t *fft, const float *in, float *re, float *im);
+
+// re/im[n/2+1] -> out[n]，已除以 n，与 audio_fft_forward 互逆
+void audio_fft_inverse(audio_fft_t *fft, const float *re, const float *im, float *out);
+
+#endif
@@ -0,0 +1,291 @@
+/*************************************************************
+ * File  :  audio_format.c
+ * Module:  Sample format and channel layout conversion kernels.
+ *
+ * The common cases (S32/S24/float <-> S16, stereo <-> mono) have
+ * SSE2 and NEON versions working on 8 samples at a time; the
+ * remaining tail and the uncommon layouts fall back to scalar C.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <string.h>
+#include <math.h>
+
+#include "audio_format.h"
+#include "audio_simd.h"
+
+uint32_t audio_sample_bytes(audio_sample_fmt_e format)
+{
+    switch (format) {
+    case AUDIO_FMT_S16:
+        return 2;
+    case AUDIO_FMT_S24_3:
+        return 3;
+    default:
+        return 4;
+    }
+}
+
+const char *audio_sample_fmt_name(audio_sample_fmt_e format)
+{
+    switch (format) {
+    case AUDIO_FMT_S16:
+        return "S16";
+    case AUDIO_FMT_S24:
+        return "S24";
+    case AUDIO_FMT_S24_3:
+        return "S24_3";
+    case AUDIO_FMT_S32:
+        return "S32";
+    case AUDIO_FMT_FLOAT:
+        return "FLOAT";
+    }
+    return "?";
+}
+
+static void s32_to_s16(const int32_t *in, int16_t *out, size_t n, int shift_left)
+{
+    size_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    __m128i sh = _mm_cvtsi32_si128(shift_left);
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(in + i + 4));
+        a = _mm_srai_epi32(_mm_sll_epi32(a, sh), 16);
+        b = _mm_srai_epi32(_mm_sll_epi32(b, sh), 16);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(a, b));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    int32x4_t sh = vdupq_n_s32(shift_left);
+    for (; i + 8 <= n; i += 8) {
+        int32x4_t a = vshlq_s32(vld1q_s32(in + i), sh);
+        int32x4_t b = vshlq_s32(vld1q_s32(in + i + 4), sh);
+        vst1q_s16(out + i, vcombine_s16(vshrn_n_s32(a, 16), vshrn_n_s32(b, 16)));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = (int16_t)((int32_t)((uint32_t)in[i] << shift_left) >> 16);
+    }
+}
+
+static void float_to_s16(const float *in, int16_t *out, size_t n)
+{
+    size_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    __m128 scale = _mm_set1_ps(32768.0f);
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+        __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(a, b));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    float32x4_t scale = vdupq_n_f32(32768.0f);
+    for (; i + 8 <= n; i += 8) {
+        int32x4_t a = audio_neon_round_s32(vmulq_f32(vld1q_f32(in + i), scale));
+        int32x4_t b = audio_neon_round_s32(vmulq_f32(vld1q_f32(in + i + 4), scale));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = audio_sat16((int32_t)lrintf(in[i] * 32768.0f));
+    }
+}
+
+static void s16_to_s32(const int16_t *in, int32_t *out, size_t n, int shift_right)
+{
+    size_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    __m128i sh = _mm_cvtsi32_si128(shift_right);
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i a = _mm_sra_epi32(_mm_unpacklo_epi16(zero, v), sh);
+        __m128i b = _mm_sra_epi32(_mm_unpackhi_epi16(zero, v), sh);
+        _mm_storeu_si128((__m128i *)(out + i), a);
+        _mm_storeu_si128((__m128i *)(out + i + 4), b);
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    int32x4_t sh = vdupq_n_s32(-shift_right);
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16(in + i);
+        vst1q_s32(out + i, vshlq_s32(vshll_n_s16(vget_low_s16(v), 16), sh));
+        vst1q_s32(out + i + 4, vshlq_s32(vshll_n_s16(vget_high_s16(v), 16), sh));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = ((int32_t)in[i] * 65536) >> shift_right;
+    }
+}
+
+static void s16_to_float(const int16_t *in, float *out, size_t n)
+{
+    size_t i = 0;
+    const float scale = 1.0f / 32768.0f;
+#if defined(AUDIO_HAVE_SSE2)
+    __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(a), vscale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), vscale));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16(in + i);
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+        vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), scale));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = in[i] * scale;
+    }
+}
+
+void audio_to_s16(const void *in, audio_sample_fmt_e format, int16_t *out, size_t samples)
+{
+    const uint8_t *p = in;
+
+    switch (format) {
+    case AUDIO_FMT_S16:
+        memcpy(out, in, samples * sizeof(int16_t));
+        break;
+    case AUDIO_FMT_S24:
+        // 高字节可能不是符号位，先左移 8 位再算术右移
+        s32_to_s16(in, out, samples, 8);
+        break;
+    case AUDIO_FMT_S32:
+        s32_to_s16(in, out, samples, 0);
+        break;
+    case AUDIO_FMT_S24_3:
+        for (size_t i = 0; i < samples; i++, p += 3) {
+            out[i] = (int16_t)(p[1] | (p[2] << 8));
+        }
+        break;
+    case AUDIO_FMT_FLOAT:
+        float_to_s16(in, out, samples);
+        break;
+    }
+}
+
+void audio_from_s16(const int16_t *in, void *out, audio_sample_fmt_e format, size_t samples)
+{
+    uint8_t *p = out;
+
+    switch (format) {
+    case AUDIO_FMT_S16:
+        memcpy(out, in, samples * sizeof(int16_t));
+        break;
+    case AUDIO_FMT_S24:
+        s16_to_s32(in, out, samples, 8);
+        break;
+    case AUDIO_FMT_S32:
+        s16_to_s32(in, out, samples, 0);
+        break;
+    case AUDIO_FMT_S24_3:
+        for (size_t i = 0; i < samples; i++, p += 3) {
+            p[0] = 0;
+            p[1] = (uint8_t)(in[i] & 0xff);
+            p[2] = (uint8_t)((uint16_t)in[i] >> 8);
+        }
+        break;
+    case AUDIO_FMT_FLOAT:
+        s16_to_float(in, out, samples);
+        break;
+    }
+}
+
+static void stereo_to_mono(const int16_t *in, int16_t *out, size_t frames)
+{
+    size_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    __m128i ones = _mm_set1_epi16(1);
+    for (; i + 8 <= frames; i += 8) {
+        __m128i a = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(in + 2 * i)), ones);
+        __m128i b = _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(in + 2 * i + 8)), ones);
+        a = _mm_srai_epi32(a, 1);
+        b = _mm_srai_epi32(b, 1);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(a, b));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    for (; i + 8 <= frames; i += 8) {
+        int32x4_t a = vpaddlq_s16(vld1q_s16(in + 2 * i));
+        int32x4_t b = vpaddlq_s16(vld1q_s16(in + 2 * i + 8));
+        vst1q_s16(out + i, vcombine_s16(vshrn_n_s32(a, 1), vshrn_n_s32(b, 1)));
+    }
+#endif
+    for (; i < frames; i++) {
+        out[i] = (int16_t)(((int32_t)in[2 * i] + in[2 * i + 1]) >> 1);
+    }
+}
+
+static void mono_to_stereo(const int16_t *in, int16_t *out, size_t frames)
+{
+    size_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    for (; i + 8 <= frames; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        _mm_storeu_si128((__m128i *)(out + 2 * i), _mm_unpacklo_epi16(v, v));
+        _mm_storeu_si128((__m128i *)(out + 2 * i + 8), _mm_unpackhi_epi16(v, v));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t v;
+        v.val[0] = vld1q_s16(in + i);
+        v.val[1] = v.val[0];
+        vst2q_s16(out + 2 * i, v);
+    }
+#endif
+    for (; i < frames; i++) {
+        out[2 * i] = out[2 * i + 1] = in[i];
+    }
+}
+
+void audio_remix_s16(const int16_t *in, uint32_t in_channels, int16_t *out,
+                     uint32_t out_channels, size_t frames, uint32_t select)
+{
+    if (in_channels == out_channels) {
+        memcpy(out, in, frames * in_channels * sizeof(int16_t));
+        return;
+    }
+
+    if (in_channels > out_channels) {
+        if (select > 0 && select <= in_channels) {
+            // 多通道麦克风只取指定通道
+            for (size_t i = 0; i < frames; i++) {
+                int16_t v = in[i * in_channels + select - 1];
+                for (uint32_t ch = 0; ch < out_channels; ch++) {
+                    out[i * out_channels + ch] = v;
+                }
+            }
+        } else if (in_channels == 2 && out_channels == 1) {
+            stereo_to_mono(in, out, frames);
+        } else {
+            for (size_t i = 0; i < frames; i++) {
+                int32_t sum = 0;
+                for (uint32_t ch = 0; ch < in_channels; ch++) {
+                    sum += in[i * in_channels + ch];
+                }
+                int16_t v = (int16_t)(sum / (int32_t)in_channels);
+                for (uint32_t ch = 0; ch < out_channels; ch++) {
+                    out[i * out_channels + ch] = v;
+                }
+            }
+        }
+        return;
+    }
+
+    if (in_channels == 1 && out_channels == 2) {
+        mono_to_stereo(in, out, frames);
+        return;
+    }
+    for (size_t i = 0; i < frames; i++) {
+        for (uint32_t ch = 0; ch < out_channels; ch++) {
+            out[i * out_channels + ch] = in[i * in_channels + ch % in_channels];
+        }
+    }
+}
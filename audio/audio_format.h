@@ -0,0 +1,50 @@
+/*************************************************************
+ * File  :  audio_format.h
+ * Module:  Sample format and channel layout conversion kernels.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_FORMAT_H_
+#define _AUDIO_FORMAT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 设备侧支持的采样格式，均为小端交错
+typedef enum {
+    AUDIO_FMT_S16 = 0,      // 16 位整数
+    AUDIO_FMT_S24,          // 24 位整数，存放在 32 位容器的低 24 位
+    AUDIO_FMT_S24_3,        // 24 位整数，紧凑 3 字节
+    AUDIO_FMT_S32,          // 32 位整数
+    AUDIO_FMT_FLOAT,        // 32 位浮点，范围 [-1, 1)
+} audio_sample_fmt_e;
+
+typedef struct {
+    uint32_t rate;
+    uint32_t channels;
+    audio_sample_fmt_e format;
+} audio_format_t;
+
+uint32_t audio_sample_bytes(audio_sample_fmt_e format);
+const char *audio_sample_fmt_name(audio_sample_fmt_e format);
+
+static inline uint32_t audio_frame_bytes(const audio_format_t *fmt)
+{
+    return fmt->channels * audio_sample_bytes(fmt->format);
+}
+
+// 任意格式与 S16 之间的转换，samples 为采样总数(帧数 x 通道数)
+void audio_to_s16(const void *in, audio_sample_fmt_e format, int16_t *out, size_t samples);
+void audio_from_s16(const int16_t *in, void *out, audio_sample_fmt_e format, size_t samples);
+
+// S16 交错数据的通道变换:
+// 多到少时 select 为 0 取所有通道平均，否则取第 select 个通道(从 1 开始)；
+// 少到多时按 in_channels 循环复制。
+void audio_remix_s16(const int16_t *in, uint32_t in_channels, int16_t *out,
+                     uint32_t out_channels, size_t frames, uint32_t select);
+
+#endif
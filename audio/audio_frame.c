@@ -0,0 +1,173 @@
+/*************************************************************
+ * File  :  audio_frame.c
+ * Module:  Preallocated, refcounted pool of cache-line-aligned
+ *          audio frame buffers.
+ *
+ * Free frames sit on a lock-free stack indexed into one aligned
+ * slab, with a version tag in the head word against ABA, so any
+ * stage on any thread may drop the last reference. The capture
+ * thread reads straight into a pooled frame and every later
+ * stage either works on it in place or takes a reference; data
+ * is copied only when a borrowed frame (DMA area, mapped file)
+ * has to outlive its callback.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_frame.h"
+#include "log.h"
+
+#define FRAME_HEAD(tag, top) (((uint64_t)(tag) << 32) | (top))
+
+static void frame_push(audio_frame_pool_t *pool, audio_frame_t *frame)
+{
+    uint64_t head = atomic_load_explicit(&pool->head, memory_order_relaxed);
+    uint64_t next;
+
+    do {
+        atomic_store_explicit(&pool->next[frame->index], (uint32_t)head, memory_order_relaxed);
+        next = FRAME_HEAD((head >> 32) + 1, frame->index + 1);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->head, &head, next,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+static audio_frame_t *frame_pop(audio_frame_pool_t *pool)
+{
+    uint64_t head = atomic_load_explicit(&pool->head, memory_order_acquire);
+    uint64_t next;
+
+    do {
+        uint32_t top = (uint32_t)head;
+        if (top == 0) {
+            return NULL;
+        }
+        next = FRAME_HEAD((head >> 32) + 1,
+                          atomic_load_explicit(&pool->next[top - 1], memory_order_relaxed));
+    } while (!atomic_compare_exchange_weak_explicit(&pool->head, &head, next,
+                                                    memory_order_acquire, memory_order_acquire));
+    return &pool->frames[(uint32_t)head - 1];
+}
+
+int audio_frame_pool_init(audio_frame_pool_t *pool, uint32_t count, uint32_t frame_bytes)
+{
+    void *storage = NULL;
+
+    memset(pool, 0, sizeof(*pool));
+    if (count == 0 || frame_bytes == 0) {
+        return -1;
+    }
+    pool->count = count;
+    pool->frame_size = (frame_bytes + AUDIO_CACHE_LINE - 1) & ~(uint32_t)(AUDIO_CACHE_LINE - 1);
+
+    if (posix_memalign(&storage, AUDIO_CACHE_LINE, (size_t)count * pool->frame_size) != 0) {
+        return -1;
+    }
+    pool->storage = storage;
+    pool->frames = calloc(count, sizeof(audio_frame_t));
+    pool->next = calloc(count, sizeof(atomic_uint));
+    if (!pool->frames || !pool->next) {
+        audio_frame_pool_deinit(pool);
+        return -1;
+    }
+    // 预先触碰所有页面，避免运行时缺页
+    memset(pool->storage, 0, (size_t)count * pool->frame_size);
+
+    atomic_init(&pool->head, 0);
+    for (uint32_t i = count; i-- > 0;) {
+        audio_frame_t *frame = &pool->frames[i];
+        frame->data = pool->storage + (size_t)i * pool->frame_size;
+        frame->capacity = pool->frame_size;
+        frame->pool = pool;
+        frame->index = i;
+        atomic_init(&frame->refs, 0);
+        frame_push(pool, frame);
+    }
+    return 0;
+}
+
+void audio_frame_pool_deinit(audio_frame_pool_t *pool)
+{
+    uint32_t in_use = atomic_load(&pool->in_use);
+    if (in_use) {
+        LOGW("帧池释放时仍有 %u 帧未归还", in_use);
+    }
+    free(pool->storage);
+    free(pool->frames);
+    free(pool->next);
+    pool->storage = NULL;
+    pool->frames = NULL;
+    pool->next = NULL;
+}
+
+void audio_frame_pool_report(const audio_frame_pool_t *pool, const char *name)
+{
+    LOGI("%s帧池: 容量=%u x %uB, 使用中=%u, 峰值=%u, 取出=%llu, 耗尽=%llu", name, pool->count,
+         pool->frame_size, atomic_load(&pool->in_use), atomic_load(&pool->high_water),
+         atomic_load(&pool->acquired), atomic_load(&pool->exhausted));
+}
+
+audio_frame_t *audio_frame_acquire(audio_frame_pool_t *pool)
+{
+    audio_frame_t *frame = frame_pop(pool);
+    if (!frame) {
+        atomic_fetch_add_explicit(&pool->exhausted, 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    frame->len = 0;
+    frame->capture_us = 0;
+    atomic_store_explicit(&frame->refs, 1, memory_order_relaxed);
+
+    uint32_t in_use = atomic_fetch_add_explicit(&pool->in_use, 1, memory_order_relaxed) + 1;
+    uint32_t high = atomic_load_explicit(&pool->high_water, memory_order_relaxed);
+    while (in_use > high &&
+           !atomic_compare_exchange_weak_explicit(&pool->high_water, &high, in_use,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+    atomic_fetch_add_explicit(&pool->acquired, 1, memory_order_relaxed);
+    return frame;
+}
+
+void audio_frame_ref(audio_frame_t *frame)
+{
+    if (frame->pool) {
+        atomic_fetch_add_explicit(&frame->refs, 1, memory_order_relaxed);
+    }
+}
+
+void audio_frame_release(audio_frame_t *frame)
+{
+    audio_frame_pool_t *pool = frame->pool;
+
+    if (!pool || atomic_fetch_sub_explicit(&frame->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    atomic_fetch_sub_explicit(&pool->in_use, 1, memory_order_relaxed);
+    frame_push(pool, frame);
+}
+
+audio_frame_t *audio_frame_hold(audio_frame_t *frame, audio_frame_pool_t *pool)
+{
+    if (frame->pool) {
+        audio_frame_ref(frame);
+        return frame;
+    }
+    if (!pool || frame->len > pool->frame_size) {
+        return NULL;
+    }
+
+    audio_frame_t *copy = audio_frame_acquire(pool);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy->data, frame->data, frame->len);
+    copy->len = frame->len;
+    copy->capture_us = frame->capture_us;
+    return copy;
+}
@@ -0,0 +1,78 @@
+/*************************************************************
+ * File  :  audio_frame.h
+ * Module:  Preallocated, refcounted pool of cache-line-aligned
+ *          audio frame buffers.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_FRAME_H_
+#define _AUDIO_FRAME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "audio_ring.h"
+
+struct audio_frame_pool;
+
+typedef struct {
+    uint8_t *data;                  // 按 cache line 对齐(借用的外部内存除外)
+    uint32_t len;                   // 有效字节数
+    uint32_t capacity;              // data 可写的字节数
+    int64_t capture_us;             // 最后一个采样的采集时刻
+    struct audio_frame_pool *pool;  // NULL 表示借用的外部内存，只在回调期间有效
+    atomic_uint refs;
+    uint32_t index;
+} audio_frame_t;
+
+typedef struct audio_frame_pool {
+    audio_frame_t *frames;
+    atomic_uint *next;              // 空闲链表，下标 + 1，0 表示链尾
+    uint8_t *storage;
+    uint32_t count;
+    uint32_t frame_size;            // 每帧容量，向上对齐到 cache line
+
+    // 高 32 位为防 ABA 的版本号，低 32 位为栈顶下标 + 1
+    _Alignas(AUDIO_CACHE_LINE) atomic_ullong head;
+
+    _Alignas(AUDIO_CACHE_LINE) atomic_uint in_use;
+    atomic_uint high_water;         // in_use 的历史最大值
+    atomic_ullong acquired;         // 成功取出的次数
+    atomic_ullong exhausted;        // 池已空、取帧失败的次数
+} audio_frame_pool_t;
+
+// 启动时一次性分配并触碰全部缓冲区，之后取放都不再分配内存
+int audio_frame_pool_init(audio_frame_pool_t *pool, uint32_t count, uint32_t frame_bytes);
+void audio_frame_pool_deinit(audio_frame_pool_t *pool);
+void audio_frame_pool_report(const audio_frame_pool_t *pool, const char *name);
+
+// 取一帧，引用计数为 1；池已空时返回 NULL。任意线程可调用
+audio_frame_t *audio_frame_acquire(audio_frame_pool_t *pool);
+void audio_frame_ref(audio_frame_t *frame);
+// 引用计数归零时放回池中；对借用帧无操作
+void audio_frame_release(audio_frame_t *frame);
+
+// 需要在回调之后继续持有一帧时调用: 池中的帧只增加引用，
+// 借用帧才从 pool 取一帧拷贝过去。失败时返回 NULL
+audio_frame_t *audio_frame_hold(audio_frame_t *frame, audio_frame_pool_t *pool);
+
+// 把外部内存包装成借用帧
+static inline void audio_frame_borrow(audio_frame_t *frame, const void *data, size_t len,
+                                      int64_t capture_us)
+{
+    frame->data = (uint8_t *)data;
+    frame->len = (uint32_t)len;
+    frame->capacity = (uint32_t)len;
+    frame->capture_us = capture_us;
+    frame->pool = NULL;
+    atomic_init(&frame->refs, 1);
+    frame->index = 0;
+}
+
+#endif
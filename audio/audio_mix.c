@@ -0,0 +1,119 @@
+/*************************************************************
+ * File  :  audio_mix.c
+ * Module:  Saturating S16 mixing kernels.
+ *
+ * Each stream is scaled by its Q12 gain and added into the
+ * accumulator with a saturating add, 8 samples at a time on
+ * SSE2 and NEON; unity gain skips the multiply entirely.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <math.h>
+
+#include "audio_mix.h"
+#include "audio_simd.h"
+
+int32_t audio_mix_gain_q12(float gain)
+{
+    if (!(gain > 0.0f)) {
+        return 0;
+    }
+    float q = gain * AUDIO_MIX_GAIN_UNITY + 0.5f;
+    return q >= AUDIO_MIX_GAIN_MAX ? AUDIO_MIX_GAIN_MAX : (int32_t)q;
+}
+
+static void mix_unity(int16_t *acc, const int16_t *in, size_t n)
+{
+    size_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(acc + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(in + i));
+        _mm_storeu_si128((__m128i *)(acc + i), _mm_adds_epi16(a, b));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    for (; i + 8 <= n; i += 8) {
+        vst1q_s16(acc + i, vqaddq_s16(vld1q_s16(acc + i), vld1q_s16(in + i)));
+    }
+#endif
+    for (; i < n; i++) {
+        acc[i] = audio_sat16((int32_t)acc[i] + in[i]);
+    }
+}
+
+static void mix_gain(int16_t *acc, const int16_t *in, size_t n, int32_t gain)
+{
+    const int32_t round = 1 << (AUDIO_MIX_GAIN_SHIFT - 1);
+    size_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    __m128i g = _mm_set1_epi16((int16_t)gain);
+    __m128i r = _mm_set1_epi32(round);
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i lo = _mm_mullo_epi16(x, g);
+        __m128i hi = _mm_mulhi_epi16(x, g);
+        __m128i p0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), r), AUDIO_MIX_GAIN_SHIFT);
+        __m128i p1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), r), AUDIO_MIX_GAIN_SHIFT);
+        __m128i a = _mm_loadu_si128((const __m128i *)(acc + i));
+        _mm_storeu_si128((__m128i *)(acc + i), _mm_adds_epi16(a, _mm_packs_epi32(p0, p1)));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t x = vld1q_s16(in + i);
+        int32x4_t p0 = vmull_n_s16(vget_low_s16(x), (int16_t)gain);
+        int32x4_t p1 = vmull_n_s16(vget_high_s16(x), (int16_t)gain);
+        int16x8_t y = vcombine_s16(vqrshrn_n_s32(p0, AUDIO_MIX_GAIN_SHIFT),
+                                   vqrshrn_n_s32(p1, AUDIO_MIX_GAIN_SHIFT));
+        vst1q_s16(acc + i, vqaddq_s16(vld1q_s16(acc + i), y));
+    }
+#endif
+    for (; i < n; i++) {
+        int16_t y = audio_sat16((in[i] * gain + round) >> AUDIO_MIX_GAIN_SHIFT);
+        acc[i] = audio_sat16((int32_t)acc[i] + y);
+    }
+}
+
+void audio_mix_s16(int16_t *acc, const int16_t *in, size_t samples, int32_t gain_q12)
+{
+    if (gain_q12 == AUDIO_MIX_GAIN_UNITY) {
+        mix_unity(acc, in, samples);
+    } else if (gain_q12 > 0) {
+        mix_gain(acc, in, samples, gain_q12);
+    }
+}
+
+uint64_t audio_energy_s16(const int16_t *in, size_t samples)
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    // 相邻两个平方和最大为 2^31，按无符号 32 位处理后再扩展到 64 位累加
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; i + 8 <= samples; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i sq = _mm_madd_epi16(x, x);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum = lanes[0] + lanes[1];
+#elif defined(AUDIO_HAVE_NEON)
+    int64x2_t acc = vdupq_n_s64(0);
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t x = vld1q_s16(in + i);
+        acc = vpadalq_s32(acc, vmull_s16(vget_low_s16(x), vget_low_s16(x)));
+        acc = vpadalq_s32(acc, vmull_s16(vget_high_s16(x), vget_high_s16(x)));
+    }
+    sum = (uint64_t)(vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1));
+#endif
+    for (; i < samples; i++) {
+        sum += (uint64_t)((int32_t)in[i] * in[i]);
+    }
+    return sum;
+}
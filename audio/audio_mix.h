@@ -0,0 +1,30 @@
+/*************************************************************
+ * File  :  audio_mix.h
+ * Module:  Saturating S16 mixing kernels.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_MIX_H_
+#define _AUDIO_MIX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 增益为 Q12 定点数，4096 表示 1.0，上限约 8.0
+#define AUDIO_MIX_GAIN_SHIFT (12)
+#define AUDIO_MIX_GAIN_UNITY (1 << AUDIO_MIX_GAIN_SHIFT)
+#define AUDIO_MIX_GAIN_MAX (32767)
+
+int32_t audio_mix_gain_q12(float gain);
+
+// acc[i] = sat16(acc[i] + sat16(in[i] * gain))，samples 为采样总数
+void audio_mix_s16(int16_t *acc, const int16_t *in, size_t samples, int32_t gain_q12);
+
+// 采样平方和，用于在超过混音路数上限时挑选声音最大的几路
+uint64_t audio_energy_s16(const int16_t *in, size_t samples);
+
+#endif
@@ -0,0 +1,349 @@
+/*************************************************************
+ * File  :  audio_ns.c
+ * Module:  Short-time spectral noise suppressor.
+ *
+ * Input is cut into blocks of 2H samples with 50% overlap and a
+ * sqrt-Hann window on both analysis and synthesis, so the
+ * overlap-added output reconstructs the input exactly when every
+ * gain is one. H is the largest power of two with 2H no longer
+ * than a frame, which keeps the added latency (H plus the
+ * alignment between frame and hop) below one frame at any rate.
+ *
+ * Per bin, the noise power follows the input quickly while the
+ * bin stays close to the current estimate and only creeps up
+ * while it is well above it, so speech barely leaks into the
+ * estimate. The gain is the Wiener gain of the decision-directed
+ * a priori SNR (previous clean power blended with the current
+ * excess power), which keeps the residual noise smooth instead
+ * of "musical", and is floored at -max_db.
+ *
+ * All buffers are allocated at init; the per-bin gain, the
+ * windowing and the float to int16 conversion run four or eight
+ * samples at a time with SSE2/NEON.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio_ns.h"
+#include "audio_simd.h"
+#include "audio_ring.h"
+#include "log.h"
+
+#define NS_MIN_HOP (16)
+#define NS_MAX_HOP (512)
+// 开始的这些分块按平均值建立噪声估计
+#define NS_INIT_BLOCKS (20)
+// 功率低于噪声估计的这个倍数时认为是噪声，快速跟踪
+#define NS_PRESENCE (4.0f)
+#define NS_NOISE_FAST (0.05f)
+#define NS_NOISE_SLOW (0.002f)
+// 先验信噪比中上一分块的权重
+#define NS_DD (0.98f)
+// 功率下限(int16 幅度的平方)，避免除零
+#define NS_POW_FLOOR (1.0f)
+
+static float *ns_alloc(uint32_t count)
+{
+    void *p = NULL;
+    if (posix_memalign(&p, AUDIO_CACHE_LINE, (count ? count : 1) * sizeof(float)) != 0) {
+        return NULL;
+    }
+    memset(p, 0, count * sizeof(float));
+    return p;
+}
+
+static uint32_t ns_gcd(uint32_t a, uint32_t b)
+{
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+void audio_ns_set_max_db(audio_ns_t *ns, uint32_t max_db)
+{
+    if (max_db == 0) {
+        max_db = AUDIO_NS_DEFAULT_MAX_DB;
+    }
+    if (max_db > AUDIO_NS_MAX_DB) {
+        max_db = AUDIO_NS_MAX_DB;
+    }
+    ns->cfg.max_db = max_db;
+    ns->gain_min = powf(10.0f, -(float)max_db / 20.0f);
+}
+
+int audio_ns_init(audio_ns_t *ns, const audio_ns_config_t *cfg)
+{
+    memset(ns, 0, sizeof(*ns));
+    ns->cfg = *cfg;
+    audio_ns_set_max_db(ns, cfg->max_db);
+
+    uint32_t hop = NS_MAX_HOP;
+    while (hop >= NS_MIN_HOP && 2 * hop > cfg->frame_samples) {
+        hop >>= 1;
+    }
+    if (hop < NS_MIN_HOP) {
+        LOGE("降噪不支持每帧 %u 个采样", cfg->frame_samples);
+        return -1;
+    }
+    ns->hop = hop;
+    ns->bins = hop + 1;
+    ns->stride = (ns->bins + 3) & ~3u;
+    // 输出每次按 H 产生、按帧取走，预先垫上对齐所需的最少采样
+    uint32_t prefill = hop - ns_gcd(cfg->frame_samples, hop);
+    ns->latency = hop + prefill;
+    audio_ns_set_max_db(ns, ns->cfg.max_db);
+
+    uint32_t n = 2 * hop;
+    ns->window = ns_alloc(n);
+    ns->frame = ns_alloc(n);
+    ns->time_buf = ns_alloc(n);
+    ns->ola = ns_alloc(hop);
+    ns->re = ns_alloc(ns->stride);
+    ns->im = ns_alloc(ns->stride);
+    ns->noise = ns_alloc(ns->stride);
+    ns->clean = ns_alloc(ns->stride);
+    ns->out_cap = cfg->frame_samples + 3 * hop;
+    ns->out = calloc(ns->out_cap, sizeof(int16_t));
+    if (!ns->window || !ns->frame || !ns->time_buf || !ns->ola || !ns->re || !ns->im || !ns->noise ||
+        !ns->clean || !ns->out || audio_fft_init(&ns->fft, n) < 0) {
+        LOGE("无法分配降噪缓冲区");
+        audio_ns_deinit(ns);
+        return -1;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        ns->window[i] = (float)sqrt(0.5 - 0.5 * cos(2.0 * M_PI * i / n));
+    }
+    audio_ns_reset(ns);
+
+    LOGI("降噪初始化: 采样率=%u, 分块=%u, 最大衰减=%udB, 附加延迟=%u 采样(%.1fms) (%s)",
+         cfg->sample_rate, hop, ns->cfg.max_db, ns->latency,
+         ns->latency * 1000.0 / cfg->sample_rate, AUDIO_SIMD_NAME);
+    return 0;
+}
+
+void audio_ns_reset(audio_ns_t *ns)
+{
+    uint32_t hop = ns->hop;
+
+    memset(ns->frame, 0, 2 * hop * sizeof(float));
+    memset(ns->ola, 0, hop * sizeof(float));
+    memset(ns->noise, 0, ns->stride * sizeof(float));
+    memset(ns->clean, 0, ns->stride * sizeof(float));
+    ns->fill = 0;
+    ns->blocks = 0;
+    // 输出前垫上 latency - H 个静音，与 H 对齐
+    ns->out_len = ns->latency - hop;
+    memset(ns->out, 0, ns->out_len * sizeof(int16_t));
+}
+
+void audio_ns_deinit(audio_ns_t *ns)
+{
+    audio_fft_deinit(&ns->fft);
+    free(ns->window);
+    free(ns->frame);
+    free(ns->time_buf);
+    free(ns->ola);
+    free(ns->re);
+    free(ns->im);
+    free(ns->noise);
+    free(ns->clean);
+    free(ns->out);
+    memset(ns, 0, sizeof(*ns));
+}
+
+// out[i] = a[i] * b[i]，n 为 4 的倍数
+static void ns_mul(float *out, const float *a, const float *b, uint32_t n)
+{
+    uint32_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    for (; i + 4 <= n; i += 4) {
+        _mm_store_ps(out + i, _mm_mul_ps(_mm_load_ps(a + i), _mm_load_ps(b + i)));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(out + i, vmulq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = a[i] * b[i];
+    }
+}
+
+#if defined(AUDIO_HAVE_NEON)
+// ARMv7 NEON 没有除法，用倒数估计加两次牛顿迭代
+static inline float32x4_t ns_div_neon(float32x4_t a, float32x4_t b)
+{
+    float32x4_t r = vrecpeq_f32(b);
+    r = vmulq_f32(r, vrecpsq_f32(b, r));
+    r = vmulq_f32(r, vrecpsq_f32(b, r));
+    return vmulq_f32(a, r);
+}
+#endif
+
+// 更新噪声估计并对每个频点乘以增益
+static void ns_gains(audio_ns_t *ns, float rate_fast, float rate_slow)
+{
+    float *re = ns->re;
+    float *im = ns->im;
+    float *noise = ns->noise;
+    float *clean = ns->clean;
+    uint32_t k = 0;
+
+#if defined(AUDIO_HAVE_SSE2)
+    const __m128 presence = _mm_set1_ps(NS_PRESENCE);
+    const __m128 fast = _mm_set1_ps(rate_fast);
+    const __m128 slow = _mm_set1_ps(rate_slow);
+    const __m128 pow_floor = _mm_set1_ps(NS_POW_FLOOR);
+    const __m128 dd = _mm_set1_ps(NS_DD);
+    const __m128 dd_rest = _mm_set1_ps(1.0f - NS_DD);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 gmin = _mm_set1_ps(ns->gain_min);
+    for (; k + 4 <= ns->stride; k += 4) {
+        __m128 r = _mm_load_ps(re + k);
+        __m128 i = _mm_load_ps(im + k);
+        __m128 p = _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(i, i));
+        __m128 n = _mm_load_ps(noise + k);
+        __m128 below = _mm_cmplt_ps(p, _mm_mul_ps(n, presence));
+        __m128 rate = _mm_or_ps(_mm_and_ps(below, fast), _mm_andnot_ps(below, slow));
+        n = _mm_max_ps(_mm_add_ps(n, _mm_mul_ps(rate, _mm_sub_ps(p, n))), pow_floor);
+        _mm_store_ps(noise + k, n);
+        __m128 gamma = _mm_div_ps(p, n);
+        __m128 xi = _mm_add_ps(_mm_mul_ps(dd, _mm_div_ps(_mm_load_ps(clean + k), n)),
+                               _mm_mul_ps(dd_rest, _mm_max_ps(_mm_sub_ps(gamma, one), zero)));
+        __m128 g = _mm_max_ps(_mm_div_ps(xi, _mm_add_ps(one, xi)), gmin);
+        _mm_store_ps(clean + k, _mm_mul_ps(_mm_mul_ps(g, g), p));
+        _mm_store_ps(re + k, _mm_mul_ps(r, g));
+        _mm_store_ps(im + k, _mm_mul_ps(i, g));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    const float32x4_t presence = vdupq_n_f32(NS_PRESENCE);
+    const float32x4_t fast = vdupq_n_f32(rate_fast);
+    const float32x4_t slow = vdupq_n_f32(rate_slow);
+    const float32x4_t pow_floor = vdupq_n_f32(NS_POW_FLOOR);
+    const float32x4_t dd = vdupq_n_f32(NS_DD);
+    const float32x4_t dd_rest = vdupq_n_f32(1.0f - NS_DD);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t gmin = vdupq_n_f32(ns->gain_min);
+    for (; k + 4 <= ns->stride; k += 4) {
+        float32x4_t r = vld1q_f32(re + k);
+        float32x4_t i = vld1q_f32(im + k);
+        float32x4_t p = vmlaq_f32(vmulq_f32(r, r), i, i);
+        float32x4_t n = vld1q_f32(noise + k);
+        uint32x4_t below = vcltq_f32(p, vmulq_f32(n, presence));
+        float32x4_t rate = vbslq_f32(below, fast, slow);
+        n = vmaxq_f32(vmlaq_f32(n, rate, vsubq_f32(p, n)), pow_floor);
+        vst1q_f32(noise + k, n);
+        float32x4_t gamma = ns_div_neon(p, n);
+        float32x4_t xi = vmlaq_f32(vmulq_f32(dd, ns_div_neon(vld1q_f32(clean + k), n)),
+                                   dd_rest, vmaxq_f32(vsubq_f32(gamma, one), zero));
+        float32x4_t g = vmaxq_f32(ns_div_neon(xi, vaddq_f32(one, xi)), gmin);
+        vst1q_f32(clean + k, vmulq_f32(vmulq_f32(g, g), p));
+        vst1q_f32(re + k, vmulq_f32(r, g));
+        vst1q_f32(im + k, vmulq_f32(i, g));
+    }
+#endif
+    for (; k < ns->stride; k++) {
+        float p = re[k] * re[k] + im[k] * im[k];
+        float n = noise[k];
+        n += (p < n * NS_PRESENCE ? rate_fast : rate_slow) * (p - n);
+        n = n > NS_POW_FLOOR ? n : NS_POW_FLOOR;
+        noise[k] = n;
+        float gamma = p / n;
+        float xi = NS_DD * clean[k] / n + (1.0f - NS_DD) * (gamma > 1.0f ? gamma - 1.0f : 0.0f);
+        float g = xi / (1.0f + xi);
+        g = g > ns->gain_min ? g : ns->gain_min;
+        clean[k] = g * g * p;
+        re[k] *= g;
+        im[k] *= g;
+    }
+}
+
+// 合成窗加重叠相加，饱和转换为 int16 追加到输出
+static void ns_synthesize(audio_ns_t *ns)
+{
+    uint32_t hop = ns->hop;
+    const float *w = ns->window;
+    const float *y = ns->time_buf;
+    float *ola = ns->ola;
+    int16_t *out = ns->out + ns->out_len;
+    uint32_t i = 0;
+
+#if defined(AUDIO_HAVE_SSE2)
+    for (; i + 8 <= hop; i += 8) {
+        __m128 a = _mm_add_ps(_mm_mul_ps(_mm_load_ps(y + i), _mm_load_ps(w + i)), _mm_load_ps(ola + i));
+        __m128 b = _mm_add_ps(_mm_mul_ps(_mm_load_ps(y + i + 4), _mm_load_ps(w + i + 4)),
+                              _mm_load_ps(ola + i + 4));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+#elif defined(AUDIO_HAVE_NEON)
+    for (; i + 8 <= hop; i += 8) {
+        float32x4_t a = vmlaq_f32(vld1q_f32(ola + i), vld1q_f32(y + i), vld1q_f32(w + i));
+        float32x4_t b = vmlaq_f32(vld1q_f32(ola + i + 4), vld1q_f32(y + i + 4), vld1q_f32(w + i + 4));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(audio_neon_round_s32(a)), vqmovn_s32(audio_neon_round_s32(b))));
+    }
+#endif
+    for (; i < hop; i++) {
+        out[i] = audio_sat16((int32_t)lrintf(y[i] * w[i] + ola[i]));
+    }
+    ns_mul(ola, y + hop, w + hop, hop);
+    ns->out_len += hop;
+}
+
+static void ns_block(audio_ns_t *ns)
+{
+    uint32_t hop = ns->hop;
+    float rate_fast = NS_NOISE_FAST;
+    float rate_slow = NS_NOISE_SLOW;
+
+    if (ns->blocks < NS_INIT_BLOCKS) {
+        rate_fast = rate_slow = 1.0f / (ns->blocks + 1);
+    }
+    ns->blocks++;
+
+    ns_mul(ns->time_buf, ns->frame, ns->window, 2 * hop);
+    audio_fft_forward(&ns->fft, ns->time_buf, ns->re, ns->im);
+    ns_gains(ns, rate_fast, rate_slow);
+    audio_fft_inverse(&ns->fft, ns->re, ns->im, ns->time_buf);
+    ns_synthesize(ns);
+    memcpy(ns->frame, ns->frame + hop, hop * sizeof(float));
+}
+
+void audio_ns_process(audio_ns_t *ns, int16_t *data, uint32_t samples)
+{
+    uint32_t hop = ns->hop;
+    uint32_t pos = 0;
+
+    if (samples != ns->cfg.frame_samples) {
+        return;
+    }
+    // 先把整帧输入取走再回写输出，二者共用 data
+    while (pos < samples) {
+        uint32_t n = hop - ns->fill < samples - pos ? hop - ns->fill : samples - pos;
+        float *dst = ns->frame + hop + ns->fill;
+        for (uint32_t i = 0; i < n; i++) {
+            dst[i] = data[pos + i];
+        }
+        ns->fill += n;
+        pos += n;
+        if (ns->fill == hop) {
+            ns_block(ns);
+            ns->fill = 0;
+        }
+    }
+
+    memcpy(data, ns->out, samples * sizeof(int16_t));
+    ns->out_len -= samples;
+    memmove(ns->out, ns->out + samples, ns->out_len * sizeof(int16_t));
+}
@@ -0,0 +1,64 @@
+/*************************************************************
+ * File  :  audio_ns.h
+ * Module:  Short-time spectral noise suppressor.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_NS_H_
+#define _AUDIO_NS_H_
+
+#include <stdint.h>
+
+#include "audio_fft.h"
+
+#define AUDIO_NS_DEFAULT_MAX_DB (15)
+#define AUDIO_NS_MAX_DB (40)
+
+typedef struct {
+    uint32_t sample_rate;       // 单声道
+    uint32_t frame_samples;     // 每次处理的采样数
+    uint32_t max_db;            // 单个频点的最大衰减，0 表示默认值
+} audio_ns_config_t;
+
+typedef struct {
+    audio_ns_config_t cfg;
+    audio_fft_t fft;
+    uint32_t hop;               // 分析步长 H，窗长 2H，50% 重叠
+    uint32_t bins;              // H + 1
+    uint32_t stride;            // 按 4 对齐的频点数组长度
+    uint32_t latency;           // 附加延迟(采样)
+    float gain_min;
+
+    float *window;              // sqrt-Hann，分析与合成共用
+    float *frame;               // 最近 2H 个输入采样，后 H 个中已有 fill 个
+    uint32_t fill;
+    float *time_buf;
+    float *ola;                 // 上一分块合成结果的后半段
+    float *re;
+    float *im;
+    float *noise;               // 噪声功率谱估计
+    float *clean;               // 上一分块增强后的功率谱，用于先验信噪比
+    uint32_t blocks;            // 已处理的分块数
+
+    int16_t *out;               // 待输出的采样
+    uint32_t out_len;
+    uint32_t out_cap;
+} audio_ns_t;
+
+int audio_ns_init(audio_ns_t *ns, const audio_ns_config_t *cfg);
+void audio_ns_deinit(audio_ns_t *ns);
+
+// 清空缓冲和噪声估计，回到刚初始化时的状态
+void audio_ns_reset(audio_ns_t *ns);
+
+// 修改最大衰减，0 表示默认值，下一分块起生效
+void audio_ns_set_max_db(audio_ns_t *ns, uint32_t max_db);
+
+// 原地处理，samples 必须等于 frame_samples；输出比输入晚 latency 个采样
+void audio_ns_process(audio_ns_t *ns, int16_t *data, uint32_t samples);
+
+#endif
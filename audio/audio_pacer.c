@@ -0,0 +1,77 @@
+/*************************************************************
+ * File  :  audio_pacer.c
+ * Module:  Drift-free absolute-time frame pacer.
+ *
+ * Every deadline is computed as start + n * interval and slept
+ * to with clock_nanosleep(TIMER_ABSTIME), so wakeup lateness
+ * never accumulates into the long-term frame rate.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <errno.h>
+#include <time.h>
+
+#include "audio_pacer.h"
+#include "audio_time.h"
+#include "log.h"
+
+// 落后超过这么多个节拍(例如系统挂起)时不再追赶，直接重新对齐
+#define PACER_MAX_BEHIND_TICKS (10)
+
+void audio_pacer_init(audio_pacer_t *pacer, uint32_t interval_us)
+{
+    pacer->interval_us = interval_us;
+    pacer->start_ns = audio_now_ns();
+    pacer->tick = 0;
+    pacer->ticks = 0;
+    pacer->resyncs = 0;
+    pacer->overshoot_ns_sum = 0;
+    pacer->overshoot_ns_max = 0;
+    pacer->last_overshoot_ns = 0;
+}
+
+int64_t audio_pacer_wait(audio_pacer_t *pacer)
+{
+    int64_t interval_ns = (int64_t)pacer->interval_us * 1000;
+    int64_t deadline_ns = pacer->start_ns + (int64_t)pacer->tick * interval_ns;
+    int64_t now_ns = audio_now_ns();
+
+    if (now_ns - deadline_ns > PACER_MAX_BEHIND_TICKS * interval_ns) {
+        pacer->start_ns = now_ns;
+        pacer->tick = 0;
+        pacer->resyncs++;
+        deadline_ns = now_ns;
+    }
+
+    struct timespec ts = {
+        .tv_sec = deadline_ns / 1000000000,
+        .tv_nsec = deadline_ns % 1000000000,
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+
+    int64_t overshoot_ns = audio_now_ns() - deadline_ns;
+    pacer->last_overshoot_ns = overshoot_ns > 0 ? (uint32_t)overshoot_ns : 0;
+    if (overshoot_ns > 0) {
+        pacer->overshoot_ns_sum += overshoot_ns;
+        if (overshoot_ns > pacer->overshoot_ns_max) {
+            pacer->overshoot_ns_max = (uint32_t)overshoot_ns;
+        }
+    }
+    pacer->tick++;
+    pacer->ticks++;
+    return deadline_ns / 1000;
+}
+
+void audio_pacer_report(const audio_pacer_t *pacer, const char *name)
+{
+    uint64_t ticks = pacer->ticks ? pacer->ticks : 1;
+
+    LOGI("%s节拍统计: 间隔=%uus, 节拍=%llu, 重新对齐=%llu, 唤醒滞后 平均=%.1fus 最大=%.1fus", name,
+         pacer->interval_us, (unsigned long long)pacer->ticks, (unsigned long long)pacer->resyncs,
+         pacer->overshoot_ns_sum / 1000.0 / ticks, pacer->overshoot_ns_max / 1000.0);
+}
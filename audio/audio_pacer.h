@@ -0,0 +1,34 @@
+/*************************************************************
+ * File  :  audio_pacer.h
+ * Module:  Drift-free absolute-time frame pacer.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_PACER_H_
+#define _AUDIO_PACER_H_
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t interval_us;
+    int64_t start_ns;       // 第 0 个节拍的时刻
+    uint64_t tick;          // 下一个节拍相对 start_ns 的序号
+    uint64_t ticks;         // 累计节拍数
+    uint64_t resyncs;       // 落后太多而重新对齐的次数
+    uint64_t overshoot_ns_sum;
+    uint32_t overshoot_ns_max;
+    uint32_t last_overshoot_ns;     // 最近一次唤醒的滞后
+} audio_pacer_t;
+
+void audio_pacer_init(audio_pacer_t *pacer, uint32_t interval_us);
+
+// 睡眠到下一个节拍的绝对时刻，返回该节拍的理论时刻(us)
+int64_t audio_pacer_wait(audio_pacer_t *pacer);
+
+void audio_pacer_report(const audio_pacer_t *pacer, const char *name);
+
+#endif
@@ -0,0 +1,879 @@
+/*************************************************************
+ * File  :  audio_playout.c
+ * Module:  Per-uid jitter buffers, mixer and dedicated playback
+ *          thread.
+ *
+ * The SDK callback only copies into a preallocated SPSC ring
+ * owned by the sending uid. A dedicated thread paced by the
+ * sound card takes at most one frame from every primed uid,
+ * mixes them with per-uid gain and writes exactly one period,
+ * keeping each ring around an adaptive target derived from
+ * that uid's measured arrival jitter.
+ * Producers only ever claim free slots. When the table is full
+ * they ask the playback thread to retire idle streams, and it
+ * does so with a compare-and-swap against the state it checked,
+ * which every push changes, so a ring never gains a second
+ * producer.
+ *
+ * With concealment enabled every uid instead renders through
+ * audio_plc: an empty ring is bridged with pitch-repeated audio
+ * rather than silence, and a smoothed buffer level above or below
+ * the target drops or inserts one pitch period per period, so the
+ * latency follows the jitter without hard drops or re-priming.
+ *
+ * With drift compensation the conversion to the device format
+ * always goes through the resampler. Its ratio cancels the
+ * measured drift of the sound card clock, and a slow feedback
+ * on how far the buffers sit above or below their targets
+ * absorbs the sender clocks, so the queues stay bounded however
+ * long the call runs.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "audio_playout.h"
+#include "audio_time.h"
+#include "audio_device.h"
+#include "audio_mix.h"
+#include "audio_simd.h"
+#include "audio_stats.h"
+#include "log.h"
+
+#define PLAYOUT_BYTES_PER_SAMPLE (2)
+// 缓冲水位的平滑系数，约 10 个周期
+#define PLAYOUT_LEVEL_SMOOTH (0.1f)
+// sent_ts 显示中间缺了不超过这么多帧时，在原位置补上隐藏信号
+#define PLAYOUT_MAX_GAP_FRAMES (3)
+// 时钟偏差补偿: 水位误差的平滑系数(约 1 秒)，每毫秒误差对应的比例调整及其上限
+#define PLAYOUT_DRIFT_SMOOTH (0.01f)
+#define PLAYOUT_DRIFT_PPM_PER_MS (5.0)
+#define PLAYOUT_DRIFT_MAX_PPM (200.0)
+
+static uint32_t clamp_u32(uint32_t v, uint32_t lo, uint32_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// 按 RFC 3550 的方式平滑到达间隔抖动，并据此更新目标缓冲深度
+static void playout_update_jitter(audio_playout_t *po, audio_playout_stream_t *st,
+                                  int64_t now_us, size_t len)
+{
+    const audio_playout_config_t *cfg = &po->cfg;
+    int64_t frame_us = (int64_t)len * 1000000 /
+                       (cfg->sample_rate * cfg->channels * PLAYOUT_BYTES_PER_SAMPLE);
+
+    if (st->last_arrival_us != 0) {
+        int64_t d = now_us - st->last_arrival_us - frame_us;
+        if (d < 0) {
+            d = -d;
+        }
+        st->jitter_us += (d - st->jitter_us) / 16;
+    }
+    st->last_arrival_us = now_us;
+
+    uint32_t min_ms = atomic_load_explicit(&po->jitter_min_ms, memory_order_relaxed);
+    uint32_t max_ms = atomic_load_explicit(&po->jitter_max_ms, memory_order_relaxed);
+    uint32_t target = cfg->frame_ms + (uint32_t)(4 * st->jitter_us / 1000);
+    // 上下限在运行中修改时两者可能暂时不一致，以下限为准
+    target = clamp_u32(target, min_ms, max_ms > min_ms ? max_ms : min_ms);
+    atomic_store_explicit(&st->target_ms, target, memory_order_relaxed);
+    atomic_store_explicit(&po->stats.jitter_us, (uint32_t)st->jitter_us, memory_order_relaxed);
+    atomic_store_explicit(&po->stats.target_ms, target, memory_order_relaxed);
+}
+
+static int32_t playout_lookup_gain(audio_playout_t *po, uint32_t uid)
+{
+    for (int i = 0; i < AUDIO_PLAYOUT_MAX_STREAMS; i++) {
+        uint64_t entry = atomic_load_explicit(&po->gains[i], memory_order_relaxed);
+        if (entry != 0 && (uint32_t)(entry >> 32) == uid) {
+            return (int32_t)(uint32_t)entry - 1;
+        }
+    }
+    return AUDIO_MIX_GAIN_UNITY;
+}
+
+// 只有写入该用户的生产者会把它从 ACTIVE 改为 PUSHING，找到时返回看到的 state 供其比较交换
+static audio_playout_stream_t *playout_find_stream(audio_playout_t *po, uint32_t conn_id, uint32_t uid,
+                                                   uint32_t *state)
+{
+    for (int i = 0; i < AUDIO_PLAYOUT_MAX_STREAMS; i++) {
+        audio_playout_stream_t *st = &po->streams[i];
+        uint32_t s = atomic_load_explicit(&st->state, memory_order_acquire);
+        if (AUDIO_STREAM_STATE(s) == AUDIO_STREAM_ACTIVE && st->conn_id == conn_id && st->uid == uid) {
+            *state = s;
+            return st;
+        }
+    }
+    return NULL;
+}
+
+// 生产者只认领空闲位置；认领后处于 PUSHING，由本次写入结束时置为 ACTIVE
+static audio_playout_stream_t *playout_claim_stream(audio_playout_t *po, uint32_t conn_id, uint32_t uid,
+                                                    int64_t now_us)
+{
+    for (int i = 0; i < AUDIO_PLAYOUT_MAX_STREAMS; i++) {
+        audio_playout_stream_t *st = &po->streams[i];
+        uint32_t expected = atomic_load_explicit(&st->state, memory_order_relaxed);
+        if (AUDIO_STREAM_STATE(expected) != AUDIO_STREAM_FREE ||
+            !atomic_compare_exchange_strong_explicit(&st->state, &expected,
+                                                     (expected & ~AUDIO_STREAM_STATE_MASK) | AUDIO_STREAM_CLAIMING,
+                                                     memory_order_acquire, memory_order_relaxed)) {
+            continue;
+        }
+        st->conn_id = conn_id;
+        st->uid = uid;
+        st->last_arrival_us = 0;
+        st->jitter_us = 0;
+        st->has_transit = false;
+        atomic_store_explicit(&st->gain_q12, playout_lookup_gain(po, uid), memory_order_relaxed);
+        atomic_store_explicit(&st->last_push_us, now_us, memory_order_relaxed);
+        atomic_store_explicit(&st->target_ms, atomic_load_explicit(&po->jitter_min_ms, memory_order_relaxed),
+                              memory_order_relaxed);
+        atomic_store_explicit(&st->starved, false, memory_order_relaxed);
+        atomic_store_explicit(&st->state, (expected & ~AUDIO_STREAM_STATE_MASK) | AUDIO_STREAM_PUSHING,
+                              memory_order_release);
+
+        atomic_fetch_add_explicit(&po->stats.streams_joined, 1, memory_order_relaxed);
+        LOGI("[conn-%u] 用户 %u 加入混音", conn_id, uid);
+        return st;
+    }
+    return NULL;
+}
+
+// 写入结束，写入次数加一，播放线程之前做的空闲检查随之失效
+static void playout_leave_stream(audio_playout_stream_t *st)
+{
+    uint32_t s = atomic_load_explicit(&st->state, memory_order_relaxed);
+
+    atomic_store_explicit(&st->state, ((s & ~AUDIO_STREAM_STATE_MASK) + AUDIO_STREAM_GEN_ONE) | AUDIO_STREAM_ACTIVE,
+                          memory_order_release);
+}
+
+// 按 sent_ts 计算相邻两帧传输时间之差 |D(i-1,i)|，16 位毫秒时间戳回绕安全
+static void playout_record_transit(audio_playout_stream_t *st, int64_t now_us, uint16_t sent_ts)
+{
+    uint16_t transit = (uint16_t)(now_us / 1000) - sent_ts;
+
+    if (st->has_transit) {
+        int16_t d = (int16_t)(transit - st->last_transit_ms);
+        audio_stats_record(AUDIO_STAT_ARRIVAL_JITTER, (uint64_t)(d < 0 ? -d : d) * 1000);
+    }
+    st->last_transit_ms = transit;
+    st->has_transit = true;
+}
+
+int audio_playout_push(audio_playout_t *po, uint32_t conn_id, uint32_t uid, uint16_t sent_ts,
+                       const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    int64_t now_us = audio_now_us();
+
+    atomic_fetch_add_explicit(&po->stats.frames_in, 1, memory_order_relaxed);
+
+    // 标记为正在写入，播放线程不会在写入期间回收；刚被回收时按新用户认领空闲位置
+    uint32_t state;
+    audio_playout_stream_t *st = playout_find_stream(po, conn_id, uid, &state);
+    if (st && !atomic_compare_exchange_strong_explicit(&st->state, &state,
+                                                       (state & ~AUDIO_STREAM_STATE_MASK) | AUDIO_STREAM_PUSHING,
+                                                       memory_order_acquire, memory_order_relaxed)) {
+        st = NULL;
+    }
+    if (!st) {
+        st = playout_claim_stream(po, conn_id, uid, now_us);
+        if (!st) {
+            atomic_store_explicit(&po->retire_idle, true, memory_order_relaxed);
+            atomic_fetch_add_explicit(&po->stats.streams_rejected, 1, memory_order_relaxed);
+            return -1;
+        }
+    }
+
+    playout_update_jitter(po, st, now_us, len);
+    playout_record_transit(st, now_us, sent_ts);
+    atomic_store_explicit(&st->last_push_us, now_us, memory_order_relaxed);
+    if (atomic_exchange_explicit(&st->starved, false, memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&po->stats.frames_late, 1, memory_order_relaxed);
+    }
+
+    while (len > 0) {
+        audio_slot_meta_t *meta;
+        uint8_t *slot = audio_ring_write_begin(&st->ring, &meta);
+        if (!slot) {
+            playout_leave_stream(st);
+            atomic_fetch_add_explicit(&po->stats.frames_dropped, 1, memory_order_relaxed);
+            return -1;
+        }
+        size_t n = len < po->frame_bytes ? len : po->frame_bytes;
+        memcpy(slot, p, n);
+        meta->len = n;
+        meta->uid = uid;
+        meta->sent_ts = sent_ts;
+        meta->ts_us = now_us;
+        audio_ring_write_commit(&st->ring);
+        p += n;
+        len -= n;
+    }
+    playout_leave_stream(st);
+    return 0;
+}
+
+int audio_playout_set_gain(audio_playout_t *po, uint32_t uid, float gain)
+{
+    int32_t gain_q12 = audio_mix_gain_q12(gain);
+    uint64_t entry = ((uint64_t)uid << 32) | (uint32_t)(gain_q12 + 1);
+    int free_idx = -1;
+    int idx = -1;
+
+    for (int i = 0; i < AUDIO_PLAYOUT_MAX_STREAMS && idx < 0; i++) {
+        uint64_t cur = atomic_load_explicit(&po->gains[i], memory_order_relaxed);
+        if (cur == 0) {
+            free_idx = free_idx < 0 ? i : free_idx;
+        } else if ((uint32_t)(cur >> 32) == uid) {
+            idx = i;
+        }
+    }
+    idx = idx >= 0 ? idx : free_idx;
+    if (idx < 0) {
+        LOGW("增益表已满，忽略用户 %u 的增益设置", uid);
+        return -1;
+    }
+    atomic_store_explicit(&po->gains[idx], entry, memory_order_relaxed);
+
+    // 该用户在每个连接上的缓冲都使用这个增益
+    for (int i = 0; i < AUDIO_PLAYOUT_MAX_STREAMS; i++) {
+        audio_playout_stream_t *st = &po->streams[i];
+        audio_stream_state_e state = AUDIO_STREAM_STATE(atomic_load_explicit(&st->state, memory_order_acquire));
+        if ((state == AUDIO_STREAM_ACTIVE || state == AUDIO_STREAM_PUSHING) && st->uid == uid) {
+            atomic_store_explicit(&st->gain_q12, gain_q12, memory_order_relaxed);
+        }
+    }
+    return 0;
+}
+
+static void playout_add_wake_late(audio_playout_t *po, uint32_t late_us)
+{
+    audio_stats_record(AUDIO_STAT_PLAYOUT_WAKEUP, late_us);
+    atomic_fetch_add_explicit(&po->stats.wake_late_sum_us, late_us, memory_order_relaxed);
+    if (late_us > atomic_load_explicit(&po->stats.wake_late_max_us, memory_order_relaxed)) {
+        atomic_store_explicit(&po->stats.wake_late_max_us, late_us, memory_order_relaxed);
+    }
+}
+
+// mmap 方式: 等设备空出位置后直接拷入 DMA 缓冲区，省去 writei 的系统调用
+static snd_pcm_sframes_t playout_mmap_write(audio_playout_t *po, const uint8_t *data,
+                                            snd_pcm_uframes_t frames)
+{
+    snd_pcm_t *handle = po->cfg.handle;
+    const snd_pcm_channel_area_t *areas;
+    snd_pcm_uframes_t offset;
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(handle);
+    int err;
+
+    if (avail < 0) {
+        return avail;
+    }
+    if (avail == 0) {
+        // 缓冲区已满: 首次填满时启动设备，之后等待空出一个周期
+        if (snd_pcm_state(handle) == SND_PCM_STATE_PREPARED) {
+            err = snd_pcm_start(handle);
+            if (err < 0) {
+                return err;
+            }
+        }
+        err = snd_pcm_wait(handle, 4 * po->cfg.frame_ms);
+        return err < 0 ? err : 0;
+    }
+
+    snd_pcm_uframes_t n = frames < (snd_pcm_uframes_t)avail ? frames : (snd_pcm_uframes_t)avail;
+    err = snd_pcm_mmap_begin(handle, &areas, &offset, &n);
+    if (err < 0) {
+        return err;
+    }
+    memcpy(audio_mmap_ptr(areas, offset), data, n * audio_frame_bytes(&po->cfg.device));
+    return snd_pcm_mmap_commit(handle, offset, n);
+}
+
+// 已播出的帧数 = 已写入 - (缓冲区大小 - 可写空间)，缓冲区大小是常数，不影响斜率，省去；
+// 设备启动前硬件指针不动，此时的位置不能参与拟合
+static void playout_observe_drift(audio_playout_t *po)
+{
+    if (audio_drift_due(&po->drift, audio_now_us()) &&
+        snd_pcm_state(po->cfg.handle) == SND_PCM_STATE_RUNNING) {
+        audio_drift_sample(&po->drift, po->cfg.handle, po->device_pos);
+    }
+}
+
+static void playout_write_device(audio_playout_t *po, const void *data, snd_pcm_uframes_t frames)
+{
+    const uint8_t *p = data;
+    uint32_t bytes_per_frame = audio_frame_bytes(&po->cfg.device);
+    int64_t start_ns = audio_now_ns();
+
+    while (frames > 0) {
+        snd_pcm_sframes_t written = po->cfg.mmap ? playout_mmap_write(po, p, frames)
+                                                 : snd_pcm_writei(po->cfg.handle, p, frames);
+        if (written < 0) {
+            audio_drift_reset(&po->drift);
+            if (audio_xrun_recover(&po->xrun, (int)written) == 0) {
+                // 恢复后丢弃本帧剩余部分，不把积压带到设备上
+                return;
+            }
+            LOGE("写入音频数据失败: %s", snd_strerror(written));
+            usleep(po->cfg.frame_ms * 1000);
+            return;
+        }
+        p += written * bytes_per_frame;
+        frames -= written;
+        po->device_pos += written;
+    }
+    atomic_fetch_add_explicit(&po->stats.io_ns_sum, audio_now_ns() - start_ns, memory_order_relaxed);
+    playout_observe_drift(po);
+
+    // 阻塞写入一返回就立即填满设备，此时仍空着的部分就是线程被唤醒晚了的那段时间
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(po->cfg.handle);
+    if (avail >= 0 && snd_pcm_state(po->cfg.handle) == SND_PCM_STATE_RUNNING) {
+        playout_add_wake_late(po, (uint32_t)((uint64_t)avail * 1000000 / po->cfg.device.rate));
+    }
+}
+
+// 写完一个周期后设备中尚未播出的数据量，即本周期数据到达扬声器还需的时间；
+// 同一个测量值也给出本周期最后一个采样的播出时刻，供回声消除对齐参考
+static void playout_record_delay(audio_playout_t *po, const uint8_t *data, size_t len)
+{
+    bool stats = atomic_load_explicit(&audio_stats_enabled, memory_order_relaxed);
+    int64_t delay_us;
+
+    if (!po->cfg.aec && !stats) {
+        return;
+    }
+    if (po->cfg.handle) {
+        snd_pcm_sframes_t delay;
+        if (snd_pcm_delay(po->cfg.handle, &delay) != 0 || delay < 0) {
+            return;
+        }
+        delay_us = (int64_t)delay * 1000000 / po->cfg.device.rate;
+        if (stats) {
+            audio_stats_record(AUDIO_STAT_PLAYOUT_DELAY, (uint64_t)delay_us);
+        }
+    } else {
+        // 无声卡时节拍器刚放行，本帧在接下来的一帧时长内"播出"
+        delay_us = po->cfg.frame_ms * 1000;
+    }
+    if (po->cfg.aec) {
+        audio_aec_push_ref(po->cfg.aec, (const int16_t *)data, len / PLAYOUT_BYTES_PER_SAMPLE,
+                           audio_now_us() + delay_us);
+    }
+}
+
+// 声卡偏差前馈，水位误差反馈；正的比例消耗更多输入，用来追赶积压
+static void playout_adjust_rate(audio_playout_t *po)
+{
+    double ppm = po->depth_err_ms * PLAYOUT_DRIFT_PPM_PER_MS;
+
+    ppm = ppm > PLAYOUT_DRIFT_MAX_PPM ? PLAYOUT_DRIFT_MAX_PPM : ppm;
+    ppm = ppm < -PLAYOUT_DRIFT_MAX_PPM ? -PLAYOUT_DRIFT_MAX_PPM : ppm;
+    audio_convert_set_ppm(&po->convert, ppm - audio_drift_ppm(&po->drift));
+}
+
+// 把一帧接收格式的音频转换为设备格式后写入
+static void playout_write(audio_playout_t *po, const uint8_t *data, size_t len)
+{
+    uint32_t frames = len / (po->cfg.channels * PLAYOUT_BYTES_PER_SAMPLE);
+
+    if (po->cfg.on_period) {
+        po->cfg.on_period(po->cfg.ctx, data, len);
+    }
+    if (!po->cfg.handle) {
+        audio_pacer_wait(&po->pacer);
+        playout_add_wake_late(po, po->pacer.last_overshoot_ns / 1000);
+    } else if (po->convert.passthrough) {
+        playout_write_device(po, data, frames);
+    } else {
+        if (po->cfg.drift_comp) {
+            playout_adjust_rate(po);
+        }
+        const uint8_t *in = data;
+        while (frames > 0) {
+            uint32_t pushed = audio_convert_push(&po->convert, in, frames);
+            in += (size_t)pushed * po->cfg.channels * PLAYOUT_BYTES_PER_SAMPLE;
+            frames -= pushed;
+            uint32_t avail = audio_convert_avail(&po->convert);
+            playout_write_device(po, audio_convert_data(&po->convert), avail);
+            audio_convert_consume(&po->convert, avail);
+        }
+    }
+    playout_record_delay(po, data, len);
+}
+
+typedef struct {
+    audio_playout_stream_t *st;
+    const int16_t *data;
+    uint32_t len;
+    uint64_t energy;
+    bool slot;                      // data 借用抖动缓冲的槽位，用完后归还
+} playout_input_t;
+
+static void playout_input_done(playout_input_t *in)
+{
+    if (in->slot) {
+        audio_ring_read_commit(&in->st->ring);
+    }
+}
+
+// 清空残留数据后把位置归还给生产者
+static void playout_release_stream(audio_playout_t *po, audio_playout_stream_t *st, uint32_t state)
+{
+    while (audio_ring_read_begin(&st->ring, NULL)) {
+        audio_ring_read_commit(&st->ring);
+    }
+    LOGI("[conn-%u] 用户 %u 离开混音: 共混音 %llu 帧", st->conn_id, st->uid, (unsigned long long)st->frames_mixed);
+    st->primed = false;
+    st->frames_mixed = 0;
+    st->has_sent_ts = false;
+    if (po->plc_ready) {
+        audio_plc_reset(&st->plc);
+    }
+    atomic_store_explicit(&st->state, (state & ~AUDIO_STREAM_STATE_MASK) | AUDIO_STREAM_FREE, memory_order_release);
+}
+
+// 空闲检查读到的 last_push_us 属于 state 对应的那次写入；之后生产者开始或完成写入都会改变 state，
+// 比较交换随之失败，所以生产者正在写入的、刚写入过的用户都不会被回收
+static bool playout_retire_stream(audio_playout_t *po, audio_playout_stream_t *st, uint32_t state, int64_t now_us)
+{
+    if (AUDIO_STREAM_STATE(state) != AUDIO_STREAM_ACTIVE ||
+        now_us - atomic_load_explicit(&st->last_push_us, memory_order_relaxed) <=
+            AUDIO_PLAYOUT_STREAM_IDLE_MS * 1000LL) {
+        return false;
+    }
+    uint32_t retiring = (state & ~AUDIO_STREAM_STATE_MASK) | AUDIO_STREAM_RETIRING;
+    if (!atomic_compare_exchange_strong_explicit(&st->state, &state, retiring, memory_order_acquire,
+                                                 memory_order_relaxed)) {
+        return false;
+    }
+    playout_release_stream(po, st, retiring);
+    return true;
+}
+
+// 启用丢包隐藏时从抖动缓冲取数据送入 plc，产生恰好一帧输出；隐藏已完全淡出时返回 false
+static bool playout_render_stream(audio_playout_t *po, audio_playout_stream_t *st, uint32_t depth,
+                                  uint32_t target)
+{
+    audio_playout_stats_t *stats = &po->stats;
+    audio_plc_t *plc = &st->plc;
+    uint32_t frame = po->frame_samples;
+    uint32_t sample_bytes = po->cfg.channels * PLAYOUT_BYTES_PER_SAMPLE;
+
+    // 水位为抖动缓冲中的帧加上 plc 中待播出的采样，高于目标一帧时压缩，低于目标半帧时拉伸
+    float level = (float)depth * frame + audio_plc_pending(plc);
+    st->level += (level - st->level) * PLAYOUT_LEVEL_SMOOTH;
+    bool compress = st->level > (float)(target + 1) * frame;
+    bool expand = st->level < ((float)target - 0.5f) * frame;
+
+    // 压缩需要两个最长周期的数据，多取一帧
+    uint32_t want = compress ? frame + 2 * plc->max_lag : frame;
+    while (audio_plc_pending(plc) < want) {
+        const audio_slot_meta_t *meta;
+        const void *slot = audio_ring_read_begin(&st->ring, &meta);
+        if (!slot) {
+            break;
+        }
+        uint32_t len = meta->len < po->frame_bytes ? meta->len : po->frame_bytes;
+        uint32_t samples = len / sample_bytes;
+
+        // 发送端每帧的时间戳间隔为一个帧长，多出的整帧就是丢失的帧
+        int16_t gap = (int16_t)(meta->sent_ts - st->last_sent_ts) - (int16_t)po->cfg.frame_ms;
+        uint32_t lost = gap > 0 ? (gap + po->cfg.frame_ms / 2) / po->cfg.frame_ms : 0;
+        uint32_t room = plc->cap - plc->len;
+        if (st->has_sent_ts && lost > 0 && lost <= PLAYOUT_MAX_GAP_FRAMES && room > samples) {
+            uint32_t n = lost * frame < room - samples ? lost * frame : room - samples;
+            if (!plc->concealing) {
+                atomic_fetch_add_explicit(&stats->plc_events, 1, memory_order_relaxed);
+            }
+            audio_plc_conceal(plc, n);
+            atomic_fetch_add_explicit(&stats->plc_samples, n, memory_order_relaxed);
+        }
+        st->last_sent_ts = meta->sent_ts;
+        st->has_sent_ts = true;
+
+        audio_plc_push(plc, slot, samples);
+        audio_ring_read_commit(&st->ring);
+    }
+
+    bool audible = true;
+    uint32_t pending = audio_plc_pending(plc);
+    if (pending < frame) {
+        if (!plc->concealing) {
+            atomic_fetch_add_explicit(&stats->plc_events, 1, memory_order_relaxed);
+        }
+        audible = audio_plc_conceal(plc, frame - pending);
+        atomic_fetch_add_explicit(&stats->plc_samples, frame - pending, memory_order_relaxed);
+        atomic_store_explicit(&st->starved, true, memory_order_relaxed);
+    } else if (compress) {
+        atomic_fetch_add_explicit(&stats->compress_samples, audio_plc_compress(plc, frame), memory_order_relaxed);
+    } else if (expand) {
+        atomic_fetch_add_explicit(&stats->expand_samples, audio_plc_expand(plc), memory_order_relaxed);
+    }
+    audio_plc_read(plc, st->out, frame);
+    return audible;
+}
+
+// 从每个已积累到目标深度的用户取一帧
+static uint32_t playout_collect(audio_playout_t *po, playout_input_t *inputs)
+{
+    const audio_playout_config_t *cfg = &po->cfg;
+    uint32_t max_frames = cfg->jitter_max_ms / cfg->frame_ms;
+    uint32_t n = 0;
+    uint32_t active = 0;
+    uint32_t max_depth = 0;
+    uint32_t primed = 0;
+    float err_ms = 0.0f;
+    // 用户表满时回收长时间没有数据的用户，只在播放线程中进行
+    bool retire = atomic_exchange_explicit(&po->retire_idle, false, memory_order_relaxed);
+    int64_t now_us = retire ? audio_now_us() : 0;
+
+    for (int i = 0; i < AUDIO_PLAYOUT_MAX_STREAMS; i++) {
+        audio_playout_stream_t *st = &po->streams[i];
+        uint32_t state = atomic_load_explicit(&st->state, memory_order_acquire);
+        if (retire && playout_retire_stream(po, st, state, now_us)) {
+            continue;
+        }
+        if (AUDIO_STREAM_STATE(state) != AUDIO_STREAM_ACTIVE && AUDIO_STREAM_STATE(state) != AUDIO_STREAM_PUSHING) {
+            continue;
+        }
+
+        uint32_t depth = audio_ring_count(&st->ring);
+        max_depth = depth > max_depth ? depth : max_depth;
+        active++;
+        uint32_t target_ms = atomic_load_explicit(&st->target_ms, memory_order_relaxed);
+        uint32_t target = (target_ms + cfg->frame_ms - 1) / cfg->frame_ms;
+        target = target ? target : 1;
+
+        if (!st->primed && depth >= target) {
+            st->primed = true;
+            st->level = (float)depth * po->frame_samples;
+        }
+
+        // 积压超过上限时丢弃最旧的帧，把延迟拉回目标值
+        while (depth > max_frames && depth > target) {
+            if (!audio_ring_read_begin(&st->ring, NULL)) {
+                break;
+            }
+            audio_ring_read_commit(&st->ring);
+            atomic_fetch_add_explicit(&po->stats.frames_dropped, 1, memory_order_relaxed);
+            depth--;
+        }
+
+        if (!st->primed) {
+            continue;
+        }
+        primed++;
+        err_ms += ((float)depth - target) * cfg->frame_ms;
+        if (cfg->plc) {
+            if (!playout_render_stream(po, st, depth, target)) {
+                // 隐藏已淡出到静音，重新积累到目标深度后再播放
+                st->primed = false;
+                audio_plc_reset(&st->plc);
+            }
+            inputs[n].st = st;
+            inputs[n].data = st->out;
+            inputs[n].len = po->frame_bytes;
+            inputs[n].slot = false;
+            n++;
+            continue;
+        }
+        const audio_slot_meta_t *meta;
+        const void *slot = audio_ring_read_begin(&st->ring, &meta);
+        if (!slot) {
+            // 缓冲被抽空，重新积累到目标深度后再播放
+            st->primed = false;
+            atomic_store_explicit(&st->starved, true, memory_order_relaxed);
+            continue;
+        }
+        inputs[n].st = st;
+        inputs[n].data = slot;
+        inputs[n].len = meta->len < po->frame_bytes ? meta->len : po->frame_bytes;
+        inputs[n].slot = true;
+        n++;
+    }
+
+    if (active) {
+        audio_stats_record(AUDIO_STAT_PLAYOUT_DEPTH, (uint64_t)max_depth * cfg->frame_ms * 1000);
+    }
+    if (cfg->drift_comp && primed) {
+        po->depth_err_ms += (err_ms / primed - po->depth_err_ms) * PLAYOUT_DRIFT_SMOOTH;
+    }
+    return n;
+}
+
+// 超过混音路数上限时只保留能量最大的几路，其余的帧直接跳过
+static uint32_t playout_cap_inputs(audio_playout_t *po, playout_input_t *inputs, uint32_t n)
+{
+    uint32_t cap = po->cfg.max_mix_streams;
+    if (n <= cap) {
+        return n;
+    }
+
+    // 按乘上增益后的能量排序，静音的用户不会占用名额
+    for (uint32_t i = 0; i < n; i++) {
+        double gain = (double)atomic_load_explicit(&inputs[i].st->gain_q12, memory_order_relaxed) /
+                      AUDIO_MIX_GAIN_UNITY;
+        uint64_t energy = audio_energy_s16(inputs[i].data, inputs[i].len / PLAYOUT_BYTES_PER_SAMPLE);
+        inputs[i].energy = (uint64_t)(energy * gain * gain);
+    }
+    for (uint32_t i = 1; i < n; i++) {
+        playout_input_t in = inputs[i];
+        uint32_t j = i;
+        while (j > 0 && inputs[j - 1].energy < in.energy) {
+            inputs[j] = inputs[j - 1];
+            j--;
+        }
+        inputs[j] = in;
+    }
+    for (uint32_t i = cap; i < n; i++) {
+        playout_input_done(&inputs[i]);
+    }
+    atomic_fetch_add_explicit(&po->stats.capped_frames, n - cap, memory_order_relaxed);
+    return cap;
+}
+
+// 上下限和混音路数按启动时的规则取值，初始化和运行中修改共用
+static void playout_apply_limits(audio_playout_t *po, const audio_playout_config_t *cfg)
+{
+    uint32_t min_ms = cfg->jitter_min_ms;
+    uint32_t max_ms = cfg->jitter_max_ms < min_ms ? min_ms : cfg->jitter_max_ms;
+    uint32_t mix = cfg->max_mix_streams ? cfg->max_mix_streams : AUDIO_PLAYOUT_DEFAULT_MIX_STREAMS;
+
+    if (po->jitter_cap_ms) {
+        max_ms = max_ms > po->jitter_cap_ms ? po->jitter_cap_ms : max_ms;
+        min_ms = min_ms > max_ms ? max_ms : min_ms;
+    }
+    po->cfg.jitter_min_ms = min_ms;
+    po->cfg.jitter_max_ms = max_ms;
+    po->cfg.max_mix_streams = mix > AUDIO_PLAYOUT_MAX_STREAMS ? AUDIO_PLAYOUT_MAX_STREAMS : mix;
+    atomic_store_explicit(&po->jitter_min_ms, min_ms, memory_order_relaxed);
+    atomic_store_explicit(&po->jitter_max_ms, max_ms, memory_order_relaxed);
+}
+
+void audio_playout_update(audio_playout_t *po, const audio_playout_config_t *cfg)
+{
+    audio_seqlock_publish(&po->update_lock, &po->update, cfg, sizeof(*cfg));
+}
+
+// 在周期边界切换丢包隐藏: 每个用户的 plc 清空后按新的方式继续从抖动缓冲取数据
+static void playout_apply_update(audio_playout_t *po, const audio_playout_config_t *cfg)
+{
+    playout_apply_limits(po, cfg);
+    if (po->plc_ready && cfg->plc != po->cfg.plc) {
+        for (int i = 0; i < AUDIO_PLAYOUT_MAX_STREAMS; i++) {
+            audio_playout_stream_t *st = &po->streams[i];
+            audio_plc_reset(&st->plc);
+            st->has_sent_ts = false;
+        }
+        po->cfg.plc = cfg->plc;
+    }
+    LOGI("播放配置已更新: 抖动缓冲=%u-%ums, 混音上限=%u 路, 丢包隐藏=%s", po->cfg.jitter_min_ms,
+         po->cfg.jitter_max_ms, po->cfg.max_mix_streams, po->cfg.plc ? "开" : "关");
+}
+
+static void *playout_thread(void *arg)
+{
+    audio_playout_t *po = arg;
+    playout_input_t inputs[AUDIO_PLAYOUT_MAX_STREAMS];
+    audio_playout_config_t update;
+
+    audio_rt_enter(&po->cfg.rt, "audio-playout");
+    while (atomic_load_explicit(&po->running, memory_order_relaxed)) {
+        if (audio_seqlock_fetch(&po->update_lock, &po->update_seen, &update, &po->update, sizeof(update))) {
+            playout_apply_update(po, &update);
+        }
+        uint32_t n = playout_collect(po, inputs);
+        n = playout_cap_inputs(po, inputs, n);
+
+        if (n == 0) {
+            playout_write(po, po->silence, po->frame_bytes);
+            atomic_fetch_add_explicit(&po->stats.silence_frames, 1, memory_order_relaxed);
+        } else if (n == 1 && inputs[0].len == po->frame_bytes &&
+                   atomic_load_explicit(&inputs[0].st->gain_q12, memory_order_relaxed) == AUDIO_MIX_GAIN_UNITY) {
+            // 只有一路且不需要调整增益时直接从槽位写出，省去一次拷贝
+            playout_write(po, (const uint8_t *)inputs[0].data, po->frame_bytes);
+        } else {
+            int64_t start_ns = audio_now_ns();
+            memset(po->mix, 0, po->frame_bytes);
+            for (uint32_t i = 0; i < n; i++) {
+                int32_t gain = atomic_load_explicit(&inputs[i].st->gain_q12, memory_order_relaxed);
+                audio_mix_s16(po->mix, inputs[i].data, inputs[i].len / PLAYOUT_BYTES_PER_SAMPLE, gain);
+            }
+            atomic_fetch_add_explicit(&po->stats.mix_ns_sum, audio_now_ns() - start_ns, memory_order_relaxed);
+            atomic_fetch_add_explicit(&po->stats.mix_periods, 1, memory_order_relaxed);
+            playout_write(po, (const uint8_t *)po->mix, po->frame_bytes);
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+            playout_input_done(&inputs[i]);
+            inputs[i].st->frames_mixed++;
+        }
+        atomic_fetch_add_explicit(&po->stats.frames_played, n, memory_order_relaxed);
+        atomic_fetch_add_explicit(&po->stats.mix_hist[n], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&po->stats.periods, 1, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+static void playout_free(audio_playout_t *po)
+{
+    for (int i = 0; i < AUDIO_PLAYOUT_MAX_STREAMS; i++) {
+        audio_ring_deinit(&po->streams[i].ring);
+        if (po->plc_ready) {
+            audio_plc_deinit(&po->streams[i].plc);
+            free(po->streams[i].out);
+            po->streams[i].out = NULL;
+        }
+    }
+    audio_convert_deinit(&po->convert);
+    audio_xrun_deinit(&po->xrun);
+    free(po->mix);
+    free(po->silence);
+    po->mix = NULL;
+    po->silence = NULL;
+}
+
+int audio_playout_start(audio_playout_t *po, const audio_playout_config_t *cfg)
+{
+    memset(po, 0, sizeof(*po));
+    po->cfg = *cfg;
+    if (po->cfg.frame_ms == 0) {
+        return -1;
+    }
+    playout_apply_limits(po, cfg);
+
+    po->frame_samples = cfg->sample_rate * cfg->frame_ms / 1000;
+    po->frame_bytes = po->frame_samples * cfg->channels * PLAYOUT_BYTES_PER_SAMPLE;
+    po->silence = calloc(1, po->frame_bytes);
+    po->mix = aligned_alloc(AUDIO_CACHE_LINE, (po->frame_bytes + AUDIO_CACHE_LINE - 1) &
+                                              ~(AUDIO_CACHE_LINE - 1));
+    if (!po->silence || !po->mix) {
+        playout_free(po);
+        return -1;
+    }
+    audio_rt_prefault(po->mix, po->frame_bytes);
+
+    audio_format_t rtc_fmt = { cfg->sample_rate, cfg->channels, AUDIO_FMT_S16 };
+    if (!cfg->handle) {
+        po->cfg.device = rtc_fmt;
+        audio_pacer_init(&po->pacer, cfg->frame_ms * 1000);
+    } else if (snd_pcm_prepare(cfg->handle) < 0 ||
+               audio_xrun_init(&po->xrun, cfg->handle, SND_PCM_STREAM_PLAYBACK, "播放",
+                               cfg->device.rate, audio_frame_bytes(&cfg->device), cfg->frame_ms) < 0) {
+        // 恢复时最多预填一帧静音
+        playout_free(po);
+        return -1;
+    }
+    po->cfg.drift_comp = cfg->drift_comp && cfg->handle;
+    audio_drift_init(&po->drift, "播放", po->cfg.device.rate);
+
+    if (audio_convert_init(&po->convert, "播放", &rtc_fmt, &po->cfg.device, po->frame_samples,
+                           po->cfg.device.rate * cfg->frame_ms / 1000, 0, po->cfg.drift_comp) < 0) {
+        playout_free(po);
+        return -1;
+    }
+
+    // 每个用户的容量至少覆盖抖动上限的两倍，多出的部分用于吸收突发
+    uint32_t slots = 2 * (po->cfg.jitter_max_ms / po->cfg.frame_ms) + 4;
+    po->jitter_cap_ms = po->cfg.jitter_max_ms;
+    for (int i = 0; i < AUDIO_PLAYOUT_MAX_STREAMS; i++) {
+        if (audio_ring_init(&po->streams[i].ring, slots, po->frame_bytes) < 0) {
+            LOGE("无法分配播放缓冲区");
+            playout_free(po);
+            return -1;
+        }
+    }
+    audio_plc_config_t plc_cfg = { cfg->sample_rate, cfg->channels, po->frame_samples };
+    po->plc_ready = cfg->plc || cfg->tunable;
+    for (int i = 0; po->plc_ready && i < AUDIO_PLAYOUT_MAX_STREAMS; i++) {
+        audio_playout_stream_t *st = &po->streams[i];
+        st->out = malloc(po->frame_bytes);
+        if (!st->out || audio_plc_init(&st->plc, &plc_cfg) < 0) {
+            LOGE("无法初始化丢包隐藏");
+            playout_free(po);
+            return -1;
+        }
+    }
+
+    atomic_store(&po->stats.target_ms, po->cfg.jitter_min_ms);
+    atomic_store(&po->running, true);
+    if (pthread_create(&po->thread, NULL, playout_thread, po) != 0) {
+        LOGE("无法创建播放线程");
+        playout_free(po);
+        return -1;
+    }
+
+    LOGI("播放线程已启动%s: 帧长=%ums, 抖动缓冲=%u-%ums, 每用户槽位=%u, 混音上限=%u 路, 丢包隐藏=%s, "
+         "时钟偏差补偿=%s (%s)",
+         cfg->handle ? "" : "(无声卡)", po->cfg.frame_ms, po->cfg.jitter_min_ms, po->cfg.jitter_max_ms,
+         po->streams[0].ring.slot_count, po->cfg.max_mix_streams, po->cfg.plc ? "开" : "关",
+         po->cfg.drift_comp ? "开" : "关", AUDIO_SIMD_NAME);
+    return 0;
+}
+
+void audio_playout_stop(audio_playout_t *po)
+{
+    if (!atomic_exchange(&po->running, false)) {
+        return;
+    }
+    pthread_join(po->thread, NULL);
+    if (po->cfg.handle) {
+        // 丢弃未播出的数据，下次启动时重新预填
+        snd_pcm_drop(po->cfg.handle);
+    }
+
+    audio_playout_stats_t *stats = &po->stats;
+    unsigned long long periods = atomic_load(&stats->periods);
+    unsigned long long played = atomic_load(&stats->frames_played);
+    unsigned long long mix_periods = atomic_load(&stats->mix_periods);
+    LOGI("播放统计(%s): 收到=%llu, 播放=%llu, 迟到=%llu, 丢弃=%llu, 静音=%llu, 目标=%ums, "
+         "写入耗时 平均=%.1fus",
+         !po->cfg.handle ? "无声卡" : (po->cfg.mmap ? "mmap" : "rw"),
+         atomic_load(&stats->frames_in), played,
+         atomic_load(&stats->frames_late), atomic_load(&stats->frames_dropped),
+         atomic_load(&stats->silence_frames), atomic_load(&stats->target_ms),
+         periods ? atomic_load(&stats->io_ns_sum) / 1000.0 / periods : 0.0);
+
+    char hist[AUDIO_PLAYOUT_MAX_STREAMS * 24] = { 0 };
+    size_t pos = 0;
+    for (int i = 0; i <= AUDIO_PLAYOUT_MAX_STREAMS && pos < sizeof(hist); i++) {
+        uint64_t count = atomic_load(&stats->mix_hist[i]);
+        if (count) {
+            pos += snprintf(hist + pos, sizeof(hist) - pos, " %d路=%llu", i, (unsigned long long)count);
+        }
+    }
+    LOGI("混音统计: 周期=%llu, 平均路数=%.2f, 超限跳过=%llu, 用户加入=%llu, 用户表满拒绝=%llu, "
+         "混音耗时 平均=%.1fus, 唤醒滞后 平均=%.1fus 最大=%uus, 分布:%s",
+         periods, periods ? (double)played / periods : 0.0,
+         atomic_load(&stats->capped_frames), atomic_load(&stats->streams_joined),
+         atomic_load(&stats->streams_rejected),
+         mix_periods ? atomic_load(&stats->mix_ns_sum) / 1000.0 / mix_periods : 0.0,
+         periods ? (double)atomic_load(&stats->wake_late_sum_us) / periods : 0.0,
+         atomic_load(&stats->wake_late_max_us), hist);
+    if (po->plc_ready) {
+        double ms = 1000.0 / po->cfg.sample_rate;
+        LOGI("丢包隐藏统计: 隐藏=%llu 次 共 %.0fms, 变速压缩 %.0fms, 变速拉伸 %.0fms",
+             atomic_load(&stats->plc_events), atomic_load(&stats->plc_samples) * ms,
+             atomic_load(&stats->compress_samples) * ms, atomic_load(&stats->expand_samples) * ms);
+    }
+    if (po->cfg.handle) {
+        audio_xrun_report(&po->xrun);
+        audio_drift_report(&po->drift);
+    } else {
+        audio_pacer_report(&po->pacer, "播放");
+    }
+    audio_convert_report(&po->convert);
+
+    playout_free(po);
+}
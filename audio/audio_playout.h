@@ -0,0 +1,176 @@
+/*************************************************************
+ * File  :  audio_playout.h
+ * Module:  Per-uid jitter buffers, mixer and dedicated playback
+ *          thread.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_PLAYOUT_H_
+#define _AUDIO_PLAYOUT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <alsa/asoundlib.h>
+
+#include "audio_ring.h"
+#include "audio_convert.h"
+#include "audio_xrun.h"
+#include "audio_pacer.h"
+#include "audio_rt.h"
+#include "audio_aec.h"
+#include "audio_plc.h"
+#include "audio_drift.h"
+#include "audio_seqlock.h"
+
+// 同时跟踪的远端用户数上限，超过后新用户被拒绝直到有用户空闲退出
+#define AUDIO_PLAYOUT_MAX_STREAMS (16)
+#define AUDIO_PLAYOUT_DEFAULT_MIX_STREAMS (4)
+// 持续这么久没有数据的用户被回收
+#define AUDIO_PLAYOUT_STREAM_IDLE_MS (2000)
+
+// 每个周期混音后的输出(接收格式)，在播放线程中调用
+typedef void (*audio_playout_period_cb)(void *ctx, const void *data, size_t len);
+
+typedef struct {
+    snd_pcm_t *handle;          // 播放设备句柄，为 NULL 时不接声卡，由节拍器按帧长定时输出
+    uint32_t sample_rate;       // 接收音频采样率
+    uint32_t channels;          // 接收音频通道数
+    audio_format_t device;      // 播放设备格式
+    bool mmap;                  // 设备以 mmap 方式访问
+    uint32_t frame_ms;          // 每帧时长
+    uint32_t jitter_min_ms;     // 抖动缓冲下限
+    uint32_t jitter_max_ms;     // 抖动缓冲上限
+    uint32_t max_mix_streams;   // 每个周期最多混音的路数，0 表示默认值
+    bool plc;                   // 欠载时做丢包隐藏，并按缓冲水位变速调整延迟
+    bool drift_comp;            // 按声卡时钟偏差和缓冲水位微调重采样比例，需要声卡
+    bool tunable;               // 关闭的丢包隐藏也预先分配，以便运行中打开
+    audio_rt_config_t rt;       // 播放线程的实时调度参数
+    audio_aec_t *aec;           // 可选，每个周期写入设备后作为回声消除的参考
+    audio_playout_period_cb on_period;  // 可选，每周期的输出
+    void *ctx;
+} audio_playout_config_t;
+
+typedef struct {
+    atomic_ullong frames_in;        // 回调收到的帧
+    atomic_ullong frames_played;    // 参与混音并写入声卡的帧(各路之和)
+    atomic_ullong frames_late;      // 到达时已错过播放时机的帧
+    atomic_ullong frames_dropped;   // 缓冲满或超过上限被丢弃的帧
+    atomic_ullong silence_frames;   // 缓冲为空时补的静音帧
+    atomic_ullong io_ns_sum;        // 写入设备的累计耗时
+    atomic_uint target_ms;          // 最近一次更新的自适应目标
+    atomic_uint jitter_us;          // 最近一次更新的到达间隔抖动估计
+    atomic_ullong periods;          // 写入声卡的周期数
+    atomic_ullong capped_frames;    // 超过混音路数上限被跳过的帧
+    atomic_ullong mix_periods;      // 需要逐路混音的周期数
+    atomic_ullong mix_ns_sum;       // 混音累计耗时
+    atomic_ullong streams_joined;   // 新加入的用户
+    atomic_ullong streams_rejected; // 用户表已满被拒绝的帧
+    atomic_ullong mix_hist[AUDIO_PLAYOUT_MAX_STREAMS + 1];  // 每周期混音路数分布
+    atomic_ullong wake_late_sum_us; // 每周期唤醒滞后累计
+    atomic_uint wake_late_max_us;   // 最大唤醒滞后
+    atomic_ullong plc_events;       // 开始丢包隐藏的次数
+    atomic_ullong plc_samples;      // 隐藏生成的采样(每通道，下同)
+    atomic_ullong compress_samples; // 变速压缩去掉的采样
+    atomic_ullong expand_samples;   // 变速拉伸插入的采样
+} audio_playout_stats_t;
+
+typedef enum {
+    AUDIO_STREAM_FREE = 0,      // 空闲，生产者可认领
+    AUDIO_STREAM_CLAIMING,      // 生产者正在初始化
+    AUDIO_STREAM_ACTIVE,        // 生产者写入，消费者读取
+    AUDIO_STREAM_PUSHING,       // 生产者正在写入一帧，消费者照常读取但不会回收
+    AUDIO_STREAM_RETIRING,      // 播放线程判定空闲，正在清空，随后置为空闲
+} audio_stream_state_e;
+
+// state 的低 4 位是 audio_stream_state_e，其余位是写入次数，
+// 播放线程据此确认空闲检查之后没有新的写入
+#define AUDIO_STREAM_STATE_MASK (0xfu)
+#define AUDIO_STREAM_GEN_ONE (0x10u)
+#define AUDIO_STREAM_STATE(s) ((audio_stream_state_e)((s) & AUDIO_STREAM_STATE_MASK))
+
+// 单个连接上单个远端用户的抖动缓冲
+typedef struct {
+    _Alignas(AUDIO_CACHE_LINE) atomic_uint state;
+    uint32_t conn_id;               // 与 uid 一起在认领时写入，ACTIVE 期间不变；
+    uint32_t uid;                   // 不同连接上的同一 uid 各用一个缓冲，保证每个环形缓冲区只有一个生产者
+    atomic_int gain_q12;
+    audio_ring_t ring;
+
+    // 生产者私有
+    int64_t last_arrival_us;
+    int64_t jitter_us;
+    uint16_t last_transit_ms;       // 上一帧的 到达时刻 - sent_ts
+    bool has_transit;
+
+    // 生产者写，播放线程回收空闲用户时读
+    atomic_llong last_push_us;
+    atomic_uint target_ms;
+
+    // 消费者通知生产者: 刚刚发生了欠载
+    atomic_bool starved;
+
+    // 消费者私有
+    bool primed;
+    uint64_t frames_mixed;
+    audio_plc_t plc;                // 启用丢包隐藏时使用
+    int16_t *out;                   // plc 产生的本周期输出
+    uint16_t last_sent_ts;          // 上一个送入 plc 的帧，用于发现丢失的帧
+    bool has_sent_ts;
+    float level;                    // 平滑后的缓冲水位(采样)
+} audio_playout_stream_t;
+
+typedef struct {
+    audio_playout_config_t cfg;
+    audio_playout_stream_t streams[AUDIO_PLAYOUT_MAX_STREAMS];
+    pthread_t thread;
+    atomic_bool running;
+    uint32_t frame_bytes;
+    uint32_t frame_samples;
+    int16_t *mix;
+    uint8_t *silence;
+    audio_xrun_t xrun;
+    audio_convert_t convert;
+    audio_pacer_t pacer;            // 无声卡时代替设备阻塞
+    audio_drift_t drift;            // 播放设备相对系统时钟的偏差
+    int64_t device_pos;             // 已写入设备的帧数
+    float depth_err_ms;             // 平滑后的缓冲水位与目标之差
+    bool plc_ready;                 // 已为每个用户分配丢包隐藏
+    uint32_t jitter_cap_ms;         // 槽位数能容纳的抖动上限
+    atomic_bool retire_idle;        // 生产者认领失败，请播放线程回收空闲用户
+
+    // 生产者计算目标深度用的抖动缓冲上下限，由播放线程更新
+    atomic_uint jitter_min_ms;
+    atomic_uint jitter_max_ms;
+
+    // 控制线程发布的新配置，在下一个周期开始时生效
+    audio_seqlock_t update_lock;
+    audio_playout_config_t update;
+    uint32_t update_seen;
+
+    // 按 uid 设置的增益，高 32 位为 uid，低 32 位为 Q12 增益 + 1，0 表示空项
+    atomic_ullong gains[AUDIO_PLAYOUT_MAX_STREAMS];
+
+    audio_playout_stats_t stats;
+} audio_playout_t;
+
+int audio_playout_start(audio_playout_t *po, const audio_playout_config_t *cfg);
+void audio_playout_stop(audio_playout_t *po);
+
+// 在 SDK 回调线程中调用，只做拷贝，不会阻塞；同一 (conn_id, uid) 只能由一个线程推送
+int audio_playout_push(audio_playout_t *po, uint32_t conn_id, uint32_t uid, uint16_t sent_ts,
+                       const void *data, size_t len);
+
+// 在运行中修改抖动缓冲上下限、混音路数上限和丢包隐藏开关，只由一个线程调用，不会阻塞播放线程；
+// 其他字段必须与启动时相同，抖动上限不超过 jitter_cap_ms，没有分配的丢包隐藏无法打开
+void audio_playout_update(audio_playout_t *po, const audio_playout_config_t *cfg);
+
+// 设置某个用户在所有连接上的混音增益(线性倍数)，可在任意时刻调用
+int audio_playout_set_gain(audio_playout_t *po, uint32_t uid, float gain);
+
+#endif
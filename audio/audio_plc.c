@@ -0,0 +1,397 @@
+/*************************************************************
+ * File  :  audio_plc.c
+ * Module:  Packet loss concealment and WSOLA time-stretch for
+ *          one playout stream.
+ *
+ * Received frames are appended to a small linear buffer that
+ * also keeps the last 30ms that were played. When the jitter
+ * buffer runs dry, the pitch period of that history is found
+ * and the last period is repeated, held for 10ms and then faded
+ * out; when data comes back it is cross-faded in. To let the
+ * buffer depth follow the network, the pending audio can be
+ * shortened or lengthened by one pitch period: the two most
+ * similar adjacent periods are cross-faded into one, or a
+ * cross-faded copy is inserted between them (WSOLA with a single
+ * overlap), which is inaudible on voiced speech and silence and
+ * is skipped on everything else.
+ *
+ * The pitch search runs on a ~4kHz mono downmix and is refined
+ * at the full rate with SSE2/NEON dot products, so it stays in
+ * the tens of microseconds per call at 48kHz stereo.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio_plc.h"
+#include "audio_simd.h"
+
+// 基音周期搜索范围 2.5ms-15ms (400Hz-67Hz)
+#define PLC_MIN_LAG_US (2500)
+#define PLC_MAX_LAG_US (15000)
+#define PLC_DECIM_RATE (4000)
+#define PLC_FADE_HOLD_MS (10)
+#define PLC_FADE_MS (50)
+#define PLC_MERGE_MS (5)
+// 相关系数低于该值时认为没有明显周期
+#define PLC_VOICED_CORR (0.5f)
+#define PLC_STRETCH_CORR (0.8f)
+// 约 -50dBFS 以下的信号按静音处理，可以任意变速
+#define PLC_SILENCE_POW (1e4f)
+
+int audio_plc_init(audio_plc_t *plc, const audio_plc_config_t *cfg)
+{
+    memset(plc, 0, sizeof(*plc));
+    plc->cfg = *cfg;
+    if (cfg->sample_rate < PLC_DECIM_RATE || cfg->channels == 0 || cfg->frame_samples == 0) {
+        return -1;
+    }
+
+    plc->decim = cfg->sample_rate / PLC_DECIM_RATE;
+    plc->min_lag = (uint32_t)((uint64_t)cfg->sample_rate * PLC_MIN_LAG_US / 1000000);
+    plc->max_lag = (uint32_t)((uint64_t)cfg->sample_rate * PLC_MAX_LAG_US / 1000000);
+    plc->fade_hold = cfg->sample_rate * PLC_FADE_HOLD_MS / 1000;
+    plc->fade_len = cfg->sample_rate * PLC_FADE_MS / 1000;
+    plc->merge_len = cfg->sample_rate * PLC_MERGE_MS / 1000;
+
+    // 历史保留两个最长周期；待播出部分还要容纳两帧新数据、一个插入的周期和几帧丢失帧的隐藏信号
+    plc->hist = 2 * plc->max_lag;
+    plc->cap = plc->hist + 6 * cfg->frame_samples + 2 * plc->max_lag;
+    plc->buf = calloc((size_t)plc->cap * cfg->channels, sizeof(int16_t));
+    plc->tmpl = calloc((size_t)plc->max_lag * cfg->channels, sizeof(int16_t));
+    plc->dec = calloc(2 * plc->max_lag / plc->decim + 1, sizeof(float));
+    if (!plc->buf || !plc->tmpl || !plc->dec) {
+        audio_plc_deinit(plc);
+        return -1;
+    }
+    audio_plc_reset(plc);
+    return 0;
+}
+
+void audio_plc_deinit(audio_plc_t *plc)
+{
+    free(plc->buf);
+    free(plc->tmpl);
+    free(plc->dec);
+    plc->buf = NULL;
+    plc->tmpl = NULL;
+    plc->dec = NULL;
+}
+
+void audio_plc_reset(audio_plc_t *plc)
+{
+    memset(plc->buf, 0, (size_t)plc->hist * plc->cfg.channels * sizeof(int16_t));
+    plc->len = plc->hist;
+    plc->concealing = false;
+    plc->fade_in = true;
+}
+
+static float plc_corr(const float *a, const float *b, uint32_t n)
+{
+    float ab = 0.0f, aa = 0.0f, bb = 0.0f;
+    for (uint32_t i = 0; i < n; i++) {
+        ab += a[i] * b[i];
+        aa += a[i] * a[i];
+        bb += b[i] * b[i];
+    }
+    return aa > 0.0f && bb > 0.0f ? ab / sqrtf(aa * bb) : 0.0f;
+}
+
+// 同时计算 a·b、a·a、b·b，用于归一化互相关
+static void plc_dot3(const int16_t *a, const int16_t *b, uint32_t n, double *ab, double *aa, double *bb)
+{
+    float sab = 0.0f, saa = 0.0f, sbb = 0.0f;
+    uint32_t i = 0;
+#if defined(AUDIO_HAVE_SSE2)
+    __m128 vab = _mm_setzero_ps(), vaa = _mm_setzero_ps(), vbb = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128 x0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+        __m128 x1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+        __m128 y0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(y, y), 16));
+        __m128 y1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(y, y), 16));
+        vab = _mm_add_ps(vab, _mm_add_ps(_mm_mul_ps(x0, y0), _mm_mul_ps(x1, y1)));
+        vaa = _mm_add_ps(vaa, _mm_add_ps(_mm_mul_ps(x0, x0), _mm_mul_ps(x1, x1)));
+        vbb = _mm_add_ps(vbb, _mm_add_ps(_mm_mul_ps(y0, y0), _mm_mul_ps(y1, y1)));
+    }
+    float t[4];
+    _mm_storeu_ps(t, vab);
+    sab = t[0] + t[1] + t[2] + t[3];
+    _mm_storeu_ps(t, vaa);
+    saa = t[0] + t[1] + t[2] + t[3];
+    _mm_storeu_ps(t, vbb);
+    sbb = t[0] + t[1] + t[2] + t[3];
+#elif defined(AUDIO_HAVE_NEON)
+    float32x4_t vab = vdupq_n_f32(0.0f), vaa = vdupq_n_f32(0.0f), vbb = vdupq_n_f32(0.0f);
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t x = vld1q_s16(a + i);
+        int16x8_t y = vld1q_s16(b + i);
+        float32x4_t x0 = vcvtq_f32_s32(vmovl_s16(vget_low_s16(x)));
+        float32x4_t x1 = vcvtq_f32_s32(vmovl_s16(vget_high_s16(x)));
+        float32x4_t y0 = vcvtq_f32_s32(vmovl_s16(vget_low_s16(y)));
+        float32x4_t y1 = vcvtq_f32_s32(vmovl_s16(vget_high_s16(y)));
+        vab = vmlaq_f32(vmlaq_f32(vab, x0, y0), x1, y1);
+        vaa = vmlaq_f32(vmlaq_f32(vaa, x0, x0), x1, x1);
+        vbb = vmlaq_f32(vmlaq_f32(vbb, y0, y0), y1, y1);
+    }
+    float t[4];
+    vst1q_f32(t, vab);
+    sab = t[0] + t[1] + t[2] + t[3];
+    vst1q_f32(t, vaa);
+    saa = t[0] + t[1] + t[2] + t[3];
+    vst1q_f32(t, vbb);
+    sbb = t[0] + t[1] + t[2] + t[3];
+#endif
+    for (; i < n; i++) {
+        sab += (float)a[i] * b[i];
+        saa += (float)a[i] * a[i];
+        sbb += (float)b[i] * b[i];
+    }
+    *ab = sab;
+    *aa = saa;
+    *bb = sbb;
+}
+
+// 在 [lo, hi] 内找相邻两段最相似的周期 l: from_end 为 false 时两段为 x[0, l) 与 x[l, 2l)，
+// 为 true 时为 x[-2l, -l) 与 x[-l, 0)。先在降采样信号上粗搜，再在原采样率上细化。
+// 返回周期，corr 为相关系数，pow 为两段的平均功率
+static uint32_t plc_find_lag(audio_plc_t *plc, const int16_t *x, bool from_end, uint32_t lo, uint32_t hi,
+                             float *corr, float *pow)
+{
+    uint32_t ch = plc->cfg.channels;
+    uint32_t d = plc->decim;
+    uint32_t m = 2 * hi / d;
+    const int16_t *region = from_end ? x - (size_t)m * d * ch : x;
+
+    for (uint32_t k = 0; k < m; k++) {
+        const int16_t *p = region + (size_t)k * d * ch;
+        int32_t sum = 0;
+        for (uint32_t j = 0; j < d * ch; j++) {
+            sum += p[j];
+        }
+        plc->dec[k] = (float)sum / (d * ch);
+    }
+
+    uint32_t lo_d = lo / d > 0 ? lo / d : 1;
+    uint32_t best_d = lo_d;
+    float best = -2.0f;
+    for (uint32_t l = lo_d; l <= hi / d; l++) {
+        const float *a = from_end ? plc->dec + m - 2 * l : plc->dec;
+        float c = plc_corr(a, a + l, l);
+        if (c > best) {
+            best = c;
+            best_d = l;
+        }
+    }
+
+    uint32_t from = best_d * d > lo + d ? best_d * d - d : lo;
+    uint32_t to = best_d * d + d < hi ? best_d * d + d : hi;
+    uint32_t lag = from;
+    *corr = -2.0f;
+    *pow = 0.0f;
+    for (uint32_t l = from; l <= to; l++) {
+        const int16_t *a = from_end ? x - (size_t)2 * l * ch : x;
+        double ab, aa, bb;
+        plc_dot3(a, a + (size_t)l * ch, l * ch, &ab, &aa, &bb);
+        float c = aa > 0.0 && bb > 0.0 ? (float)(ab / sqrt(aa * bb)) : 0.0f;
+        if (c > *corr) {
+            *corr = c;
+            *pow = (float)((aa + bb) / (2.0 * l * ch));
+            lag = l;
+        }
+    }
+    return lag;
+}
+
+static float plc_gain(const audio_plc_t *plc, uint32_t n)
+{
+    if (n < plc->fade_hold) {
+        return 1.0f;
+    }
+    n -= plc->fade_hold;
+    return n >= plc->fade_len ? 0.0f : 1.0f - (float)n / plc->fade_len;
+}
+
+// 从已有信号的末尾取一个基音周期作为循环模板
+static void plc_start_conceal(audio_plc_t *plc)
+{
+    uint32_t ch = plc->cfg.channels;
+    const int16_t *end = plc->buf + (size_t)plc->len * ch;
+    float corr, pow;
+    uint32_t lag = plc_find_lag(plc, end, true, plc->min_lag, plc->max_lag, &corr, &pow);
+
+    // 清音段没有明显周期，用最长的周期重复以减少嗡嗡声
+    if (corr < PLC_VOICED_CORR) {
+        lag = plc->max_lag;
+    }
+    const int16_t *period = end - (size_t)lag * ch;
+    memcpy(plc->tmpl, period, (size_t)lag * ch * sizeof(int16_t));
+
+    // 周期末尾逐渐过渡到周期起点之前的样本，循环时首尾相接处保持连续
+    uint32_t ov = lag / 4;
+    for (uint32_t i = 0; i < ov; i++) {
+        float w = (float)(i + 1) / (ov + 1);
+        for (uint32_t c = 0; c < ch; c++) {
+            size_t idx = (size_t)(lag - ov + i) * ch + c;
+            plc->tmpl[idx] = (int16_t)lrintf(period[idx] * (1.0f - w) + period[idx - (size_t)lag * ch] * w);
+        }
+    }
+
+    plc->lag = lag;
+    plc->tmpl_pos = 0;
+    plc->concealed = 0;
+    plc->concealing = true;
+}
+
+// 隐藏信号的下一个采样点乘以 w 后写入 dst
+static void plc_next(audio_plc_t *plc, int16_t *dst, float w, const int16_t *mix_in)
+{
+    uint32_t ch = plc->cfg.channels;
+    const int16_t *src = plc->tmpl + (size_t)plc->tmpl_pos * ch;
+    float g = plc_gain(plc, plc->concealed) * w;
+
+    for (uint32_t c = 0; c < ch; c++) {
+        float v = src[c] * g + (mix_in ? mix_in[c] * (1.0f - w) : 0.0f);
+        dst[c] = (int16_t)lrintf(v);
+    }
+    plc->tmpl_pos = plc->tmpl_pos + 1 == plc->lag ? 0 : plc->tmpl_pos + 1;
+    plc->concealed++;
+}
+
+int audio_plc_push(audio_plc_t *plc, const int16_t *data, uint32_t samples)
+{
+    uint32_t ch = plc->cfg.channels;
+    uint32_t i = 0;
+
+    if (plc->len + samples > plc->cap) {
+        return -1;
+    }
+    int16_t *dst = plc->buf + (size_t)plc->len * ch;
+    if (plc->concealing) {
+        uint32_t m = samples < plc->merge_len ? samples : plc->merge_len;
+        for (; i < m; i++) {
+            float w = 1.0f - (float)(i + 1) / (m + 1);
+            plc_next(plc, dst + (size_t)i * ch, w, data + (size_t)i * ch);
+        }
+        plc->concealing = false;
+    } else if (plc->fade_in) {
+        uint32_t m = samples < plc->merge_len ? samples : plc->merge_len;
+        for (; i < m; i++) {
+            float w = (float)(i + 1) / (m + 1);
+            for (uint32_t c = 0; c < ch; c++) {
+                dst[(size_t)i * ch + c] = (int16_t)lrintf(data[(size_t)i * ch + c] * w);
+            }
+        }
+    }
+    plc->fade_in = false;
+    memcpy(dst + (size_t)i * ch, data + (size_t)i * ch, (size_t)(samples - i) * ch * sizeof(int16_t));
+    plc->len += samples;
+    return 0;
+}
+
+bool audio_plc_conceal(audio_plc_t *plc, uint32_t samples)
+{
+    uint32_t ch = plc->cfg.channels;
+
+    if (!plc->concealing) {
+        plc_start_conceal(plc);
+    }
+    if (plc->len + samples > plc->cap) {
+        samples = plc->cap - plc->len;
+    }
+    int16_t *dst = plc->buf + (size_t)plc->len * ch;
+    for (uint32_t i = 0; i < samples; i++) {
+        plc_next(plc, dst + (size_t)i * ch, 1.0f, NULL);
+    }
+    plc->len += samples;
+    return plc_gain(plc, plc->concealed) > 0.0f;
+}
+
+// 在待播出数据的开头找一个适合变速的周期，hi 为允许的最大周期
+static uint32_t plc_stretch_lag(audio_plc_t *plc, uint32_t hi)
+{
+    float corr, pow;
+
+    hi = hi < plc->max_lag ? hi : plc->max_lag;
+    if (hi < plc->min_lag) {
+        return 0;
+    }
+    uint32_t lag = plc_find_lag(plc, plc->buf + (size_t)plc->hist * plc->cfg.channels, false,
+                                plc->min_lag, hi, &corr, &pow);
+    if (pow <= PLC_SILENCE_POW) {
+        // 静音段直接按最长的周期处理
+        return hi;
+    }
+    return corr >= PLC_STRETCH_CORR ? lag : 0;
+}
+
+uint32_t audio_plc_compress(audio_plc_t *plc, uint32_t keep)
+{
+    uint32_t ch = plc->cfg.channels;
+    uint32_t pending = audio_plc_pending(plc);
+    uint32_t hi = pending > keep ? pending - keep : 0;
+    uint32_t lag = plc_stretch_lag(plc, pending / 2 < hi ? pending / 2 : hi);
+
+    if (lag == 0) {
+        return 0;
+    }
+    // p[0, l) 与 p[l, 2l) 交叉淡化为一段，开头接上历史，结尾接上 p[2l]
+    int16_t *p = plc->buf + (size_t)plc->hist * ch;
+    for (uint32_t i = 0; i < lag; i++) {
+        float w = (i + 0.5f) / lag;
+        for (uint32_t c = 0; c < ch; c++) {
+            size_t idx = (size_t)i * ch + c;
+            p[idx] = (int16_t)lrintf(p[idx] * (1.0f - w) + p[idx + (size_t)lag * ch] * w);
+        }
+    }
+    memmove(p + (size_t)lag * ch, p + (size_t)2 * lag * ch, (size_t)(pending - 2 * lag) * ch * sizeof(int16_t));
+    plc->len -= lag;
+    return lag;
+}
+
+uint32_t audio_plc_expand(audio_plc_t *plc)
+{
+    uint32_t ch = plc->cfg.channels;
+    uint32_t pending = audio_plc_pending(plc);
+    uint32_t room = plc->cap - plc->len;
+    uint32_t lag = plc_stretch_lag(plc, pending / 2 < room ? pending / 2 : room);
+
+    if (lag == 0) {
+        return 0;
+    }
+    // 在 p[l) 之前插入一段: 从 p[l, 2l) 逐渐过渡到 p[0, l)，结尾再次接上 p[l]
+    int16_t *p = plc->buf + (size_t)plc->hist * ch;
+    memmove(p + (size_t)2 * lag * ch, p + (size_t)lag * ch, (size_t)(pending - lag) * ch * sizeof(int16_t));
+    for (uint32_t i = 0; i < lag; i++) {
+        float w = (i + 0.5f) / lag;
+        for (uint32_t c = 0; c < ch; c++) {
+            size_t idx = (size_t)i * ch + c;
+            size_t ins = idx + (size_t)lag * ch;
+            p[ins] = (int16_t)lrintf(p[ins + (size_t)lag * ch] * (1.0f - w) + p[idx] * w);
+        }
+    }
+    plc->len += lag;
+    return lag;
+}
+
+void audio_plc_read(audio_plc_t *plc, int16_t *out, uint32_t samples)
+{
+    uint32_t ch = plc->cfg.channels;
+    uint32_t pending = audio_plc_pending(plc);
+    uint32_t n = samples < pending ? samples : pending;
+
+    memcpy(out, plc->buf + (size_t)plc->hist * ch, (size_t)n * ch * sizeof(int16_t));
+    memset(out + (size_t)n * ch, 0, (size_t)(samples - n) * ch * sizeof(int16_t));
+
+    // 播出的部分成为新的历史，只保留最近的 hist 个采样
+    uint32_t drop = n;
+    memmove(plc->buf, plc->buf + (size_t)drop * ch, (size_t)(plc->len - drop) * ch * sizeof(int16_t));
+    plc->len -= drop;
+}
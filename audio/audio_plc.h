@@ -0,0 +1,72 @@
+/*************************************************************
+ * File  :  audio_plc.h
+ * Module:  Packet loss concealment and WSOLA time-stretch for
+ *          one playout stream.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_PLC_H_
+#define _AUDIO_PLC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint32_t frame_samples;     // 每帧每通道的采样数
+} audio_plc_config_t;
+
+// 以下长度均为每通道的采样数，缓冲区中为交织数据
+typedef struct {
+    audio_plc_config_t cfg;
+    int16_t *buf;               // [0, hist) 已播出的历史，[hist, len) 待播出
+    uint32_t cap;
+    uint32_t hist;
+    uint32_t len;
+    float *dec;                 // 基音搜索用的降采样单声道信号
+    int16_t *tmpl;              // 隐藏时循环播放的一个基音周期
+    uint32_t decim;
+    uint32_t min_lag;
+    uint32_t max_lag;
+    uint32_t fade_hold;         // 隐藏开始后保持原幅度的采样数
+    uint32_t fade_len;          // 之后淡出到静音的采样数
+    uint32_t merge_len;         // 隐藏结束时与新数据交叉淡化的采样数
+
+    bool concealing;
+    bool fade_in;               // 从静音开始，新数据淡入
+    uint32_t lag;
+    uint32_t tmpl_pos;
+    uint32_t concealed;         // 本次丢失已生成的采样数
+} audio_plc_t;
+
+int audio_plc_init(audio_plc_t *plc, const audio_plc_config_t *cfg);
+void audio_plc_deinit(audio_plc_t *plc);
+
+// 丢弃待播出数据和历史，回到静音状态
+void audio_plc_reset(audio_plc_t *plc);
+
+static inline uint32_t audio_plc_pending(const audio_plc_t *plc)
+{
+    return plc->len - plc->hist;
+}
+
+// 追加收到的数据，正在隐藏时先与隐藏信号交叉淡化；空间不足返回 -1
+int audio_plc_push(audio_plc_t *plc, const int16_t *data, uint32_t samples);
+
+// 按基音周期重复历史信号，追加 samples 个隐藏采样；已完全淡出时返回 false
+bool audio_plc_conceal(audio_plc_t *plc, uint32_t samples);
+
+// 在待播出数据中去掉/插入一个基音周期，返回改变的采样数，0 表示信号不适合变速；
+// 压缩后至少保留 keep 个待播出的采样
+uint32_t audio_plc_compress(audio_plc_t *plc, uint32_t keep);
+uint32_t audio_plc_expand(audio_plc_t *plc);
+
+// 取出 samples 个待播出的采样
+void audio_plc_read(audio_plc_t *plc, int16_t *out, uint32_t samples);
+
+#endif
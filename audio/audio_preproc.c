@@ -0,0 +1,196 @@
+/*************************************************************
+ * File  :  audio_preproc.c
+ * Module:  Capture pre-processing chain (noise suppression, then
+ *          automatic gain control) with per-stage timing.
+ *
+ * Stages run in a fixed order on the frame buffer in place:
+ * noise suppression first so the gain control measures speech
+ * rather than the plant-room floor. Every stage is timed on its
+ * own and recorded both in the per-second histograms and in the
+ * report against the frame duration, so the added CPU per frame
+ * and the added latency can be checked at any sample rate.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <string.h>
+
+#include "audio_preproc.h"
+#include "audio_time.h"
+#include "audio_stats.h"
+#include "log.h"
+
+static const char *const g_stage_names[AUDIO_PREPROC_STAGES] = {
+    [AUDIO_PREPROC_NS]  = "降噪",
+    [AUDIO_PREPROC_AGC] = "自动增益",
+};
+
+static const audio_stat_id_e g_stage_stats[AUDIO_PREPROC_STAGES] = {
+    [AUDIO_PREPROC_NS]  = AUDIO_STAT_NS,
+    [AUDIO_PREPROC_AGC] = AUDIO_STAT_AGC,
+};
+
+static audio_agc_config_t preproc_agc_config(const audio_preproc_config_t *cfg)
+{
+    audio_agc_config_t agc_cfg = {
+        .sample_rate    = cfg->sample_rate,
+        .frame_samples  = cfg->frame_samples,
+        .target_dbfs    = cfg->agc_target_dbfs,
+        .max_gain_db    = cfg->agc_max_gain_db,
+    };
+    return agc_cfg;
+}
+
+static int preproc_start_agc(audio_preproc_t *pp, const audio_preproc_config_t *cfg)
+{
+    audio_agc_config_t agc_cfg = preproc_agc_config(cfg);
+    return audio_agc_init(&pp->agc, &agc_cfg);
+}
+
+int audio_preproc_init(audio_preproc_t *pp, const audio_preproc_config_t *cfg)
+{
+    memset(pp, 0, sizeof(*pp));
+    pp->cfg = *cfg;
+
+    if (cfg->ns && cfg->channels != 1) {
+        LOGW("降噪只支持单声道，已跳过");
+    } else if ((cfg->ns || cfg->tunable) && cfg->channels == 1) {
+        audio_ns_config_t ns_cfg = { cfg->sample_rate, cfg->frame_samples, cfg->ns_max_db };
+        if (audio_ns_init(&pp->ns, &ns_cfg) < 0) {
+            audio_preproc_deinit(pp);
+            return -1;
+        }
+        pp->ready[AUDIO_PREPROC_NS] = true;
+        pp->enabled[AUDIO_PREPROC_NS] = cfg->ns;
+    }
+    // 自动增益没有需要分配的状态，打开时再初始化
+    if (cfg->agc && preproc_start_agc(pp, cfg) < 0) {
+        audio_preproc_deinit(pp);
+        return -1;
+    }
+    pp->ready[AUDIO_PREPROC_AGC] = cfg->agc || cfg->tunable;
+    pp->enabled[AUDIO_PREPROC_AGC] = cfg->agc;
+    if (!pp->ready[AUDIO_PREPROC_NS] && !pp->ready[AUDIO_PREPROC_AGC]) {
+        return -1;
+    }
+    return 0;
+}
+
+void audio_preproc_deinit(audio_preproc_t *pp)
+{
+    if (pp->ready[AUDIO_PREPROC_NS]) {
+        audio_ns_deinit(&pp->ns);
+    }
+    memset(pp->ready, 0, sizeof(pp->ready));
+    memset(pp->enabled, 0, sizeof(pp->enabled));
+}
+
+uint32_t audio_preproc_latency(const audio_preproc_t *pp)
+{
+    return pp->enabled[AUDIO_PREPROC_NS] ? pp->ns.latency : 0;
+}
+
+void audio_preproc_report(const audio_preproc_t *pp)
+{
+    double frame_us = (double)pp->cfg.frame_samples * 1000000.0 / pp->cfg.sample_rate;
+
+    for (int i = 0; i < AUDIO_PREPROC_STAGES; i++) {
+        const audio_preproc_stage_stats_t *st = &pp->stats[i];
+        uint64_t frames = atomic_load(&st->frames);
+        // 运行中关闭的阶段仍报告处理过的帧
+        if (!pp->enabled[i] && frames == 0) {
+            continue;
+        }
+        double avg_us = frames ? atomic_load(&st->cost_ns_sum) / 1000.0 / frames : 0.0;
+        LOGI("预处理 %s: 帧=%llu, 耗时 平均=%.1fus 最大=%.1fus, 占帧时长 %.2f%%",
+             g_stage_names[i], (unsigned long long)frames, avg_us, atomic_load(&st->cost_ns_max) / 1000.0,
+             avg_us * 100.0 / frame_us);
+    }
+    if (pp->enabled[AUDIO_PREPROC_NS]) {
+        LOGI("降噪附加延迟: %u 采样(%.1fms)", pp->ns.latency, pp->ns.latency * 1000.0 / pp->cfg.sample_rate);
+    }
+    if (pp->enabled[AUDIO_PREPROC_AGC]) {
+        LOGI("自动增益: 当前增益=%.1fdB, 门限以下=%llu 帧, 限幅=%llu 帧",
+             atomic_load(&pp->agc.stats.gain_db_x10) / 10.0, atomic_load(&pp->agc.stats.gated_frames),
+             atomic_load(&pp->agc.stats.limited_frames));
+    }
+}
+
+int audio_preproc_update(audio_preproc_t *pp, const audio_preproc_config_t *cfg)
+{
+    if (cfg->ns && !pp->ready[AUDIO_PREPROC_NS]) {
+        LOGE("降噪没有分配，无法在运行中打开");
+        return -1;
+    }
+    if (cfg->agc) {
+        audio_agc_config_t agc_cfg = preproc_agc_config(cfg);
+        if (!pp->ready[AUDIO_PREPROC_AGC] || !audio_agc_config_valid(&agc_cfg)) {
+            LOGE("自动增益参数不合法，无法在运行中打开");
+            return -1;
+        }
+    }
+    audio_seqlock_publish(&pp->update_lock, &pp->update, cfg, sizeof(*cfg));
+    return 0;
+}
+
+// 在帧边界切换: 降噪重新打开时从空缓冲开始，输出先垫上 latency 个静音采样，
+// 关闭时丢弃其中未输出的部分；自动增益重新打开时增益从 0dB 开始
+static void preproc_apply(audio_preproc_t *pp, const audio_preproc_config_t *cfg)
+{
+    if (pp->ready[AUDIO_PREPROC_NS]) {
+        if (cfg->ns && !pp->enabled[AUDIO_PREPROC_NS]) {
+            audio_ns_reset(&pp->ns);
+        }
+        audio_ns_set_max_db(&pp->ns, cfg->ns_max_db);
+        pp->enabled[AUDIO_PREPROC_NS] = cfg->ns;
+        pp->cfg.ns = cfg->ns;
+        pp->cfg.ns_max_db = cfg->ns_max_db;
+    }
+    if (pp->ready[AUDIO_PREPROC_AGC]) {
+        bool agc = cfg->agc;
+        // 参数在发布前已检查过；初始化仍然失败时保持关闭，不在未初始化的状态上处理
+        if (agc && !pp->enabled[AUDIO_PREPROC_AGC] && preproc_start_agc(pp, cfg) < 0) {
+            agc = false;
+        }
+        pp->agc.cfg.target_dbfs = cfg->agc_target_dbfs;
+        pp->agc.cfg.max_gain_db = cfg->agc_max_gain_db;
+        pp->enabled[AUDIO_PREPROC_AGC] = agc;
+        pp->cfg.agc = agc;
+        pp->cfg.agc_target_dbfs = cfg->agc_target_dbfs;
+        pp->cfg.agc_max_gain_db = cfg->agc_max_gain_db;
+    }
+}
+
+static void preproc_account(audio_preproc_t *pp, audio_preproc_stage_e stage, int64_t start_ns)
+{
+    audio_preproc_stage_stats_t *st = &pp->stats[stage];
+    uint64_t cost_ns = audio_now_ns() - start_ns;
+
+    audio_stats_record(g_stage_stats[stage], cost_ns);
+    atomic_fetch_add_explicit(&st->frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&st->cost_ns_sum, cost_ns, memory_order_relaxed);
+    if (cost_ns > atomic_load_explicit(&st->cost_ns_max, memory_order_relaxed)) {
+        atomic_store_explicit(&st->cost_ns_max, (uint32_t)cost_ns, memory_order_relaxed);
+    }
+}
+
+void audio_preproc_process(audio_preproc_t *pp, int16_t *data, uint32_t samples)
+{
+    audio_preproc_config_t update;
+    if (audio_seqlock_fetch(&pp->update_lock, &pp->update_seen, &update, &pp->update, sizeof(update))) {
+        preproc_apply(pp, &update);
+    }
+    if (pp->enabled[AUDIO_PREPROC_NS]) {
+        int64_t start_ns = audio_now_ns();
+        audio_ns_process(&pp->ns, data, samples);
+        preproc_account(pp, AUDIO_PREPROC_NS, start_ns);
+    }
+    if (pp->enabled[AUDIO_PREPROC_AGC]) {
+        int64_t start_ns = audio_now_ns();
+        audio_agc_process(&pp->agc, data, samples);
+        preproc_account(pp, AUDIO_PREPROC_AGC, start_ns);
+    }
+}
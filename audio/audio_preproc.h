@@ -0,0 +1,77 @@
+/*************************************************************
+ * File  :  audio_preproc.h
+ * Module:  Capture pre-processing chain (noise suppression, then
+ *          automatic gain control) with per-stage timing.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_PREPROC_H_
+#define _AUDIO_PREPROC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "audio_ns.h"
+#include "audio_agc.h"
+#include "audio_seqlock.h"
+
+typedef enum {
+    AUDIO_PREPROC_NS = 0,
+    AUDIO_PREPROC_AGC,
+    AUDIO_PREPROC_STAGES,
+} audio_preproc_stage_e;
+
+typedef struct {
+    uint32_t sample_rate;       // RTC 格式
+    uint32_t channels;
+    uint32_t frame_samples;     // 每帧每通道的采样数
+    bool ns;                    // 降噪只支持单声道
+    uint32_t ns_max_db;
+    bool agc;
+    int agc_target_dbfs;
+    uint32_t agc_max_gain_db;
+    bool tunable;               // 关闭的降噪也预先分配，以便运行中打开
+} audio_preproc_config_t;
+
+typedef struct {
+    atomic_ullong frames;
+    atomic_ullong cost_ns_sum;
+    atomic_uint cost_ns_max;
+} audio_preproc_stage_stats_t;
+
+typedef struct {
+    audio_preproc_config_t cfg;
+    bool ready[AUDIO_PREPROC_STAGES];       // 已分配，可以启用
+    bool enabled[AUDIO_PREPROC_STAGES];     // 当前启用，只由处理线程修改
+    audio_ns_t ns;
+    audio_agc_t agc;
+    audio_preproc_stage_stats_t stats[AUDIO_PREPROC_STAGES];
+
+    // 控制线程发布的新配置，在下一帧开始时生效
+    audio_seqlock_t update_lock;
+    audio_preproc_config_t update;
+    uint32_t update_seen;
+} audio_preproc_t;
+
+// 没有任何可用的处理阶段时返回 -1
+int audio_preproc_init(audio_preproc_t *pp, const audio_preproc_config_t *cfg);
+void audio_preproc_deinit(audio_preproc_t *pp);
+void audio_preproc_report(const audio_preproc_t *pp);
+
+// 在运行中打开/关闭各阶段或修改其参数，只由一个线程调用，不会阻塞处理线程；
+// 采样率、通道数和帧长必须与初始化时相同。要打开的阶段没有分配或参数不合法时
+// 返回 -1，不发布
+int audio_preproc_update(audio_preproc_t *pp, const audio_preproc_config_t *cfg);
+
+// 当前的附加延迟(采样)，降噪打开或关闭后随之改变
+uint32_t audio_preproc_latency(const audio_preproc_t *pp);
+
+// 原地处理一帧，samples 为采样总数
+void audio_preproc_process(audio_preproc_t *pp, int16_t *data, uint32_t samples);
+
+#endif
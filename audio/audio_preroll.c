@@ -0,0 +1,280 @@
+/*************************************************************
+ * File  :  audio_preroll.c
+ * Module:  Pre-roll capture ring that keeps the audio captured
+ *          while no connection is up and catches up after join.
+ *
+ * Capture keeps running while the connections are joining or
+ * reconnecting, so the sound card is drained at its own rate and
+ * never overruns. Every frame goes into a ring that holds at most
+ * window_ms; while offline nothing is taken out and the oldest
+ * audio is dropped once the window is full. Once a connection is
+ * up, each captured frame releases at least one frame, so the
+ * backlog never grows, and once two whole frames are queued the
+ * surplus is worked off in one of two ways:
+ *
+ *   stretch  pitch periods are cut out of the queued audio with the
+ *            WSOLA compressor of the playout PLC, at most 25% of
+ *            each frame, so speech plays back slightly faster and
+ *            silence is squeezed out first. If nothing could be
+ *            cut for 200ms (noise, music), or the backlog is still
+ *            there after twice the time the 25% rate would need, it
+ *            falls back to
+ *   burst    two frames are released per captured frame, i.e. the
+ *            backlog is sent at twice the real-time rate.
+ *
+ * A backlog of B ms is therefore gone after at most 8B ms of
+ * stretching plus B ms of bursting, or B ms in burst mode. Output
+ * frames carry the capture time of their last sample, so the
+ * capture-to-send latency in the statistics shows the backlog.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_preroll.h"
+#include "log.h"
+
+// 变速时每帧最多压缩的比例
+#define PREROLL_STRETCH_PCT (25)
+// 变速追赶的期限为按上述比例所需时间的倍数
+#define PREROLL_DEADLINE_FACTOR (2)
+// 连续这么久没能压缩时改为加速发送
+#define PREROLL_STALL_US (200 * 1000)
+// 加速发送时每次输入最多取出的帧数
+#define PREROLL_BURST_FRAMES (2)
+
+static const char *const g_preroll_mode_names[] = {
+    [AUDIO_PREROLL_STRETCH] = "stretch",
+    [AUDIO_PREROLL_BURST]   = "burst",
+};
+
+const char *audio_preroll_mode_name(audio_preroll_mode_e mode)
+{
+    return (unsigned)mode < AUDIO_PREROLL_MODE_COUNT ? g_preroll_mode_names[mode] : "?";
+}
+
+int audio_preroll_mode_parse(const char *name, audio_preroll_mode_e *mode)
+{
+    for (int i = 0; i < AUDIO_PREROLL_MODE_COUNT; i++) {
+        if (strcmp(name, g_preroll_mode_names[i]) == 0) {
+            *mode = (audio_preroll_mode_e)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int audio_preroll_init(audio_preroll_t *p, const audio_preroll_config_t *cfg)
+{
+    memset(p, 0, sizeof(*p));
+    p->cfg = *cfg;
+    if (cfg->sample_rate == 0 || cfg->channels == 0 || cfg->frame_samples == 0 ||
+        cfg->mode >= AUDIO_PREROLL_MODE_COUNT) {
+        return -1;
+    }
+
+    // 窗口至少一帧，环形缓冲区再多留一帧给正在写入的输入
+    p->window = (uint32_t)((uint64_t)cfg->sample_rate * cfg->window_ms / 1000);
+    if (p->window < cfg->frame_samples) {
+        p->window = cfg->frame_samples;
+    }
+    p->cap = p->window + cfg->frame_samples;
+    p->ring = calloc((size_t)p->cap * cfg->channels, sizeof(int16_t));
+    p->out = calloc((size_t)cfg->frame_samples * cfg->channels, sizeof(int16_t));
+    audio_plc_config_t plc_cfg = {
+        .sample_rate    = cfg->sample_rate,
+        .channels       = cfg->channels,
+        .frame_samples  = cfg->frame_samples,
+    };
+    if (!p->ring || !p->out || audio_plc_init(&p->stretch, &plc_cfg) < 0) {
+        audio_preroll_deinit(p);
+        return -1;
+    }
+    return 0;
+}
+
+void audio_preroll_deinit(audio_preroll_t *p)
+{
+    free(p->ring);
+    free(p->out);
+    p->ring = NULL;
+    p->out = NULL;
+    audio_plc_deinit(&p->stretch);
+}
+
+void audio_preroll_report(const audio_preroll_t *p)
+{
+    const audio_preroll_stats_t *s = &p->stats;
+    // 平均时间只算已经追上的几次
+    uint32_t catchups = atomic_load(&s->catchups);
+    uint32_t done = catchups - (p->catching_up ? 1 : 0);
+    uint32_t rate_ms = p->cfg.sample_rate / 1000;
+
+    LOGI("预录缓冲统计(%s, 窗口 %u ms): 输入=%llu 帧, 输出=%llu 帧, 积压 当前=%u ms 最大=%u ms, "
+         "丢弃=%llu ms, 压缩=%llu ms, 加速多发=%llu 帧, 追赶 %u 次(改为加速 %u 次) 平均=%llu ms 最大=%u ms",
+         audio_preroll_mode_name(p->cfg.mode), p->cfg.window_ms,
+         atomic_load(&s->frames_in), atomic_load(&s->frames_out),
+         atomic_load(&s->backlog) / rate_ms, atomic_load(&s->backlog_max) / rate_ms,
+         atomic_load(&s->dropped) / rate_ms, atomic_load(&s->compressed) / rate_ms,
+         atomic_load(&s->burst_frames), catchups, atomic_load(&s->fallbacks),
+         done ? atomic_load(&s->catchup_us_sum) / done / 1000 : 0ull,
+         atomic_load(&s->catchup_us_max) / 1000);
+}
+
+static void preroll_update_backlog(audio_preroll_t *p)
+{
+    uint32_t backlog = audio_preroll_backlog(p);
+
+    atomic_store_explicit(&p->stats.backlog, backlog, memory_order_relaxed);
+    if (backlog > atomic_load_explicit(&p->stats.backlog_max, memory_order_relaxed)) {
+        atomic_store_explicit(&p->stats.backlog_max, backlog, memory_order_relaxed);
+    }
+}
+
+void audio_preroll_push(audio_preroll_t *p, const int16_t *pcm, uint32_t samples, int64_t capture_us)
+{
+    uint32_t ch = p->cfg.channels;
+
+    atomic_fetch_add_explicit(&p->stats.frames_in, 1, memory_order_relaxed);
+    if (samples > p->window) {
+        atomic_fetch_add_explicit(&p->stats.dropped, samples - p->window, memory_order_relaxed);
+        pcm += (size_t)(samples - p->window) * ch;
+        samples = p->window;
+    }
+    // 积压超出窗口时丢弃环形缓冲区中最旧的音频，已进入压缩缓冲的部分不动
+    uint32_t over = audio_preroll_backlog(p) + samples > p->window ?
+                    audio_preroll_backlog(p) + samples - p->window : 0;
+    if (over > p->count) {
+        over = p->count;
+    }
+    if (over) {
+        p->head = (p->head + over) % p->cap;
+        p->count -= over;
+        atomic_fetch_add_explicit(&p->stats.dropped, over, memory_order_relaxed);
+    }
+
+    uint32_t tail = (p->head + p->count) % p->cap;
+    uint32_t first = samples < p->cap - tail ? samples : p->cap - tail;
+    memcpy(p->ring + (size_t)tail * ch, pcm, (size_t)first * ch * sizeof(int16_t));
+    memcpy(p->ring, pcm + (size_t)first * ch, (size_t)(samples - first) * ch * sizeof(int16_t));
+    p->count += samples;
+    p->last_us = capture_us;
+    p->tick_out = 0;
+    preroll_update_backlog(p);
+}
+
+// 从环形缓冲区搬到压缩缓冲，使其中至少有 need 个待发送的采样
+static void preroll_refill(audio_preroll_t *p, uint32_t need)
+{
+    uint32_t ch = p->cfg.channels;
+    audio_plc_t *st = &p->stretch;
+
+    while (p->count > 0 && audio_plc_pending(st) < need) {
+        uint32_t n = need - audio_plc_pending(st);
+        uint32_t room = st->cap - st->len;
+        n = n < p->count ? n : p->count;
+        n = n < room ? n : room;
+        n = n < p->cap - p->head ? n : p->cap - p->head;
+        if (n == 0 || audio_plc_push(st, p->ring + (size_t)p->head * ch, n) < 0) {
+            break;
+        }
+        p->head = (p->head + n) % p->cap;
+        p->count -= n;
+    }
+}
+
+// 积压达到两帧时开始追赶，期限按变速所需时间计算
+static void preroll_start_catchup(audio_preroll_t *p, uint32_t backlog)
+{
+    int64_t excess_us = (int64_t)(backlog - p->cfg.frame_samples) * 1000000 / p->cfg.sample_rate;
+
+    p->catching_up = true;
+    p->fallback = p->cfg.mode == AUDIO_PREROLL_BURST;
+    p->credit = 0;
+    p->catchup_start_us = p->last_us;
+    p->progress_us = p->last_us;
+    p->deadline_us = p->last_us + excess_us * 100 / PREROLL_STRETCH_PCT * PREROLL_DEADLINE_FACTOR;
+    atomic_fetch_add_explicit(&p->stats.catchups, 1, memory_order_relaxed);
+}
+
+static void preroll_end_catchup(audio_preroll_t *p)
+{
+    uint64_t us = p->last_us - p->catchup_start_us;
+
+    p->catching_up = false;
+    atomic_fetch_add_explicit(&p->stats.catchup_us_sum, us, memory_order_relaxed);
+    if (us > atomic_load_explicit(&p->stats.catchup_us_max, memory_order_relaxed)) {
+        atomic_store_explicit(&p->stats.catchup_us_max, (uint32_t)us, memory_order_relaxed);
+    }
+}
+
+// 每次输入最多压缩一帧的 25%，本次压缩多了就从后面的帧扣除；
+// 信号不适合变速、一点也没有压缩时返回 false
+static bool preroll_compress(audio_preroll_t *p)
+{
+    uint32_t fs = p->cfg.frame_samples;
+    int32_t limit = (int32_t)fs;
+
+    p->credit += (int32_t)(fs * PREROLL_STRETCH_PCT / 100);
+    if (p->credit > limit) {
+        p->credit = limit;
+    }
+    while (p->credit > 0 && audio_preroll_backlog(p) >= 2 * fs) {
+        // 压缩只作用于待发送部分的开头，先备足两个最长基音周期
+        preroll_refill(p, fs + 2 * p->stretch.max_lag);
+        uint32_t n = audio_plc_compress(&p->stretch, fs);
+        if (n == 0) {
+            return false;
+        }
+        p->credit -= (int32_t)n;
+        atomic_fetch_add_explicit(&p->stats.compressed, n, memory_order_relaxed);
+    }
+    return true;
+}
+
+bool audio_preroll_pop(audio_preroll_t *p, audio_frame_t *out)
+{
+    uint32_t fs = p->cfg.frame_samples;
+    uint32_t backlog = audio_preroll_backlog(p);
+
+    if (backlog < fs) {
+        return false;
+    }
+    if (!p->catching_up && backlog >= 2 * fs) {
+        preroll_start_catchup(p, backlog);
+    }
+    if (p->catching_up && !p->fallback && p->tick_out == 0) {
+        if (preroll_compress(p)) {
+            p->progress_us = p->last_us;
+        }
+        if (p->last_us >= p->deadline_us || p->last_us - p->progress_us >= PREROLL_STALL_US) {
+            p->fallback = true;
+            atomic_fetch_add_explicit(&p->stats.fallbacks, 1, memory_order_relaxed);
+        }
+    }
+    if (p->tick_out >= (p->catching_up && p->fallback ? PREROLL_BURST_FRAMES : 1)) {
+        return false;
+    }
+
+    preroll_refill(p, fs);
+    audio_plc_read(&p->stretch, p->out, fs);
+    if (p->tick_out++ > 0) {
+        atomic_fetch_add_explicit(&p->stats.burst_frames, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&p->stats.frames_out, 1, memory_order_relaxed);
+
+    // 剩下的积压都比这一帧新，这一帧的最后一个采样比最新输入早这么多
+    uint32_t remain = audio_preroll_backlog(p);
+    int64_t capture_us = p->last_us - (int64_t)remain * 1000000 / p->cfg.sample_rate;
+    audio_frame_borrow(out, p->out, (size_t)fs * p->cfg.channels * sizeof(int16_t), capture_us);
+    if (p->catching_up && remain < fs) {
+        preroll_end_catchup(p);
+    }
+    preroll_update_backlog(p);
+    return true;
+}
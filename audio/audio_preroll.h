@@ -0,0 +1,90 @@
+/*************************************************************
+ * File  :  audio_preroll.h
+ * Module:  Pre-roll capture ring that keeps the audio captured
+ *          while no connection is up and catches up after join.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_PREROLL_H_
+#define _AUDIO_PREROLL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "audio_frame.h"
+#include "audio_plc.h"
+
+typedef enum {
+    AUDIO_PREROLL_STRETCH = 0,      // 按基音周期压缩积压的音频，每帧最多缩短 25%
+    AUDIO_PREROLL_BURST,            // 每帧时间多发一帧，以两倍速率发出积压
+    AUDIO_PREROLL_MODE_COUNT,
+} audio_preroll_mode_e;
+
+typedef struct {
+    audio_preroll_mode_e mode;
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint32_t frame_samples;         // 每帧每通道的采样数，取出的帧都是这个长度
+    uint32_t window_ms;             // 最多保留的积压，超出时丢弃最旧的音频
+} audio_preroll_config_t;
+
+// 采样数均为每通道的采样数
+typedef struct {
+    atomic_ullong frames_in;
+    atomic_ullong frames_out;
+    atomic_ullong dropped;          // 积压超过窗口时丢弃的采样
+    atomic_ullong compressed;       // 变速压缩掉的采样
+    atomic_ullong burst_frames;     // 超出实时速率多发的帧
+    atomic_uint catchups;           // 开始追赶的次数
+    atomic_uint fallbacks;          // 变速未能按时追上、改为加速发送的次数
+    atomic_ullong catchup_us_sum;   // 积压回到一帧以内所用的时间
+    atomic_uint catchup_us_max;
+    atomic_uint backlog;            // 当前积压
+    atomic_uint backlog_max;
+} audio_preroll_stats_t;
+
+typedef struct {
+    audio_preroll_config_t cfg;
+    int16_t *ring;                  // 交织数据，[head, head + count) 为积压中较早的部分
+    uint32_t cap;
+    uint32_t head;
+    uint32_t count;
+    uint32_t window;
+    audio_plc_t stretch;            // 积压中即将发出的部分，只用其中的 WSOLA 压缩
+    int16_t *out;                   // 一帧输出
+    int64_t last_us;                // 最新输入的最后一个采样的采集时刻
+    uint32_t tick_out;              // 本次输入之后已经取出的帧数
+    int32_t credit;                 // 还可以压缩的采样数
+    bool catching_up;
+    bool fallback;
+    int64_t catchup_start_us;
+    int64_t deadline_us;            // 变速到这个时刻还没追上就改为加速发送
+    int64_t progress_us;            // 最近一次压缩成功的时刻
+    audio_preroll_stats_t stats;
+} audio_preroll_t;
+
+const char *audio_preroll_mode_name(audio_preroll_mode_e mode);
+int audio_preroll_mode_parse(const char *name, audio_preroll_mode_e *mode);
+
+int audio_preroll_init(audio_preroll_t *p, const audio_preroll_config_t *cfg);
+void audio_preroll_deinit(audio_preroll_t *p);
+void audio_preroll_report(const audio_preroll_t *p);
+
+static inline uint32_t audio_preroll_backlog(const audio_preroll_t *p)
+{
+    return p->count + audio_plc_pending(&p->stretch);
+}
+
+// 采集线程每收到一帧调用一次，不论是否有连接；capture_us 为最后一个采样的采集时刻
+void audio_preroll_push(audio_preroll_t *p, const int16_t *pcm, uint32_t samples, int64_t capture_us);
+
+// 有连接时在每次 push 之后循环调用，取出本次应发送的帧，out 借用内部缓冲区，
+// 下次调用前有效；没有可发送的帧时返回 false
+bool audio_preroll_pop(audio_preroll_t *p, audio_frame_t *out);
+
+#endif
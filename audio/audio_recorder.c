@@ -0,0 +1,531 @@
+/*************************************************************
+ * File  :  audio_recorder.c
+ * Module:  Asynchronous recording tap for the sent stream and
+ *          every received uid.
+ *
+ * Each producer thread (the capture thread, and the SDK callback
+ * of each connection) owns a lane and appends a small record
+ * header plus the PCM frame to its lane's active chunk without
+ * taking any lock, so a real-time thread never waits on the
+ * writer or on another producer. A chunk that fills up, or has
+ * been pending for RECORDER_FLUSH_MS when the next frame arrives,
+ * is handed over through the lane's single-producer queue; the
+ * writer thread drains every lane, demultiplexes the records per
+ * stream, issues one writev per stream per chunk and returns the
+ * chunk through the lane's free queue. All chunks are allocated
+ * up front from the memory budget and split evenly across lanes;
+ * when the disk falls behind and a lane has none free, frames are
+ * dropped and counted instead of stalling the audio paths.
+ *
+ * Every stream is written as WAV whose RIFF and data sizes start
+ * out as 0xFFFFFFFF, the streaming convention most readers
+ * accept, and are patched when the file is closed, so a file cut
+ * short by a crash is still playable. Files rotate on size or on
+ * audio duration, and a stream that has been quiet for
+ * RECORDER_IDLE_US is closed and its slot released.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "audio_recorder.h"
+#include "audio_rt.h"
+#include "audio_time.h"
+#include "log.h"
+
+#define RECORDER_FLUSH_MS (200)
+#define RECORDER_IDLE_US (5 * 1000000)
+#define RECORDER_RETRY_US (1000000)
+#define RECORDER_WAV_HEADER (44)
+#define RECORDER_PATH_SIZE (512)
+
+typedef struct {
+    int64_t t_us;
+    uint32_t conn_id;
+    uint32_t uid;
+    uint32_t len;
+    uint32_t dir;
+    uint32_t lane;
+} recorder_record_t;
+
+// 记录按 8 字节对齐，头部可以直接按结构体访问
+static size_t recorder_record_size(size_t len)
+{
+    return (sizeof(recorder_record_t) + len + 7) & ~(size_t)7;
+}
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    put_le16(p, v & 0xffff);
+    put_le16(p + 2, v >> 16);
+}
+
+static void recorder_wav_header(const audio_recorder_t *rec, uint8_t *h, uint32_t data_size)
+{
+    uint32_t channels = rec->cfg.channels;
+
+    memcpy(h, "RIFF", 4);
+    put_le32(h + 4, data_size == UINT32_MAX ? UINT32_MAX : data_size + RECORDER_WAV_HEADER - 8);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put_le32(h + 16, 16);
+    put_le16(h + 20, 1);
+    put_le16(h + 22, channels);
+    put_le32(h + 24, rec->cfg.sample_rate);
+    put_le32(h + 28, rec->byte_rate);
+    put_le16(h + 32, channels * sizeof(int16_t));
+    put_le16(h + 34, 16);
+    memcpy(h + 36, "data", 4);
+    put_le32(h + 40, data_size);
+}
+
+static void recorder_close_file(audio_recorder_t *rec, audio_recorder_stream_t *st)
+{
+    uint8_t header[RECORDER_WAV_HEADER];
+
+    if (st->fd < 0) {
+        return;
+    }
+    // 补上实际长度；超过 4GB 的文件保持流式长度
+    recorder_wav_header(rec, header, st->data_bytes < UINT32_MAX ? (uint32_t)st->data_bytes : UINT32_MAX);
+    if (pwrite(st->fd, header, sizeof(header), 0) != sizeof(header)) {
+        LOGW("无法更新录音文件头: %s", strerror(errno));
+    }
+    close(st->fd);
+    st->fd = -1;
+}
+
+static int recorder_open_file(audio_recorder_t *rec, audio_recorder_stream_t *st)
+{
+    char path[RECORDER_PATH_SIZE];
+    char stamp[32];
+    uint8_t header[RECORDER_WAV_HEADER];
+    time_t now = time(NULL);
+    struct tm tm;
+
+    localtime_r(&now, &tm);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    if (st->dir == AUDIO_RECORD_SEND) {
+        snprintf(path, sizeof(path), "%s/%s_%s_%u.wav", rec->cfg.dir, rec->cfg.send_basename, stamp,
+                 st->file_index);
+    } else {
+        snprintf(path, sizeof(path), "%s/%s_%u_%u_%s_%u.wav", rec->cfg.dir, rec->cfg.recv_basename,
+                 st->conn_id, st->uid, stamp, st->file_index);
+    }
+
+    st->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (st->fd < 0) {
+        LOGE("无法创建录音文件 %s: %s", path, strerror(errno));
+        return -1;
+    }
+    recorder_wav_header(rec, header, UINT32_MAX);
+    if (write(st->fd, header, sizeof(header)) != sizeof(header)) {
+        LOGE("无法写入录音文件 %s: %s", path, strerror(errno));
+        close(st->fd);
+        st->fd = -1;
+        return -1;
+    }
+    st->data_bytes = 0;
+    st->file_index++;
+    atomic_fetch_add_explicit(&rec->stats.files, 1, memory_order_relaxed);
+    LOGI("开始录音: %s", path);
+    return 0;
+}
+
+// 把该流积攒的帧一次写出，失败时关闭文件，一段时间后再重新创建
+static void recorder_flush_stream(audio_recorder_t *rec, audio_recorder_stream_t *st, int64_t now_us)
+{
+    struct iovec *iov = st->iov;
+    int count = st->iov_count;
+    int frames = st->iov_count;
+
+    if (count == 0) {
+        return;
+    }
+    while (count > 0) {
+        ssize_t n = writev(st->fd, iov, count);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            LOGE("写入录音文件失败: %s", strerror(errno));
+            atomic_fetch_add_explicit(&rec->stats.write_errors, frames, memory_order_relaxed);
+            recorder_close_file(rec, st);
+            st->retry_us = now_us + RECORDER_RETRY_US;
+            st->iov_count = 0;
+            st->iov_bytes = 0;
+            return;
+        }
+        // 部分写入时跳过已写出的部分
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    st->data_bytes += st->iov_bytes;
+    atomic_fetch_add_explicit(&rec->stats.frames, frames, memory_order_relaxed);
+    atomic_fetch_add_explicit(&rec->stats.bytes, st->iov_bytes, memory_order_relaxed);
+    st->iov_count = 0;
+    st->iov_bytes = 0;
+}
+
+static audio_recorder_stream_t *recorder_find_stream(audio_recorder_t *rec, const recorder_record_t *r)
+{
+    audio_recorder_stream_t *slot = NULL;
+
+    for (int i = 0; i < AUDIO_RECORDER_MAX_STREAMS; i++) {
+        audio_recorder_stream_t *st = &rec->streams[i];
+        if (!st->used) {
+            slot = slot ? slot : st;
+        } else if (st->dir == r->dir && st->conn_id == r->conn_id && st->uid == r->uid) {
+            return st;
+        }
+    }
+    if (!slot) {
+        return NULL;
+    }
+    memset(slot, 0, sizeof(*slot));
+    slot->used = true;
+    slot->dir = r->dir;
+    slot->conn_id = r->conn_id;
+    slot->uid = r->uid;
+    slot->lane = r->lane;
+    slot->fd = -1;
+    return slot;
+}
+
+static void recorder_append(audio_recorder_t *rec, const recorder_record_t *r, int64_t now_us)
+{
+    audio_recorder_stream_t *st = recorder_find_stream(rec, r);
+    if (!st) {
+        atomic_fetch_add_explicit(&rec->stats.rejected_frames, 1, memory_order_relaxed);
+        return;
+    }
+    st->last_us = r->t_us;
+
+    if (st->fd >= 0) {
+        uint64_t bytes = st->data_bytes + st->iov_bytes;
+        if (bytes > 0 && ((rec->rotate_bytes && bytes + r->len > rec->rotate_bytes) ||
+                          (rec->cfg.rotate_sec && bytes >= (uint64_t)rec->cfg.rotate_sec * rec->byte_rate))) {
+            recorder_flush_stream(rec, st, now_us);
+            recorder_close_file(rec, st);
+        }
+    }
+    if (st->fd < 0 && (now_us < st->retry_us || recorder_open_file(rec, st) < 0)) {
+        if (now_us >= st->retry_us) {
+            st->retry_us = now_us + RECORDER_RETRY_US;
+        }
+        atomic_fetch_add_explicit(&rec->stats.write_errors, 1, memory_order_relaxed);
+        return;
+    }
+
+    st->iov[st->iov_count].iov_base = (void *)(r + 1);
+    st->iov[st->iov_count].iov_len = r->len;
+    st->iov_count++;
+    st->iov_bytes += r->len;
+    if (st->iov_count == AUDIO_RECORDER_IOV_MAX) {
+        recorder_flush_stream(rec, st, now_us);
+    }
+}
+
+// iov 指向块内的数据，块归还之前必须把所有流写出
+static void recorder_process_chunk(audio_recorder_t *rec, const audio_recorder_chunk_t *c, int64_t now_us)
+{
+    size_t pos = 0;
+
+    while (pos < c->used) {
+        const recorder_record_t *r = (const recorder_record_t *)(c->data + pos);
+        recorder_append(rec, r, now_us);
+        pos += recorder_record_size(r->len);
+    }
+    for (int i = 0; i < AUDIO_RECORDER_MAX_STREAMS; i++) {
+        if (rec->streams[i].used && rec->streams[i].iov_count) {
+            recorder_flush_stream(rec, &rec->streams[i], now_us);
+        }
+    }
+}
+
+// 用户离开或不再说话后关闭文件并释放该流；通道中还压着该流最后一段数据时先不关闭，
+// 避免之后为这段数据再建一个文件
+static void recorder_close_idle(audio_recorder_t *rec, int64_t now_us)
+{
+    for (int i = 0; i < AUDIO_RECORDER_MAX_STREAMS; i++) {
+        audio_recorder_stream_t *st = &rec->streams[i];
+        if (st->used && !rec->lanes[st->lane].held && now_us - st->last_us > RECORDER_IDLE_US) {
+            recorder_close_file(rec, st);
+            st->used = false;
+        }
+    }
+}
+
+static int recorder_queue_init(audio_recorder_queue_t *q, uint32_t count)
+{
+    uint32_t cap = 1;
+
+    while (cap < count) {
+        cap <<= 1;
+    }
+    q->slots = calloc(cap, sizeof(*q->slots));
+    q->mask = cap - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    return q->slots ? 0 : -1;
+}
+
+// 队列容量不小于通道的块数，写入不会失败
+static void recorder_queue_push(audio_recorder_queue_t *q, audio_recorder_chunk_t *c)
+{
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    q->slots[head & q->mask] = c;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
+
+static audio_recorder_chunk_t *recorder_queue_pop(audio_recorder_queue_t *q)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    if (tail == atomic_load_explicit(&q->head, memory_order_acquire)) {
+        return NULL;
+    }
+    audio_recorder_chunk_t *c = q->slots[tail & q->mask];
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return c;
+}
+
+// 由通道的生产者调用；停止时生产者都已退出，改由写盘线程调用
+static void recorder_seal(audio_recorder_t *rec, audio_recorder_lane_t *lane)
+{
+    if (!lane->active) {
+        return;
+    }
+    recorder_queue_push(&lane->full, lane->active);
+    lane->active = NULL;
+    atomic_store_explicit(&lane->pending, false, memory_order_release);
+    sem_post(&rec->wake);
+}
+
+static void recorder_wait(audio_recorder_t *rec)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += RECORDER_FLUSH_MS * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    if (sem_timedwait(&rec->wake, &ts) == 0) {
+        // 一次唤醒就会取走所有通道的块，合并积压的通知
+        while (sem_trywait(&rec->wake) == 0) {
+        }
+    }
+}
+
+static void *recorder_thread(void *arg)
+{
+    audio_recorder_t *rec = arg;
+
+    for (;;) {
+        bool stopping = !atomic_load_explicit(&rec->accepting, memory_order_acquire);
+        uint32_t n = 0;
+
+        for (uint32_t i = 0; i < rec->lane_count; i++) {
+            audio_recorder_lane_t *lane = &rec->lanes[i];
+            if (stopping) {
+                recorder_seal(rec, lane);
+            }
+            // 先取快照再取块: 快照为假时，该通道之前交出的块都能在下面取到
+            lane->held = atomic_load_explicit(&lane->pending, memory_order_acquire);
+        }
+
+        int64_t now_us = audio_now_us();
+        for (uint32_t i = 0; i < rec->lane_count; i++) {
+            audio_recorder_lane_t *lane = &rec->lanes[i];
+            audio_recorder_chunk_t *c;
+            while ((c = recorder_queue_pop(&lane->full)) != NULL) {
+                recorder_process_chunk(rec, c, now_us);
+                c->used = 0;
+                atomic_fetch_sub_explicit(&rec->chunks_in_use, 1, memory_order_relaxed);
+                recorder_queue_push(&lane->free, c);
+                n++;
+            }
+        }
+        recorder_close_idle(rec, now_us);
+
+        if (stopping) {
+            break;
+        }
+        if (n == 0) {
+            recorder_wait(rec);
+        }
+    }
+    return NULL;
+}
+
+void audio_recorder_write(audio_recorder_t *rec, uint32_t lane_id, audio_record_dir_e dir, uint32_t conn_id,
+                          uint32_t uid, const void *data, size_t len)
+{
+    size_t need = recorder_record_size(len);
+
+    if (need > AUDIO_RECORDER_CHUNK_BYTES || lane_id >= rec->lane_count ||
+        !atomic_load_explicit(&rec->accepting, memory_order_relaxed)) {
+        return;
+    }
+    audio_recorder_lane_t *lane = &rec->lanes[lane_id];
+    int64_t now_us = audio_now_us();
+
+    // 块写满，或数据较少但已积攒 RECORDER_FLUSH_MS 时交给写盘线程，限制丢失进程时的数据量
+    if (lane->active && (lane->active->used + need > AUDIO_RECORDER_CHUNK_BYTES ||
+                         now_us - lane->active_us >= RECORDER_FLUSH_MS * 1000LL)) {
+        recorder_seal(rec, lane);
+    }
+    if (!lane->active) {
+        lane->active = recorder_queue_pop(&lane->free);
+        if (!lane->active) {
+            atomic_fetch_add_explicit(&rec->stats.dropped_frames, 1, memory_order_relaxed);
+            return;
+        }
+        lane->active_us = now_us;
+        atomic_store_explicit(&lane->pending, true, memory_order_relaxed);
+        uint32_t in_use = atomic_fetch_add_explicit(&rec->chunks_in_use, 1, memory_order_relaxed) + 1;
+        if (in_use > atomic_load_explicit(&rec->stats.chunks_peak, memory_order_relaxed)) {
+            atomic_store_explicit(&rec->stats.chunks_peak, in_use, memory_order_relaxed);
+        }
+    }
+
+    audio_recorder_chunk_t *c = lane->active;
+    recorder_record_t *r = (recorder_record_t *)(c->data + c->used);
+    r->t_us = now_us;
+    r->conn_id = conn_id;
+    r->uid = uid;
+    r->len = (uint32_t)len;
+    r->dir = dir;
+    r->lane = lane_id;
+    memcpy(r + 1, data, len);
+    c->used += need;
+}
+
+static void recorder_free(audio_recorder_t *rec)
+{
+    if (rec->chunks) {
+        free(rec->chunks[0].data);
+    }
+    if (rec->lanes) {
+        for (uint32_t i = 0; i < rec->lane_count; i++) {
+            free(rec->lanes[i].full.slots);
+            free(rec->lanes[i].free.slots);
+        }
+    }
+    free(rec->chunks);
+    free(rec->lanes);
+    rec->chunks = NULL;
+    rec->lanes = NULL;
+}
+
+int audio_recorder_start(audio_recorder_t *rec, const audio_recorder_config_t *cfg)
+{
+    memset(rec, 0, sizeof(*rec));
+    rec->cfg = *cfg;
+    if (!cfg->dir || cfg->sample_rate == 0 || cfg->channels == 0) {
+        return -1;
+    }
+    rec->byte_rate = cfg->sample_rate * cfg->channels * sizeof(int16_t);
+    rec->rotate_bytes = (uint64_t)cfg->rotate_mb * 1024 * 1024;
+    rec->lane_count = 1 + cfg->recv_lanes;
+    // 每条通道至少两块，一块在生产者手中，一块在写盘
+    uint32_t per_lane = (uint32_t)((uint64_t)cfg->budget_kb * 1024 / AUDIO_RECORDER_CHUNK_BYTES / rec->lane_count);
+    if (per_lane < 2) {
+        per_lane = 2;
+    }
+    rec->chunk_count = per_lane * rec->lane_count;
+
+    rec->chunks = calloc(rec->chunk_count, sizeof(*rec->chunks));
+    rec->lanes = calloc(rec->lane_count, sizeof(*rec->lanes));
+    uint8_t *data = malloc((size_t)rec->chunk_count * AUDIO_RECORDER_CHUNK_BYTES);
+    if (!rec->chunks || !rec->lanes || !data) {
+        LOGE("无法分配录音缓冲区");
+        free(data);
+        recorder_free(rec);
+        return -1;
+    }
+    audio_rt_prefault(data, (size_t)rec->chunk_count * AUDIO_RECORDER_CHUNK_BYTES);
+    for (uint32_t i = 0; i < rec->lane_count; i++) {
+        audio_recorder_lane_t *lane = &rec->lanes[i];
+        if (recorder_queue_init(&lane->full, per_lane) < 0 || recorder_queue_init(&lane->free, per_lane) < 0) {
+            LOGE("无法分配录音缓冲区");
+            recorder_free(rec);
+            return -1;
+        }
+        atomic_init(&lane->pending, false);
+        for (uint32_t j = 0; j < per_lane; j++) {
+            audio_recorder_chunk_t *c = &rec->chunks[i * per_lane + j];
+            c->data = data + (size_t)(i * per_lane + j) * AUDIO_RECORDER_CHUNK_BYTES;
+            recorder_queue_push(&lane->free, c);
+        }
+    }
+
+    sem_init(&rec->wake, 0, 0);
+    atomic_init(&rec->chunks_in_use, 0);
+    atomic_store(&rec->accepting, true);
+    atomic_store(&rec->running, true);
+    if (pthread_create(&rec->thread, NULL, recorder_thread, rec) != 0) {
+        LOGE("无法创建录音线程");
+        atomic_store(&rec->running, false);
+        sem_destroy(&rec->wake);
+        recorder_free(rec);
+        return -1;
+    }
+
+    LOGI("录音已启动: 目录=%s, 内存预算=%u 通道 x %u 块 x %uKB, 轮转=%uMB/%us", cfg->dir, rec->lane_count,
+         per_lane, AUDIO_RECORDER_CHUNK_BYTES / 1024, cfg->rotate_mb, cfg->rotate_sec);
+    return 0;
+}
+
+void audio_recorder_stop(audio_recorder_t *rec)
+{
+    if (!atomic_exchange(&rec->running, false)) {
+        return;
+    }
+    atomic_store_explicit(&rec->accepting, false, memory_order_release);
+    sem_post(&rec->wake);
+    pthread_join(rec->thread, NULL);
+
+    for (int i = 0; i < AUDIO_RECORDER_MAX_STREAMS; i++) {
+        if (rec->streams[i].used) {
+            recorder_close_file(rec, &rec->streams[i]);
+            rec->streams[i].used = false;
+        }
+    }
+
+    audio_recorder_stats_t *stats = &rec->stats;
+    LOGI("录音统计: 文件=%llu, 写入=%llu 帧 %.1fMB, 内存预算不足丢弃=%llu, 流数超限丢弃=%llu, "
+         "写盘失败=%llu, 缓冲块峰值=%u/%u",
+         atomic_load(&stats->files), atomic_load(&stats->frames),
+         atomic_load(&stats->bytes) / 1024.0 / 1024.0, atomic_load(&stats->dropped_frames),
+         atomic_load(&stats->rejected_frames), atomic_load(&stats->write_errors),
+         atomic_load(&stats->chunks_peak), rec->chunk_count);
+
+    sem_destroy(&rec->wake);
+    recorder_free(rec);
+}
@@ -0,0 +1,130 @@
+/*************************************************************
+ * File  :  audio_recorder.h
+ * Module:  Asynchronous recording tap for the sent stream and
+ *          every received uid.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_RECORDER_H_
+#define _AUDIO_RECORDER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/uio.h>
+
+#include "audio_ring.h"
+
+// 发送流加上同时录制的接收用户数
+#define AUDIO_RECORDER_MAX_STREAMS (33)
+// 每块缓冲区的大小，内存预算按块预分配
+#define AUDIO_RECORDER_CHUNK_BYTES (64 * 1024)
+#define AUDIO_RECORDER_IOV_MAX (64)
+// 发送流固定使用通道 0，第 N 个连接的接收回调使用通道 N
+#define AUDIO_RECORDER_SEND_LANE (0)
+
+typedef enum {
+    AUDIO_RECORD_SEND = 0,          // 发给所有连接的采集音频
+    AUDIO_RECORD_RECV,              // 某个连接上某个用户的接收音频
+} audio_record_dir_e;
+
+typedef struct {
+    const char *dir;                // 录音文件目录
+    const char *send_basename;
+    const char *recv_basename;
+    uint32_t sample_rate;           // 两个方向都是 RTC 格式的 S16 PCM
+    uint32_t channels;
+    uint32_t rotate_mb;             // 单个文件的大小上限，0 表示不限
+    uint32_t rotate_sec;            // 单个文件的音频时长上限，0 表示不限
+    uint32_t budget_kb;             // 等待写盘的数据最多占用的内存，平均分给各通道
+    uint32_t recv_lanes;            // 接收回调的通道数，每个连接一条
+} audio_recorder_config_t;
+
+typedef struct {
+    atomic_ullong frames;           // 写入文件的帧
+    atomic_ullong bytes;
+    atomic_ullong dropped_frames;   // 内存预算用尽时丢弃的帧
+    atomic_ullong rejected_frames;  // 录音流数已满时丢弃的帧
+    atomic_ullong write_errors;     // 写盘失败丢失的帧
+    atomic_ullong files;            // 创建的文件数
+    atomic_uint chunks_peak;        // 同时等待写盘的缓冲块数峰值
+} audio_recorder_stats_t;
+
+typedef struct audio_recorder_chunk {
+    uint8_t *data;
+    size_t used;
+} audio_recorder_chunk_t;
+
+// 单生产者单消费者的块队列，容量为 2 的幂
+typedef struct {
+    audio_recorder_chunk_t **slots;
+    uint32_t mask;
+    _Alignas(AUDIO_CACHE_LINE) atomic_uint head;    // 只由写入方修改
+    _Alignas(AUDIO_CACHE_LINE) atomic_uint tail;    // 只由读取方修改
+} audio_recorder_queue_t;
+
+// 每个生产者线程独占一条通道，与写盘线程之间只通过两个块队列交接
+typedef struct {
+    audio_recorder_chunk_t *active; // 生产者正在追加的块，只由生产者访问
+    int64_t active_us;              // active 中第一帧的时刻
+    atomic_bool pending;            // active 中有尚未交给写盘线程的数据
+    bool held;                      // 写盘线程每轮开始时对 pending 的快照
+    audio_recorder_queue_t full;    // 生产者 -> 写盘线程
+    audio_recorder_queue_t free;    // 写盘线程 -> 生产者
+} audio_recorder_lane_t;
+
+// 只由写盘线程访问
+typedef struct {
+    bool used;
+    audio_record_dir_e dir;
+    uint32_t conn_id;
+    uint32_t uid;
+    uint32_t lane;                  // 写入该流的通道，通道还有未交出的数据时不按空闲关闭
+    int fd;
+    uint64_t data_bytes;            // 当前文件已写入的 PCM 字节数
+    uint32_t file_index;
+    int64_t last_us;                // 最近一帧的入队时刻，超过空闲时间后关闭文件
+    int64_t retry_us;               // 写盘失败后，到这个时刻之前不再创建文件
+    struct iovec iov[AUDIO_RECORDER_IOV_MAX];
+    int iov_count;
+    size_t iov_bytes;
+} audio_recorder_stream_t;
+
+typedef struct {
+    audio_recorder_config_t cfg;
+    uint64_t rotate_bytes;
+    uint32_t byte_rate;
+    pthread_t thread;
+    atomic_bool running;
+
+    // 生产者只拷贝一帧到自己通道的块中，不加锁，也从不等待磁盘
+    audio_recorder_lane_t *lanes;
+    uint32_t lane_count;
+    audio_recorder_chunk_t *chunks;
+    uint32_t chunk_count;
+    atomic_uint chunks_in_use;
+    atomic_bool accepting;
+    sem_t wake;                     // 生产者交出块时唤醒写盘线程
+
+    audio_recorder_stream_t streams[AUDIO_RECORDER_MAX_STREAMS];
+    audio_recorder_stats_t stats;
+} audio_recorder_t;
+
+int audio_recorder_start(audio_recorder_t *rec, const audio_recorder_config_t *cfg);
+
+// 停止接收新帧，把已排队的数据写完并关闭所有文件；调用前所有生产者必须已经退出
+void audio_recorder_stop(audio_recorder_t *rec);
+
+// 同一通道只能由一个线程调用，不同通道之间互不影响；通道的块用尽时丢弃该帧并计数，
+// 不加锁也不会阻塞在磁盘上
+void audio_recorder_write(audio_recorder_t *rec, uint32_t lane, audio_record_dir_e dir, uint32_t conn_id,
+                          uint32_t uid, const void *data, size_t len);
+
+#endif
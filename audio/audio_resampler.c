@@ -0,0 +1,216 @@
+/*************************************************************
+ * File  :  audio_resampler.c
+ * Module:  Polyphase sample-rate converter for interleaved S16.
+ *
+ * A Kaiser-windowed sinc is tabulated at RESAMPLER_PHASES
+ * fractional offsets in Q15. The read position advances in
+ * 32.32 fixed point, so any ratio (including the fine ppm
+ * adjustment used for clock-drift compensation) is handled
+ * without a rational L/M decomposition. The inner product is
+ * the only hot loop and has SSE2 and NEON versions.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio_resampler.h"
+#include "audio_simd.h"
+
+#define RESAMPLER_PHASES (256)
+#define RESAMPLER_BASE_TAPS (24)
+#define RESAMPLER_CUTOFF (0.92)
+#define RESAMPLER_KAISER_BETA (8.0)
+
+static double bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static void resampler_build_filter(audio_resampler_t *rs)
+{
+    double fc = rs->out_rate < rs->in_rate ? (double)rs->out_rate / rs->in_rate : 1.0;
+    double half = rs->taps / 2.0;
+    double i0_beta = bessel_i0(RESAMPLER_KAISER_BETA);
+
+    fc *= RESAMPLER_CUTOFF;
+    for (uint32_t p = 0; p <= RESAMPLER_PHASES; p++) {
+        double frac = (double)p / RESAMPLER_PHASES;
+        double h[rs->taps];
+        double sum = 0.0;
+
+        for (uint32_t k = 0; k < rs->taps; k++) {
+            double u = (double)k - (half - 1) - frac;
+            double x = fc * u;
+            double sinc = fabs(x) < 1e-9 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+            double r = u / half;
+            double w = fabs(r) < 1.0 ? bessel_i0(RESAMPLER_KAISER_BETA * sqrt(1.0 - r * r)) / i0_beta : 0.0;
+            h[k] = sinc * w;
+            sum += h[k];
+        }
+        // 每个相位单独归一化，保证直流增益为 1
+        for (uint32_t k = 0; k < rs->taps; k++) {
+            rs->coefs[p * rs->taps + k] = (int16_t)lrint(h[k] / sum * 32767.0);
+        }
+    }
+}
+
+static inline int32_t dot_s16(const int16_t *x, const int16_t *c, uint32_t n)
+{
+#if defined(AUDIO_HAVE_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (uint32_t k = 0; k < n; k += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(x + k));
+        __m128i b = _mm_load_si128((const __m128i *)(c + k));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a, b));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(acc);
+#elif defined(AUDIO_HAVE_NEON)
+    int32x4_t acc = vdupq_n_s32(0);
+    for (uint32_t k = 0; k < n; k += 8) {
+        int16x8_t a = vld1q_s16(x + k);
+        int16x8_t b = vld1q_s16(c + k);
+        acc = vmlal_s16(acc, vget_low_s16(a), vget_low_s16(b));
+        acc = vmlal_s16(acc, vget_high_s16(a), vget_high_s16(b));
+    }
+#if defined(__aarch64__)
+    return vaddvq_s32(acc);
+#else
+    int32x2_t s = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    return vget_lane_s32(vpadd_s32(s, s), 0);
+#endif
+#else
+    int32_t acc = 0;
+    for (uint32_t k = 0; k < n; k++) {
+        acc += (int32_t)x[k] * c[k];
+    }
+    return acc;
+#endif
+}
+
+static void resampler_update_step(audio_resampler_t *rs)
+{
+    double ratio = (double)rs->in_rate / rs->out_rate * (1.0 + rs->ratio_ppm * 1e-6);
+    rs->step = (uint64_t)(ratio * 4294967296.0);
+}
+
+int audio_resampler_init(audio_resampler_t *rs, uint32_t in_rate, uint32_t out_rate,
+                         uint32_t channels, uint32_t max_in_frames)
+{
+    void *mem = NULL;
+
+    memset(rs, 0, sizeof(*rs));
+    if (!in_rate || !out_rate || !channels || channels > AUDIO_RESAMPLER_MAX_CHANNELS) {
+        return -1;
+    }
+
+    rs->in_rate = in_rate;
+    rs->out_rate = out_rate;
+    rs->channels = channels;
+    rs->max_in_frames = max_in_frames;
+
+    // 降采样时滤波器按比例加长，保持相同的过渡带宽度
+    double scale = out_rate < in_rate ? (double)in_rate / out_rate : 1.0;
+    rs->taps = ((uint32_t)ceil(RESAMPLER_BASE_TAPS * scale) + 7) & ~7u;
+
+    if (posix_memalign(&mem, 16, (size_t)(RESAMPLER_PHASES + 1) * rs->taps * sizeof(int16_t)) != 0) {
+        return -1;
+    }
+    rs->coefs = mem;
+    for (uint32_t ch = 0; ch < channels; ch++) {
+        rs->history[ch] = calloc(rs->taps + max_in_frames, sizeof(int16_t));
+        if (!rs->history[ch]) {
+            audio_resampler_deinit(rs);
+            return -1;
+        }
+    }
+
+    resampler_build_filter(rs);
+    // 预置 taps-1 个零采样，使第一个输出对齐到输入起点
+    rs->hist_len = rs->taps - 1;
+    rs->pos = 0;
+    resampler_update_step(rs);
+    return 0;
+}
+
+void audio_resampler_deinit(audio_resampler_t *rs)
+{
+    free(rs->coefs);
+    rs->coefs = NULL;
+    for (uint32_t ch = 0; ch < AUDIO_RESAMPLER_MAX_CHANNELS; ch++) {
+        free(rs->history[ch]);
+        rs->history[ch] = NULL;
+    }
+}
+
+uint32_t audio_resampler_max_out(const audio_resampler_t *rs, uint32_t in_frames)
+{
+    return (uint32_t)((uint64_t)in_frames * rs->out_rate / rs->in_rate) + 4;
+}
+
+void audio_resampler_set_ppm(audio_resampler_t *rs, double ppm)
+{
+    rs->ratio_ppm = ppm;
+    resampler_update_step(rs);
+}
+
+uint32_t audio_resampler_process(audio_resampler_t *rs, const int16_t *in, uint32_t in_frames,
+                                 int16_t *out)
+{
+    uint32_t channels = rs->channels;
+    uint32_t produced = 0;
+
+    if (in_frames > rs->max_in_frames) {
+        in_frames = rs->max_in_frames;
+    }
+
+    // 解交错追加到各通道历史缓冲
+    for (uint32_t ch = 0; ch < channels; ch++) {
+        int16_t *h = rs->history[ch] + rs->hist_len;
+        for (uint32_t i = 0; i < in_frames; i++) {
+            h[i] = in[i * channels + ch];
+        }
+    }
+    rs->hist_len += in_frames;
+
+    for (;;) {
+        uint32_t idx = (uint32_t)(rs->pos >> 32);
+        uint32_t phase = (uint32_t)(((rs->pos & 0xffffffffu) * RESAMPLER_PHASES + 0x80000000u) >> 32);
+        if (idx + rs->taps > rs->hist_len) {
+            break;
+        }
+
+        const int16_t *c = rs->coefs + (size_t)phase * rs->taps;
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            int32_t acc = dot_s16(rs->history[ch] + idx, c, rs->taps);
+            out[produced * channels + ch] = audio_sat16((acc + (1 << 14)) >> 15);
+        }
+        produced++;
+        rs->pos += rs->step;
+    }
+
+    // 丢弃已经用不到的历史采样
+    uint32_t consumed = (uint32_t)(rs->pos >> 32);
+    if (consumed > rs->hist_len) {
+        consumed = rs->hist_len;
+    }
+    for (uint32_t ch = 0; ch < channels; ch++) {
+        memmove(rs->history[ch], rs->history[ch] + consumed,
+                (rs->hist_len - consumed) * sizeof(int16_t));
+    }
+    rs->hist_len -= consumed;
+    rs->pos -= (uint64_t)consumed << 32;
+    return produced;
+}
@@ -0,0 +1,46 @@
+/*************************************************************
+ * File  :  audio_resampler.h
+ * Module:  Polyphase sample-rate converter for interleaved S16.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_RESAMPLER_H_
+#define _AUDIO_RESAMPLER_H_
+
+#include <stdint.h>
+
+#define AUDIO_RESAMPLER_MAX_CHANNELS (8)
+
+typedef struct {
+    uint32_t in_rate;
+    uint32_t out_rate;
+    uint32_t channels;
+    uint32_t taps;                  // 每个相位的抽头数，8 的倍数
+    uint32_t max_in_frames;         // 单次输入的最大帧数
+    int16_t *coefs;                 // (相位数+1) x taps，Q15
+    int16_t *history[AUDIO_RESAMPLER_MAX_CHANNELS];
+    uint32_t hist_len;              // 历史缓冲中的有效采样数
+    uint64_t pos;                   // 32.32 定点读位置
+    uint64_t step;                  // 32.32 定点步长 = in_rate / out_rate
+    double ratio_ppm;               // 额外的细调比例
+} audio_resampler_t;
+
+int audio_resampler_init(audio_resampler_t *rs, uint32_t in_rate, uint32_t out_rate,
+                         uint32_t channels, uint32_t max_in_frames);
+void audio_resampler_deinit(audio_resampler_t *rs);
+
+// 输出帧数上限，用于分配输出缓冲
+uint32_t audio_resampler_max_out(const audio_resampler_t *rs, uint32_t in_frames);
+
+// 处理 in_frames 帧交错输入，返回写入 out 的帧数
+uint32_t audio_resampler_process(audio_resampler_t *rs, const int16_t *in, uint32_t in_frames,
+                                 int16_t *out);
+
+// 在名义比例上叠加 ppm 级别的微调，正值表示消耗更多输入
+void audio_resampler_set_ppm(audio_resampler_t *rs, double ppm);
+
+#endif
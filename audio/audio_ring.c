@@ -0,0 +1,111 @@
+/*************************************************************
+ * File  :  audio_ring.c
+ * Module:  Lock-free single-producer/single-consumer ring of
+ *          preallocated audio frames.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_ring.h"
+
+static uint32_t round_up_pow2(uint32_t v)
+{
+    uint32_t n = 1;
+    while (n < v) {
+        n <<= 1;
+    }
+    return n;
+}
+
+int audio_ring_init(audio_ring_t *ring, uint32_t slot_count, uint32_t slot_size)
+{
+    void *data = NULL;
+
+    memset(ring, 0, sizeof(*ring));
+    if (slot_count == 0 || slot_size == 0) {
+        return -1;
+    }
+
+    ring->slot_count = round_up_pow2(slot_count);
+    ring->mask = ring->slot_count - 1;
+    // 槽位按 cache line 对齐，方便后续 SIMD 处理
+    ring->slot_size = (slot_size + AUDIO_CACHE_LINE - 1) & ~(uint32_t)(AUDIO_CACHE_LINE - 1);
+
+    if (posix_memalign(&data, AUDIO_CACHE_LINE, (size_t)ring->slot_count * ring->slot_size) != 0) {
+        return -1;
+    }
+    ring->data = data;
+    ring->meta = calloc(ring->slot_count, sizeof(audio_slot_meta_t));
+    if (!ring->meta) {
+        free(ring->data);
+        ring->data = NULL;
+        return -1;
+    }
+    // 预先触碰所有页面，避免运行时缺页
+    memset(ring->data, 0, (size_t)ring->slot_count * ring->slot_size);
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return 0;
+}
+
+void audio_ring_deinit(audio_ring_t *ring)
+{
+    free(ring->data);
+    free(ring->meta);
+    ring->data = NULL;
+    ring->meta = NULL;
+}
+
+void *audio_ring_write_begin(audio_ring_t *ring, audio_slot_meta_t **meta)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head - tail >= ring->slot_count) {
+        return NULL;
+    }
+    if (meta) {
+        *meta = &ring->meta[head & ring->mask];
+    }
+    return ring->data + (size_t)(head & ring->mask) * ring->slot_size;
+}
+
+void audio_ring_write_commit(audio_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+const void *audio_ring_read_begin(audio_ring_t *ring, const audio_slot_meta_t **meta)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head == tail) {
+        return NULL;
+    }
+    if (meta) {
+        *meta = &ring->meta[tail & ring->mask];
+    }
+    return ring->data + (size_t)(tail & ring->mask) * ring->slot_size;
+}
+
+void audio_ring_read_commit(audio_ring_t *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+uint32_t audio_ring_count(const audio_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&((audio_ring_t *)ring)->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&((audio_ring_t *)ring)->tail, memory_order_acquire);
+    return head - tail;
+}
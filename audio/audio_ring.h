@@ -0,0 +1,56 @@
+/*************************************************************
+ * File  :  audio_ring.h
+ * Module:  Lock-free single-producer/single-consumer ring of
+ *          preallocated audio frames.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_RING_H_
+#define _AUDIO_RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define AUDIO_CACHE_LINE (64)
+
+// 每个槽位附带的元数据
+typedef struct {
+    int64_t ts_us;      // 入队时间(单调时钟)
+    uint32_t len;       // 有效字节数
+    uint32_t uid;       // 来源用户
+    uint16_t sent_ts;   // 发送端时间戳
+} audio_slot_meta_t;
+
+// 槽位在初始化时一次性分配，读写路径上不做任何内存分配。
+// head 只由生产者写，tail 只由消费者写，分别占用独立的 cache line。
+typedef struct {
+    uint8_t *data;
+    audio_slot_meta_t *meta;
+    uint32_t slot_size;
+    uint32_t slot_count;    // 2 的幂
+    uint32_t mask;
+
+    _Alignas(AUDIO_CACHE_LINE) atomic_uint head;
+    _Alignas(AUDIO_CACHE_LINE) atomic_uint tail;
+} audio_ring_t;
+
+int audio_ring_init(audio_ring_t *ring, uint32_t slot_count, uint32_t slot_size);
+void audio_ring_deinit(audio_ring_t *ring);
+
+// 生产者: 取得下一个空闲槽位，满时返回 NULL
+void *audio_ring_write_begin(audio_ring_t *ring, audio_slot_meta_t **meta);
+void audio_ring_write_commit(audio_ring_t *ring);
+
+// 消费者: 取得最早的已提交槽位，空时返回 NULL
+const void *audio_ring_read_begin(audio_ring_t *ring, const audio_slot_meta_t **meta);
+void audio_ring_read_commit(audio_ring_t *ring);
+
+// 当前已提交的槽位数(近似值，任意线程可调用)
+uint32_t audio_ring_count(const audio_ring_t *ring);
+
+#endif
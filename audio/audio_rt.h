@@ -0,0 +1,40 @@
+/*************************************************************
+ * File  :  audio_rt.h
+ * Module:  Real-time scheduling, CPU pinning and memory locking
+ *          for audio threads.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_RT_H_
+#define _AUDIO_RT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define AUDIO_RT_DEFAULT_PRIORITY (70)
+// 线程启动时预先触碰的栈大小
+#define AUDIO_RT_STACK_PREFAULT_BYTES (128 * 1024)
+
+typedef struct {
+    bool enabled;       // 以 SCHED_FIFO 运行
+    int priority;       // SCHED_FIFO 优先级，超出系统范围时截断
+    int cpu;            // 绑定的 CPU，小于 0 表示不绑定
+} audio_rt_config_t;
+
+// 锁定当前和以后的全部内存，并让 malloc 不再把释放的内存还给系统。
+// 需要在分配音频缓冲区之前调用。
+int audio_rt_lock_memory(void);
+
+// 在音频线程入口调用: 命名线程、设置调度策略和 CPU 亲和性并预先触碰栈。
+// 权限不足时只打印警告，线程仍以普通调度运行。
+void audio_rt_enter(const audio_rt_config_t *rt, const char *name);
+
+// 逐页写入一遍，保证缓冲区在启动阶段就已经驻留
+void audio_rt_prefault(void *buf, size_t len);
+
+#endif
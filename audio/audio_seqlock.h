@@ -0,0 +1,54 @@
+/*************************************************************
+ * File  :  audio_seqlock.h
+ * Module:  Single-writer sequence lock that hands small parameter
+ *          blocks to real-time threads without blocking them.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_SEQLOCK_H_
+#define _AUDIO_SEQLOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+
+typedef struct {
+    atomic_uint seq;                // 奇数表示正在写入，每发布一次加 2
+} audio_seqlock_t;
+
+// 只由一个线程调用，把 src 发布到 box
+static inline void audio_seqlock_publish(audio_seqlock_t *lock, void *box, const void *src, size_t size)
+{
+    uint32_t seq = atomic_load_explicit(&lock->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&lock->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(box, src, size);
+    atomic_store_explicit(&lock->seq, seq + 2, memory_order_release);
+}
+
+// 读者在帧开始时调用，从不等待: box 中有 *seen 之后发布的完整版本时拷到 dst 并返回 true；
+// 正在写入或拷贝期间被改写时返回 false，留到下一帧再取
+static inline bool audio_seqlock_fetch(audio_seqlock_t *lock, uint32_t *seen, void *dst, const void *box,
+                                       size_t size)
+{
+    uint32_t seq = atomic_load_explicit(&lock->seq, memory_order_acquire);
+
+    if (seq == *seen || (seq & 1)) {
+        return false;
+    }
+    memcpy(dst, box, size);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&lock->seq, memory_order_relaxed) != seq) {
+        return false;
+    }
+    *seen = seq;
+    return true;
+}
+
+#endif
@@ -0,0 +1,52 @@
+/*************************************************************
+ * File  :  audio_simd.h
+ * Module:  SIMD feature selection shared by the DSP kernels.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_SIMD_H_
+#define _AUDIO_SIMD_H_
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#define AUDIO_HAVE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AUDIO_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(AUDIO_HAVE_SSE2)
+#define AUDIO_SIMD_NAME "sse2"
+#elif defined(AUDIO_HAVE_NEON)
+#define AUDIO_SIMD_NAME "neon"
+#else
+#define AUDIO_SIMD_NAME "scalar"
+#endif
+
+static inline int16_t audio_sat16(int32_t v)
+{
+    return v > 32767 ? 32767 : (v < -32768 ? -32768 : (int16_t)v);
+}
+
+#if defined(AUDIO_HAVE_NEON)
+// 浮点转整数按最近偶数舍入，与 SSE2 的 cvtps 和标量的 lrintf 结果一致；vcvtq_s32_f32 向零截断，不能直接用
+static inline int32x4_t audio_neon_round_s32(float32x4_t v)
+{
+#if defined(__aarch64__)
+    return vcvtnq_s32_f32(v);
+#else
+    // ARMv7 没有舍入转换: 加减 1.5*2^23 后小数部分已按最近偶数舍去，|v| < 2^22 时结果精确，
+    // 更大的值舍入有误差，但转换后仍会饱和到同一个 16 位边界
+    const float32x4_t magic = vdupq_n_f32(12582912.0f);
+    return vcvtq_s32_f32(vsubq_f32(vaddq_f32(v, magic), magic));
+#endif
+}
+#endif
+
+#endif
@@ -0,0 +1,276 @@
+/*************************************************************
+ * File  :  audio_source.c
+ * Module:  Pluggable send-side audio sources.
+ *
+ * The ALSA source is the poll-driven capture thread. File and
+ * generator sources run on their own thread driven by the
+ * absolute-time pacer, so they can generate load and run
+ * reproducible soak tests without a sound card. PCM files are
+ * memory-mapped; pre-encoded files go through the SDK file
+ * parser and are sent as-is, with no encode cost on the device.
+ * A batch of N makes those sources wake once per N intervals and
+ * emit N frames back to back, stamped as if each had been
+ * captured at the end of its own interval, mirroring the
+ * batched capture thread.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "audio_source.h"
+#include "audio_stats.h"
+#include "log.h"
+
+#define SOURCE_TONE_AMPLITUDE (8192.0)
+#define SOURCE_NOISE_SHIFT (19)
+
+static const char *g_source_names[] = { "alsa", "file", "sine", "noise" };
+
+const char *audio_source_name(audio_source_type_e type)
+{
+    return (unsigned)type < sizeof(g_source_names) / sizeof(g_source_names[0]) ? g_source_names[type] : "?";
+}
+
+int audio_source_parse(const char *name, audio_source_type_e *type)
+{
+    for (size_t i = 0; i < sizeof(g_source_names) / sizeof(g_source_names[0]); i++) {
+        if (strcmp(name, g_source_names[i]) == 0) {
+            *type = (audio_source_type_e)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int source_map_file(audio_source_t *src)
+{
+    struct stat st;
+    int fd = open(src->cfg.file_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGE("无法打开音频文件 %s: %s", src->cfg.file_path, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < src->frame_bytes) {
+        LOGE("音频文件 %s 不足一帧", src->cfg.file_path);
+        close(fd);
+        return -1;
+    }
+
+    src->map_len = st.st_size;
+    src->map = mmap(NULL, src->map_len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (src->map == MAP_FAILED) {
+        src->map = NULL;
+        LOGE("无法映射音频文件 %s: %s", src->cfg.file_path, strerror(errno));
+        return -1;
+    }
+    madvise(src->map, src->map_len, MADV_SEQUENTIAL);
+    return 0;
+}
+
+// 发生器的输出缓冲: 优先用帧池中的帧，池已空时退回到内部缓冲区
+static audio_frame_t *source_gen_frame(audio_source_t *src, audio_frame_t *borrowed)
+{
+    audio_frame_t *frame = src->cfg.pool ? audio_frame_acquire(src->cfg.pool) : NULL;
+    if (!frame) {
+        audio_frame_borrow(borrowed, src->frame, src->frame_bytes, 0);
+        frame = borrowed;
+    }
+    frame->len = src->frame_bytes;
+    return frame;
+}
+
+// 取下一帧；到文件末尾时从头循环。文件数据以借用帧交出
+static audio_frame_t *source_next_frame(audio_source_t *src, audio_frame_t *borrowed, frame_t *file_frame)
+{
+    const audio_source_config_t *cfg = &src->cfg;
+
+    switch (cfg->type) {
+    case AUDIO_SOURCE_FILE:
+        if (src->parser) {
+            if (src->parser->obtain_frame(src->parser, file_frame) < 0) {
+                destroy_file_parser(src->parser);
+                src->parser = create_file_parser(cfg->file_type, cfg->file_path);
+                if (!src->parser || src->parser->obtain_frame(src->parser, file_frame) < 0) {
+                    return NULL;
+                }
+            }
+            audio_frame_borrow(borrowed, file_frame->ptr, file_frame->len, 0);
+            return borrowed;
+        }
+        if (src->map_pos + src->frame_bytes > src->map_len) {
+            src->map_pos = 0;
+        }
+        audio_frame_borrow(borrowed, src->map + src->map_pos, src->frame_bytes, 0);
+        src->map_pos += src->frame_bytes;
+        return borrowed;
+
+    case AUDIO_SOURCE_SINE: {
+        audio_frame_t *frame = source_gen_frame(src, borrowed);
+        int16_t *out = (int16_t *)frame->data;
+        uint32_t samples = src->frame_bytes / (cfg->channels * sizeof(int16_t));
+        double step = 2.0 * M_PI * atomic_load_explicit(&src->tone_hz, memory_order_relaxed) / cfg->sample_rate;
+        for (uint32_t i = 0; i < samples; i++) {
+            int16_t v = (int16_t)(SOURCE_TONE_AMPLITUDE * sin(src->phase));
+            for (uint32_t ch = 0; ch < cfg->channels; ch++) {
+                out[i * cfg->channels + ch] = v;
+            }
+            src->phase += step;
+        }
+        src->phase = fmod(src->phase, 2.0 * M_PI);
+        return frame;
+    }
+
+    case AUDIO_SOURCE_NOISE: {
+        audio_frame_t *frame = source_gen_frame(src, borrowed);
+        int16_t *out = (int16_t *)frame->data;
+        uint32_t samples = src->frame_bytes / sizeof(int16_t);
+        for (uint32_t i = 0; i < samples; i++) {
+            // xorshift32
+            src->rng ^= src->rng << 13;
+            src->rng ^= src->rng >> 17;
+            src->rng ^= src->rng << 5;
+            out[i] = (int16_t)((int32_t)src->rng >> SOURCE_NOISE_SHIFT);
+        }
+        return frame;
+    }
+
+    default:
+        return NULL;
+    }
+}
+
+static void *source_thread(void *arg)
+{
+    audio_source_t *src = arg;
+    const audio_source_config_t *cfg = &src->cfg;
+
+    audio_rt_enter(&cfg->rt, "audio-source");
+    audio_pacer_init(&src->pacer, cfg->interval_us * cfg->batch);
+    while (atomic_load_explicit(&src->running, memory_order_relaxed)) {
+        int64_t tick_us = audio_pacer_wait(&src->pacer);
+        audio_stats_record(AUDIO_STAT_CAPTURE_WAKEUP, src->pacer.last_overshoot_ns / 1000);
+
+        for (uint32_t i = 0; i < cfg->batch; i++) {
+            frame_t file_frame = { 0 };
+            audio_frame_t borrowed;
+
+            audio_frame_t *frame = source_next_frame(src, &borrowed, &file_frame);
+            if (!frame) {
+                LOGE("音频源 %s 无法取得数据", audio_source_name(cfg->type));
+                return NULL;
+            }
+            // 一批中的第 i 帧在节拍前 (batch - 1 - i) 个间隔就已完整
+            frame->capture_us = tick_us - (int64_t)(cfg->batch - 1 - i) * cfg->interval_us;
+            cfg->on_frame(cfg->ctx, frame);
+            audio_frame_release(frame);
+            if (src->parser) {
+                src->parser->release_frame(src->parser, &file_frame);
+            }
+            atomic_fetch_add_explicit(&src->frames, 1, memory_order_relaxed);
+        }
+    }
+    return NULL;
+}
+
+int audio_source_start(audio_source_t *src, const audio_source_config_t *cfg)
+{
+    memset(src, 0, sizeof(*src));
+    src->cfg = *cfg;
+
+    if (cfg->type == AUDIO_SOURCE_ALSA) {
+        return audio_capture_start(&src->capture, &cfg->capture);
+    }
+
+    if (!cfg->on_frame || cfg->interval_us == 0) {
+        return -1;
+    }
+    if (src->cfg.batch == 0) {
+        src->cfg.batch = 1;
+    }
+    src->frame_bytes = (uint32_t)((uint64_t)cfg->sample_rate * cfg->interval_us / 1000000) *
+                       cfg->channels * sizeof(int16_t);
+    if (cfg->pool && cfg->pool->frame_size < src->frame_bytes) {
+        LOGE("帧池容量 %uB 小于音频源帧 %uB", cfg->pool->frame_size, src->frame_bytes);
+        return -1;
+    }
+    src->rng = 0x12345678;
+    atomic_init(&src->tone_hz, cfg->tone_hz);
+
+    if (cfg->type == AUDIO_SOURCE_FILE) {
+        if (!cfg->file_path) {
+            LOGE("文件音频源需要指定 --send-audio-file");
+            return -1;
+        }
+        if (cfg->file_type == MEDIA_FILE_TYPE_PCM) {
+            if (source_map_file(src) < 0) {
+                return -1;
+            }
+        } else {
+            src->parser = create_file_parser(cfg->file_type, cfg->file_path);
+            if (!src->parser) {
+                LOGE("无法解析音频文件 %s", cfg->file_path);
+                return -1;
+            }
+        }
+    } else {
+        src->frame = calloc(1, src->frame_bytes);
+        if (!src->frame) {
+            return -1;
+        }
+        audio_rt_prefault(src->frame, src->frame_bytes);
+    }
+
+    atomic_store(&src->running, true);
+    if (pthread_create(&src->thread, NULL, source_thread, src) != 0) {
+        LOGE("无法创建音频源线程");
+        atomic_store(&src->running, false);
+        audio_source_stop(src);
+        return -1;
+    }
+
+    LOGI("音频源 %s 已启动: 间隔=%uus, 每次唤醒=%u 帧%s%s", audio_source_name(cfg->type), cfg->interval_us,
+         src->cfg.batch, cfg->file_path ? ", 文件=" : "", cfg->file_path ? cfg->file_path : "");
+    return 0;
+}
+
+void audio_source_set_tone(audio_source_t *src, uint32_t tone_hz)
+{
+    atomic_store_explicit(&src->tone_hz, tone_hz, memory_order_relaxed);
+}
+
+void audio_source_stop(audio_source_t *src)
+{
+    if (src->cfg.type == AUDIO_SOURCE_ALSA) {
+        audio_capture_stop(&src->capture);
+        return;
+    }
+
+    if (atomic_exchange(&src->running, false)) {
+        pthread_join(src->thread, NULL);
+        LOGI("音频源 %s 已停止: 帧数=%llu", audio_source_name(src->cfg.type),
+             atomic_load(&src->frames));
+        audio_pacer_report(&src->pacer, "音频源");
+    }
+
+    if (src->parser) {
+        destroy_file_parser(src->parser);
+        src->parser = NULL;
+    }
+    if (src->map) {
+        munmap(src->map, src->map_len);
+        src->map = NULL;
+    }
+    free(src->frame);
+    src->frame = NULL;
+}
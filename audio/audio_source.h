@@ -0,0 +1,77 @@
+/*************************************************************
+ * File  :  audio_source.h
+ * Module:  Pluggable send-side audio sources.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_SOURCE_H_
+#define _AUDIO_SOURCE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "file_parser.h"
+#include "audio_capture.h"
+#include "audio_pacer.h"
+
+typedef enum {
+    AUDIO_SOURCE_ALSA = 0,      // 声卡采集
+    AUDIO_SOURCE_FILE,          // PCM 或预编码文件，循环播放
+    AUDIO_SOURCE_SINE,          // 正弦波发生器
+    AUDIO_SOURCE_NOISE,         // 白噪声发生器
+} audio_source_type_e;
+
+typedef struct {
+    audio_source_type_e type;
+    audio_capture_config_t capture;     // ALSA 采集参数
+    const char *file_path;              // 文件路径
+    media_file_type_e file_type;        // 文件类型，PCM 以外的按帧透传
+    uint32_t sample_rate;               // 文件/发生器输出的采样率
+    uint32_t channels;                  // 文件/发生器输出的通道数
+    uint32_t interval_us;               // 文件/发生器的发送间隔
+    uint32_t batch;                     // 文件/发生器每次唤醒连续送出的帧数，0 与 1 相同
+    uint32_t tone_hz;                   // 正弦波频率
+    audio_rt_config_t rt;               // 文件/发生器线程的实时调度参数
+    audio_frame_pool_t *pool;           // 可选，发生器直接写入池中的帧
+    audio_capture_frame_cb on_frame;    // 文件/发生器每帧回调
+    void *ctx;
+} audio_source_config_t;
+
+typedef struct {
+    audio_source_config_t cfg;
+    audio_capture_t capture;
+    pthread_t thread;
+    atomic_bool running;
+    audio_pacer_t pacer;
+    atomic_ullong frames;
+
+    // PCM 文件映射
+    uint8_t *map;
+    size_t map_len;
+    size_t map_pos;
+    // 预编码文件
+    media_file_parser_t *parser;
+    // 发生器
+    int16_t *frame;
+    uint32_t frame_bytes;
+    double phase;
+    atomic_uint tone_hz;                // 正弦波频率，可在运行中修改
+    uint32_t rng;
+} audio_source_t;
+
+int audio_source_start(audio_source_t *src, const audio_source_config_t *cfg);
+void audio_source_stop(audio_source_t *src);
+
+// 修改正弦波频率，从下一帧起生效，相位连续
+void audio_source_set_tone(audio_source_t *src, uint32_t tone_hz);
+
+const char *audio_source_name(audio_source_type_e type);
+int audio_source_parse(const char *name, audio_source_type_e *type);
+
+#endif
@@ -0,0 +1,359 @@
+/*************************************************************
+ * File  :  audio_stats.c
+ * Module:  Lock-free latency histograms and periodic JSON
+ *          stats output.
+ *
+ * Every metric owns two histogram banks. Hot paths add into the
+ * active bank with relaxed atomics only; once per interval the
+ * reporter thread flips the active bank, summarizes the retired
+ * one as a JSON line and clears it. A writer that loaded the old
+ * bank index just before the flip may land one sample in the
+ * next report, which is accepted in exchange for no locking.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "audio_stats.h"
+#include "audio_pacer.h"
+#include "audio_ring.h"
+#include "log.h"
+
+#define STATS_LINE_SIZE (128 * 1024)
+#define STATS_UNIX_PREFIX "unix:"
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t pos;
+} stats_line_t;
+
+typedef struct {
+    _Alignas(AUDIO_CACHE_LINE) audio_hist_t bank[2];
+} stats_metric_t;
+
+static const char *const stats_names[AUDIO_STAT_COUNT] = {
+    [AUDIO_STAT_CAPTURE_READ]    = "capture_read_ns",
+    [AUDIO_STAT_CAPTURE_DELAY]   = "capture_delay_us",
+    [AUDIO_STAT_SEND]            = "send_ns",
+    [AUDIO_STAT_ARRIVAL_JITTER]  = "arrival_jitter_us",
+    [AUDIO_STAT_PLAYOUT_DEPTH]   = "playout_depth_us",
+    [AUDIO_STAT_PLAYOUT_DELAY]   = "playout_delay_us",
+    [AUDIO_STAT_CAPTURE_WAKEUP]  = "capture_wakeup_late_us",
+    [AUDIO_STAT_PLAYOUT_WAKEUP]  = "playout_wakeup_late_us",
+    [AUDIO_STAT_AEC]             = "aec_ns",
+    [AUDIO_STAT_VAD]             = "vad_ns",
+    [AUDIO_STAT_NS]              = "ns_ns",
+    [AUDIO_STAT_AGC]             = "agc_ns",
+    [AUDIO_STAT_ENCODE]          = "encode_ns",
+};
+
+atomic_bool audio_stats_enabled;
+
+static struct {
+    stats_metric_t metrics[AUDIO_STAT_COUNT];
+    atomic_uint bank;
+    pthread_t thread;
+    atomic_bool running;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    bool is_unix;
+    int fd;
+    uint64_t lines;
+    uint64_t dropped_lines;
+    char *line;
+} g_stats;
+
+static uint32_t hist_index(uint64_t value)
+{
+    if (value < AUDIO_HIST_SUB_COUNT) {
+        return (uint32_t)value;
+    }
+    int msb = 63 - __builtin_clzll(value);
+    if (msb > AUDIO_HIST_MAX_MSB) {
+        return AUDIO_HIST_BUCKETS - 1;
+    }
+    int shift = msb - AUDIO_HIST_SUB_BITS;
+    return (uint32_t)((shift + 1) * AUDIO_HIST_SUB_COUNT + (value >> shift) - AUDIO_HIST_SUB_COUNT);
+}
+
+// 桶覆盖的区间 [lo, lo + width)
+static uint64_t hist_bucket_lo(uint32_t idx, uint64_t *width)
+{
+    if (idx < AUDIO_HIST_SUB_COUNT) {
+        *width = 1;
+        return idx;
+    }
+    int shift = (int)(idx / AUDIO_HIST_SUB_COUNT) - 1;
+    *width = 1ULL << shift;
+    return (uint64_t)(idx % AUDIO_HIST_SUB_COUNT + AUDIO_HIST_SUB_COUNT) << shift;
+}
+
+static void hist_reset(audio_hist_t *h)
+{
+    for (uint32_t i = 0; i < AUDIO_HIST_BUCKETS; i++) {
+        atomic_store_explicit(&h->buckets[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&h->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->min, UINT64_MAX, memory_order_relaxed);
+    atomic_store_explicit(&h->max, 0, memory_order_relaxed);
+}
+
+// 追加到行缓冲区，空间不足时截断并把 pos 停在末尾
+static void stats_append(stats_line_t *line, const char *fmt, ...)
+{
+    if (line->pos >= line->size) {
+        return;
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line->buf + line->pos, line->size - line->pos, fmt, ap);
+    va_end(ap);
+    line->pos = n < 0 ? line->size : line->pos + (size_t)n;
+    if (line->pos > line->size) {
+        line->pos = line->size;
+    }
+}
+
+void audio_stats_record_slow(audio_stat_id_e id, uint64_t value)
+{
+    uint32_t bank = atomic_load_explicit(&g_stats.bank, memory_order_relaxed);
+    audio_hist_t *h = &g_stats.metrics[id].bank[bank];
+
+    atomic_fetch_add_explicit(&h->buckets[hist_index(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+
+    uint64_t cur = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (value > cur &&
+           !atomic_compare_exchange_weak_explicit(&h->max, &cur, value, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+    cur = atomic_load_explicit(&h->min, memory_order_relaxed);
+    while (value < cur &&
+           !atomic_compare_exchange_weak_explicit(&h->min, &cur, value, memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
+// 取百分位所在桶的中点，并限制在实际的最小/最大值之内
+static uint64_t hist_percentile(const uint32_t *buckets, uint64_t count, uint64_t min,
+                                uint64_t max, double pct)
+{
+    uint64_t rank = (uint64_t)(pct / 100.0 * count + 0.5);
+    uint64_t seen = 0;
+
+    rank = rank ? rank : 1;
+    for (uint32_t i = 0; i < AUDIO_HIST_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t width;
+            uint64_t v = hist_bucket_lo(i, &width) + width / 2;
+            return v < min ? min : (v > max ? max : v);
+        }
+    }
+    return max;
+}
+
+static void stats_format_metric(stats_line_t *line, audio_stat_id_e id, audio_hist_t *h)
+{
+    uint32_t buckets[AUDIO_HIST_BUCKETS];
+    uint64_t count = 0;
+
+    // 计数取各桶之和，热路径上省掉一次原子加
+    for (uint32_t i = 0; i < AUDIO_HIST_BUCKETS; i++) {
+        buckets[i] = atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        count += buckets[i];
+    }
+    uint64_t sum = atomic_load_explicit(&h->sum, memory_order_relaxed);
+    uint64_t min = atomic_load_explicit(&h->min, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    hist_reset(h);
+
+    stats_append(line, "\"%s\":{\"count\":%llu", stats_names[id], (unsigned long long)count);
+    if (count == 0) {
+        stats_append(line, "}");
+        return;
+    }
+    stats_append(line, ",\"min\":%llu,\"max\":%llu,\"mean\":%llu,\"p50\":%llu,\"p90\":%llu,"
+                       "\"p99\":%llu,\"p999\":%llu,\"hist\":[",
+                 (unsigned long long)min, (unsigned long long)max,
+                 (unsigned long long)(sum / count),
+                 (unsigned long long)hist_percentile(buckets, count, min, max, 50.0),
+                 (unsigned long long)hist_percentile(buckets, count, min, max, 90.0),
+                 (unsigned long long)hist_percentile(buckets, count, min, max, 99.0),
+                 (unsigned long long)hist_percentile(buckets, count, min, max, 99.9));
+
+    // 只输出非空桶: [桶下界, 计数]，便于下游按桶合并多个周期
+    bool first = true;
+    for (uint32_t i = 0; i < AUDIO_HIST_BUCKETS; i++) {
+        if (buckets[i] == 0) {
+            continue;
+        }
+        uint64_t width;
+        stats_append(line, "%s[%llu,%u]", first ? "" : ",",
+                     (unsigned long long)hist_bucket_lo(i, &width), buckets[i]);
+        first = false;
+    }
+    stats_append(line, "]}");
+}
+
+static int stats_open_sink(void)
+{
+    if (!g_stats.is_unix) {
+        g_stats.fd = open(g_stats.path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (g_stats.fd < 0) {
+            LOGE("无法打开统计输出文件 %s: %s", g_stats.path, strerror(errno));
+            return -1;
+        }
+        return 0;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    memcpy(addr.sun_path, g_stats.path, sizeof(addr.sun_path));
+    g_stats.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (g_stats.fd < 0) {
+        return -1;
+    }
+    if (connect(g_stats.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(g_stats.fd);
+        g_stats.fd = -1;
+        return -1;
+    }
+    LOGI("统计输出已连接到 %s", g_stats.path);
+    return 0;
+}
+
+// Unix 套接字断开或对端不在时丢弃本行，下个周期再重连，不阻塞统计线程
+static void stats_write_line(const char *line, size_t len)
+{
+    if (g_stats.fd < 0 && (!g_stats.is_unix || stats_open_sink() < 0)) {
+        g_stats.dropped_lines++;
+        return;
+    }
+
+    ssize_t n = g_stats.is_unix ? send(g_stats.fd, line, len, MSG_NOSIGNAL | MSG_DONTWAIT)
+                                : write(g_stats.fd, line, len);
+    if (n == (ssize_t)len) {
+        g_stats.lines++;
+        return;
+    }
+    g_stats.dropped_lines++;
+    if (g_stats.is_unix && n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        close(g_stats.fd);
+        g_stats.fd = -1;
+    }
+}
+
+static void stats_emit(uint32_t interval_ms)
+{
+    uint32_t old = atomic_load_explicit(&g_stats.bank, memory_order_relaxed);
+    atomic_store_explicit(&g_stats.bank, old ^ 1, memory_order_relaxed);
+
+    struct timespec ts;
+    stats_line_t line = { g_stats.line, STATS_LINE_SIZE, 0 };
+    clock_gettime(CLOCK_REALTIME, &ts);
+    stats_append(&line, "{\"ts_ms\":%lld,\"interval_ms\":%u",
+                 (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000, interval_ms);
+    for (int id = 0; id < AUDIO_STAT_COUNT; id++) {
+        stats_append(&line, ",");
+        stats_format_metric(&line, id, &g_stats.metrics[id].bank[old]);
+    }
+    stats_append(&line, "}\n");
+    if (line.pos >= line.size) {
+        LOGW("统计行超过 %d 字节，已丢弃", STATS_LINE_SIZE);
+        g_stats.dropped_lines++;
+        return;
+    }
+    stats_write_line(line.buf, line.pos);
+}
+
+static void *stats_thread(void *arg)
+{
+    audio_pacer_t pacer;
+
+    audio_pacer_init(&pacer, AUDIO_STATS_INTERVAL_MS * 1000);
+    while (atomic_load_explicit(&g_stats.running, memory_order_relaxed)) {
+        audio_pacer_wait(&pacer);
+        stats_emit(AUDIO_STATS_INTERVAL_MS);
+    }
+    return NULL;
+}
+
+int audio_stats_start(const char *target)
+{
+    const char *path = target;
+
+    g_stats.is_unix = strncmp(target, STATS_UNIX_PREFIX, strlen(STATS_UNIX_PREFIX)) == 0;
+    if (g_stats.is_unix) {
+        path += strlen(STATS_UNIX_PREFIX);
+    }
+    if (strlen(path) == 0 || strlen(path) >= sizeof(g_stats.path)) {
+        LOGE("统计输出路径 \"%s\" 不合法", target);
+        return -1;
+    }
+    snprintf(g_stats.path, sizeof(g_stats.path), "%s", path);
+
+    g_stats.line = malloc(STATS_LINE_SIZE);
+    if (!g_stats.line) {
+        return -1;
+    }
+    g_stats.fd = -1;
+    if (stats_open_sink() < 0 && !g_stats.is_unix) {
+        free(g_stats.line);
+        g_stats.line = NULL;
+        return -1;
+    }
+
+    for (int id = 0; id < AUDIO_STAT_COUNT; id++) {
+        hist_reset(&g_stats.metrics[id].bank[0]);
+        hist_reset(&g_stats.metrics[id].bank[1]);
+    }
+    atomic_store(&g_stats.bank, 0);
+    atomic_store(&g_stats.running, true);
+    if (pthread_create(&g_stats.thread, NULL, stats_thread, NULL) != 0) {
+        LOGE("无法创建统计线程");
+        atomic_store(&g_stats.running, false);
+        if (g_stats.fd >= 0) {
+            close(g_stats.fd);
+        }
+        free(g_stats.line);
+        g_stats.line = NULL;
+        return -1;
+    }
+    atomic_store(&audio_stats_enabled, true);
+
+    LOGI("延迟统计已启动: 每 %dms 输出到 %s%s", AUDIO_STATS_INTERVAL_MS,
+         g_stats.is_unix ? STATS_UNIX_PREFIX : "", g_stats.path);
+    return 0;
+}
+
+void audio_stats_stop(void)
+{
+    if (!atomic_exchange(&g_stats.running, false)) {
+        return;
+    }
+    atomic_store(&audio_stats_enabled, false);
+    pthread_join(g_stats.thread, NULL);
+
+    LOGI("延迟统计: 输出 %llu 行, 丢弃 %llu 行", (unsigned long long)g_stats.lines,
+         (unsigned long long)g_stats.dropped_lines);
+    if (g_stats.fd >= 0) {
+        close(g_stats.fd);
+        g_stats.fd = -1;
+    }
+    free(g_stats.line);
+    g_stats.line = NULL;
+}
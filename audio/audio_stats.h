@@ -0,0 +1,67 @@
+/*************************************************************
+ * File  :  audio_stats.h
+ * Module:  Lock-free latency histograms and periodic JSON
+ *          stats output.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_STATS_H_
+#define _AUDIO_STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// 对数-线性分桶: 每个 2 的幂区间分 16 个子桶，相对误差不超过 6.25%
+#define AUDIO_HIST_SUB_BITS (4)
+#define AUDIO_HIST_SUB_COUNT (1 << AUDIO_HIST_SUB_BITS)
+#define AUDIO_HIST_MAX_MSB (31)
+#define AUDIO_HIST_BUCKETS ((AUDIO_HIST_MAX_MSB - AUDIO_HIST_SUB_BITS + 2) * AUDIO_HIST_SUB_COUNT)
+
+#define AUDIO_STATS_INTERVAL_MS (1000)
+
+typedef enum {
+    AUDIO_STAT_CAPTURE_READ = 0,    // 从声卡读出一帧的耗时(ns)
+    AUDIO_STAT_CAPTURE_DELAY,       // 一帧从采集到回调处理(含发送)完成的时间(us)
+    AUDIO_STAT_SEND,                // agora_rtc_send_audio_data 调用耗时(ns)
+    AUDIO_STAT_ARRIVAL_JITTER,      // 按 sent_ts 计算的相邻帧传输时间差(us)
+    AUDIO_STAT_PLAYOUT_DEPTH,       // 每个周期各用户抖动缓冲的最大深度(us)
+    AUDIO_STAT_PLAYOUT_DELAY,       // 播放设备 snd_pcm_delay(us)
+    AUDIO_STAT_CAPTURE_WAKEUP,      // 采集/音频源线程每个周期的唤醒滞后(us)
+    AUDIO_STAT_PLAYOUT_WAKEUP,      // 播放线程每个周期的唤醒滞后(us)
+    AUDIO_STAT_AEC,                 // 每帧回声消除耗时(ns)
+    AUDIO_STAT_VAD,                 // 每帧语音检测耗时(ns)
+    AUDIO_STAT_NS,                  // 每帧降噪耗时(ns)
+    AUDIO_STAT_AGC,                 // 每帧自动增益耗时(ns)
+    AUDIO_STAT_ENCODE,              // 每帧发送端编码耗时(ns)
+    AUDIO_STAT_COUNT,
+} audio_stat_id_e;
+
+typedef struct {
+    atomic_ullong sum;
+    atomic_ullong min;
+    atomic_ullong max;
+    atomic_uint buckets[AUDIO_HIST_BUCKETS];
+} audio_hist_t;
+
+extern atomic_bool audio_stats_enabled;
+
+void audio_stats_record_slow(audio_stat_id_e id, uint64_t value);
+
+// 热路径调用: 未启用时只有一次 relaxed 读
+static inline void audio_stats_record(audio_stat_id_e id, uint64_t value)
+{
+    if (atomic_load_explicit(&audio_stats_enabled, memory_order_relaxed)) {
+        audio_stats_record_slow(id, value);
+    }
+}
+
+// target 为文件路径，或 "unix:<path>" 表示连接到该 Unix 域流套接字
+int audio_stats_start(const char *target);
+void audio_stats_stop(void);
+
+#endif
@@ -0,0 +1,39 @@
+/*************************************************************
+ * File  :  audio_time.h
+ * Module:  Monotonic time helpers for the audio pipeline.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_TIME_H_
+#define _AUDIO_TIME_H_
+
+#include <stdint.h>
+#include <time.h>
+
+// 单调时钟，微秒
+static inline int64_t audio_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 单调时钟，纳秒
+static inline int64_t audio_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// 单调时钟，毫秒
+static inline int64_t audio_now_ms(void)
+{
+    return audio_now_us() / 1000;
+}
+
+#endif
@@ -0,0 +1,383 @@
+/*************************************************************
+ * File  :  audio_vad.c
+ * Module:  Energy and spectral flatness voice activity detector
+ *          used to gate the send path.
+ *
+ * Each frame is scored with two cheap features: its energy
+ * relative to a noise floor that drops quickly and rises slowly
+ * (minimum tracking), and the spectral flatness of the tail of
+ * the frame over the voice band, i.e. the ratio of geometric to
+ * arithmetic mean of the power spectrum. Stationary noise is
+ * spectrally flat, voiced speech and tones are not, so a frame
+ * only a few dB above the floor still counts as speech when its
+ * spectrum has structure. The raw decision then goes through an
+ * attack timer (ignore clicks) and a hangover timer (keep the
+ * ends of words and short pauses), and the send path drops or
+ * thins out the frames that remain silent.
+ *
+ * The int16 to float windowing, the power spectrum and the log2
+ * used for the geometric mean run four bins at a time with
+ * SSE2/NEON; the frame energy reuses audio_energy_s16.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "audio_vad.h"
+#include "audio_simd.h"
+#include "audio_ring.h"
+#include "audio_mix.h"
+#include "audio_time.h"
+#include "audio_stats.h"
+#include "log.h"
+
+#define VAD_MAX_FFT (512)
+#define VAD_BAND_LO_HZ (200)
+#define VAD_BAND_HI_HZ (4000)
+// 低于该能量一律视为静音
+#define VAD_ABS_FLOOR_DB (-60.0f)
+// 高出噪声底这么多时不看频谱直接判为语音
+#define VAD_SNR_LOUD_DB (15.0f)
+// 高出噪声底这么多且频谱不平坦时判为语音
+#define VAD_SNR_DB (5.0f)
+#define VAD_FLATNESS_DB (-6.0f)
+// 频谱极不平坦(单音、音乐)时不论能量都视为有声
+#define VAD_TONAL_DB (-15.0f)
+#define VAD_NOISE_MIN_DB (-90.0f)
+#define VAD_NOISE_FALL (0.5f)
+#define VAD_NOISE_RISE_DB_PER_S (1.0f)
+
+static const char *const g_vad_mode_names[] = {
+    [AUDIO_VAD_OFF]         = "off",
+    [AUDIO_VAD_SUPPRESS]    = "suppress",
+    [AUDIO_VAD_THIN]        = "thin",
+};
+
+const char *audio_vad_mode_name(audio_vad_mode_e mode)
+{
+    return (unsigned)mode < sizeof(g_vad_mode_names) / sizeof(g_vad_mode_names[0]) ? g_vad_mode_names[mode] : "?";
+}
+
+int audio_vad_mode_parse(const char *name, audio_vad_mode_e *mode)
+{
+    for (size_t i = 0; i < sizeof(g_vad_mode_names) / sizeof(g_vad_mode_names[0]); i++) {
+        if (strcmp(name, g_vad_mode_names[i]) == 0) {
+            *mode = (audio_vad_mode_e)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static float *vad_alloc(uint32_t count)
+{
+    void *p = NULL;
+    if (posix_memalign(&p, AUDIO_CACHE_LINE, (count ? count : 1) * sizeof(float)) != 0) {
+        return NULL;
+    }
+    memset(p, 0, count * sizeof(float));
+    return p;
+}
+
+static uint32_t vad_frames(uint32_t ms, uint32_t frame_ms)
+{
+    return (ms + frame_ms - 1) / frame_ms;
+}
+
+// 模式和按帧计的起始、拖尾、稀疏间隔，初始化和运行中修改共用
+static void vad_apply_timing(audio_vad_t *vad, const audio_vad_config_t *cfg)
+{
+    uint32_t frame_ms = vad->cfg.frame_samples * 1000 / vad->cfg.sample_rate;
+
+    frame_ms = frame_ms ? frame_ms : 1;
+    vad->cfg.mode = cfg->mode;
+    vad->cfg.attack_ms = cfg->attack_ms;
+    vad->cfg.hangover_ms = cfg->hangover_ms;
+    vad->cfg.thin_ms = cfg->thin_ms ? cfg->thin_ms : AUDIO_VAD_DEFAULT_THIN_MS;
+    vad->attack_frames = vad_frames(cfg->attack_ms, frame_ms);
+    vad->attack_frames = vad->attack_frames ? vad->attack_frames : 1;
+    vad->hangover_frames = vad_frames(cfg->hangover_ms, frame_ms);
+    vad->thin_frames = vad_frames(vad->cfg.thin_ms, frame_ms);
+    vad->thin_frames = vad->thin_frames ? vad->thin_frames : 1;
+    if (vad->hangover_left > vad->hangover_frames) {
+        vad->hangover_left = vad->hangover_frames;
+    }
+}
+
+int audio_vad_init(audio_vad_t *vad, const audio_vad_config_t *cfg)
+{
+    memset(vad, 0, sizeof(*vad));
+    vad->cfg = *cfg;
+    if (cfg->sample_rate == 0 || cfg->channels == 0 || cfg->frame_samples == 0) {
+        return -1;
+    }
+
+    uint32_t n = VAD_MAX_FFT;
+    while (n > cfg->frame_samples) {
+        n >>= 1;
+    }
+    if (n < AUDIO_FFT_MIN_SIZE || audio_fft_init(&vad->fft, n) < 0) {
+        LOGE("语音检测不支持每帧 %u 个采样", cfg->frame_samples);
+        return -1;
+    }
+    vad->fft_size = n;
+    uint32_t nyquist = cfg->sample_rate / 2 < VAD_BAND_HI_HZ ? cfg->sample_rate / 2 : VAD_BAND_HI_HZ;
+    vad->band_lo = VAD_BAND_LO_HZ * n / cfg->sample_rate;
+    vad->band_lo = vad->band_lo ? vad->band_lo : 1;
+    vad->band_hi = nyquist * n / cfg->sample_rate;
+    if (vad->band_hi <= vad->band_lo) {
+        vad->band_hi = n / 2;
+    }
+
+    vad->window = vad_alloc(n);
+    vad->time_buf = vad_alloc(n);
+    vad->re = vad_alloc(n / 2 + 1);
+    vad->im = vad_alloc(n / 2 + 1);
+    if (!vad->window || !vad->time_buf || !vad->re || !vad->im) {
+        LOGE("无法分配语音检测缓冲区");
+        audio_vad_deinit(vad);
+        return -1;
+    }
+    // Hann 窗，顺带把 int16 缩放到 [-1, 1)
+    for (uint32_t i = 0; i < n; i++) {
+        vad->window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / n)) / 32768.0f;
+    }
+
+    vad_apply_timing(vad, cfg);
+
+    LOGI("语音检测已启用(%s): 分析长度=%u, 频带=%u-%uHz, 起始=%u 帧, 拖尾=%u 帧, 稀疏间隔=%u 帧 (%s)",
+         audio_vad_mode_name(cfg->mode), n, vad->band_lo * cfg->sample_rate / n,
+         vad->band_hi * cfg->sample_rate / n, vad->attack_frames, vad->hangover_frames,
+         vad->thin_frames, AUDIO_SIMD_NAME);
+    return 0;
+}
+
+void audio_vad_deinit(audio_vad_t *vad)
+{
+    audio_fft_deinit(&vad->fft);
+    free(vad->window);
+    free(vad->time_buf);
+    free(vad->re);
+    free(vad->im);
+    vad->window = NULL;
+    vad->time_buf = NULL;
+    vad->re = NULL;
+    vad->im = NULL;
+}
+
+void audio_vad_report(const audio_vad_t *vad)
+{
+    uint64_t frames = atomic_load(&vad->stats.frames);
+
+    LOGI("语音检测统计(%s): 帧=%llu, 语音=%llu, 语音段=%llu, 未发送=%llu 帧/%llu 字节, 噪声底=%.1fdBFS, "
+         "耗时 平均=%.1fus 最大=%.1fus",
+         audio_vad_mode_name(vad->cfg.mode), (unsigned long long)frames,
+         atomic_load(&vad->stats.speech_frames), atomic_load(&vad->stats.talkspurts),
+         atomic_load(&vad->stats.dropped_frames), atomic_load(&vad->stats.dropped_bytes),
+         atomic_load(&vad->stats.noise_db_x10) / 10.0,
+         frames ? atomic_load(&vad->stats.cost_ns_sum) / 1000.0 / frames : 0.0,
+         atomic_load(&vad->stats.cost_ns_max) / 1000.0);
+}
+
+// 取第一个通道最后 n 个采样，加窗并转为浮点
+static void vad_window(audio_vad_t *vad, const int16_t *data, size_t samples)
+{
+    uint32_t channels = vad->cfg.channels;
+    uint32_t n = vad->fft_size;
+    const int16_t *src = data + (samples / channels - n) * channels;
+    const float *w = vad->window;
+    float *out = vad->time_buf;
+    uint32_t i = 0;
+
+    if (channels == 1) {
+#if defined(AUDIO_HAVE_SSE2)
+        for (; i + 8 <= n; i += 8) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+            // 符号扩展: 先放到高 16 位再算术右移
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+            _mm_store_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), _mm_load_ps(w + i)));
+            _mm_store_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), _mm_load_ps(w + i + 4)));
+        }
+#elif defined(AUDIO_HAVE_NEON)
+        for (; i + 8 <= n; i += 8) {
+            int16x8_t x = vld1q_s16(src + i);
+            float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(x)));
+            float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(x)));
+            vst1q_f32(out + i, vmulq_f32(lo, vld1q_f32(w + i)));
+            vst1q_f32(out + i + 4, vmulq_f32(hi, vld1q_f32(w + i + 4)));
+        }
+#endif
+    }
+    for (; i < n; i++) {
+        out[i] = src[i * channels] * w[i];
+    }
+}
+
+// log2 的快速近似: 指数部分加上尾数的二次拟合，误差约 0.006
+static inline float vad_log2(float x)
+{
+    union { float f; uint32_t u; } v = { x };
+    float e = (float)((int32_t)((v.u >> 23) & 0xff) - 127);
+    v.u = (v.u & 0x7fffff) | 0x3f800000;
+    float t = v.f - 1.0f;
+    return e + t * (1.3466f - 0.3466f * t);
+}
+
+// 频带内功率谱的谱平坦度(dB，<= 0)
+static float vad_flatness(const audio_vad_t *vad)
+{
+    const float *re = vad->re;
+    const float *im = vad->im;
+    uint32_t k = vad->band_lo;
+    uint32_t end = vad->band_hi;
+    float sum = 0.0f;
+    float sum_log2 = 0.0f;
+    const float eps = 1e-12f;
+
+#if defined(AUDIO_HAVE_SSE2)
+    __m128 acc = _mm_setzero_ps();
+    __m128 acc_log = _mm_setzero_ps();
+    const __m128i mant_mask = _mm_set1_epi32(0x7fffff);
+    const __m128i one_bits = _mm_set1_epi32(0x3f800000);
+    const __m128i bias = _mm_set1_epi32(127);
+    for (; k + 4 <= end; k += 4) {
+        __m128 r = _mm_loadu_ps(re + k);
+        __m128 i = _mm_loadu_ps(im + k);
+        __m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(i, i)), _mm_set1_ps(eps));
+        acc = _mm_add_ps(acc, p);
+        __m128i bits = _mm_castps_si128(p);
+        __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), bias));
+        __m128 t = _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, mant_mask), one_bits)),
+                              _mm_set1_ps(1.0f));
+        __m128 poly = _mm_mul_ps(t, _mm_sub_ps(_mm_set1_ps(1.3466f), _mm_mul_ps(_mm_set1_ps(0.3466f), t)));
+        acc_log = _mm_add_ps(acc_log, _mm_add_ps(e, poly));
+    }
+    float lanes[4], log_lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    _mm_storeu_ps(log_lanes, acc_log);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    sum_log2 = log_lanes[0] + log_lanes[1] + log_lanes[2] + log_lanes[3];
+#elif defined(AUDIO_HAVE_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    float32x4_t acc_log = vdupq_n_f32(0.0f);
+    const uint32x4_t mant_mask = vdupq_n_u32(0x7fffff);
+    const uint32x4_t one_bits = vdupq_n_u32(0x3f800000);
+    for (; k + 4 <= end; k += 4) {
+        float32x4_t r = vld1q_f32(re + k);
+        float32x4_t i = vld1q_f32(im + k);
+        float32x4_t p = vaddq_f32(vmlaq_f32(vmulq_f32(r, r), i, i), vdupq_n_f32(eps));
+        acc = vaddq_f32(acc, p);
+        uint32x4_t bits = vreinterpretq_u32_f32(p);
+        float32x4_t e = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)), vdupq_n_s32(127)));
+        float32x4_t t = vsubq_f32(vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits, mant_mask), one_bits)),
+                                  vdupq_n_f32(1.0f));
+        float32x4_t poly = vmulq_f32(t, vmlsq_f32(vdupq_n_f32(1.3466f), vdupq_n_f32(0.3466f), t));
+        acc_log = vaddq_f32(acc_log, vaddq_f32(e, poly));
+    }
+    float lanes[4], log_lanes[4];
+    vst1q_f32(lanes, acc);
+    vst1q_f32(log_lanes, acc_log);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    sum_log2 = log_lanes[0] + log_lanes[1] + log_lanes[2] + log_lanes[3];
+#endif
+    for (; k < end; k++) {
+        float p = re[k] * re[k] + im[k] * im[k] + eps;
+        sum += p;
+        sum_log2 += vad_log2(p);
+    }
+
+    uint32_t bins = vad->band_hi - vad->band_lo;
+    // 10*log10(几何平均/算术平均) = 10*log10(2) * (平均 log2 - log2(平均))
+    return 3.0103f * (sum_log2 / bins - vad_log2(sum / bins));
+}
+
+void audio_vad_update(audio_vad_t *vad, const audio_vad_config_t *cfg)
+{
+    audio_seqlock_publish(&vad->update_lock, &vad->update, cfg, sizeof(*cfg));
+}
+
+bool audio_vad_process(audio_vad_t *vad, const int16_t *data, size_t samples)
+{
+    audio_vad_config_t update;
+    if (audio_seqlock_fetch(&vad->update_lock, &vad->update_seen, &update, &vad->update, sizeof(update))) {
+        vad_apply_timing(vad, &update);
+    }
+    if (vad->cfg.mode == AUDIO_VAD_OFF || samples < (size_t)vad->fft_size * vad->cfg.channels) {
+        return true;
+    }
+    int64_t start_ns = audio_now_ns();
+
+    double mean = (double)audio_energy_s16(data, samples) / samples / (32768.0 * 32768.0);
+    float energy_db = 10.0f * log10f((float)mean + 1e-10f);
+
+    vad_window(vad, data, samples);
+    audio_fft_forward(&vad->fft, vad->time_buf, vad->re, vad->im);
+    float flat_db = vad_flatness(vad);
+
+    // 噪声底: 低于当前值时快速跟随，高于时按固定速率缓慢上升
+    float frame_s = (float)vad->cfg.frame_samples / vad->cfg.sample_rate;
+    if (!vad->noise_init) {
+        vad->noise_db = energy_db;
+        vad->noise_init = true;
+    } else if (energy_db < vad->noise_db) {
+        vad->noise_db += VAD_NOISE_FALL * (energy_db - vad->noise_db);
+    } else {
+        float rise = VAD_NOISE_RISE_DB_PER_S * frame_s;
+        vad->noise_db += energy_db - vad->noise_db < rise ? energy_db - vad->noise_db : rise;
+    }
+    if (vad->noise_db < VAD_NOISE_MIN_DB) {
+        vad->noise_db = VAD_NOISE_MIN_DB;
+    }
+
+    bool speech = false;
+    if (energy_db >= VAD_ABS_FLOOR_DB) {
+        float snr = energy_db - vad->noise_db;
+        speech = snr > VAD_SNR_LOUD_DB || (snr > VAD_SNR_DB && flat_db < VAD_FLATNESS_DB) ||
+                 flat_db < VAD_TONAL_DB;
+    }
+
+    vad->speech_run = speech ? vad->speech_run + 1 : 0;
+    if (vad->speech_run >= vad->attack_frames) {
+        if (!vad->active) {
+            atomic_fetch_add_explicit(&vad->stats.talkspurts, 1, memory_order_relaxed);
+        }
+        vad->active = true;
+        vad->hangover_left = vad->hangover_frames;
+    } else if (vad->active) {
+        if (vad->hangover_left > 0) {
+            vad->hangover_left--;
+        } else {
+            vad->active = false;
+            vad->silent_run = 0;
+        }
+    }
+
+    bool send = true;
+    if (vad->active) {
+        atomic_fetch_add_explicit(&vad->stats.speech_frames, 1, memory_order_relaxed);
+    } else {
+        vad->silent_run++;
+        send = vad->cfg.mode == AUDIO_VAD_THIN && vad->silent_run % vad->thin_frames == 0;
+    }
+    if (!send) {
+        atomic_fetch_add_explicit(&vad->stats.dropped_frames, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&vad->stats.dropped_bytes, samples * sizeof(int16_t), memory_order_relaxed);
+    }
+
+    uint64_t cost_ns = audio_now_ns() - start_ns;
+    audio_stats_record(AUDIO_STAT_VAD, cost_ns);
+    atomic_fetch_add_explicit(&vad->stats.frames, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&vad->stats.cost_ns_sum, cost_ns, memory_order_relaxed);
+    if (cost_ns > atomic_load_explicit(&vad->stats.cost_ns_max, memory_order_relaxed)) {
+        atomic_store_explicit(&vad->stats.cost_ns_max, (uint32_t)cost_ns, memory_order_relaxed);
+    }
+    atomic_store_explicit(&vad->stats.noise_db_x10, (int)(vad->noise_db * 10.0f), memory_order_relaxed);
+    return send;
+}
@@ -0,0 +1,96 @@
+/*************************************************************
+ * File  :  audio_vad.h
+ * Module:  Energy and spectral flatness voice activity detector
+ *          used to gate the send path.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_VAD_H_
+#define _AUDIO_VAD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "audio_fft.h"
+#include "audio_seqlock.h"
+
+#define AUDIO_VAD_DEFAULT_HANGOVER_MS (300)
+#define AUDIO_VAD_DEFAULT_ATTACK_MS (20)
+#define AUDIO_VAD_DEFAULT_THIN_MS (200)
+
+typedef enum {
+    AUDIO_VAD_OFF = 0,              // 不检测，全部发送
+    AUDIO_VAD_SUPPRESS,             // 静音帧全部不发送
+    AUDIO_VAD_THIN,                 // 静音期间每 thin_ms 只发送一帧
+} audio_vad_mode_e;
+
+typedef struct {
+    audio_vad_mode_e mode;
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint32_t frame_samples;         // 每帧每通道的采样数
+    uint32_t attack_ms;             // 连续这么久判为语音才开始发送，0 表示一帧
+    uint32_t hangover_ms;           // 语音结束后继续发送的时长
+    uint32_t thin_ms;               // THIN 模式下静音期间的发送间隔
+} audio_vad_config_t;
+
+typedef struct {
+    atomic_ullong frames;           // 检测的帧
+    atomic_ullong speech_frames;    // 判为语音(含拖尾)的帧
+    atomic_ullong dropped_frames;   // 因静音没有发送的帧
+    atomic_ullong dropped_bytes;
+    atomic_ullong talkspurts;       // 从静音转为语音的次数
+    atomic_ullong cost_ns_sum;
+    atomic_uint cost_ns_max;
+    atomic_int noise_db_x10;        // 当前噪声底估计(0.1dBFS)
+} audio_vad_stats_t;
+
+typedef struct {
+    audio_vad_config_t cfg;
+    audio_fft_t fft;
+    uint32_t fft_size;              // 不超过一帧的 2 的幂，取帧尾部分析
+    uint32_t band_lo;               // 计算谱平坦度的 bin 范围
+    uint32_t band_hi;
+    float *window;
+    float *time_buf;
+    float *re;
+    float *im;
+
+    uint32_t attack_frames;
+    uint32_t hangover_frames;
+    uint32_t thin_frames;
+    float noise_db;                 // 噪声底，下降快上升慢
+    bool noise_init;
+    uint32_t speech_run;            // 连续判为语音的帧数
+    uint32_t hangover_left;
+    uint32_t silent_run;            // 进入静音后的帧数
+    bool active;
+
+    // 控制线程发布的新配置，在下一帧开始时生效
+    audio_seqlock_t update_lock;
+    audio_vad_config_t update;
+    uint32_t update_seen;
+
+    audio_vad_stats_t stats;
+} audio_vad_t;
+
+const char *audio_vad_mode_name(audio_vad_mode_e mode);
+int audio_vad_mode_parse(const char *name, audio_vad_mode_e *mode);
+
+int audio_vad_init(audio_vad_t *vad, const audio_vad_config_t *cfg);
+void audio_vad_deinit(audio_vad_t *vad);
+void audio_vad_report(const audio_vad_t *vad);
+
+// 在运行中修改模式、起始、拖尾和稀疏间隔，只由一个线程调用，不会阻塞发送线程；
+// cfg 中的其他字段必须与初始化时相同
+void audio_vad_update(audio_vad_t *vad, const audio_vad_config_t *cfg);
+
+// 在发送线程中对每一帧 RTC 格式的 PCM 调用，返回该帧是否需要发送
+bool audio_vad_process(audio_vad_t *vad, const int16_t *data, size_t samples);
+
+#endif
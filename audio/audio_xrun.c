@@ -0,0 +1,142 @@
+/*************************************************************
+ * File  :  audio_xrun.c
+ * Module:  Xrun and suspend/resume recovery for ALSA handles.
+ *
+ * Re-prepares the device after an overrun/underrun or a system
+ * suspend. Playback is restarted with at most prefill_frames of
+ * silence so that the recovery itself never builds up latency;
+ * capture is restarted right away since the poll-driven reader
+ * does not start the stream implicitly.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "audio_xrun.h"
+#include "audio_time.h"
+#include "log.h"
+
+#define XRUN_RESUME_RETRY_US (10 * 1000)
+#define XRUN_RESUME_MAX_RETRY (100)
+
+int audio_xrun_init(audio_xrun_t *xrun, snd_pcm_t *handle, snd_pcm_stream_t stream,
+                    const char *name, uint32_t sample_rate, uint32_t bytes_per_frame,
+                    uint32_t prefill_ms)
+{
+    memset(xrun, 0, sizeof(*xrun));
+    xrun->handle = handle;
+    xrun->stream = stream;
+    xrun->name = name;
+    xrun->bytes_per_frame = bytes_per_frame;
+    xrun->prefill_frames = sample_rate * prefill_ms / 1000;
+
+    snd_pcm_hw_params_t *hw_params;
+    snd_pcm_access_t access = SND_PCM_ACCESS_RW_INTERLEAVED;
+    snd_pcm_hw_params_alloca(&hw_params);
+    if (snd_pcm_hw_params_current(handle, hw_params) == 0) {
+        snd_pcm_hw_params_get_access(hw_params, &access);
+    }
+    xrun->mmap = access == SND_PCM_ACCESS_MMAP_INTERLEAVED;
+
+    if (stream == SND_PCM_STREAM_PLAYBACK && xrun->prefill_frames > 0) {
+        xrun->silence = calloc(xrun->prefill_frames, xrun->bytes_per_frame);
+        if (!xrun->silence) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void audio_xrun_deinit(audio_xrun_t *xrun)
+{
+    free(xrun->silence);
+    xrun->silence = NULL;
+}
+
+static int xrun_restart(audio_xrun_t *xrun)
+{
+    int err = snd_pcm_prepare(xrun->handle);
+    if (err < 0) {
+        return err;
+    }
+
+    if (xrun->stream == SND_PCM_STREAM_CAPTURE) {
+        return snd_pcm_start(xrun->handle);
+    }
+
+    // 只预填有限的静音，播放延迟不会因恢复而增长
+    if (xrun->silence) {
+        snd_pcm_sframes_t n = xrun->mmap
+                              ? snd_pcm_mmap_writei(xrun->handle, xrun->silence, xrun->prefill_frames)
+                              : snd_pcm_writei(xrun->handle, xrun->silence, xrun->prefill_frames);
+        if (n < 0) {
+            return (int)n;
+        }
+    }
+    return 0;
+}
+
+static int xrun_resume(audio_xrun_t *xrun)
+{
+    int err;
+    int retry = 0;
+
+    while ((err = snd_pcm_resume(xrun->handle)) == -EAGAIN && retry++ < XRUN_RESUME_MAX_RETRY) {
+        usleep(XRUN_RESUME_RETRY_US);
+    }
+    if (err == 0) {
+        return 0;
+    }
+    // 驱动不支持 resume 或 resume 后需要重新准备
+    return xrun_restart(xrun);
+}
+
+int audio_xrun_recover(audio_xrun_t *xrun, int err)
+{
+    int64_t start_us = audio_now_us();
+
+    if (err == -EPIPE) {
+        atomic_fetch_add_explicit(&xrun->stats.xruns, 1, memory_order_relaxed);
+        err = xrun_restart(xrun);
+    } else if (err == -ESTRPIPE) {
+        atomic_fetch_add_explicit(&xrun->stats.suspends, 1, memory_order_relaxed);
+        err = xrun_resume(xrun);
+    } else {
+        return err;
+    }
+
+    uint32_t cost_us = (uint32_t)(audio_now_us() - start_us);
+    if (err < 0) {
+        atomic_fetch_add_explicit(&xrun->stats.failed, 1, memory_order_relaxed);
+        LOGE("%s设备恢复失败: %s", xrun->name, snd_strerror(err));
+        return err;
+    }
+
+    atomic_fetch_add_explicit(&xrun->stats.recovered, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&xrun->stats.recovery_us_sum, cost_us, memory_order_relaxed);
+    atomic_store_explicit(&xrun->stats.recovery_us_last, cost_us, memory_order_relaxed);
+    if (cost_us > atomic_load_explicit(&xrun->stats.recovery_us_max, memory_order_relaxed)) {
+        atomic_store_explicit(&xrun->stats.recovery_us_max, cost_us, memory_order_relaxed);
+    }
+    LOGW("%s设备已恢复: 耗时=%uus, xrun=%llu, 挂起=%llu", xrun->name, cost_us,
+         atomic_load(&xrun->stats.xruns), atomic_load(&xrun->stats.suspends));
+    return 0;
+}
+
+void audio_xrun_report(const audio_xrun_t *xrun)
+{
+    audio_xrun_stats_t *stats = (audio_xrun_stats_t *)&xrun->stats;
+    uint64_t recovered = atomic_load(&stats->recovered);
+
+    LOGI("%s设备恢复统计: xrun=%llu, 挂起=%llu, 成功=%llu, 失败=%llu, 耗时 平均=%lluus 最大=%uus",
+         xrun->name, atomic_load(&stats->xruns), atomic_load(&stats->suspends),
+         (unsigned long long)recovered, atomic_load(&stats->failed),
+         recovered ? atomic_load(&stats->recovery_us_sum) / recovered : 0ULL,
+         atomic_load(&stats->recovery_us_max));
+}
@@ -0,0 +1,51 @@
+/*************************************************************
+ * File  :  audio_xrun.h
+ * Module:  Xrun and suspend/resume recovery for ALSA handles.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#ifndef _AUDIO_XRUN_H_
+#define _AUDIO_XRUN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <alsa/asoundlib.h>
+
+typedef struct {
+    atomic_ullong xruns;            // 上溢/欠载次数
+    atomic_ullong suspends;         // 挂起次数
+    atomic_ullong recovered;        // 恢复成功次数
+    atomic_ullong failed;           // 恢复失败次数
+    atomic_ullong recovery_us_sum;  // 累计恢复耗时
+    atomic_uint recovery_us_max;    // 最大恢复耗时
+    atomic_uint recovery_us_last;   // 最近一次恢复耗时
+} audio_xrun_stats_t;
+
+typedef struct {
+    snd_pcm_t *handle;
+    snd_pcm_stream_t stream;
+    const char *name;
+    bool mmap;                      // 设备以 mmap 方式访问
+    uint32_t prefill_frames;        // 播放恢复后最多预填的静音帧数
+    uint32_t bytes_per_frame;
+    uint8_t *silence;
+    audio_xrun_stats_t stats;
+} audio_xrun_t;
+
+// prefill_ms 限定播放恢复后预填静音的上限，避免恢复本身引入积压
+int audio_xrun_init(audio_xrun_t *xrun, snd_pcm_t *handle, snd_pcm_stream_t stream,
+                    const char *name, uint32_t sample_rate, uint32_t bytes_per_frame,
+                    uint32_t prefill_ms);
+void audio_xrun_deinit(audio_xrun_t *xrun);
+
+// 处理 -EPIPE/-ESTRPIPE，成功返回 0，其它错误原样返回
+int audio_xrun_recover(audio_xrun_t *xrun, int err);
+
+void audio_xrun_report(const audio_xrun_t *xrun);
+
+#endif
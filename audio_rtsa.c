@@ -10,29 +10,156 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
 #include <alsa/asoundlib.h>
 #include "app_config.h"
+#include "audio_device.h"
+#include "audio_playout.h"
+#include "audio_source.h"
+#include "audio_convert.h"
+#include "audio_time.h"
+#include "audio_stats.h"
+#include "audio_frame.h"
+#include "audio_aec.h"
+#include "audio_vad.h"
+#include "audio_encoder.h"
+#include "audio_preroll.h"
+#include "audio_preproc.h"
+#include "audio_ctl.h"
+#include "audio_recorder.h"
+#include "audio_event.h"
 
-// 音频设备结构体
+#define APP_CHANNEL_NAME_LEN (64)
+#define APP_DEVICE_NAME_LEN (128)
+#define APP_CONN_REPORT_INTERVAL_US (10 * 1000 * 1000)
+// 发送侧帧池大小: 采集、处理和发送各阶段同时持有的帧数上限
+#define APP_FRAME_POOL_FRAMES (16)
+#define APP_EVENT_QUEUE_SIZE (256)
+// 主线程处理事件和控制命令的间隔
+#define APP_EVENT_POLL_MS (20)
+
+// SDK 回调和信号处理函数投递给主线程的事件
+typedef enum {
+    APP_EVENT_JOINED = 0,
+    APP_EVENT_REJOINED,
+    APP_EVENT_RECONNECTING,
+    APP_EVENT_LOST,
+    APP_EVENT_ERROR,
+    APP_EVENT_STOP,
+} app_event_type_e;
+
+typedef enum {
+    APP_CONN_JOINING = 0,
+    APP_CONN_CONNECTED,
+    APP_CONN_RECONNECTING,      // SDK 正在重连
+    APP_CONN_LOST,              // 超时未能重连，SDK 仍会继续尝试
+} app_conn_state_e;
+
+// 应用状态只由主线程根据事件修改
+typedef enum {
+    APP_STATE_JOINING = 0,      // 等待第一个连接加入频道，发送侧未启动
+    APP_STATE_ACTIVE,           // 至少一个连接可用，采集运行
+    APP_STATE_OFFLINE,          // 所有连接都断开，采集暂停，设备保持打开
+    APP_STATE_STOPPING,
+} app_state_e;
+
+// 单个连接的状态与发送统计，统计只由发送线程更新，控制线程的 stats 命令经主线程读取
+typedef struct {
+    connection_id_t conn_id;
+    char channel[APP_CHANNEL_NAME_LEN + 1];
+    atomic_bool connected;      // 由主线程根据事件设置，发送线程读取
+    bool created;
+    app_conn_state_e state;
+    int64_t down_us;            // 最近一次断开的时刻
+    uint32_t reconnects;
+    uint64_t outage_us_sum;     // 从断开到重新加入频道的时间
+    uint64_t outage_us_max;
+    atomic_ullong frames_sent;
+    atomic_ullong bytes_sent;
+    atomic_ullong send_errors;
+    atomic_ullong skipped_frames;
+    atomic_ullong vad_frames;   // 判为静音没有发送的帧，即省去的编码调用
+    atomic_ullong vad_bytes;
+    atomic_ullong send_ns_sum;
+    atomic_ullong send_ns_max;
+} app_conn_t;
+
+// 控制线程交给主线程执行的命令，执行期间控制线程等待结果
 typedef struct {
-    snd_pcm_t *capture_handle;    // 录音设备句柄
-    snd_pcm_t *playback_handle;   // 播放设备句柄
-    snd_pcm_hw_params_t *hw_params;  // 硬件参数
-    unsigned int sample_rate;      // 采样率
-    unsigned int channels;         // 通道数
-    snd_pcm_format_t format;      // 音频格式
-} audio_device_t;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int argc;
+    char **argv;
+    char *reply;
+    size_t size;
+    int result;
+    bool pending;
+    bool closing;               // 主线程已退出轮询，不再执行命令
+} app_ctl_req_t;
+
+// 启动各阶段的耗时；打开声卡与 SDK 初始化、加入频道并行
+typedef struct {
+    int64_t start_us;               // 进入 main 的时刻
+    int64_t devices_us;             // 设备线程打开并配置声卡
+    int64_t sdk_init_us;
+    int64_t conns_us;               // 创建连接并设置带宽估计
+    int64_t join_us;                // 发起加入频道的调用
+    int64_t device_wait_us;         // 发起加入之后还要等待设备线程的时间
+    int64_t audio_us;               // 回声消除、播放线程和预录采集的启动
+    int64_t joined_us;              // 第一个连接加入成功，相对 start_us
+} app_startup_t;
 
 // 应用程序结构体
 typedef struct {
     app_config_t config;
     audio_device_t audio_dev;
-    connection_id_t conn_id;
-    bool b_stop_flag;
-    bool b_connected_flag;
+    audio_playout_t playout;
+    audio_source_t source;
+    audio_convert_t capture_convert;
+    audio_frame_pool_t frame_pool;
+    uint8_t *capture_scratch;       // 帧池用尽时处理链使用的后备帧，只由采集线程使用
+    atomic_ullong scratch_frames;   // 在后备帧中处理的采集帧
+    audio_aec_t aec;
+    bool aec_enabled;
+    audio_vad_t vad;
+    bool vad_enabled;
+    audio_encoder_t encoder;
+    bool encoder_enabled;
+    audio_preroll_t preroll;
+    bool preroll_enabled;
+    audio_preproc_t preproc;
+    bool preproc_enabled;
+    app_conn_t conns[MAX_CONN_CNT];
+    int conn_cnt;
+    int64_t conn_report_us;
+    char capture_device[APP_DEVICE_NAME_LEN + 1];
+    char playback_device[APP_DEVICE_NAME_LEN + 1];
+    atomic_bool playout_ready;      // 播放线程运行中，SDK 回调可以写入
+    atomic_int playout_users;       // 正在写入播放缓冲区的 SDK 回调数
+    uint64_t playout_gains[AUDIO_PLAYOUT_MAX_STREAMS];  // 播放线程重启时保存的增益表
+    audio_ctl_t ctl;
+    app_ctl_req_t ctl_req;
+    audio_recorder_t recorder;
+    bool record_send;               // 发送的是 PCM 时才录制发送流
+    bool record_recv;
+    atomic_ullong recv_encoded;     // 收到的非 PCM 帧，无法播放和录制
+    audio_event_queue_t events;
+    atomic_bool stop_requested;     // 事件队列已满时信号处理函数的后备通知
+    app_state_e state;
+    bool send_started;              // 发送侧已启动，启用预录时在加入频道之前启动
+    bool send_paused;               // 所有连接断开期间音频源已停止
+    int64_t offline_us;             // 进入 OFFLINE 的时刻
+    uint32_t sdk_errors;
+    pthread_t device_thread;
+    bool device_opening;            // 设备线程运行中
+    int device_result;
+    app_startup_t startup;
 } app_t;
 
 static app_t g_app = {
@@ -52,11 +179,25 @@ static app_t g_app = {
         .audio_data_type            = AUDIO_DATA_TYPE_PCM,
         .audio_codec_type           = AUDIO_CODEC_TYPE_OPUS,
         .send_audio_file_path       = NULL,
+        .audio_source               = AUDIO_SOURCE_ALSA,
+        .tone_hz                    = DEFAULT_TONE_HZ,
 
         // pcm related config
         .pcm_sample_rate            = DEFAULT_PCM_SAMPLE_RATE,
         .pcm_channel_num            = DEFAULT_PCM_CHANNEL_NUM,
         .pcm_duration               = DEFAULT_SEND_AUDIO_FRAME_PERIOD_MS,
+        .jitter_min_ms              = DEFAULT_JITTER_MIN_MS,
+        .jitter_max_ms              = DEFAULT_JITTER_MAX_MS,
+        .plc                        = false,
+        .drift_comp                 = false,
+        .mix_max_streams            = DEFAULT_MIX_MAX_STREAMS,
+        .record_rotate_mb           = DEFAULT_RECORD_ROTATE_MB,
+        .record_rotate_sec          = DEFAULT_RECORD_ROTATE_SEC,
+        .record_budget_kb           = DEFAULT_RECORD_BUDGET_KB,
+        .capture_batch              = 1,
+        .preroll_ms                 = 0,
+        .preroll_mode               = AUDIO_PREROLL_STRETCH,
+        .device_cache               = DEFAULT_DEVICE_CACHE_FILENAME,
 
         // advanced config
         .enable_audio_mixer         = false,
@@ -64,264 +205,1470 @@ static app_t g_app = {
         .local_ap                   = "",
         .domain_limit               = false,
         .lan_accelerate             = false,
+        .conn_cnt                   = 0,
+        .rt                         = false,
+        .rt_prio_capture            = AUDIO_RT_DEFAULT_PRIORITY,
+        .rt_prio_playout            = AUDIO_RT_DEFAULT_PRIORITY,
+        .rt_cpu_capture             = -1,
+        .rt_cpu_playout             = -1,
+        .aec                        = false,
+        .aec_tail_ms                = AUDIO_AEC_DEFAULT_TAIL_MS,
+        .vad_mode                   = AUDIO_VAD_OFF,
+        .vad_attack_ms              = AUDIO_VAD_DEFAULT_ATTACK_MS,
+        .vad_hangover_ms            = AUDIO_VAD_DEFAULT_HANGOVER_MS,
+        .vad_thin_ms                = AUDIO_VAD_DEFAULT_THIN_MS,
+        .ns                         = false,
+        .ns_max_db                  = AUDIO_NS_DEFAULT_MAX_DB,
+        .agc                        = false,
+        .agc_target_dbfs            = AUDIO_AGC_DEFAULT_TARGET_DBFS,
+        .agc_max_gain_db            = AUDIO_AGC_DEFAULT_MAX_GAIN_DB,
     },
 
-    .b_stop_flag            = false,
-    .b_connected_flag       = false,
+    .ctl_req = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .cond = PTHREAD_COND_INITIALIZER,
+    },
+};
+
+static const char *const g_app_state_names[] = {
+    [APP_STATE_JOINING]     = "joining",
+    [APP_STATE_ACTIVE]      = "active",
+    [APP_STATE_OFFLINE]     = "offline",
+    [APP_STATE_STOPPING]    = "stopping",
 };
 
-// 信号处理函数
+static const char *const g_conn_state_names[] = {
+    [APP_CONN_JOINING]      = "joining",
+    [APP_CONN_CONNECTED]    = "connected",
+    [APP_CONN_RECONNECTING] = "reconnecting",
+    [APP_CONN_LOST]         = "lost",
+};
+
+// 信号处理函数只投递事件；SA_RESETHAND 使退出卡住时再按一次 Ctrl-C 直接结束进程
 static void app_signal_handler(int sig) {
-    switch (sig) {
-    case SIGINT:
-        g_app.b_stop_flag = true;
-        break;
-    default:
-        LOGW("no handler, sig=%d", sig);
-    }
-}
-
-// 初始化音频设备
-static int init_audio_device(audio_device_t *dev, const char *capture_device, 
-                           const char *playback_device) {
-    int err;
-    snd_pcm_uframes_t buffer_size = 1024;
-    snd_pcm_uframes_t period_size = 256;
-    
-    // 初始化录音设备
-    err = snd_pcm_open(&dev->capture_handle, capture_device, 
-                      SND_PCM_STREAM_CAPTURE, 0);
-    if (err < 0) {
-        LOGE("无法打开录音设备: %s", snd_strerror(err));
+    if (audio_event_post(&g_app.events, APP_EVENT_STOP, 0, 0, sig, 0, NULL) < 0) {
+        atomic_store(&g_app.stop_requested, true);
+    }
+}
+
+static void app_install_signals(void) {
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = app_signal_handler;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+}
+
+// 根据 SDK 回调中的 conn_id 找到对应连接
+static app_conn_t *app_find_conn(connection_id_t conn_id) {
+    for (int i = 0; i < g_app.conn_cnt; i++) {
+        if (g_app.conns[i].created && g_app.conns[i].conn_id == conn_id) {
+            return &g_app.conns[i];
+        }
+    }
+    return NULL;
+}
+
+static bool app_any_connected(void) {
+    for (int i = 0; i < g_app.conn_cnt; i++) {
+        if (atomic_load_explicit(&g_app.conns[i].connected, memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 解析每个连接加入的频道：-c 给出列表时按列表，否则第 N 个连接加入 <频道名>_N
+static int app_setup_conns(app_config_t *config) {
+    char names[MAX_CONN_CNT][APP_CHANNEL_NAME_LEN + 1];
+    int name_cnt = 0;
+    const char *p = config->p_channel;
+
+    while (*p) {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len == 0 || len > APP_CHANNEL_NAME_LEN || name_cnt == MAX_CONN_CNT) {
+            LOGE("频道列表 \"%s\" 不合法", config->p_channel);
+            return -1;
+        }
+        memcpy(names[name_cnt], p, len);
+        names[name_cnt++][len] = '\0';
+        p += end ? len + 1 : len;
+    }
+    if (name_cnt == 0) {
+        LOGE("频道名称不能为空");
         return -1;
     }
-    
-    // 初始化播放设备
-    err = snd_pcm_open(&dev->playback_handle, playback_device, 
-                      SND_PCM_STREAM_PLAYBACK, 0);
-    if (err < 0) {
-        LOGE("无法打开播放设备: %s", snd_strerror(err));
-        snd_pcm_close(dev->capture_handle);
+
+    g_app.conn_cnt = config->conn_cnt > 0 ? config->conn_cnt : name_cnt;
+    if (name_cnt > 1 && g_app.conn_cnt != name_cnt) {
+        LOGE("conn-cnt=%d 与频道列表数量 %d 不一致", g_app.conn_cnt, name_cnt);
         return -1;
     }
-    
-    // 设置硬件参数
-    snd_pcm_hw_params_alloca(&dev->hw_params);
-    err = snd_pcm_hw_params_any(dev->capture_handle, dev->hw_params);
-    if (err < 0) {
-        LOGE("无法初始化硬件参数: %s", snd_strerror(err));
-        goto error;
-    }
-    
-    // 设置访问模式
-    err = snd_pcm_hw_params_set_access(dev->capture_handle, dev->hw_params,
-                                      SND_PCM_ACCESS_RW_INTERLEAVED);
-    if (err < 0) {
-        LOGE("无法设置访问模式: %s", snd_strerror(err));
-        goto error;
-    }
-    
-    // 设置采样格式
-    dev->format = SND_PCM_FORMAT_S16_LE;  // 16位有符号整数，小端
-    err = snd_pcm_hw_params_set_format(dev->capture_handle, dev->hw_params,
-                                      dev->format);
-    if (err < 0) {
-        LOGE("无法设置采样格式: %s", snd_strerror(err));
-        goto error;
-    }
-    
-    // 设置采样率
-    unsigned int min_rate, max_rate;
-    err = snd_pcm_hw_params_get_rate_min(dev->hw_params, &min_rate, NULL);
-    if (err < 0) {
-        LOGE("无法获取最小采样率: %s", snd_strerror(err));
-        goto error;
-    }
-    err = snd_pcm_hw_params_get_rate_max(dev->hw_params, &max_rate, NULL);
-    if (err < 0) {
-        LOGE("无法获取最大采样率: %s", snd_strerror(err));
-        goto error;
-    }
-    
-    dev->sample_rate = 16000;  // 目标采样率
-    if (dev->sample_rate < min_rate || dev->sample_rate > max_rate) {
-        LOGW("设备不支持目标采样率 %dHz，将使用 %dHz", dev->sample_rate, min_rate);
-        dev->sample_rate = min_rate;
-    }
-    
-    err = snd_pcm_hw_params_set_rate_near(dev->capture_handle, dev->hw_params,
-                                         &dev->sample_rate, 0);
-    if (err < 0) {
-        LOGE("无法设置采样率: %s", snd_strerror(err));
-        goto error;
-    }
-    
-    // 设置通道数
-    unsigned int min_channels, max_channels;
-    err = snd_pcm_hw_params_get_channels_min(dev->hw_params, &min_channels);
-    if (err < 0) {
-        LOGE("无法获取最小通道数: %s", snd_strerror(err));
-        goto error;
-    }
-    err = snd_pcm_hw_params_get_channels_max(dev->hw_params, &max_channels);
-    if (err < 0) {
-        LOGE("无法获取最大通道数: %s", snd_strerror(err));
-        goto error;
-    }
-    
-    LOGI("设备支持的通道数范围: %d-%d", min_channels, max_channels);
-    
-    // 使用设备支持的最小通道数
-    dev->channels = min_channels;
-    err = snd_pcm_hw_params_set_channels(dev->capture_handle, dev->hw_params,
-                                        dev->channels);
-    if (err < 0) {
-        LOGE("无法设置通道数: %s", snd_strerror(err));
-        goto error;
-    }
-    
-    LOGI("音频设备配置: 采样率=%dHz, 通道数=%d", dev->sample_rate, dev->channels);
-    
-    // 设置缓冲区大小
-    err = snd_pcm_hw_params_set_buffer_size_near(dev->capture_handle, dev->hw_params, &buffer_size);
-    if (err < 0) {
-        LOGE("无法设置缓冲区大小: %s", snd_strerror(err));
-        goto error;
-    }
-    
-    // 设置周期大小
-    err = snd_pcm_hw_params_set_period_size_near(dev->capture_handle, dev->hw_params, &period_size, 0);
-    if (err < 0) {
-        LOGE("无法设置周期大小: %s", snd_strerror(err));
-        goto error;
-    }
-    
-    // 应用参数
-    err = snd_pcm_hw_params(dev->capture_handle, dev->hw_params);
-    if (err < 0) {
-        LOGE("无法应用硬件参数: %s", snd_strerror(err));
-        goto error;
-    }
-    
-    // 对播放设备应用相同的参数
-    err = snd_pcm_hw_params(dev->playback_handle, dev->hw_params);
-    if (err < 0) {
-        LOGE("无法应用播放设备参数: %s", snd_strerror(err));
-        goto error;
-    }
-    
+
+    for (int i = 0; i < g_app.conn_cnt; i++) {
+        app_conn_t *conn = &g_app.conns[i];
+        atomic_init(&conn->connected, false);
+        if (name_cnt > 1 || i == 0) {
+            if (snprintf(conn->channel, sizeof(conn->channel), "%s", names[i]) >= (int)sizeof(conn->channel)) {
+                LOGE("频道名称 \"%s\" 过长", names[i]);
+                return -1;
+            }
+        } else if (snprintf(conn->channel, sizeof(conn->channel), "%s_%d", names[0], i) >=
+                   (int)sizeof(conn->channel)) {
+            LOGE("频道名称 \"%s\" 过长，无法加后缀", names[0]);
+            return -1;
+        }
+    }
     return 0;
-    
-error:
-    snd_pcm_close(dev->capture_handle);
-    snd_pcm_close(dev->playback_handle);
-    return -1;
 }
 
-// 清理音频设备
-static void cleanup_audio_device(audio_device_t *dev) {
-    if (dev->capture_handle) {
-        snd_pcm_close(dev->capture_handle);
+static void app_report_conns(void) {
+    for (int i = 0; i < g_app.conn_cnt; i++) {
+        app_conn_t *conn = &g_app.conns[i];
+        uint64_t frames = atomic_load_explicit(&conn->frames_sent, memory_order_relaxed);
+        uint64_t max_ns = atomic_load_explicit(&conn->send_ns_max, memory_order_relaxed);
+        uint64_t avg_ns = frames ? atomic_load_explicit(&conn->send_ns_sum, memory_order_relaxed) / frames : 0;
+        LOGI("[conn-%u] %s: %s 发送 %llu 帧/%llu 字节, 失败 %llu, 未连接跳过 %llu, "
+             "静音省去 %llu 帧/%llu 字节, 发送耗时 平均 %llu.%03llu ms 最大 %llu.%03llu ms, "
+             "重连 %u 次 中断 平均 %llu ms 最大 %llu ms",
+             conn->conn_id, conn->channel,
+             atomic_load(&conn->connected) ? "已连接" : "未连接",
+             (unsigned long long)frames, atomic_load_explicit(&conn->bytes_sent, memory_order_relaxed),
+             atomic_load_explicit(&conn->send_errors, memory_order_relaxed),
+             atomic_load_explicit(&conn->skipped_frames, memory_order_relaxed),
+             atomic_load_explicit(&conn->vad_frames, memory_order_relaxed),
+             atomic_load_explicit(&conn->vad_bytes, memory_order_relaxed),
+             (unsigned long long)(avg_ns / 1000000), (unsigned long long)(avg_ns / 1000 % 1000),
+             (unsigned long long)(max_ns / 1000000), (unsigned long long)(max_ns / 1000 % 1000), conn->reconnects,
+             (unsigned long long)(conn->reconnects ? conn->outage_us_sum / conn->reconnects / 1000 : 0),
+             (unsigned long long)(conn->outage_us_max / 1000));
     }
-    if (dev->playback_handle) {
-        snd_pcm_close(dev->playback_handle);
+    if (atomic_load(&g_app.recv_encoded) > 0) {
+        LOGI("收到未解码的音频 %llu 帧，未播放", atomic_load(&g_app.recv_encoded));
+    }
+    if (g_app.frame_pool.frames) {
+        audio_frame_pool_report(&g_app.frame_pool, "发送");
     }
 }
 
-// 发送音频数据
-static int app_send_audio(void) {
+// 发送一帧 RTC 格式的音频，同一份数据依次发给所有已连接的连接
+static void app_send_frame(const audio_frame_t *frame) {
+    const void *data = frame->data;
+    size_t len = frame->len;
     app_config_t *config = &g_app.config;
     audio_frame_info_t info = { 0 };
     info.data_type = config->audio_data_type;
-    
-    // 计算每帧的字节数
-    int bytes_per_frame = 2 * config->pcm_channel_num;  // 16位采样，每个采样2字节
-    int frames_per_packet = config->pcm_sample_rate * config->pcm_duration / 1000;  // 每包帧数
-    int buffer_size = frames_per_packet * bytes_per_frame;
-    
-    // 从USB麦克风读取音频数据
-    char buffer[buffer_size];
-    snd_pcm_sframes_t frames = snd_pcm_readi(g_app.audio_dev.capture_handle, 
-                                           buffer, frames_per_packet);
-    if (frames < 0) {
-        LOGE("读取音频数据失败: %s", snd_strerror(frames));
+    // 录制处理后的完整采集音频，包括语音检测判为静音而没有发送的帧
+    if (g_app.record_send) {
+        audio_recorder_write(&g_app.recorder, AUDIO_RECORDER_SEND_LANE, AUDIO_RECORD_SEND, 0, 0, data, len);
+    }
+    // 静音帧不交给 SDK，每个连接都省去一次编码和发送
+    bool send = !g_app.vad_enabled || audio_vad_process(&g_app.vad, (const int16_t *)data, len / sizeof(int16_t));
+    // 只编码一次，同一份码流发给所有连接，SDK 原样透传
+    if (send && g_app.encoder_enabled) {
+        const uint8_t *coded;
+        int n = audio_encoder_encode(&g_app.encoder, (const int16_t *)data, len / sizeof(int16_t), &coded);
+        if (n < 0) {
+            LOGE("编码失败，丢弃 %zu 字节", len);
+            return;
+        }
+        data = coded;
+        len = n;
+        info.data_type = audio_encoder_data_type(g_app.encoder.cfg.type);
+    }
+    // 省去的字节数按实际会发出的负载计算，启用编码器时是编码后的大小
+    size_t vad_bytes = !send && g_app.encoder_enabled ?
+                       audio_encoder_frame_bytes(&g_app.encoder, len / sizeof(int16_t)) : len;
+
+    for (int i = 0; i < g_app.conn_cnt; i++) {
+        app_conn_t *conn = &g_app.conns[i];
+        if (!atomic_load_explicit(&conn->connected, memory_order_acquire)) {
+            atomic_fetch_add_explicit(&conn->skipped_frames, 1, memory_order_relaxed);
+            continue;
+        }
+        if (!send) {
+            atomic_fetch_add_explicit(&conn->vad_frames, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&conn->vad_bytes, vad_bytes, memory_order_relaxed);
+            continue;
+        }
+
+        int64_t t0 = audio_now_ns();
+        int rval = agora_rtc_send_audio_data(conn->conn_id, data, len, &info);
+        uint64_t cost_ns = audio_now_ns() - t0;
+        audio_stats_record(AUDIO_STAT_SEND, cost_ns);
+
+        atomic_fetch_add_explicit(&conn->send_ns_sum, cost_ns, memory_order_relaxed);
+        if (cost_ns > atomic_load_explicit(&conn->send_ns_max, memory_order_relaxed)) {
+            atomic_store_explicit(&conn->send_ns_max, cost_ns, memory_order_relaxed);
+        }
+        if (rval < 0) {
+            atomic_fetch_add_explicit(&conn->send_errors, 1, memory_order_relaxed);
+            LOGE("[conn-%u] 发送音频数据失败: %s", conn->conn_id, agora_rtc_err_2_str(rval));
+        } else {
+            atomic_fetch_add_explicit(&conn->frames_sent, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&conn->bytes_sent, len, memory_order_relaxed);
+        }
+    }
+
+    int64_t now_us = audio_now_us();
+    if (g_app.conn_report_us == 0) {
+        g_app.conn_report_us = now_us;
+    } else if (now_us - g_app.conn_report_us >= APP_CONN_REPORT_INTERVAL_US) {
+        g_app.conn_report_us = now_us;
+        app_report_conns();
+    }
+}
+
+// 处理后的采集音频: 启用预录时先进入预录缓冲，有连接时取出应发送的帧，
+// 否则只在有连接时发送
+static void app_send_captured(const audio_frame_t *frame) {
+    if (!g_app.preroll_enabled) {
+        if (app_any_connected()) {
+            app_send_frame(frame);
+        }
+        return;
+    }
+
+    audio_frame_t out;
+    audio_preroll_push(&g_app.preroll, (const int16_t *)frame->data,
+                       frame->len / (g_app.preroll.cfg.channels * sizeof(int16_t)), frame->capture_us);
+    if (!app_any_connected()) {
+        return;
+    }
+    while (audio_preroll_pop(&g_app.preroll, &out)) {
+        app_send_frame(&out);
+    }
+}
+
+// 采集音频的处理链: 回声消除、降噪、自动增益，都在帧上原地进行
+static void app_process_capture(audio_frame_t *frame) {
+    int16_t *pcm = (int16_t *)frame->data;
+    uint32_t samples = frame->len / sizeof(int16_t);
+
+    if (g_app.aec_enabled) {
+        audio_aec_process(&g_app.aec, pcm, samples, frame->capture_us);
+    }
+    if (g_app.preproc_enabled) {
+        audio_preproc_process(&g_app.preproc, pcm, samples);
+        // 降噪的输出晚于输入，采集时刻随之前移，延迟统计中包含这段时间；降噪可在运行中开关，每帧重新取
+        frame->capture_us -= (int64_t)audio_preproc_latency(&g_app.preproc) * 1000000 / g_app.preproc.cfg.sample_rate;
+    }
+}
+
+// 发送音频数据，由采集线程每帧调用一次
+static void app_send_audio(void *ctx, audio_frame_t *frame) {
+    app_config_t *config = &g_app.config;
+    audio_convert_t *cv = &g_app.capture_convert;
+
+    // 所有连接都断开时丢弃，保持录音设备持续运转；启用预录时照常处理，写入预录缓冲
+    if (!g_app.preroll_enabled && !app_any_connected()) {
+        return;
+    }
+
+    if (cv->passthrough) {
+        if (!g_app.aec_enabled && !g_app.preproc_enabled) {
+            app_send_captured(frame);
+            return;
+        }
+        // 处理链原地改写数据，借用的 DMA 区先拷到帧池里；帧池用尽时拷到后备帧，
+        // 不发送未经回声消除和增益处理的音频
+        audio_frame_t scratch;
+        audio_frame_t *own = audio_frame_hold(frame, &g_app.frame_pool);
+        if (!own) {
+            atomic_fetch_add_explicit(&g_app.scratch_frames, 1, memory_order_relaxed);
+            audio_frame_borrow(&scratch, g_app.capture_scratch, frame->len, frame->capture_us);
+            memcpy(scratch.data, frame->data, frame->len);
+            own = &scratch;
+        }
+        app_process_capture(own);
+        app_send_captured(own);
+        audio_frame_release(own);
+        return;
+    }
+
+    // 设备格式与 RTC 不一致时先转换，再按 pcm_duration 切帧发送；
+    // 转换结果直接从转换器的缓冲区发出
+    uint32_t frame_samples = config->pcm_sample_rate * config->pcm_duration / 1000;
+    if (config->drift_comp) {
+        // 声卡时钟偏快时多消耗输入，发出的音频保持名义采样率
+        audio_convert_set_ppm(cv, audio_drift_ppm(&g_app.source.capture.drift));
+    }
+    const uint8_t *in = frame->data;
+    uint32_t in_frames = frame->len / audio_frame_bytes(&cv->in);
+    while (in_frames > 0) {
+        // 超过转换器单次容量的输入分段推入，每段切完帧再推下一段
+        uint32_t pushed = audio_convert_push(cv, in, in_frames);
+        in += (size_t)pushed * audio_frame_bytes(&cv->in);
+        in_frames -= pushed;
+        int64_t pending_us = (int64_t)in_frames * 1000000 / cv->in.rate;
+        uint32_t avail;
+        while ((avail = audio_convert_avail(cv)) >= frame_samples) {
+            // 一次可能切出多帧，每帧按排在它之后的数据(包括尚未推入的输入)前移，与采集线程的批量切片一致
+            int64_t capture_us = frame->capture_us - pending_us -
+                                 (int64_t)(avail - frame_samples) * 1000000 / config->pcm_sample_rate;
+            audio_frame_t out;
+            audio_frame_borrow(&out, audio_convert_data(cv), frame_samples * cv->out_frame_bytes, capture_us);
+            app_process_capture(&out);
+            app_send_captured(&out);
+            audio_convert_consume(cv, frame_samples);
+        }
+    }
+}
+
+// 文件/发生器音频源已经是 RTC 格式，直接发送
+static void app_send_source_frame(void *ctx, audio_frame_t *frame) {
+    app_send_captured(frame);
+}
+
+// 发送侧帧池按配置一次性分配，容量取 RTC 帧和声卡采集帧中较大者
+static int app_init_frame_pool(app_config_t *config) {
+    uint32_t frame_bytes = config->pcm_sample_rate * config->pcm_duration / 1000 *
+                           config->pcm_channel_num * sizeof(int16_t);
+
+    if (config->audio_source == AUDIO_SOURCE_ALSA) {
+        audio_pcm_t *pcm = &g_app.audio_dev.capture;
+        audio_format_t device_fmt = audio_pcm_format(pcm);
+        uint32_t device_bytes = pcm->sample_rate * config->pcm_duration / 1000 * audio_frame_bytes(&device_fmt);
+        if (device_bytes > frame_bytes) {
+            frame_bytes = device_bytes;
+        }
+    }
+    g_app.capture_scratch = calloc(1, frame_bytes);
+    if (!g_app.capture_scratch || audio_frame_pool_init(&g_app.frame_pool, APP_FRAME_POOL_FRAMES, frame_bytes) < 0) {
+        LOGE("无法分配发送帧池");
         return -1;
     }
-    
-    // 确保读取到足够的帧数
-    if (frames < frames_per_packet) {
-        LOGW("读取的帧数不足: %ld < %d", (long)frames, frames_per_packet);
+    audio_rt_prefault(g_app.capture_scratch, frame_bytes);
+    atomic_store(&g_app.scratch_frames, 0);
+    return 0;
+}
+
+// 启动发送侧音频源
+static int app_start_source(app_config_t *config) {
+    audio_source_config_t source_cfg = {
+        .type           = config->audio_source,
+        .file_path      = config->send_audio_file_path,
+        .file_type      = audio_data_type_to_file_type(config->audio_data_type),
+        .sample_rate    = config->pcm_sample_rate,
+        .channels       = config->pcm_channel_num,
+        .interval_us    = audio_data_type_frame_us(config->audio_data_type, config->pcm_duration),
+        .batch          = config->capture_batch,
+        .tone_hz        = config->tone_hz,
+        .rt             = { config->rt, config->rt_prio_capture, config->rt_cpu_capture },
+        .pool           = &g_app.frame_pool,
+        .on_frame       = app_send_source_frame,
+        .ctx            = &g_app,
+    };
+
+    if (config->audio_source == AUDIO_SOURCE_ALSA) {
+        audio_pcm_t *pcm = &g_app.audio_dev.capture;
+        audio_format_t device_fmt = audio_pcm_format(pcm);
+        audio_format_t rtc_fmt = { config->pcm_sample_rate, config->pcm_channel_num, AUDIO_FMT_S16 };
+
+        if (config->audio_data_type != AUDIO_DATA_TYPE_PCM) {
+            LOGE("声卡采集只能发送 PCM 数据，预编码数据请使用 --source file");
+            return -1;
+        }
+        source_cfg.capture = (audio_capture_config_t) {
+            .handle         = pcm->handle,
+            .sample_rate    = pcm->sample_rate,
+            .bytes_per_frame = audio_frame_bytes(&device_fmt),
+            .frame_ms       = config->pcm_duration,
+            .mmap           = pcm->mmap,
+            .batch          = config->capture_batch,
+            .rt             = source_cfg.rt,
+            .pool           = &g_app.frame_pool,
+            .on_frame       = app_send_audio,
+            .ctx            = &g_app,
+        };
+        if (audio_convert_init(&g_app.capture_convert, "采集", &device_fmt, &rtc_fmt,
+                               pcm->sample_rate * config->pcm_duration / 1000,
+                               config->pcm_sample_rate * config->pcm_duration / 1000,
+                               config->capture_channel, config->drift_comp) < 0) {
+            return -1;
+        }
+    }
+
+    return audio_source_start(&g_app.source, &source_cfg);
+}
+
+// 回声消除以播放的混音结果为参考，要求采集与播放都是 RTC 格式的单声道，
+// 且发送的是本机声卡采集的音频
+static int app_init_aec(app_config_t *config) {
+    if (config->receive_data_only || config->audio_source != AUDIO_SOURCE_ALSA) {
+        LOGW("回声消除只作用于声卡采集的发送音频，已忽略 --aec");
+        return 0;
+    }
+    if (config->pcm_channel_num != 1) {
+        LOGW("回声消除只支持单声道，已忽略 --aec");
+        return 0;
+    }
+    audio_aec_config_t aec_cfg = {
+        .sample_rate    = config->pcm_sample_rate,
+        .frame_samples  = config->pcm_sample_rate * config->pcm_duration / 1000,
+        .tail_ms        = config->aec_tail_ms,
+    };
+    if (audio_aec_init(&g_app.aec, &aec_cfg) < 0) {
         return -1;
     }
-    
-    // 发送音频数据
-    int rval = agora_rtc_send_audio_data(g_app.conn_id, buffer, 
-                                        frames * bytes_per_frame, &info);
-    if (rval < 0) {
-        LOGE("发送音频数据失败: %s", agora_rtc_err_2_str(rval));
+    g_app.aec_enabled = true;
+    return 0;
+}
+
+// 启用控制套接字时，可在运行中打开的处理也预先初始化，控制命令只发布新参数
+static bool app_tunable(const app_config_t *config) {
+    return config->ctl_socket != NULL;
+}
+
+static audio_preproc_config_t app_preproc_config(const app_config_t *config) {
+    audio_preproc_config_t pp_cfg = {
+        .sample_rate    = config->pcm_sample_rate,
+        .channels       = config->pcm_channel_num,
+        .frame_samples  = config->pcm_sample_rate * config->pcm_duration / 1000,
+        .ns             = config->ns,
+        .ns_max_db      = config->ns_max_db,
+        .agc            = config->agc,
+        .agc_target_dbfs = config->agc_target_dbfs,
+        .agc_max_gain_db = config->agc_max_gain_db,
+        .tunable        = app_tunable(config),
+    };
+    return pp_cfg;
+}
+
+// 降噪与自动增益只作用于声卡采集的音频，在采集线程中逐帧处理
+static int app_init_preproc(app_config_t *config) {
+    if (config->audio_source != AUDIO_SOURCE_ALSA) {
+        if (config->ns || config->agc) {
+            LOGW("降噪和自动增益只作用于声卡采集的音频，已忽略 --ns/--agc");
+        }
+        return 0;
+    }
+    audio_preproc_config_t pp_cfg = app_preproc_config(config);
+    if (audio_preproc_init(&g_app.preproc, &pp_cfg) < 0) {
+        // 只要求了单声道才支持的降噪时没有可用的阶段，不算错误
+        return config->agc || config->pcm_channel_num == 1 ? -1 : 0;
+    }
+    g_app.preproc_enabled = true;
+    return 0;
+}
+
+static audio_vad_config_t app_vad_config(const app_config_t *config) {
+    audio_vad_config_t vad_cfg = {
+        .mode           = config->vad_mode,
+        .sample_rate    = config->pcm_sample_rate,
+        .channels       = config->pcm_channel_num,
+        .frame_samples  = config->pcm_sample_rate * config->pcm_duration / 1000,
+        .attack_ms      = config->vad_attack_ms,
+        .hangover_ms    = config->vad_hangover_ms,
+        .thin_ms        = config->vad_thin_ms,
+    };
+    return vad_cfg;
+}
+
+// 语音检测只作用于未编码的 PCM，在发送线程中逐帧判断
+static int app_init_vad(app_config_t *config) {
+    if (config->audio_data_type != AUDIO_DATA_TYPE_PCM) {
+        if (config->vad_mode != AUDIO_VAD_OFF) {
+            LOGW("语音检测只支持 PCM 数据，已忽略 --vad");
+        }
+        return 0;
+    }
+    audio_vad_config_t vad_cfg = app_vad_config(config);
+    if (audio_vad_init(&g_app.vad, &vad_cfg) < 0) {
+        return -1;
+    }
+    g_app.vad_enabled = true;
+    return 0;
+}
+
+// 发送端编码在语音检测之后进行，静音帧不编码
+static int app_init_encoder(app_config_t *config) {
+    audio_encoder_config_t enc_cfg = {
+        .type           = config->encode,
+        .sample_rate    = config->pcm_sample_rate,
+        .channels       = config->pcm_channel_num,
+        .frame_samples  = config->pcm_sample_rate * config->pcm_duration / 1000,
+    };
+    if (audio_encoder_init(&g_app.encoder, &enc_cfg) < 0) {
+        return -1;
+    }
+    g_app.encoder_enabled = true;
+    return 0;
+}
+
+static int app_init_preroll(app_config_t *config) {
+    audio_preroll_config_t preroll_cfg = {
+        .mode           = config->preroll_mode,
+        .sample_rate    = config->pcm_sample_rate,
+        .channels       = config->pcm_channel_num,
+        .frame_samples  = config->pcm_sample_rate * config->pcm_duration / 1000,
+        .window_ms      = config->preroll_ms,
+    };
+    if (audio_preroll_init(&g_app.preroll, &preroll_cfg) < 0) {
+        return -1;
+    }
+    g_app.preroll_enabled = true;
+    return 0;
+}
+
+// 解析 "uid:gain,uid:gain" 形式的每用户混音增益
+static void app_apply_mix_gains(const char *gains) {
+    const char *p = gains;
+
+    while (p && *p) {
+        char *end;
+        uint32_t uid = strtoul(p, &end, 10);
+        if (end == p || *end != ':') {
+            LOGW("混音增益 \"%s\" 格式错误，应为 uid:gain", p);
+            return;
+        }
+        p = end + 1;
+        float gain = strtof(p, &end);
+        if (end == p) {
+            LOGW("混音增益 \"%s\" 格式错误，应为 uid:gain", p);
+            return;
+        }
+        audio_playout_set_gain(&g_app.playout, uid, gain);
+        LOGI("用户 %u 混音增益 %.2f", uid, gain);
+        p = *end == ',' ? end + 1 : end;
+    }
+}
+
+// 不需要声卡采集时不打开录音设备
+static const char *app_capture_device_name(const app_config_t *config) {
+    if (config->receive_data_only || config->audio_source != AUDIO_SOURCE_ALSA) {
+        return NULL;
+    }
+    return config->capture_device;
+}
+
+// "none" 表示不接声卡，播放线程按帧长定时丢弃混音结果
+static const char *app_playback_device_name(const app_config_t *config) {
+    return strcmp(config->playback_device, "none") == 0 ? NULL : config->playback_device;
+}
+
+static audio_device_params_t app_device_params(const app_config_t *config) {
+    audio_device_params_t params = {
+        .sample_rate    = config->device_sample_rate ? config->device_sample_rate : config->pcm_sample_rate,
+        .channels       = config->pcm_channel_num,
+        .frame_ms       = config->pcm_duration,
+        .period_frames  = config->alsa_period_frames,
+        .capture_batch  = config->capture_batch,
+        .mmap           = config->alsa_mmap,
+    };
+    return params;
+}
+
+static audio_playout_config_t app_playout_config(const app_config_t *config) {
+    audio_playout_config_t playout_cfg = {
+        .handle         = g_app.audio_dev.playback.handle,
+        .sample_rate    = config->pcm_sample_rate,
+        .channels       = config->pcm_channel_num,
+        .device         = audio_pcm_format(&g_app.audio_dev.playback),
+        .mmap           = g_app.audio_dev.playback.mmap,
+        .frame_ms       = config->pcm_duration,
+        .jitter_min_ms  = config->jitter_min_ms,
+        .jitter_max_ms  = config->jitter_max_ms,
+        .plc            = config->plc,
+        .drift_comp     = config->drift_comp,
+        .max_mix_streams = config->mix_max_streams,
+        .rt             = { config->rt, config->rt_prio_playout, config->rt_cpu_playout },
+        .aec            = g_app.aec_enabled ? &g_app.aec : NULL,
+        .tunable        = app_tunable(config),
+    };
+    return playout_cfg;
+}
+
+static int app_start_playout(app_config_t *config) {
+    audio_playout_config_t playout_cfg = app_playout_config(config);
+    if (audio_playout_start(&g_app.playout, &playout_cfg) < 0) {
+        return -1;
+    }
+    // 重启前通过控制命令设置的增益继续有效
+    for (int i = 0; i < AUDIO_PLAYOUT_MAX_STREAMS; i++) {
+        atomic_store(&g_app.playout.gains[i], g_app.playout_gains[i]);
+    }
+    app_apply_mix_gains(config->mix_gains);
+    atomic_store(&g_app.playout_ready, true);
+    return 0;
+}
+
+// 先挡住新的 SDK 回调，等正在写入的回调退出后再停止播放线程
+static void app_stop_playout(void) {
+    if (!atomic_exchange(&g_app.playout_ready, false)) {
+        return;
+    }
+    while (atomic_load(&g_app.playout_users) > 0) {
+        usleep(100);
+    }
+    for (int i = 0; i < AUDIO_PLAYOUT_MAX_STREAMS; i++) {
+        g_app.playout_gains[i] = atomic_load(&g_app.playout.gains[i]);
+    }
+    audio_playout_stop(&g_app.playout);
+}
+
+// 启动发送侧: 语音检测、降噪/自动增益、编码、帧池和音频源，失败时由 app_stop_send 清理
+static int app_start_send(app_config_t *config) {
+    if (config->receive_data_only) {
+        return 0;
+    }
+    if ((config->vad_mode != AUDIO_VAD_OFF || app_tunable(config)) && app_init_vad(config) < 0) {
+        LOGE("初始化语音检测失败");
+        return -1;
+    }
+    if ((config->ns || config->agc || app_tunable(config)) && app_init_preproc(config) < 0) {
+        LOGE("初始化降噪/自动增益失败");
+        return -1;
+    }
+    if (config->encode != AUDIO_ENCODER_NONE && app_init_encoder(config) < 0) {
+        LOGE("初始化发送端编码失败");
+        return -1;
+    }
+    if (config->preroll_ms && app_init_preroll(config) < 0) {
+        LOGE("初始化预录缓冲失败");
+        return -1;
+    }
+    if (app_init_frame_pool(config) < 0) {
+        LOGE("启动音频源失败");
+        return -1;
+    }
+    // 所有连接都断开期间不启动音频源，连接恢复时由 app_resume_send 启动
+    if (!g_app.send_paused && app_start_source(config) < 0) {
+        LOGE("启动音频源失败");
+        return -1;
+    }
+    g_app.send_started = true;
+    return 0;
+}
+
+// 只有声卡音频源经过格式转换；清零后重复停止或再次启动都不会重复释放
+static void app_deinit_convert(void) {
+    if (g_app.capture_convert.name) {
+        audio_convert_report(&g_app.capture_convert);
+        audio_convert_deinit(&g_app.capture_convert);
+        memset(&g_app.capture_convert, 0, sizeof(g_app.capture_convert));
+    }
+}
+
+// 采集线程在两帧之间退出，之后发送侧的状态只由主线程访问
+static void app_stop_send(void) {
+    audio_source_stop(&g_app.source);
+    app_deinit_convert();
+    g_app.send_started = false;
+
+    if (g_app.frame_pool.frames) {
+        audio_frame_pool_deinit(&g_app.frame_pool);
+    }
+    if (atomic_load(&g_app.scratch_frames) > 0) {
+        LOGW("发送帧池用尽时在后备帧中处理的采集帧: %llu", atomic_load(&g_app.scratch_frames));
+    }
+    free(g_app.capture_scratch);
+    g_app.capture_scratch = NULL;
+    if (g_app.vad_enabled) {
+        audio_vad_report(&g_app.vad);
+        audio_vad_deinit(&g_app.vad);
+        g_app.vad_enabled = false;
+    }
+    if (g_app.preproc_enabled) {
+        audio_preproc_report(&g_app.preproc);
+        audio_preproc_deinit(&g_app.preproc);
+        g_app.preproc_enabled = false;
+    }
+    if (g_app.encoder_enabled) {
+        audio_encoder_report(&g_app.encoder);
+        audio_encoder_deinit(&g_app.encoder);
+        g_app.encoder_enabled = false;
+    }
+    if (g_app.preroll_enabled) {
+        audio_preroll_report(&g_app.preroll);
+        audio_preroll_deinit(&g_app.preroll);
+        g_app.preroll_enabled = false;
+    }
+}
+
+// 所有连接都断开时停止音频源，不再逐帧读出后丢弃；声卡保持打开，
+// 语音检测、降噪和编码器的状态都保留
+static void app_pause_send(void) {
+    // 启用预录时继续采集，音频留在预录缓冲中
+    if (g_app.config.receive_data_only || g_app.send_paused || g_app.preroll_enabled) {
+        return;
+    }
+    g_app.send_paused = true;
+    audio_source_stop(&g_app.source);
+    app_deinit_convert();
+}
+
+// 连接恢复后重新启动音频源，声卡只需 prepare/start，不重新打开
+static int app_resume_send(app_config_t *config) {
+    if (config->receive_data_only || !g_app.send_paused) {
+        return 0;
+    }
+    g_app.send_paused = false;
+    return app_start_source(config);
+}
+
+// 录音在加入频道之前启动，在 SDK 结束、发送线程退出之后停止，写入时不需要额外的同步
+static int app_start_recorder(app_config_t *config) {
+    audio_recorder_config_t rec_cfg = {
+        .dir            = config->record_dir,
+        .send_basename  = DEFAULT_SEND_AUDIO_BASENAME,
+        .recv_basename  = DEFAULT_RECV_AUDIO_BASENAME,
+        .sample_rate    = config->pcm_sample_rate,
+        .channels       = config->pcm_channel_num,
+        .rotate_mb      = config->record_rotate_mb,
+        .rotate_sec     = config->record_rotate_sec,
+        .budget_kb      = config->record_budget_kb,
+        .recv_lanes     = g_app.conn_cnt,
+    };
+    if (audio_recorder_start(&g_app.recorder, &rec_cfg) < 0) {
+        LOGE("启动录音失败");
         return -1;
     }
-    
+    g_app.record_recv = true;
+    g_app.record_send = !config->receive_data_only && config->audio_data_type == AUDIO_DATA_TYPE_PCM;
+    if (!config->receive_data_only && !g_app.record_send) {
+        LOGW("发送的是编码后的数据，只录制接收音频");
+    }
     return 0;
 }
 
-// 事件处理函数
+static void app_stop_recorder(void) {
+    if (g_app.record_recv) {
+        g_app.record_send = false;
+        g_app.record_recv = false;
+        audio_recorder_stop(&g_app.recorder);
+    }
+}
+
+// 控制命令: 需要重启的部分，或只需发布给运行中线程的部分
+enum {
+    APP_RESTART_SEND        = 1 << 0,
+    APP_RESTART_PLAYOUT     = 1 << 1,
+    APP_REOPEN_CAPTURE      = 1 << 2,
+    APP_REOPEN_PLAYBACK     = 1 << 3,
+    APP_UPDATE_SEND         = 1 << 4,
+    APP_UPDATE_PLAYOUT      = 1 << 5,
+};
+
+static size_t app_ctl_append(char *buf, size_t size, size_t pos, const char *fmt, ...) {
+    va_list ap;
+
+    if (pos >= size) {
+        return pos;
+    }
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + pos, size - pos, fmt, ap);
+    va_end(ap);
+    return n < 0 ? pos : pos + n;
+}
+
+// 在主线程中执行: 连接和应用状态、各模块是否启用都只由主线程修改，音频线程更新的计数都是原子量
+static int app_ctl_stats(char *reply, size_t size) {
+    audio_playout_stats_t *ps = &g_app.playout.stats;
+    size_t pos = 0;
+
+    for (int i = 0; i < g_app.conn_cnt; i++) {
+        app_conn_t *conn = &g_app.conns[i];
+        pos = app_ctl_append(reply, size, pos,
+                             "conn-%u channel=%s state=%s sent=%llu bytes=%llu errors=%llu "
+                             "skipped=%llu vad_skipped=%llu reconnects=%u outage_max_ms=%llu\n",
+                             conn->conn_id, conn->channel, g_conn_state_names[conn->state],
+                             atomic_load(&conn->frames_sent), atomic_load(&conn->bytes_sent),
+                             atomic_load(&conn->send_errors), atomic_load(&conn->skipped_frames),
+                             atomic_load(&conn->vad_frames), conn->reconnects,
+                             (unsigned long long)(conn->outage_us_max / 1000));
+    }
+    pos = app_ctl_append(reply, size, pos, "app state=%s sdk_errors=%u events=%llu events_dropped=%llu\n",
+                         g_app_state_names[g_app.state], g_app.sdk_errors, atomic_load(&g_app.events.posted),
+                         atomic_load(&g_app.events.dropped));
+    if (g_app.source.cfg.type == AUDIO_SOURCE_ALSA && atomic_load(&g_app.source.capture.running)) {
+        audio_capture_t *cap = &g_app.source.capture;
+        uint64_t frames = atomic_load(&cap->stats.frames);
+        pos = app_ctl_append(reply, size, pos,
+                             "capture frames=%llu read_errors=%llu latency_avg_us=%llu latency_max_us=%u "
+                             "drift_ppm=%.2f\n",
+                             (unsigned long long)frames, atomic_load(&cap->stats.read_errors),
+                             frames ? atomic_load(&cap->stats.latency_sum_us) / frames : 0ULL,
+                             atomic_load(&cap->stats.latency_max_us), audio_drift_ppm(&cap->drift));
+    }
+    if (atomic_load(&g_app.playout_ready)) {
+        pos = app_ctl_append(reply, size, pos,
+                             "playout in=%llu played=%llu late=%llu dropped=%llu silence=%llu target_ms=%u "
+                             "jitter_us=%u plc_events=%llu drift_ppm=%.2f\n",
+                             atomic_load(&ps->frames_in), atomic_load(&ps->frames_played),
+                             atomic_load(&ps->frames_late), atomic_load(&ps->frames_dropped),
+                             atomic_load(&ps->silence_frames), atomic_load(&ps->target_ms),
+                             atomic_load(&ps->jitter_us), atomic_load(&ps->plc_events),
+                             audio_drift_ppm(&g_app.playout.drift));
+    }
+    if (g_app.preroll_enabled) {
+        audio_preroll_stats_t *rs = &g_app.preroll.stats;
+        uint32_t rate_ms = g_app.preroll.cfg.sample_rate / 1000;
+        pos = app_ctl_append(reply, size, pos, "preroll mode=%s backlog_ms=%u backlog_max_ms=%u dropped_ms=%llu "
+                             "compressed_ms=%llu burst_frames=%llu catchups=%u fallbacks=%u catchup_max_ms=%u\n",
+                             audio_preroll_mode_name(g_app.preroll.cfg.mode), atomic_load(&rs->backlog) / rate_ms,
+                             atomic_load(&rs->backlog_max) / rate_ms, atomic_load(&rs->dropped) / rate_ms,
+                             atomic_load(&rs->compressed) / rate_ms, atomic_load(&rs->burst_frames),
+                             atomic_load(&rs->catchups), atomic_load(&rs->fallbacks),
+                             atomic_load(&rs->catchup_us_max) / 1000);
+    }
+    if (g_app.encoder_enabled) {
+        audio_encoder_stats_t *es = &g_app.encoder.stats;
+        uint64_t frames = atomic_load(&es->frames);
+        pos = app_ctl_append(reply, size, pos, "encode codec=%s frames=%llu bytes_out=%llu cost_avg_ns=%llu "
+                             "cost_max_ns=%u\n",
+                             audio_encoder_name(g_app.encoder.cfg.type), (unsigned long long)frames,
+                             atomic_load(&es->bytes_out), frames ? atomic_load(&es->cost_ns_sum) / frames : 0ULL,
+                             atomic_load(&es->cost_ns_max));
+    }
+    if (g_app.record_recv) {
+        audio_recorder_stats_t *rs = &g_app.recorder.stats;
+        pos = app_ctl_append(reply, size, pos, "record files=%llu frames=%llu bytes=%llu dropped=%llu "
+                             "rejected=%llu write_errors=%llu\n",
+                             atomic_load(&rs->files), atomic_load(&rs->frames), atomic_load(&rs->bytes),
+                             atomic_load(&rs->dropped_frames), atomic_load(&rs->rejected_frames),
+                             atomic_load(&rs->write_errors));
+    }
+    return 0;
+}
+
+static void app_ctl_get(char *reply, size_t size) {
+    app_config_t *config = &g_app.config;
+    size_t pos = 0;
+
+    pos = app_ctl_append(reply, size, pos, "capture-device=%s\nplayback-device=%s\ncapture-channel=%u\n",
+                         config->capture_device, config->playback_device, config->capture_channel);
+    pos = app_ctl_append(reply, size, pos, "capture-batch=%u\nencode=%s\n", config->capture_batch,
+                         audio_encoder_name(config->encode));
+    pos = app_ctl_append(reply, size, pos, "tone-hz=%u\njitter-min-ms=%u\njitter-max-ms=%u\nmix-max-streams=%u\n",
+                         config->tone_hz, config->jitter_min_ms, config->jitter_max_ms, config->mix_max_streams);
+    pos = app_ctl_append(reply, size, pos, "plc=%d\ndrift-comp=%d\n", config->plc, config->drift_comp);
+    pos = app_ctl_append(reply, size, pos, "vad=%s\nvad-attack-ms=%u\nvad-hangover-ms=%u\nvad-thin-ms=%u\n",
+                         audio_vad_mode_name(config->vad_mode), config->vad_attack_ms, config->vad_hangover_ms,
+                         config->vad_thin_ms);
+    app_ctl_append(reply, size, pos, "ns=%d\nns-max-db=%u\nagc=%d\nagc-target-dbfs=%d\nagc-max-gain-db=%u\n",
+                   config->ns, config->ns_max_db, config->agc, config->agc_target_dbfs, config->agc_max_gain_db);
+}
+
+static bool app_parse_u32(const char *value, uint32_t *out) {
+    char *end;
+    unsigned long v = strtoul(value, &end, 10);
+    if (end == value || *end || value[0] == '-') {
+        return false;
+    }
+    *out = (uint32_t)v;
+    return true;
+}
+
+static bool app_parse_bool(const char *value, bool *out) {
+    if (!strcmp(value, "1") || !strcmp(value, "on")) {
+        *out = true;
+    } else if (!strcmp(value, "0") || !strcmp(value, "off")) {
+        *out = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 只发布给运行中处理阶段的选项: 该阶段在当前配置下不会初始化，或发送侧已启动而它没有初始化时
+// 修改不会有任何效果，返回原因
+static const char *app_ctl_stage_missing(const app_config_t *config, const char *key) {
+    bool vad = !strncmp(key, "vad", 3);
+    bool preproc = !strcmp(key, "ns") || !strncmp(key, "ns-", 3) || !strncmp(key, "agc", 3);
+
+    if (!strcmp(key, "tone-hz") && config->audio_source != AUDIO_SOURCE_SINE) {
+        return "当前音频源不是 sine";
+    }
+    if ((vad || preproc) && config->receive_data_only) {
+        return "当前只接收不发送";
+    }
+    if (vad && (config->audio_data_type != AUDIO_DATA_TYPE_PCM || (g_app.send_started && !g_app.vad_enabled))) {
+        return "语音检测只作用于 PCM 数据，当前没有启用";
+    }
+    if (preproc && (config->audio_source != AUDIO_SOURCE_ALSA || (g_app.send_started && !g_app.preproc_enabled))) {
+        return "降噪和自动增益只作用于声卡采集的音频，当前没有启用";
+    }
+    return NULL;
+}
+
+// 把一个选项写入 next，返回需要重启的部分；选项不能在运行时修改或取值不合法时返回 -1
+static int app_ctl_parse_set(app_config_t *next, const char *key, const char *value, char *reply, size_t size) {
+    bool ok;
+    int mask;
+
+    const char *missing = app_ctl_stage_missing(next, key);
+    if (missing) {
+        snprintf(reply, size, "%s 不会生效: %s", key, missing);
+        return -1;
+    }
+
+    if (!strcmp(key, "capture-device")) {
+        next->capture_device = value;
+        ok = strlen(value) <= APP_DEVICE_NAME_LEN;
+        mask = APP_RESTART_SEND | APP_REOPEN_CAPTURE;
+    } else if (!strcmp(key, "playback-device")) {
+        next->playback_device = value;
+        ok = strlen(value) <= APP_DEVICE_NAME_LEN;
+        mask = APP_RESTART_PLAYOUT | APP_REOPEN_PLAYBACK;
+    } else if (!strcmp(key, "capture-channel")) {
+        ok = app_parse_u32(value, &next->capture_channel);
+        mask = APP_RESTART_SEND;
+    } else if (!strcmp(key, "capture-batch")) {
+        // avail_min 在打开设备时设置，需要重新打开录音设备
+        ok = app_parse_u32(value, &next->capture_batch) && next->capture_batch >= 1 &&
+             next->capture_batch <= AUDIO_CAPTURE_MAX_BATCH;
+        mask = APP_RESTART_SEND | APP_REOPEN_CAPTURE;
+    } else if (!strcmp(key, "tone-hz")) {
+        ok = app_parse_u32(value, &next->tone_hz);
+        mask = APP_UPDATE_SEND;
+    } else if (!strcmp(key, "jitter-min-ms")) {
+        ok = app_parse_u32(value, &next->jitter_min_ms);
+        mask = APP_UPDATE_PLAYOUT;
+    } else if (!strcmp(key, "jitter-max-ms")) {
+        ok = app_parse_u32(value, &next->jitter_max_ms);
+        // 超过抖动缓冲槽位能容纳的上限时需要重新分配
+        mask = atomic_load(&g_app.playout_ready) && next->jitter_max_ms > g_app.playout.jitter_cap_ms ?
+               APP_RESTART_PLAYOUT : APP_UPDATE_PLAYOUT;
+    } else if (!strcmp(key, "mix-max-streams")) {
+        ok = app_parse_u32(value, &next->mix_max_streams);
+        mask = APP_UPDATE_PLAYOUT;
+    } else if (!strcmp(key, "plc")) {
+        ok = app_parse_bool(value, &next->plc);
+        mask = APP_UPDATE_PLAYOUT;
+    } else if (!strcmp(key, "drift-comp")) {
+        ok = app_parse_bool(value, &next->drift_comp);
+        mask = APP_RESTART_SEND | APP_RESTART_PLAYOUT;
+    } else if (!strcmp(key, "vad")) {
+        ok = audio_vad_mode_parse(value, &next->vad_mode) == 0;
+        mask = APP_UPDATE_SEND;
+    } else if (!strcmp(key, "vad-attack-ms")) {
+        ok = app_parse_u32(value, &next->vad_attack_ms);
+        mask = APP_UPDATE_SEND;
+    } else if (!strcmp(key, "vad-hangover-ms")) {
+        ok = app_parse_u32(value, &next->vad_hangover_ms);
+        mask = APP_UPDATE_SEND;
+    } else if (!strcmp(key, "vad-thin-ms")) {
+        ok = app_parse_u32(value, &next->vad_thin_ms);
+        mask = APP_UPDATE_SEND;
+    } else if (!strcmp(key, "ns")) {
+        ok = app_parse_bool(value, &next->ns) && (!next->ns || next->pcm_channel_num == 1);
+        mask = APP_UPDATE_SEND;
+    } else if (!strcmp(key, "ns-max-db")) {
+        ok = app_parse_u32(value, &next->ns_max_db);
+        mask = APP_UPDATE_SEND;
+    } else if (!strcmp(key, "agc")) {
+        ok = app_parse_bool(value, &next->agc);
+        mask = APP_UPDATE_SEND;
+    } else if (!strcmp(key, "agc-target-dbfs")) {
+        char *end;
+        next->agc_target_dbfs = (int)strtol(value, &end, 10);
+        ok = end != value && !*end;
+        mask = APP_UPDATE_SEND;
+    } else if (!strcmp(key, "agc-max-gain-db")) {
+        ok = app_parse_u32(value, &next->agc_max_gain_db);
+        mask = APP_UPDATE_SEND;
+    } else if (!strcmp(key, "pcm-duration") || !strcmp(key, "pcm-sample-rate") ||
+               !strcmp(key, "pcm-channel-num") || !strcmp(key, "audio-codec") ||
+               !strcmp(key, "audio-type") || !strcmp(key, "encode") || !strcmp(key, "enable-audio-mixer")) {
+        // 这些参数在加入频道时交给 SDK，SDK 不支持在连接上修改
+        snprintf(reply, size, "%s 在加入频道时与 SDK 协商，需要重新加入频道才能修改", key);
+        return -1;
+    } else {
+        snprintf(reply, size, "不支持在运行时修改 %s", key);
+        return -1;
+    }
+
+    if (!ok) {
+        snprintf(reply, size, "%s 的取值 \"%s\" 不合法", key, value);
+        return -1;
+    }
+    return mask;
+}
+
+// 发送侧运行中可修改的参数发布给采集线程，在下一帧开始时生效，不中断采集；参数无法生效时返回 -1
+static int app_update_send(const app_config_t *config) {
+    if (config->audio_source == AUDIO_SOURCE_SINE) {
+        audio_source_set_tone(&g_app.source, config->tone_hz);
+    }
+    if (g_app.vad_enabled) {
+        audio_vad_config_t vad_cfg = app_vad_config(config);
+        audio_vad_update(&g_app.vad, &vad_cfg);
+    }
+    if (g_app.preproc_enabled) {
+        audio_preproc_config_t pp_cfg = app_preproc_config(config);
+        return audio_preproc_update(&g_app.preproc, &pp_cfg);
+    }
+    return 0;
+}
+
+// 停止受影响的线程，换上新配置后重新启动，只需发布的参数交给运行中的线程；设备名称拷贝到常驻缓冲区，设备句柄保存的是它的地址
+static int app_restart_audio(const app_config_t *next, int mask) {
+    app_config_t *config = &g_app.config;
+    int rval = 0;
+    bool send_started = g_app.send_started;
+
+    if (mask & APP_RESTART_SEND) {
+        app_stop_send();
+    }
+    if (mask & APP_RESTART_PLAYOUT) {
+        app_stop_playout();
+    }
+
+    *config = *next;
+    if (config->capture_device != g_app.capture_device) {
+        memmove(g_app.capture_device, config->capture_device, strlen(config->capture_device) + 1);
+        config->capture_device = g_app.capture_device;
+    }
+    if (config->playback_device != g_app.playback_device) {
+        memmove(g_app.playback_device, config->playback_device, strlen(config->playback_device) + 1);
+        config->playback_device = g_app.playback_device;
+    }
+
+    audio_device_params_t params = app_device_params(config);
+    if ((mask & APP_REOPEN_CAPTURE) &&
+        audio_device_reopen(&g_app.audio_dev, SND_PCM_STREAM_CAPTURE, app_capture_device_name(config),
+                            &params) < 0) {
+        rval = -1;
+    }
+    if ((mask & APP_REOPEN_PLAYBACK) &&
+        audio_device_reopen(&g_app.audio_dev, SND_PCM_STREAM_PLAYBACK, app_playback_device_name(config),
+                            &params) < 0) {
+        rval = -1;
+    }
+    if ((mask & APP_UPDATE_SEND) && app_update_send(config) < 0) {
+        rval = -1;
+    }
+    if ((mask & APP_UPDATE_PLAYOUT) && atomic_load(&g_app.playout_ready)) {
+        audio_playout_config_t playout_cfg = app_playout_config(config);
+        audio_playout_update(&g_app.playout, &playout_cfg);
+    }
+    if (rval == 0 && (mask & APP_RESTART_PLAYOUT) && app_start_playout(config) < 0) {
+        LOGE("启动播放线程失败");
+        rval = -1;
+    }
+    // 还没有启动的发送侧由状态机在加入后启动
+    if (rval == 0 && (mask & APP_RESTART_SEND) && send_started && app_start_send(config) < 0) {
+        rval = -1;
+    }
+    return rval;
+}
+
+static int app_ctl_set(const char *key, const char *value, char *reply, size_t size) {
+    app_config_t prev = g_app.config;
+    app_config_t next = prev;
+    char prev_capture[APP_DEVICE_NAME_LEN + 1];
+    char prev_playback[APP_DEVICE_NAME_LEN + 1];
+
+    int mask = app_ctl_parse_set(&next, key, value, reply, size);
+    if (mask < 0) {
+        return -1;
+    }
+
+    LOGI("控制命令: 设置 %s=%s", key, value);
+    memcpy(prev_capture, g_app.capture_device, sizeof(prev_capture));
+    memcpy(prev_playback, g_app.playback_device, sizeof(prev_playback));
+    if (app_restart_audio(&next, mask) == 0) {
+        snprintf(reply, size, "%s=%s", key, value);
+        return 0;
+    }
+
+    // 原配置中的设备名称指向已被覆盖的缓冲区，改用副本
+    prev.capture_device = prev_capture;
+    prev.playback_device = prev_playback;
+    if (app_restart_audio(&prev, mask) < 0) {
+        LOGE("恢复原配置失败，%s%s已停止", mask & APP_RESTART_SEND ? "发送" : "",
+             mask & APP_RESTART_PLAYOUT ? "播放" : "");
+        snprintf(reply, size, "%s=%s 无法生效，恢复原配置也失败", key, value);
+        return -1;
+    }
+    LOGW("%s=%s 无法生效，已恢复原配置", key, value);
+    snprintf(reply, size, "%s=%s 无法生效，已恢复原配置", key, value);
+    return -1;
+}
+
+// 在主线程中执行所有命令，读取和修改的配置、连接状态都只属于主线程
+static int app_ctl_execute(int argc, char **argv, char *reply, size_t size) {
+    if (!strcmp(argv[0], "stats") && argc == 1) {
+        return app_ctl_stats(reply, size);
+    }
+    if (!strcmp(argv[0], "get") && argc == 1) {
+        app_ctl_get(reply, size);
+        return 0;
+    }
+    if (!strcmp(argv[0], "set") && argc == 3) {
+        return app_ctl_set(argv[1], argv[2], reply, size);
+    }
+    if (!strcmp(argv[0], "gain") && argc == 3) {
+        uint32_t uid;
+        char *end;
+        float gain = strtof(argv[2], &end);
+        if (!app_parse_u32(argv[1], &uid) || end == argv[2] || *end || gain < 0.0f) {
+            snprintf(reply, size, "用法: gain <uid> <gain>");
+            return -1;
+        }
+        if (!atomic_load(&g_app.playout_ready) || audio_playout_set_gain(&g_app.playout, uid, gain) < 0) {
+            snprintf(reply, size, "无法设置用户 %u 的增益", uid);
+            return -1;
+        }
+        LOGI("控制命令: 用户 %u 混音增益 %.2f", uid, gain);
+        return 0;
+    }
+    snprintf(reply, size, "未知命令 %s，可用命令: stats, get, set <option> <value>, gain <uid> <gain>", argv[0]);
+    return -1;
+}
+
+// 控制线程的回调: 命令交给主线程并等待结果
+static int app_ctl_command(void *ctx, int argc, char **argv, char *reply, size_t size) {
+    app_ctl_req_t *req = &g_app.ctl_req;
+    int rval;
+
+    pthread_mutex_lock(&req->lock);
+    if (req->closing) {
+        pthread_mutex_unlock(&req->lock);
+        snprintf(reply, size, "正在退出");
+        return -1;
+    }
+    req->argc = argc;
+    req->argv = argv;
+    req->reply = reply;
+    req->size = size;
+    req->pending = true;
+    pthread_cond_broadcast(&req->cond);
+    while (req->pending && !req->closing) {
+        pthread_cond_wait(&req->cond, &req->lock);
+    }
+    if (req->pending) {
+        req->pending = false;
+        snprintf(reply, size, "正在退出");
+        rval = -1;
+    } else {
+        rval = req->result;
+    }
+    pthread_mutex_unlock(&req->lock);
+    return rval;
+}
+
+// 主线程轮询: 最多等待 timeout_ms，期间收到命令就执行
+static void app_ctl_serve(int timeout_ms) {
+    app_ctl_req_t *req = &g_app.ctl_req;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&req->lock);
+    if (!req->pending) {
+        pthread_cond_timedwait(&req->cond, &req->lock, &ts);
+    }
+    if (req->pending) {
+        req->result = app_ctl_execute(req->argc, req->argv, req->reply, req->size);
+        req->pending = false;
+        pthread_cond_broadcast(&req->cond);
+    }
+    pthread_mutex_unlock(&req->lock);
+}
+
+static int app_start_ctl(app_config_t *config) {
+    audio_ctl_config_t ctl_cfg = {
+        .path           = config->ctl_socket,
+        .on_command     = app_ctl_command,
+        .ctx            = &g_app,
+    };
+    return audio_ctl_start(&g_app.ctl, &ctl_cfg);
+}
+
+// 先让等待中的命令失败返回，再停止控制线程
+static void app_stop_ctl(void) {
+    pthread_mutex_lock(&g_app.ctl_req.lock);
+    g_app.ctl_req.closing = true;
+    pthread_cond_broadcast(&g_app.ctl_req.cond);
+    pthread_mutex_unlock(&g_app.ctl_req.lock);
+    audio_ctl_stop(&g_app.ctl);
+}
+
+// 事件处理函数: SDK 线程只投递事件，连接和应用状态都由主线程在 app_process_events 中修改
 static void __on_join_channel_success(connection_id_t conn_id, uint32_t uid, int elapsed) {
-    g_app.b_connected_flag = true;
-    connection_info_t conn_info = { 0 };
-    agora_rtc_get_connection_info(g_app.conn_id, &conn_info);
-    LOGI("[conn-%u] Join the channel %s successfully, uid %u elapsed %d ms", conn_id,
-         conn_info.channel_name, uid, elapsed);
+    audio_event_post(&g_app.events, APP_EVENT_JOINED, conn_id, uid, 0, elapsed, NULL);
 }
 
 static void __on_reconnecting(connection_id_t conn_id) {
-    g_app.b_connected_flag = false;
-    LOGW("[conn-%u] connection timeout, reconnecting", conn_id);
+    audio_event_post(&g_app.events, APP_EVENT_RECONNECTING, conn_id, 0, 0, 0, NULL);
 }
 
 static void __on_connection_lost(connection_id_t conn_id) {
-    g_app.b_connected_flag = false;
-    LOGW("[conn-%u] Lost connection from the channel", conn_id);
+    audio_event_post(&g_app.events, APP_EVENT_LOST, conn_id, 0, 0, 0, NULL);
 }
 
 static void __on_rejoin_channel_success(connection_id_t conn_id, uint32_t uid, int elapsed_ms) {
-    g_app.b_connected_flag = true;
-    LOGI("[conn-%u] Rejoin the channel successfully, uid %u elapsed %d ms", conn_id, uid, elapsed_ms);
+    audio_event_post(&g_app.events, APP_EVENT_REJOINED, conn_id, uid, 0, elapsed_ms, NULL);
 }
 
 static void __on_error(connection_id_t conn_id, int code, const char *msg) {
-    if (code == ERR_INVALID_APP_ID) {
-        LOGE("Invalid App ID. Please double check. Error msg \"%s\"", msg);
-    } else if (code == ERR_INVALID_CHANNEL_NAME) {
-        LOGE("Invalid channel name for conn_id %u. Please double check. Error msg \"%s\"", conn_id,
-             msg);
-    } else if (code == ERR_INVALID_TOKEN || code == ERR_TOKEN_EXPIRED) {
-        LOGE("Invalid token. Please double check. Error msg \"%s\"", msg);
+    audio_event_post(&g_app.events, APP_EVENT_ERROR, conn_id, 0, code, 0, msg);
+}
+
+// 身份或频道参数错误时重试没有意义，其余错误由 SDK 自行恢复
+static bool app_error_is_fatal(int code) {
+    return code == ERR_INVALID_APP_ID || code == ERR_INVALID_CHANNEL_NAME || code == ERR_INVALID_TOKEN ||
+           code == ERR_TOKEN_EXPIRED;
+}
+
+static void app_handle_error(const audio_event_t *ev) {
+    g_app.sdk_errors++;
+    if (ev->code == ERR_INVALID_APP_ID) {
+        LOGE("Invalid App ID. Please double check. Error msg \"%s\"", ev->msg);
+    } else if (ev->code == ERR_INVALID_CHANNEL_NAME) {
+        LOGE("Invalid channel name for conn_id %u. Please double check. Error msg \"%s\"", ev->conn_id,
+             ev->msg);
+    } else if (ev->code == ERR_INVALID_TOKEN || ev->code == ERR_TOKEN_EXPIRED) {
+        LOGE("Invalid token. Please double check. Error msg \"%s\"", ev->msg);
+    } else {
+        LOGW("[conn-%u] Error %d is captured, continue. Error msg \"%s\"", ev->conn_id, ev->code, ev->msg);
+    }
+    if (app_error_is_fatal(ev->code)) {
+        g_app.state = APP_STATE_STOPPING;
+    }
+}
+
+static void app_conn_up(app_conn_t *conn, const audio_event_t *ev) {
+    if (conn->state == APP_CONN_CONNECTED) {
+        return;
+    }
+    if (conn->down_us) {
+        uint64_t outage_us = ev->ts_us - conn->down_us;
+        conn->reconnects++;
+        conn->outage_us_sum += outage_us;
+        if (outage_us > conn->outage_us_max) {
+            conn->outage_us_max = outage_us;
+        }
+        conn->down_us = 0;
+        LOGI("[conn-%u] Rejoin the channel successfully, uid %u elapsed %d ms, outage %llu ms", conn->conn_id,
+             ev->uid, ev->value, (unsigned long long)(outage_us / 1000));
+    } else {
+        LOGI("[conn-%u] Join the channel %s successfully, uid %u elapsed %d ms", conn->conn_id, conn->channel,
+             ev->uid, ev->value);
+    }
+    if (g_app.startup.joined_us == 0) {
+        g_app.startup.joined_us = ev->ts_us - g_app.startup.start_us;
+    }
+    conn->state = APP_CONN_CONNECTED;
+    atomic_store_explicit(&conn->connected, true, memory_order_release);
+}
+
+static void app_conn_down(app_conn_t *conn, const audio_event_t *ev) {
+    if (ev->type == APP_EVENT_RECONNECTING) {
+        LOGW("[conn-%u] connection timeout, reconnecting", conn->conn_id);
     } else {
-        LOGW("Error %d is captured. Error msg \"%s\"", code, msg);
+        LOGW("[conn-%u] Lost connection from the channel", conn->conn_id);
+    }
+    // 从连接状态断开时开始计时，RECONNECTING 之后的 LOST 不重新计时
+    if (conn->state == APP_CONN_CONNECTED) {
+        conn->down_us = ev->ts_us;
+    }
+    conn->state = ev->type == APP_EVENT_RECONNECTING ? APP_CONN_RECONNECTING : APP_CONN_LOST;
+    atomic_store_explicit(&conn->connected, false, memory_order_release);
+}
+
+static void app_handle_event(const audio_event_t *ev) {
+    app_conn_t *conn = app_find_conn(ev->conn_id);
+
+    switch (ev->type) {
+    case APP_EVENT_JOINED:
+    case APP_EVENT_REJOINED:
+        if (conn) {
+            app_conn_up(conn, ev);
+        }
+        break;
+    case APP_EVENT_RECONNECTING:
+    case APP_EVENT_LOST:
+        if (conn) {
+            app_conn_down(conn, ev);
+        }
+        break;
+    case APP_EVENT_ERROR:
+        app_handle_error(ev);
+        break;
+    case APP_EVENT_STOP:
+        LOGI("收到信号 %d，正在退出", ev->code);
+        g_app.state = APP_STATE_STOPPING;
+        break;
+    default:
+        break;
+    }
+}
+
+// 设备是探测能力后打开的还是按缓存直接打开的
+static const char *app_pcm_open_desc(const audio_pcm_t *pcm) {
+    if (!pcm->handle) {
+        return "未打开";
+    }
+    return pcm->cached ? "缓存" : "探测";
+}
+
+// 第一个连接加入、开始发送时输出一次
+static void app_report_startup(int64_t now_us) {
+    app_startup_t *st = &g_app.startup;
+    audio_pcm_t *capture = &g_app.audio_dev.capture;
+    audio_pcm_t *playback = &g_app.audio_dev.playback;
+
+    LOGI("启动耗时: 设备 %lld ms(录音 %s %u ms, 播放 %s %u ms), SDK 初始化 %lld ms, 创建连接 %lld ms, "
+         "发起加入 %lld ms, 等待设备 %lld ms, 启动音频 %lld ms, 加入成功 %lld ms, 开始发送 %lld ms",
+         (long long)(st->devices_us / 1000), app_pcm_open_desc(capture), capture->open_us / 1000,
+         app_pcm_open_desc(playback), playback->open_us / 1000, (long long)(st->sdk_init_us / 1000),
+         (long long)(st->conns_us / 1000), (long long)(st->join_us / 1000),
+         (long long)(st->device_wait_us / 1000), (long long)(st->audio_us / 1000),
+         (long long)(st->joined_us / 1000), (long long)((now_us - st->start_us) / 1000));
+}
+
+// 声卡的打开和能力探测较慢，在后台线程中进行，与 SDK 初始化和加入频道并行；
+// 线程只写 audio_dev 和结果，主线程在 app_wait_devices 之后才读取
+static void *app_device_thread(void *arg) {
+    app_config_t *config = arg;
+    audio_device_params_t params = app_device_params(config);
+    int64_t t0 = audio_now_us();
+
+    g_app.device_result = audio_device_open(&g_app.audio_dev, app_capture_device_name(config),
+                                            app_playback_device_name(config), &params);
+    g_app.startup.devices_us = audio_now_us() - t0;
+    return NULL;
+}
+
+static void app_start_devices(app_config_t *config) {
+    if (pthread_create(&g_app.device_thread, NULL, app_device_thread, config) != 0) {
+        LOGW("无法创建设备线程，直接打开音频设备");
+        app_device_thread(config);
+        return;
     }
+    g_app.device_opening = true;
+}
 
-    g_app.b_stop_flag = true;
+static int app_wait_devices(void) {
+    if (g_app.device_opening) {
+        pthread_join(g_app.device_thread, NULL);
+        g_app.device_opening = false;
+    }
+    return g_app.device_result;
+}
+
+// SDK 初始化或加入失败时按启动的逆序清理: 先结束 SDK，不再有接收回调写入录音，
+// 再等设备线程结束、关闭已打开的设备，最后停止录音和统计线程
+static void app_abort_startup(bool sdk_ready) {
+    if (sdk_ready) {
+        for (int i = 0; i < g_app.conn_cnt; i++) {
+            app_conn_t *conn = &g_app.conns[i];
+            if (conn->created) {
+                agora_rtc_leave_channel(conn->conn_id);
+                agora_rtc_destroy_connection(conn->conn_id);
+            }
+        }
+        agora_rtc_fini();
+    }
+    if (app_wait_devices() == 0) {
+        audio_device_close(&g_app.audio_dev);
+    }
+    audio_device_cache_close();
+    app_stop_recorder();
+    audio_stats_stop();
+}
+
+// 根据连接状态切换应用状态: 第一次有连接时启动发送侧，全部断开时暂停采集，恢复后继续
+static void app_update_state(app_config_t *config) {
+    bool up = app_any_connected();
+    int64_t now_us = audio_now_us();
+
+    switch (g_app.state) {
+    case APP_STATE_JOINING:
+        if (up) {
+            g_app.state = g_app.send_started || app_start_send(config) == 0 ? APP_STATE_ACTIVE : APP_STATE_STOPPING;
+            app_report_startup(now_us);
+        }
+        break;
+    case APP_STATE_ACTIVE:
+        if (!up) {
+            if (g_app.preroll_enabled) {
+                LOGW("所有连接都已断开，继续采集，保留最近 %u ms", config->preroll_ms);
+            } else {
+                LOGW("所有连接都已断开，暂停采集");
+            }
+            app_pause_send();
+            g_app.offline_us = now_us;
+            g_app.state = APP_STATE_OFFLINE;
+        }
+        break;
+    case APP_STATE_OFFLINE:
+        if (up) {
+            if (g_app.preroll_enabled) {
+                LOGI("连接已恢复，中断 %lld ms，补发预录缓冲中积压的 %u ms",
+                     (long long)((now_us - g_app.offline_us) / 1000),
+                     atomic_load(&g_app.preroll.stats.backlog) / (config->pcm_sample_rate / 1000));
+            } else {
+                LOGI("连接已恢复，继续采集，中断 %lld ms", (long long)((now_us - g_app.offline_us) / 1000));
+            }
+            if (app_resume_send(config) < 0) {
+                LOGE("恢复采集失败");
+                g_app.state = APP_STATE_STOPPING;
+                break;
+            }
+            g_app.state = APP_STATE_ACTIVE;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void app_process_events(app_config_t *config) {
+    audio_event_t ev;
+
+    while (audio_event_pop(&g_app.events, &ev)) {
+        app_handle_event(&ev);
+    }
+    if (atomic_load(&g_app.stop_requested)) {
+        g_app.state = APP_STATE_STOPPING;
+    }
+    if (g_app.state != APP_STATE_STOPPING) {
+        app_update_state(config);
+    }
 }
 
 static void __on_audio_data(connection_id_t conn_id, const uint32_t uid, uint16_t sent_ts,
                            const void *data, size_t len, const audio_frame_info_t *info_ptr) {
-    // 计算每帧的字节数
-    int bytes_per_frame = 2 * g_app.config.pcm_channel_num;  // 16位采样，每个采样2字节
-    int frames = len / bytes_per_frame;
-    
-    // 将接收到的音频数据写入3.5mm音频输出
-    snd_pcm_sframes_t written = snd_pcm_writei(g_app.audio_dev.playback_handle, 
-                                            data, frames);
-    if (written < 0) {
-        LOGE("写入音频数据失败: %s", snd_strerror(written));
+    // 播放和录音都按 PCM 处理，SDK 透传的编码帧只计数
+    if (info_ptr && info_ptr->data_type != AUDIO_DATA_TYPE_PCM) {
+        if (atomic_fetch_add(&g_app.recv_encoded, 1) == 0) {
+            LOGW("[conn-%u] 收到 uid=%u 未解码的音频(类型 %d)，不播放也不录制", conn_id, uid, info_ptr->data_type);
+        }
         return;
     }
-    
-    // 确保所有数据都被写入
-    if (written < frames) {
-        LOGW("部分音频数据未被写入: %ld < %d", (long)written, frames);
+    if (g_app.record_recv) {
+        // 同一连接的回调在同一个线程中，每个连接独占一条录音通道
+        app_conn_t *conn = app_find_conn(conn_id);
+        if (conn) {
+            audio_recorder_write(&g_app.recorder, 1 + (uint32_t)(conn - g_app.conns), AUDIO_RECORD_RECV, conn_id,
+                                 uid, data, len);
+        }
     }
+    // 播放线程因控制命令重启期间直接丢弃
+    if (!atomic_load(&g_app.playout_ready)) {
+        return;
+    }
+    atomic_fetch_add(&g_app.playout_users, 1);
+    // 只拷贝到该用户的播放缓冲区，由播放线程混音后写入3.5mm音频输出
+    if (atomic_load(&g_app.playout_ready) &&
+        audio_playout_push(&g_app.playout, conn_id, uid, sent_ts, data, len) < 0) {
+        LOGD("[conn-%u] 播放缓冲区已满，丢弃 uid=%u 的音频帧", conn_id, uid);
+    }
+    atomic_fetch_sub(&g_app.playout_users, 1);
 }
 
 static void app_init_event_handler(agora_rtc_event_handler_t *event_handler, app_config_t *config) {
@@ -338,6 +1685,7 @@ int main(int argc, char **argv) {
     int rval = 0;
     char priv_params[512] = { 0 };
 
+    g_app.startup.start_us = audio_now_us();
     LOGI("Welcome to RTSA SDK v%s", agora_rtc_get_version());
 
     // 0. 解析命令行参数
@@ -349,15 +1697,44 @@ int main(int argc, char **argv) {
 
     app_print_config(config);
 
-    // 1. 初始化音频设备
-    const char *capture_device = config->capture_device ? config->capture_device : "default";
-    const char *playback_device = config->playback_device ? config->playback_device : "default";
-    if (init_audio_device(&g_app.audio_dev, capture_device, playback_device) < 0) {
-        LOGE("初始化音频设备失败");
+    if (app_setup_conns(config) < 0) {
         return -1;
     }
+    // 事件队列在注册信号处理函数和初始化 SDK 之前就绪
+    if (audio_event_queue_init(&g_app.events, APP_EVENT_QUEUE_SIZE) < 0) {
+        LOGE("无法分配事件队列");
+        return -1;
+    }
+    app_install_signals();
+
+    // 在分配任何音频缓冲区之前锁定内存，之后的分配也都常驻
+    if (config->rt) {
+        audio_rt_lock_memory();
+    }
+
+    if (config->stats_out && audio_stats_start(config->stats_out) < 0) {
+        return -1;
+    }
+    if (config->record_dir && app_start_recorder(config) < 0) {
+        audio_stats_stop();
+        return -1;
+    }
+
+    // 1. 在后台线程中打开音频设备，同时初始化 SDK 并加入频道
+    // 设备名称保存在 g_app 中，控制命令可以在运行时修改
+    snprintf(g_app.capture_device, sizeof(g_app.capture_device), "%s",
+             config->capture_device ? config->capture_device : "default");
+    snprintf(g_app.playback_device, sizeof(g_app.playback_device), "%s",
+             config->playback_device ? config->playback_device : "default");
+    config->capture_device = g_app.capture_device;
+    config->playback_device = g_app.playback_device;
+    if (config->device_cache && strcmp(config->device_cache, "none") != 0) {
+        audio_device_cache_open(config->device_cache);
+    }
+    app_start_devices(config);
 
     // 2. 初始化声网RTC SDK
+    int64_t phase_us = audio_now_us();
     int appid_len = strlen(config->p_appid);
     void *p_appid = (void *)(appid_len == 0 ? NULL : config->p_appid);
 
@@ -375,26 +1752,37 @@ int main(int argc, char **argv) {
     rval = agora_rtc_init(p_appid, &event_handler, &service_opt);
     if (rval < 0) {
         LOGE("Failed to initialize Agora sdk, reason: %s", agora_rtc_err_2_str(rval));
+        app_abort_startup(false);
         return -1;
     }
+    g_app.startup.sdk_init_us = audio_now_us() - phase_us;
+    phase_us = audio_now_us();
 
-    // 3. 创建连接
-    rval = agora_rtc_create_connection(&g_app.conn_id);
-    if (rval < 0) {
-        LOGE("Failed to create connection, reason: %s", agora_rtc_err_2_str(rval));
-        return -1;
-    }
+    // 3. 创建连接并设置连接配置，每个连接对应一个频道
+    for (int i = 0; i < g_app.conn_cnt; i++) {
+        app_conn_t *conn = &g_app.conns[i];
+        rval = agora_rtc_create_connection(&conn->conn_id);
+        if (rval < 0) {
+            LOGE("Failed to create connection, reason: %s", agora_rtc_err_2_str(rval));
+            app_abort_startup(true);
+            return -1;
+        }
+        conn->created = true;
 
-    // 4. 设置连接配置
-    rval = agora_rtc_set_bwe_param(g_app.conn_id, DEFAULT_BANDWIDTH_ESTIMATE_MIN_BITRATE,
-                                  DEFAULT_BANDWIDTH_ESTIMATE_MAX_BITRATE,
-                                  DEFAULT_BANDWIDTH_ESTIMATE_START_BITRATE);
-    if (rval != 0) {
-        LOGE("Failed set bwe param, reason: %s", agora_rtc_err_2_str(rval));
-        return -1;
+        // 4. 设置连接配置
+        rval = agora_rtc_set_bwe_param(conn->conn_id, DEFAULT_BANDWIDTH_ESTIMATE_MIN_BITRATE,
+                                      DEFAULT_BANDWIDTH_ESTIMATE_MAX_BITRATE,
+                                      DEFAULT_BANDWIDTH_ESTIMATE_START_BITRATE);
+        if (rval != 0) {
+            LOGE("Failed set bwe param, reason: %s", agora_rtc_err_2_str(rval));
+            app_abort_startup(true);
+            return -1;
+        }
     }
+    g_app.startup.conns_us = audio_now_us() - phase_us;
 
-    // 5. 加入频道
+    // 5. 加入频道，加入结果由 SDK 回调通过事件队列送到主线程
+    phase_us = audio_now_us();
     int token_len = strlen(config->p_token);
     void *p_token = (void *)(token_len == 0 ? NULL : config->p_token);
 
@@ -405,45 +1793,95 @@ int main(int argc, char **argv) {
     channel_options.enable_lan_accelerate = config->lan_accelerate;
 
     channel_options.audio_codec_opt.pcm_duration = config->pcm_duration;
-    channel_options.audio_codec_opt.audio_codec_type = config->audio_codec_type;
+    // 应用内编码时关闭 SDK 的编码器，编码后的帧原样发送
+    channel_options.audio_codec_opt.audio_codec_type =
+            config->encode != AUDIO_ENCODER_NONE ? AUDIO_CODEC_DISABLED : config->audio_codec_type;
     channel_options.audio_codec_opt.pcm_sample_rate = config->pcm_sample_rate;
     channel_options.audio_codec_opt.pcm_channel_num = config->pcm_channel_num;
 
-    if (!config->uname) {
-        rval = agora_rtc_join_channel(g_app.conn_id, config->p_channel, config->uid, p_token, &channel_options);
-    } else {
-        rval = agora_rtc_join_channel_with_user_account(g_app.conn_id, config->p_channel, config->uname, p_token,
-                                                       &channel_options);
+    for (int i = 0; i < g_app.conn_cnt; i++) {
+        app_conn_t *conn = &g_app.conns[i];
+        if (!config->uname) {
+            rval = agora_rtc_join_channel(conn->conn_id, conn->channel, config->uid, p_token, &channel_options);
+        } else {
+            rval = agora_rtc_join_channel_with_user_account(conn->conn_id, conn->channel, config->uname, p_token,
+                                                           &channel_options);
+        }
+        if (rval < 0) {
+            LOGE("Failed to join channel \"%s\", reason: %s", conn->channel, agora_rtc_err_2_str(rval));
+            app_abort_startup(true);
+            return -1;
+        }
     }
-    if (rval < 0) {
-        LOGE("Failed to join channel \"%s\", reason: %s", config->p_channel, agora_rtc_err_2_str(rval));
-        return -1;
+    g_app.startup.join_us = audio_now_us() - phase_us;
+
+    // 6. 等待设备打开后启动播放线程；播放线程就绪之前收到的音频被丢弃
+    phase_us = audio_now_us();
+    if (app_wait_devices() < 0) {
+        LOGE("初始化音频设备失败");
+        g_app.state = APP_STATE_STOPPING;
+        rval = -1;
+    }
+    g_app.startup.device_wait_us = audio_now_us() - phase_us;
+    phase_us = audio_now_us();
+    if (g_app.state != APP_STATE_STOPPING && config->aec && app_init_aec(config) < 0) {
+        LOGE("初始化回声消除失败");
+        g_app.state = APP_STATE_STOPPING;
+        rval = -1;
     }
+    if (g_app.state != APP_STATE_STOPPING && app_start_playout(config) < 0) {
+        LOGE("启动播放线程失败");
+        g_app.state = APP_STATE_STOPPING;
+        rval = -1;
+    }
+    // 启用预录时不等加入成功就开始采集，加入过程中的音频在加入后补发
+    if (g_app.state != APP_STATE_STOPPING && config->preroll_ms && app_start_send(config) < 0) {
+        g_app.state = APP_STATE_STOPPING;
+        rval = -1;
+    }
+    g_app.startup.audio_us = audio_now_us() - phase_us;
 
-    // 6. 等待成功加入频道
-    while (!g_app.b_connected_flag && !g_app.b_stop_flag) {
-        usleep(100 * 1000);
+    // 7. 主线程只负责控制: 处理 SDK 事件驱动状态机，第一个连接加入频道后启动音频源(启用预录时已经启动)
+    if (g_app.state != APP_STATE_STOPPING && config->ctl_socket && app_start_ctl(config) < 0) {
+        g_app.state = APP_STATE_STOPPING;
     }
 
-    // 7. 主循环：发送和接收音频数据
-    while (!g_app.b_stop_flag) {
-        if (g_app.b_connected_flag) {
-            app_send_audio();
-        }
-        usleep(1000);  // 避免CPU占用过高
+    // 8. 控制命令和事件在这里处理，两次轮询之间音频线程不受影响
+    while (g_app.state != APP_STATE_STOPPING) {
+        app_ctl_serve(APP_EVENT_POLL_MS);
+        app_process_events(config);
     }
+    app_stop_ctl();
 
-    // 8. 离开频道
-    agora_rtc_leave_channel(g_app.conn_id);
+    app_stop_send();
+    app_report_conns();
 
-    // 9. 销毁连接
-    agora_rtc_destroy_connection(g_app.conn_id);
+    // 9. 离开频道并销毁连接
+    for (int i = 0; i < g_app.conn_cnt; i++) {
+        app_conn_t *conn = &g_app.conns[i];
+        atomic_store(&conn->connected, false);
+        agora_rtc_leave_channel(conn->conn_id);
+        agora_rtc_destroy_connection(conn->conn_id);
+    }
 
     // 10. 结束RTC SDK
     agora_rtc_fini();
 
-    // 11. 清理音频设备
-    cleanup_audio_device(&g_app.audio_dev);
+    // 11. 停止播放线程并清理音频设备
+    app_stop_playout();
+    if (g_app.aec_enabled) {
+        audio_aec_report(&g_app.aec);
+        audio_aec_deinit(&g_app.aec);
+    }
+    audio_device_close(&g_app.audio_dev);
+    audio_device_cache_close();
+    app_stop_recorder();
+    audio_stats_stop();
+    LOGI("事件队列: 投递 %llu, 丢弃 %llu, SDK 错误 %u", atomic_load(&g_app.events.posted),
+         atomic_load(&g_app.events.dropped), g_app.sdk_errors);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    audio_event_queue_deinit(&g_app.events);
 
-    return 0;
+    return rval < 0 ? -1 : 0;
 } 
\ No newline at end of file
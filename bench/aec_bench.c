@@ -0,0 +1,238 @@
+/*************************************************************
+ * File  :  aec_bench.c
+ * Module:  CPU cost and convergence benchmark for the echo
+ *          canceller.
+ *
+ * Synthesizes a far-end talker (talk spurts of shaped noise),
+ * plays it through a random exponentially decaying room impulse
+ * response with a pure acoustic delay, adds optional near-end
+ * double talk and a noise floor, and runs the result through
+ * audio_aec frame by frame with the same timestamp contract the
+ * app uses (reference pushed ahead with its play-out time, mic
+ * frames tagged with their capture time). Reports the cost of
+ * every frame against the frame budget and the echo return loss
+ * enhancement once converged.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+
+#include "audio_aec.h"
+#include "audio_simd.h"
+#include "audio_time.h"
+
+#define BENCH_RIR_MS (80)
+#define BENCH_ACOUSTIC_DELAY_MS (5)
+#define BENCH_DEVICE_FRAMES (2)         // 参考比采集提前写入的帧数，模拟播放设备缓冲
+#define BENCH_CONVERGE_S (2)            // 前几秒不计入 ERLE
+
+typedef struct {
+    uint32_t duration_s;
+    uint32_t sample_rate;
+    uint32_t frame_ms;
+    uint32_t tail_ms;
+    int32_t ref_error_ms;               // 人为加在参考播放时刻上的误差
+    float echo_gain;                    // 回声路径总增益
+    bool double_talk;
+} aec_bench_config_t;
+
+static uint32_t g_rng = 0x2545f491;
+
+static float bench_randf(void)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return (int32_t)g_rng / 2147483648.0f;
+}
+
+// 模拟说话人: 低通噪声乘以音节包络，讲 2 秒停 0.5 秒
+static void bench_talker(float *out, size_t n, uint32_t rate, float level, float syllable_hz)
+{
+    float lp = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        double t = (double)i / rate;
+        double spurt = fmod(t, 2.5);
+        float env = spurt < 2.0 ? (float)pow(0.5 * (1.0 + sin(2.0 * M_PI * syllable_hz * t)), 2.0) : 0.0f;
+        lp += 0.3f * (bench_randf() - lp);
+        out[i] = level * env * lp * 3.0f;
+    }
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_usage(const char *prog)
+{
+    printf("Usage: %s [OPTION]\n", prog);
+    printf(" -t  simulated duration in seconds; default 20\n");
+    printf(" -r  sample rate; default 16000\n");
+    printf(" -D  frame duration in ms; default 20\n");
+    printf(" -T  echo tail in ms; default %d\n", AUDIO_AEC_DEFAULT_TAIL_MS);
+    printf(" -e  error added to the measured playout delay in ms; default 0\n");
+    printf(" -g  echo path gain; default 0.5\n");
+    printf(" -d  add near-end double talk between 60%% and 75%% of the run\n");
+}
+
+int main(int argc, char **argv)
+{
+    aec_bench_config_t cfg = {
+        .duration_s     = 20,
+        .sample_rate    = 16000,
+        .frame_ms       = 20,
+        .tail_ms        = AUDIO_AEC_DEFAULT_TAIL_MS,
+        .echo_gain      = 0.5f,
+    };
+    int ch;
+    while ((ch = getopt(argc, argv, "ht:r:D:T:e:g:d")) != -1) {
+        switch (ch) {
+        case 't':
+            cfg.duration_s = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            cfg.sample_rate = strtoul(optarg, NULL, 10);
+            break;
+        case 'D':
+            cfg.frame_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 'T':
+            cfg.tail_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 'e':
+            cfg.ref_error_ms = atoi(optarg);
+            break;
+        case 'g':
+            cfg.echo_gain = strtof(optarg, NULL);
+            break;
+        case 'd':
+            cfg.double_talk = true;
+            break;
+        default:
+            bench_usage(argv[0]);
+            return -1;
+        }
+    }
+
+    uint32_t frame = cfg.sample_rate * cfg.frame_ms / 1000;
+    uint32_t frames = cfg.duration_s * 1000 / cfg.frame_ms;
+    size_t total = (size_t)frame * frames;
+    uint32_t rir_len = cfg.sample_rate * BENCH_RIR_MS / 1000;
+    uint32_t delay = cfg.sample_rate * BENCH_ACOUSTIC_DELAY_MS / 1000;
+
+    float *far = calloc(total, sizeof(float));
+    float *near = calloc(total, sizeof(float));
+    float *echo = calloc(total, sizeof(float));
+    float *rir = calloc(rir_len, sizeof(float));
+    int16_t *far16 = calloc(total, sizeof(int16_t));
+    int16_t *mic16 = calloc(total, sizeof(int16_t));
+    uint64_t *cost = calloc(frames, sizeof(uint64_t));
+    if (!far || !near || !echo || !rir || !far16 || !mic16 || !cost) {
+        return -1;
+    }
+
+    // 房间冲激响应: 纯延迟后接指数衰减的随机序列，总能量为 echo_gain^2
+    double energy = 0.0;
+    for (uint32_t i = 0; i < rir_len; i++) {
+        rir[i] = i < delay ? 0.0f : bench_randf() * expf(-(float)(i - delay) / (cfg.sample_rate * 0.015f));
+        energy += rir[i] * rir[i];
+    }
+    for (uint32_t i = 0; i < rir_len; i++) {
+        rir[i] *= cfg.echo_gain / sqrt(energy);
+    }
+
+    bench_talker(far, total, cfg.sample_rate, 0.3f, 4.0f);
+    if (cfg.double_talk) {
+        size_t begin = total * 60 / 100;
+        size_t end = total * 75 / 100;
+        bench_talker(near + begin, end - begin, cfg.sample_rate, 0.2f, 3.1f);
+    }
+    for (size_t n = 0; n < total; n++) {
+        far16[n] = audio_sat16((int32_t)lrintf(far[n] * 32767.0f));
+    }
+    for (size_t n = 0; n < total; n++) {
+        float acc = 0.0f;
+        uint32_t taps = n + 1 < rir_len ? (uint32_t)n + 1 : rir_len;
+        for (uint32_t k = 0; k < taps; k++) {
+            acc += rir[k] * far16[n - k];
+        }
+        echo[n] = acc / 32768.0f;
+        float noise = bench_randf() * 1e-3f;
+        mic16[n] = audio_sat16((int32_t)lrintf((echo[n] + near[n] + noise) * 32767.0f));
+    }
+
+    audio_aec_t aec;
+    audio_aec_config_t aec_cfg = { cfg.sample_rate, frame, cfg.tail_ms };
+    if (audio_aec_init(&aec, &aec_cfg) < 0) {
+        return -1;
+    }
+
+    // 第 i 帧参考在 [i, i+1) 帧时长内播出；写入领先采集 BENCH_DEVICE_FRAMES 帧
+    int64_t frame_us = (int64_t)cfg.frame_ms * 1000;
+    uint32_t pushed = 0;
+    double echo_sum = 0.0, out_far_sum = 0.0, near_sum = 0.0, out_dt_sum = 0.0;
+    int16_t *out = malloc(frame * sizeof(int16_t));
+    for (uint32_t i = 0; i < frames; i++) {
+        while (pushed < frames && pushed <= i + BENCH_DEVICE_FRAMES) {
+            int64_t play_end_us = (pushed + 1) * frame_us + cfg.ref_error_ms * 1000;
+            audio_aec_push_ref(&aec, far16 + (size_t)pushed * frame, frame, play_end_us);
+            pushed++;
+        }
+
+        memcpy(out, mic16 + (size_t)i * frame, frame * sizeof(int16_t));
+        int64_t capture_us = (i + 1) * frame_us - 1000000 / cfg.sample_rate;
+        int64_t t0 = audio_now_ns();
+        audio_aec_process(&aec, out, frame, capture_us);
+        cost[i] = audio_now_ns() - t0;
+
+        if (i * cfg.frame_ms < BENCH_CONVERGE_S * 1000) {
+            continue;
+        }
+        for (uint32_t j = 0; j < frame; j++) {
+            size_t n = (size_t)i * frame + j;
+            float o = out[j] / 32768.0f;
+            if (near[n] != 0.0f) {
+                near_sum += (double)near[n] * near[n];
+                out_dt_sum += (double)(o - near[n]) * (o - near[n]);
+            } else {
+                echo_sum += (double)echo[n] * echo[n];
+                out_far_sum += (double)o * o;
+            }
+        }
+    }
+
+    qsort(cost, frames, sizeof(uint64_t), cmp_u64);
+    double sum = 0.0;
+    for (uint32_t i = 0; i < frames; i++) {
+        sum += cost[i];
+    }
+    double avg_us = sum / frames / 1000.0;
+
+    printf("aec_bench: %us, %uHz, %ums frames, tail %ums, %u blocks of %u x %u partitions (%s)\n",
+           cfg.duration_s, cfg.sample_rate, cfg.frame_ms, aec.cfg.tail_ms, frame / aec.block,
+           aec.block, aec.parts, AUDIO_SIMD_NAME);
+    printf("  %-24s: avg=%.1f p50=%.1f p99=%.1f max=%.1f us\n", "cost per frame", avg_us,
+           cost[frames / 2] / 1000.0, cost[frames * 99 / 100] / 1000.0, cost[frames - 1] / 1000.0);
+    printf("  %-24s: %.2f%% of one core\n", "frame budget used", avg_us * 100.0 / frame_us);
+    printf("  %-24s: %.1f dB\n", "ERLE (far-end only)",
+           out_far_sum > 0.0 ? 10.0 * log10(echo_sum / out_far_sum) : 0.0);
+    if (cfg.double_talk) {
+        printf("  %-24s: %.1f dB\n", "near-end / residual (DT)",
+               out_dt_sum > 0.0 ? 10.0 * log10(near_sum / out_dt_sum) : 0.0);
+    }
+    audio_aec_report(&aec);
+    audio_aec_deinit(&aec);
+    return 0;
+}
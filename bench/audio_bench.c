@@ -0,0 +1,359 @@
+/*************************************************************
+ * File  :  audio_bench.c
+ * Module:  Loopback latency/throughput benchmark.
+ *
+ * Runs the send and receive halves of audio_rtsa against the
+ * fake RTC SDK without any sound card: a sine source paced like
+ * a capture device feeds N connections, the fake SDK loops the
+ * frames back as one or more remote uids, and the playout mixer
+ * runs headless at the frame rate. Each sent frame carries its
+ * capture time in the first bytes, which gives the network leg
+ * (capture -> on_audio_data) for every frame and the full path
+ * (capture -> played period) whenever a period was not mixed.
+ * With -B the source emits N frames per wakeup, as the capture
+ * thread does with --capture-batch, and the report shows the
+ * wakeup rate next to the extra capture -> send latency it costs.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include "agora_rtc_api.h"
+#include "audio_source.h"
+#include "audio_playout.h"
+#include "audio_time.h"
+#include "audio_rt.h"
+
+#define BENCH_MAGIC (0x68636e6562617472ULL)
+#define BENCH_MAX_CONN (16)
+
+typedef struct {
+    int64_t *v;
+    size_t n;
+    size_t cap;
+} bench_samples_t;
+
+typedef struct {
+    uint32_t duration_s;
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint32_t frame_ms;
+    uint32_t conn_cnt;
+    uint32_t mix_max_streams;
+    uint32_t batch;                 // 音频源每次唤醒送出的帧数
+    int rt_priority;                // 大于 0 时音频线程以 SCHED_FIFO 运行
+    bool plc;
+} bench_config_t;
+
+static struct {
+    bench_config_t cfg;
+    connection_id_t conns[BENCH_MAX_CONN];
+    atomic_int joined;
+    audio_source_t source;
+    audio_playout_t playout;
+    audio_frame_pool_t pool;
+
+    bench_samples_t send_ns;    // 发送线程写
+    bench_samples_t queue_us;   // 发送线程写: 帧完整到开始发送
+    bench_samples_t net_us;     // SDK 回调线程写
+    bench_samples_t e2e_us;     // 播放线程写
+    uint64_t frames_sent;
+    uint64_t send_errors;
+} g_bench;
+
+static int samples_init(bench_samples_t *s, size_t cap)
+{
+    s->v = malloc(cap * sizeof(*s->v));
+    s->n = 0;
+    s->cap = cap;
+    return s->v ? 0 : -1;
+}
+
+static void samples_add(bench_samples_t *s, int64_t v)
+{
+    if (s->n < s->cap) {
+        s->v[s->n++] = v;
+    }
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void samples_report(bench_samples_t *s, const char *name, const char *unit)
+{
+    if (s->n == 0) {
+        printf("  %-24s: n/a\n", name);
+        return;
+    }
+    qsort(s->v, s->n, sizeof(*s->v), cmp_i64);
+    printf("  %-24s: n=%zu p50=%lld p99=%lld max=%lld %s\n", name, s->n,
+           (long long)s->v[s->n / 2], (long long)s->v[s->n * 99 / 100],
+           (long long)s->v[s->n - 1], unit);
+}
+
+// 帧头写入魔数和采集时刻，之后原样穿过 SDK 回环和未混音的播放周期
+static void bench_stamp(uint8_t *frame, int64_t capture_us)
+{
+    uint64_t magic = BENCH_MAGIC;
+    memcpy(frame, &magic, sizeof(magic));
+    memcpy(frame + sizeof(magic), &capture_us, sizeof(capture_us));
+}
+
+static bool bench_read_stamp(const void *data, size_t len, int64_t *capture_us)
+{
+    uint64_t magic;
+    if (len < sizeof(magic) + sizeof(*capture_us)) {
+        return false;
+    }
+    memcpy(&magic, data, sizeof(magic));
+    memcpy(capture_us, (const uint8_t *)data + sizeof(magic), sizeof(*capture_us));
+    return magic == BENCH_MAGIC;
+}
+
+// 发生器直接写入池中的帧，时间戳就地写进帧头
+static void bench_send(void *ctx, audio_frame_t *frame)
+{
+    audio_frame_info_t info = { 0 };
+    info.data_type = AUDIO_DATA_TYPE_PCM;
+
+    samples_add(&g_bench.queue_us, audio_now_us() - frame->capture_us);
+    bench_stamp(frame->data, frame->capture_us);
+    for (uint32_t i = 0; i < g_bench.cfg.conn_cnt; i++) {
+        int64_t t0 = audio_now_ns();
+        int rval = agora_rtc_send_audio_data(g_bench.conns[i], frame->data, frame->len, &info);
+        samples_add(&g_bench.send_ns, audio_now_ns() - t0);
+        if (rval < 0) {
+            g_bench.send_errors++;
+        } else {
+            g_bench.frames_sent++;
+        }
+    }
+}
+
+static void bench_on_period(void *ctx, const void *data, size_t len)
+{
+    int64_t capture_us;
+    if (bench_read_stamp(data, len, &capture_us)) {
+        samples_add(&g_bench.e2e_us, audio_now_us() - capture_us);
+    }
+}
+
+static void bench_on_join(connection_id_t conn_id, uint32_t uid, int elapsed)
+{
+    atomic_fetch_add(&g_bench.joined, 1);
+}
+
+static void bench_on_audio_data(connection_id_t conn_id, const uint32_t uid, uint16_t sent_ts,
+                                const void *data, size_t len, const audio_frame_info_t *info_ptr)
+{
+    int64_t capture_us;
+    if (bench_read_stamp(data, len, &capture_us)) {
+        samples_add(&g_bench.net_us, audio_now_us() - capture_us);
+    }
+    audio_playout_push(&g_bench.playout, conn_id, uid, sent_ts, data, len);
+}
+
+static void bench_usage(const char *prog)
+{
+    printf("Usage: %s [OPTION]\n", prog);
+    printf(" -t  duration in seconds; default 10\n");
+    printf(" -r  sample rate; default 16000\n");
+    printf(" -n  channels; default 1\n");
+    printf(" -D  frame duration in ms; default 20\n");
+    printf(" -c  connections fed from the one source; default 1\n");
+    printf(" -m  max streams mixed per period; default %d\n", AUDIO_PLAYOUT_DEFAULT_MIX_STREAMS);
+    printf(" -L  enable loss concealment and time-stretch in playout; capture->played then only\n");
+    printf("     counts periods that still start on a received frame\n");
+    printf(" -B  frames emitted per source wakeup and sent as one burst; default 1\n");
+    printf(" -P  run the source and playout threads under SCHED_FIFO at this priority; default 0=off\n");
+    printf("The fake SDK reads FAKE_RTC_DELAY_MS, FAKE_RTC_JITTER_MS, FAKE_RTC_LOSS_PCT\n");
+    printf("and FAKE_RTC_UIDS from the environment.\n");
+}
+
+static int bench_parse_args(int argc, char **argv, bench_config_t *cfg)
+{
+    int ch;
+    while ((ch = getopt(argc, argv, "ht:r:n:D:c:m:B:LP:")) != -1) {
+        switch (ch) {
+        case 't':
+            cfg->duration_s = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            cfg->sample_rate = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            cfg->channels = strtoul(optarg, NULL, 10);
+            break;
+        case 'D':
+            cfg->frame_ms = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            cfg->conn_cnt = strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            cfg->mix_max_streams = strtoul(optarg, NULL, 10);
+            break;
+        case 'B':
+            cfg->batch = strtoul(optarg, NULL, 10);
+            break;
+        case 'L':
+            cfg->plc = true;
+            break;
+        case 'P':
+            cfg->rt_priority = atoi(optarg);
+            break;
+        default:
+            return -1;
+        }
+    }
+    if (cfg->conn_cnt == 0 || cfg->conn_cnt > BENCH_MAX_CONN || cfg->frame_ms == 0 ||
+        cfg->duration_s == 0 || cfg->batch == 0 || cfg->batch > AUDIO_CAPTURE_MAX_BATCH) {
+        return -1;
+    }
+    return 0;
+}
+
+static double cpu_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    bench_config_t *cfg = &g_bench.cfg;
+    *cfg = (bench_config_t) {
+        .duration_s     = 10,
+        .sample_rate    = 16000,
+        .channels       = 1,
+        .frame_ms       = 20,
+        .conn_cnt       = 1,
+        .batch          = 1,
+    };
+    if (bench_parse_args(argc, argv, cfg) < 0) {
+        bench_usage(argv[0]);
+        return -1;
+    }
+
+    uint32_t frame_bytes = cfg->sample_rate * cfg->frame_ms / 1000 * cfg->channels * 2;
+    size_t frames = (size_t)cfg->duration_s * 1000 / cfg->frame_ms + 64;
+    uint32_t uids = getenv("FAKE_RTC_UIDS") ? strtoul(getenv("FAKE_RTC_UIDS"), NULL, 10) : 1;
+    if (audio_frame_pool_init(&g_bench.pool, 4, frame_bytes) < 0 ||
+        samples_init(&g_bench.send_ns, frames * cfg->conn_cnt) < 0 ||
+        samples_init(&g_bench.queue_us, frames) < 0 ||
+        samples_init(&g_bench.net_us, frames * cfg->conn_cnt * (uids ? uids : 1)) < 0 ||
+        samples_init(&g_bench.e2e_us, frames) < 0) {
+        return -1;
+    }
+
+    audio_rt_config_t rt = { cfg->rt_priority > 0, cfg->rt_priority, -1 };
+    if (rt.enabled) {
+        audio_rt_lock_memory();
+    }
+
+    audio_playout_config_t playout_cfg = {
+        .handle             = NULL,
+        .sample_rate        = cfg->sample_rate,
+        .channels           = cfg->channels,
+        .frame_ms           = cfg->frame_ms,
+        .jitter_min_ms      = 40,
+        .jitter_max_ms      = 200,
+        .max_mix_streams    = cfg->mix_max_streams,
+        .plc                = cfg->plc,
+        .rt                 = rt,
+        .on_period          = bench_on_period,
+    };
+    if (audio_playout_start(&g_bench.playout, &playout_cfg) < 0) {
+        return -1;
+    }
+
+    agora_rtc_event_handler_t handler = { 0 };
+    handler.on_join_channel_success = bench_on_join;
+    handler.on_audio_data = bench_on_audio_data;
+    rtc_service_option_t service_opt = { 0 };
+    if (agora_rtc_init(NULL, &handler, &service_opt) < 0) {
+        return -1;
+    }
+
+    rtc_channel_options_t channel_options = { 0 };
+    channel_options.auto_subscribe_audio = true;
+    channel_options.audio_codec_opt.audio_codec_type = AUDIO_CODEC_DISABLED;
+    channel_options.audio_codec_opt.pcm_sample_rate = cfg->sample_rate;
+    channel_options.audio_codec_opt.pcm_channel_num = cfg->channels;
+    channel_options.audio_codec_opt.pcm_duration = cfg->frame_ms;
+    for (uint32_t i = 0; i < cfg->conn_cnt; i++) {
+        char channel[32];
+        snprintf(channel, sizeof(channel), "bench_%u", i);
+        if (agora_rtc_create_connection(&g_bench.conns[i]) < 0 ||
+            agora_rtc_join_channel(g_bench.conns[i], channel, 0, NULL, &channel_options) < 0) {
+            return -1;
+        }
+    }
+    while (atomic_load(&g_bench.joined) < (int)cfg->conn_cnt) {
+        usleep(1000);
+    }
+
+    audio_source_config_t source_cfg = {
+        .type           = AUDIO_SOURCE_SINE,
+        .sample_rate    = cfg->sample_rate,
+        .channels       = cfg->channels,
+        .interval_us    = cfg->frame_ms * 1000,
+        .batch          = cfg->batch,
+        .tone_hz        = 440,
+        .rt             = rt,
+        .pool           = &g_bench.pool,
+        .on_frame       = bench_send,
+    };
+    double cpu_start = cpu_seconds();
+    int64_t wall_start_us = audio_now_us();
+    uint64_t periods_start = atomic_load(&g_bench.playout.stats.periods);
+    if (audio_source_start(&g_bench.source, &source_cfg) < 0) {
+        return -1;
+    }
+    sleep(cfg->duration_s);
+    audio_source_stop(&g_bench.source);
+    double wall_s = (audio_now_us() - wall_start_us) / 1e6;
+    double cpu_s = cpu_seconds() - cpu_start;
+    uint64_t periods = atomic_load(&g_bench.playout.stats.periods) - periods_start;
+    uint64_t wakeups = g_bench.source.pacer.ticks;
+
+    // 等回环中的帧排空后再停止播放
+    usleep((cfg->frame_ms * 4 + 500) * 1000);
+    audio_playout_stop(&g_bench.playout);
+    for (uint32_t i = 0; i < cfg->conn_cnt; i++) {
+        agora_rtc_leave_channel(g_bench.conns[i]);
+        agora_rtc_destroy_connection(g_bench.conns[i]);
+    }
+    agora_rtc_fini();
+
+    printf("audio_bench: %us, %uHz x%u, %ums frames x%u per wakeup, %u conn(s), %u fake uid(s) per conn\n",
+           cfg->duration_s, cfg->sample_rate, cfg->channels, cfg->frame_ms, cfg->batch, cfg->conn_cnt, uids);
+    printf("  %-24s: %.1f (errors %llu)\n", "sent frames/s", g_bench.frames_sent / wall_s,
+           (unsigned long long)g_bench.send_errors);
+    printf("  %-24s: %.1f\n", "source wakeups/s", wakeups / wall_s);
+    printf("  %-24s: %.1f\n", "played periods/s", periods / wall_s);
+    printf("  %-24s: %.1f us (process CPU %.1f%%)\n", "CPU per sent frame",
+           g_bench.frames_sent ? cpu_s * 1e6 / g_bench.frames_sent : 0.0, cpu_s * 100.0 / wall_s);
+    samples_report(&g_bench.queue_us, "capture->send", "us");
+    samples_report(&g_bench.send_ns, "send call", "ns");
+    samples_report(&g_bench.net_us, "capture->on_audio_data", "us");
+    samples_report(&g_bench.e2e_us, "capture->played", "us");
+    audio_frame_pool_report(&g_bench.pool, "音频源");
+    audio_frame_pool_deinit(&g_bench.pool);
+    return 0;
+}
@@ -0,0 +1,418 @@
+/*************************************************************
+ * File  :  fake_rtc.c
+ * Module:  Local loopback stand-in for the agora_rtc_* API.
+ *
+ * Implements the subset of the RTC SDK used by audio_rtsa so the
+ * application and the benchmark can run without a network. Every
+ * frame passed to agora_rtc_send_audio_data() is queued and later
+ * delivered back through on_audio_data() on the SDK's own thread,
+ * once per fake remote uid, after a configurable delay, jitter and
+ * loss. Parameters come from the environment:
+ *
+ *   FAKE_RTC_DELAY_MS   one-way delay, default 20
+ *   FAKE_RTC_JITTER_MS  extra uniform random delay, default 0
+ *   FAKE_RTC_LOSS_PCT   per-uid loss probability in %, default 0
+ *   FAKE_RTC_UIDS       fake remote users per connection, default 1;
+ *                       every connection uses the same uids 1001..
+ *   FAKE_RTC_JOIN_MS    delay before on_join_channel_success, default 10
+ *   FAKE_RTC_OUTAGE_EVERY_MS  time connected before each simulated
+ *                       outage, default 0 (never)
+ *   FAKE_RTC_OUTAGE_MS  outage length, default 2000
+ *
+ * An outage raises on_reconnecting, drops everything sent or in
+ * flight until on_rejoin_channel_success fires OUTAGE_MS later.
+ * Frames keep their send order; jitter only stretches the gaps.
+ * agora_rtc_send_audio_data() must be called from one thread, as
+ * audio_rtsa does, because the loopback queue is an SPSC ring.
+ *
+ * This is a part of the Agora RTC Service SDK.
+ * Copyright (C) 2020 Agora IO
+ * All rights reserved.
+ *
+ *************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include "agora_rtc_api.h"
+#include "audio_ring.h"
+#include "audio_time.h"
+
+#define FAKE_RTC_MAX_CONN (16)
+#define FAKE_RTC_QUEUE_SLOTS (512)
+#define FAKE_RTC_MAX_FRAME_BYTES (8 * 1024)
+#define FAKE_RTC_UID_BASE (1000)
+#define FAKE_RTC_JOIN_POLL_MS (5)
+
+typedef struct {
+    bool used;
+    atomic_bool joined;
+    atomic_llong join_at_us;        // 非 0 时表示待回调加入成功的时刻
+    int64_t join_start_us;
+    atomic_llong outage_at_us;      // 非 0 时表示下一次模拟断线的时刻
+    atomic_llong rejoin_at_us;      // 非 0 时表示断线中，到时回调重新加入成功
+    char channel[65];
+    uint32_t uid;
+} fake_conn_t;
+
+static struct {
+    agora_rtc_event_handler_t handler;
+    bool inited;
+    fake_conn_t conns[FAKE_RTC_MAX_CONN + 1];   // 下标即 conn_id，0 不用
+    audio_ring_t queue;
+    sem_t wakeup;                   // 每入队一帧 post 一次
+    pthread_t thread;
+    atomic_bool running;
+    atomic_int data_type;
+
+    uint32_t delay_ms;
+    uint32_t jitter_ms;
+    uint32_t loss_pct;
+    uint32_t uids;
+    uint32_t join_ms;
+    uint32_t outage_every_ms;
+    uint32_t outage_ms;
+
+    // 发送线程私有
+    uint32_t send_rand;
+    int64_t last_due_us;
+
+    // 回环线程私有
+    uint32_t loop_rand;
+
+    atomic_ullong sent;
+    atomic_ullong delivered;
+    atomic_ullong lost;
+    atomic_ullong overflow;
+} g_fake;
+
+static uint32_t fake_env(const char *name, uint32_t def)
+{
+    const char *v = getenv(name);
+    return v && *v ? (uint32_t)strtoul(v, NULL, 10) : def;
+}
+
+static uint32_t fake_rand(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static fake_conn_t *fake_conn(connection_id_t conn_id)
+{
+    if (conn_id == 0 || conn_id > FAKE_RTC_MAX_CONN || !g_fake.conns[conn_id].used) {
+        return NULL;
+    }
+    return &g_fake.conns[conn_id];
+}
+
+static void fake_poll_joins(int64_t now_us)
+{
+    for (connection_id_t id = 1; id <= FAKE_RTC_MAX_CONN; id++) {
+        fake_conn_t *conn = &g_fake.conns[id];
+        int64_t at = atomic_load(&conn->join_at_us);
+        if (at == 0 || now_us < at || !atomic_compare_exchange_strong(&conn->join_at_us, &at, 0)) {
+            continue;
+        }
+        atomic_store(&conn->joined, true);
+        if (g_fake.outage_every_ms) {
+            atomic_store(&conn->outage_at_us, now_us + g_fake.outage_every_ms * 1000LL);
+        }
+        if (g_fake.handler.on_join_channel_success) {
+            g_fake.handler.on_join_channel_success(id, conn->uid,
+                                                   (int)((now_us - conn->join_start_us) / 1000));
+        }
+    }
+}
+
+// 周期性地模拟网络中断: 先回调 on_reconnecting，期间收发都丢弃，
+// outage_ms 后回调 on_rejoin_channel_success 并安排下一次中断
+static void fake_poll_outages(int64_t now_us)
+{
+    for (connection_id_t id = 1; id <= FAKE_RTC_MAX_CONN; id++) {
+        fake_conn_t *conn = &g_fake.conns[id];
+        int64_t at = atomic_load(&conn->outage_at_us);
+        if (at != 0 && now_us >= at && atomic_compare_exchange_strong(&conn->outage_at_us, &at, 0)) {
+            atomic_store(&conn->joined, false);
+            atomic_store(&conn->rejoin_at_us, now_us + g_fake.outage_ms * 1000LL);
+            if (g_fake.handler.on_reconnecting) {
+                g_fake.handler.on_reconnecting(id);
+            }
+            continue;
+        }
+        at = atomic_load(&conn->rejoin_at_us);
+        if (at == 0 || now_us < at || !atomic_compare_exchange_strong(&conn->rejoin_at_us, &at, 0)) {
+            continue;
+        }
+        atomic_store(&conn->joined, true);
+        atomic_store(&conn->outage_at_us, now_us + g_fake.outage_every_ms * 1000LL);
+        if (g_fake.handler.on_rejoin_channel_success) {
+            g_fake.handler.on_rejoin_channel_success(id, conn->uid, (int)g_fake.outage_ms);
+        }
+    }
+}
+
+static void fake_deliver(connection_id_t conn_id, uint16_t sent_ts, const void *data, size_t len)
+{
+    fake_conn_t *conn = fake_conn(conn_id);
+    audio_frame_info_t info = { 0 };
+
+    if (!conn || !atomic_load(&conn->joined) || !g_fake.handler.on_audio_data) {
+        return;
+    }
+    info.data_type = atomic_load_explicit(&g_fake.data_type, memory_order_relaxed);
+    for (uint32_t i = 0; i < g_fake.uids; i++) {
+        if (g_fake.loss_pct && fake_rand(&g_fake.loop_rand) % 100 < g_fake.loss_pct) {
+            atomic_fetch_add_explicit(&g_fake.lost, 1, memory_order_relaxed);
+            continue;
+        }
+        // 每个连接使用同一组 uid，与真实频道中同一用户出现在多个频道时一样
+        uint32_t uid = FAKE_RTC_UID_BASE + i + 1;
+        g_fake.handler.on_audio_data(conn_id, uid, sent_ts, data, len, &info);
+        atomic_fetch_add_explicit(&g_fake.delivered, 1, memory_order_relaxed);
+    }
+}
+
+static void fake_sleep_until_us(int64_t due_us)
+{
+    struct timespec ts = { due_us / 1000000, due_us % 1000000 * 1000 };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+// 队列为空时阻塞在信号量上，只在有帧或有待回调的加入事件时醒来，
+// 避免替身自身的轮询开销混进基准测试的 CPU 统计
+static void *fake_loop_thread(void *arg)
+{
+    while (atomic_load_explicit(&g_fake.running, memory_order_relaxed)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += FAKE_RTC_JOIN_POLL_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        bool got = sem_timedwait(&g_fake.wakeup, &ts) == 0;
+        fake_poll_joins(audio_now_us());
+        if (g_fake.outage_every_ms) {
+            fake_poll_outages(audio_now_us());
+        }
+        if (!got) {
+            continue;
+        }
+
+        const audio_slot_meta_t *meta;
+        const void *data = audio_ring_read_begin(&g_fake.queue, &meta);
+        if (!data) {
+            continue;
+        }
+        fake_sleep_until_us(meta->ts_us);
+        fake_deliver(meta->uid, meta->sent_ts, data, meta->len);
+        audio_ring_read_commit(&g_fake.queue);
+    }
+    return NULL;
+}
+
+const char *agora_rtc_get_version(void)
+{
+    return "fake-loopback";
+}
+
+const char *agora_rtc_err_2_str(int err)
+{
+    return err == 0 ? "ok" : "fake rtc error";
+}
+
+int agora_rtc_init(const char *app_id, const agora_rtc_event_handler_t *event_handler,
+                   rtc_service_option_t *option)
+{
+    if (g_fake.inited || !event_handler) {
+        return -1;
+    }
+    memset(g_fake.conns, 0, sizeof(g_fake.conns));
+    g_fake.handler = *event_handler;
+    g_fake.delay_ms = fake_env("FAKE_RTC_DELAY_MS", 20);
+    g_fake.jitter_ms = fake_env("FAKE_RTC_JITTER_MS", 0);
+    g_fake.loss_pct = fake_env("FAKE_RTC_LOSS_PCT", 0);
+    g_fake.uids = fake_env("FAKE_RTC_UIDS", 1);
+    g_fake.join_ms = fake_env("FAKE_RTC_JOIN_MS", 10);
+    g_fake.outage_every_ms = fake_env("FAKE_RTC_OUTAGE_EVERY_MS", 0);
+    g_fake.outage_ms = fake_env("FAKE_RTC_OUTAGE_MS", 2000);
+    g_fake.send_rand = 0x2545f491;
+    g_fake.loop_rand = 0x9e3779b9;
+    g_fake.last_due_us = 0;
+    atomic_store(&g_fake.sent, 0);
+    atomic_store(&g_fake.delivered, 0);
+    atomic_store(&g_fake.lost, 0);
+    atomic_store(&g_fake.overflow, 0);
+
+    if (audio_ring_init(&g_fake.queue, FAKE_RTC_QUEUE_SLOTS, FAKE_RTC_MAX_FRAME_BYTES) < 0) {
+        return -1;
+    }
+    sem_init(&g_fake.wakeup, 0, 0);
+    atomic_store(&g_fake.running, true);
+    if (pthread_create(&g_fake.thread, NULL, fake_loop_thread, NULL) != 0) {
+        sem_destroy(&g_fake.wakeup);
+        audio_ring_deinit(&g_fake.queue);
+        return -1;
+    }
+    g_fake.inited = true;
+
+    fprintf(stderr, "fake rtc: delay=%ums jitter=%ums loss=%u%% uids=%u outage=%ums every %ums\n",
+            g_fake.delay_ms, g_fake.jitter_ms, g_fake.loss_pct, g_fake.uids, g_fake.outage_ms,
+            g_fake.outage_every_ms);
+    return 0;
+}
+
+int agora_rtc_fini(void)
+{
+    if (!g_fake.inited) {
+        return -1;
+    }
+    atomic_store(&g_fake.running, false);
+    sem_post(&g_fake.wakeup);
+    pthread_join(g_fake.thread, NULL);
+    sem_destroy(&g_fake.wakeup);
+    audio_ring_deinit(&g_fake.queue);
+    g_fake.inited = false;
+
+    fprintf(stderr, "fake rtc: sent=%llu delivered=%llu lost=%llu overflow=%llu\n",
+            atomic_load(&g_fake.sent), atomic_load(&g_fake.delivered), atomic_load(&g_fake.lost),
+            atomic_load(&g_fake.overflow));
+    return 0;
+}
+
+int agora_rtc_create_connection(connection_id_t *conn_id)
+{
+    for (connection_id_t id = 1; id <= FAKE_RTC_MAX_CONN; id++) {
+        if (!g_fake.conns[id].used) {
+            memset(&g_fake.conns[id], 0, sizeof(g_fake.conns[id]));
+            g_fake.conns[id].used = true;
+            *conn_id = id;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int agora_rtc_destroy_connection(connection_id_t conn_id)
+{
+    fake_conn_t *conn = fake_conn(conn_id);
+    if (!conn) {
+        return -1;
+    }
+    atomic_store(&conn->joined, false);
+    atomic_store(&conn->join_at_us, 0);
+    atomic_store(&conn->outage_at_us, 0);
+    atomic_store(&conn->rejoin_at_us, 0);
+    conn->used = false;
+    return 0;
+}
+
+int agora_rtc_get_connection_info(connection_id_t conn_id, connection_info_t *conn_info)
+{
+    fake_conn_t *conn = fake_conn(conn_id);
+    if (!conn || !conn_info) {
+        return -1;
+    }
+    snprintf(conn_info->channel_name, sizeof(conn_info->channel_name), "%s", conn->channel);
+    conn_info->uid = conn->uid;
+    return 0;
+}
+
+int agora_rtc_set_bwe_param(connection_id_t conn_id, uint32_t min_bps, uint32_t max_bps,
+                            uint32_t start_bps)
+{
+    return fake_conn(conn_id) ? 0 : -1;
+}
+
+static int fake_join(connection_id_t conn_id, const char *channel, uint32_t uid)
+{
+    fake_conn_t *conn = fake_conn(conn_id);
+    if (!conn || !channel) {
+        return -1;
+    }
+    snprintf(conn->channel, sizeof(conn->channel), "%s", channel);
+    conn->uid = uid ? uid : conn_id;
+    conn->join_start_us = audio_now_us();
+    atomic_store(&conn->join_at_us, conn->join_start_us + g_fake.join_ms * 1000LL);
+    return 0;
+}
+
+int agora_rtc_join_channel(connection_id_t conn_id, const char *channel_name, uint32_t uid,
+                           const char *token, rtc_channel_options_t *options)
+{
+    return fake_join(conn_id, channel_name, uid);
+}
+
+int agora_rtc_join_channel_with_user_account(connection_id_t conn_id, const char *channel_name,
+                                             const char *uname, const char *token,
+                                             rtc_channel_options_t *options)
+{
+    return fake_join(conn_id, channel_name, 0);
+}
+
+int agora_rtc_leave_channel(connection_id_t conn_id)
+{
+    fake_conn_t *conn = fake_conn(conn_id);
+    if (!conn) {
+        return -1;
+    }
+    atomic_store(&conn->joined, false);
+    atomic_store(&conn->join_at_us, 0);
+    atomic_store(&conn->outage_at_us, 0);
+    atomic_store(&conn->rejoin_at_us, 0);
+    return 0;
+}
+
+int agora_rtc_send_audio_data(connection_id_t conn_id, const void *data_ptr, size_t data_len,
+                              audio_frame_info_t *info_ptr)
+{
+    fake_conn_t *conn = fake_conn(conn_id);
+    if (!conn || !atomic_load_explicit(&conn->joined, memory_order_relaxed) ||
+        data_len > FAKE_RTC_MAX_FRAME_BYTES) {
+        return -1;
+    }
+
+    audio_slot_meta_t *meta;
+    void *slot = audio_ring_write_begin(&g_fake.queue, &meta);
+    if (!slot) {
+        atomic_fetch_add_explicit(&g_fake.overflow, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    int64_t now_us = audio_now_us();
+    int64_t due_us = now_us + g_fake.delay_ms * 1000LL;
+    if (g_fake.jitter_ms) {
+        due_us += fake_rand(&g_fake.send_rand) % (g_fake.jitter_ms * 1000);
+    }
+    // 抖动只拉开间隔，不打乱顺序
+    if (due_us < g_fake.last_due_us) {
+        due_us = g_fake.last_due_us;
+    }
+    g_fake.last_due_us = due_us;
+
+    memcpy(slot, data_ptr, data_len);
+    meta->len = data_len;
+    meta->uid = conn_id;
+    meta->sent_ts = (uint16_t)(now_us / 1000);
+    meta->ts_us = due_us;
+    audio_ring_write_commit(&g_fake.queue);
+    sem_post(&g_fake.wakeup);
+
+    if (info_ptr) {
+        atomic_store_explicit(&g_fake.data_type, info_ptr->data_type, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&g_fake.sent, 1, memory_order_relaxed);
+    return 0;
+}